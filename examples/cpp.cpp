@@ -0,0 +1,102 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <NvPipe.hpp>
+
+#include "utils.h"
+
+#include <iostream>
+#include <vector>
+
+
+int main(int argc, char* argv[])
+{
+    std::cout << "NvPipe example application: C++ interface with reusable buffers." << std::endl << std::endl;
+
+    const uint32_t width = 3840;
+    const uint32_t height = 2160;
+
+    const NvPipe_Codec codec = NVPIPE_H264;
+    const float bitrateMbps = 32;
+    const uint32_t targetFPS = 90;
+
+    // Construct dummy frame
+    std::vector<uint8_t> rgba(nvpipe::frameSize(NVPIPE_BGRA32, width, height));
+    for (uint32_t y = 0; y < height; ++y)
+        for (uint32_t x = 0; x < width; ++x)
+            rgba[4 * (y * width + x) + 1] = (255.0f * x * y) / (width * height) * (y % 100 < 50);
+
+    nvpipe::Encoder encoder(NVPIPE_BGRA32, codec, NVPIPE_LOSSY, bitrateMbps * 1000 * 1000, targetFPS);
+    if (!encoder)
+    {
+        std::cerr << "Failed to create encoder: " << nvpipe::createError() << std::endl;
+        return 1;
+    }
+
+    nvpipe::Decoder decoder(NVPIPE_BGRA32, codec);
+    if (!decoder)
+    {
+        std::cerr << "Failed to create decoder: " << nvpipe::createError() << std::endl;
+        return 1;
+    }
+
+    // Sized on the first frame and reused afterwards
+    nvpipe::PacketBuffer packet;
+    std::vector<uint8_t> decompressed(rgba.size());
+
+    Timer timer;
+
+    std::cout << "Frame | Encode (ms) | Decode (ms) | Size (KB)" << std::endl;
+
+    for (uint32_t i = 0; i < 10; ++i)
+    {
+        timer.reset();
+        const nvpipe::Result encoded = encoder.encode(rgba, width * 4, packet, width, height);
+        double encodeMs = timer.getElapsedMilliseconds();
+
+        if (!encoded)
+        {
+            std::cerr << "Encode error: " << encoded.error() << std::endl;
+            continue;
+        }
+
+        timer.reset();
+        const nvpipe::Result decoded = decoder.decode(packet.view(), decompressed, width, height);
+        double decodeMs = timer.getElapsedMilliseconds();
+
+        if (!decoded)
+            std::cerr << "Decode error: " << decoded.error() << std::endl;
+
+        double sizeKB = encoded.size() / 1000.0;
+        std::cout << std::fixed << std::setprecision(1) << std::setw(5) << i << " | " << std::setw(11) << encodeMs << " | " <<  std::setw(11) << decodeMs << " | " <<  std::setw(8) << sizeKB << std::endl;
+    }
+
+    savePPM(decompressed.data(), width, height, "cpp-output.ppm");
+
+    // Encoder and decoder are destroyed with their handles
+    return 0;
+}
@@ -54,7 +54,7 @@ int main(int argc, char* argv[])
     Timer timer;
 
     std::vector<uint8_t> rgba(width * height * 4);
-    std::vector<uint8_t> compressed(rgba.size());
+    std::vector<uint8_t> compressed(NvPipe_GetMaxCompressedSize(NVPIPE_BGRA32, codec, width, height));
 
 
     // Encoding
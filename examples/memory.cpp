@@ -65,7 +65,7 @@ int main(int argc, char* argv[])
     std::cout << "Resolution: " << width << " x " << height << std::endl;
 
 
-    std::vector<uint8_t> compressed(rgba.size());
+    std::vector<uint8_t> compressed(NvPipe_GetMaxCompressedSize(NVPIPE_BGRA32, codec, width, height));
     std::vector<uint8_t> decompressed(rgba.size());
 
     Timer timer;
@@ -0,0 +1,346 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Denoise.h"
+#include "HostKernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+
+namespace
+{
+
+const float MAX_SPATIAL = 64.0f;    // a quarter of the way to the 3x3 blur
+const float MAX_TEMPORAL = 192.0f;  // three quarters of the previous output
+const float MIN_THRESHOLD = 2.0f;   // 8-bit code values, scaled for 16-bit samples
+const float MAX_THRESHOLD = 24.0f;
+
+const uint32_t MIN_ROWS_PER_RANGE = 64;
+
+
+// Scalar row kernels
+
+void narrowRow(const int32_t* src, bool wide, uint32_t n, void* dst)
+{
+    if (wide)
+    {
+        uint16_t* d = (uint16_t*) dst;
+        for (uint32_t i = 0; i < n; ++i)
+            d[i] = (uint16_t) src[i];
+    }
+    else
+    {
+        uint8_t* d = (uint8_t*) dst;
+        for (uint32_t i = 0; i < n; ++i)
+            d[i] = (uint8_t) src[i];
+    }
+}
+
+/**
+ * @brief Vertical [1 2 1] sums.
+ */
+void verticalSum(const int32_t* above, const int32_t* center, const int32_t* below, uint32_t n, int32_t* dst)
+{
+    for (uint32_t i = 0; i < n; ++i)
+        dst[i] = above[i] + 2 * center[i] + below[i];
+}
+
+/**
+ * @brief Repeats the border pixels into the one pixel padding on both sides of a row.
+ */
+void padRow(int32_t* row, uint32_t n, uint32_t channels)
+{
+    for (uint32_t c = 0; c < channels; ++c)
+    {
+        row[(int32_t) c - (int32_t) channels] = row[c];
+        row[n + c] = row[n - channels + c];
+    }
+}
+
+inline int32_t filterSample(int32_t x, int32_t left, int32_t middle, int32_t right, const int32_t* previous, const Denoiser::Params& params)
+{
+    const int32_t blur = (left + 2 * middle + right + 8) >> 4;
+    int32_t s = x + (((blur - x) * params.spatial + 128) >> 8);
+
+    if (previous)
+    {
+        const int32_t p = *previous;
+        const int32_t t = std::max(params.threshold - std::abs(s - p), 0);
+        const int32_t a = std::min((t * params.slope) >> 16, params.temporal);
+        s += ((p - s) * a + 128) >> 8;
+    }
+
+    return s;
+}
+
+void filterRow(const int32_t* center, const int32_t* vertical, const int32_t* previous, uint32_t n, uint32_t channels, const Denoiser::Params& params, int32_t* dst)
+{
+    const int32_t* left = vertical - channels;
+    const int32_t* right = vertical + channels;
+
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        if (channels == 4 && (i & 3) == 3)
+            dst[i] = center[i];
+        else
+            dst[i] = filterSample(center[i], left[i], vertical[i], right[i], previous ? previous + i : nullptr, params);
+    }
+}
+
+
+#ifdef NVPIPE_HOST_SIMD
+
+// AVX2 row kernels, only called if cpuSupportsAvx2()
+
+NVPIPE_TARGET_AVX2 void narrowRowAVX2(const int32_t* src, bool wide, uint32_t n, void* dst)
+{
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m256i v = _mm256_loadu_si256((const __m256i*) (src + i));
+        const __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+        if (wide)
+            _mm_storeu_si128((__m128i*) ((uint16_t*) dst + i), packed);
+        else
+            _mm_storel_epi64((__m128i*) ((uint8_t*) dst + i), _mm_packus_epi16(packed, packed));
+    }
+
+    narrowRow(src + i, wide, n - i, wide ? (void*) ((uint16_t*) dst + i) : (void*) ((uint8_t*) dst + i));
+}
+
+NVPIPE_TARGET_AVX2 void verticalSumAVX2(const int32_t* above, const int32_t* center, const int32_t* below, uint32_t n, int32_t* dst)
+{
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m256i a = _mm256_loadu_si256((const __m256i*) (above + i));
+        const __m256i c = _mm256_loadu_si256((const __m256i*) (center + i));
+        const __m256i b = _mm256_loadu_si256((const __m256i*) (below + i));
+        _mm256_storeu_si256((__m256i*) (dst + i), _mm256_add_epi32(_mm256_add_epi32(a, b), _mm256_slli_epi32(c, 1)));
+    }
+
+    verticalSum(above + i, center + i, below + i, n - i, dst + i);
+}
+
+NVPIPE_TARGET_AVX2 void filterRowAVX2(const int32_t* center, const int32_t* vertical, const int32_t* previous, uint32_t n, uint32_t channels, const Denoiser::Params& params, int32_t* dst)
+{
+    const __m256i spatial = _mm256_set1_epi32(params.spatial);
+    const __m256i temporal = _mm256_set1_epi32(params.temporal);
+    const __m256i threshold = _mm256_set1_epi32(params.threshold);
+    const __m256i slope = _mm256_set1_epi32(params.slope);
+    const __m256i round4 = _mm256_set1_epi32(8);
+    const __m256i round8 = _mm256_set1_epi32(128);
+    const __m256i zero = _mm256_setzero_si256();
+    const int32_t* left = vertical - channels;
+    const int32_t* right = vertical + channels;
+
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m256i x = _mm256_loadu_si256((const __m256i*) (center + i));
+        const __m256i l = _mm256_loadu_si256((const __m256i*) (left + i));
+        const __m256i m = _mm256_loadu_si256((const __m256i*) (vertical + i));
+        const __m256i r = _mm256_loadu_si256((const __m256i*) (right + i));
+
+        const __m256i blur = _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(l, r), _mm256_add_epi32(_mm256_slli_epi32(m, 1), round4)), 4);
+        __m256i s = _mm256_add_epi32(x, _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(blur, x), spatial), round8), 8));
+
+        if (previous)
+        {
+            const __m256i p = _mm256_loadu_si256((const __m256i*) (previous + i));
+            const __m256i t = _mm256_max_epi32(_mm256_sub_epi32(threshold, _mm256_abs_epi32(_mm256_sub_epi32(s, p))), zero);
+            const __m256i a = _mm256_min_epi32(_mm256_srai_epi32(_mm256_mullo_epi32(t, slope), 16), temporal);
+            s = _mm256_add_epi32(s, _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(p, s), a), round8), 8));
+        }
+
+        // BGRA: pass alpha through (lanes 3 and 7)
+        if (channels == 4)
+            s = _mm256_blend_epi32(s, x, 0x88);
+
+        _mm256_storeu_si256((__m256i*) (dst + i), s);
+    }
+
+    for (; i < n; ++i)
+    {
+        if (channels == 4 && (i & 3) == 3)
+            dst[i] = center[i];
+        else
+            dst[i] = filterSample(center[i], left[i], vertical[i], right[i], previous ? previous + i : nullptr, params);
+    }
+}
+
+#endif
+
+}
+
+
+Denoiser::Denoiser(uint32_t channels, bool wide, Allocator* allocator) : channels(channels), wide(wide), allocator(allocator ? allocator : &heap)
+{
+}
+
+Denoiser::~Denoiser()
+{
+    this->releaseBuffers();
+}
+
+void Denoiser::releaseBuffers()
+{
+    for (auto& b : this->buffers)
+    {
+        this->allocator->free(b);
+        b = nullptr;
+    }
+    this->bufferSize = 0;
+}
+
+void Denoiser::setStrength(float strength)
+{
+    this->strength = std::min(std::max(strength, 0.0f), 1.0f);
+}
+
+void Denoiser::reset()
+{
+    this->hasReference = false;
+}
+
+uint64_t Denoiser::getMemorySize() const
+{
+    return 2 * this->bufferSize;
+}
+
+const void* Denoiser::process(const void* src, uint64_t srcPitch, uint32_t width, uint32_t height)
+{
+    if (width == 0 || height == 0)
+        return src;
+
+    const uint64_t rowSize = (uint64_t) width * this->channels * (this->wide ? 2 : 1);
+
+    // A new frame size starts without reference
+    if (width != this->width || height != this->height)
+    {
+        this->width = width;
+        this->height = height;
+        this->hasReference = false;
+        this->releaseBuffers();
+        for (auto& b : this->buffers)
+            b = (uint8_t*) this->allocator->allocate(rowSize * height);
+        this->bufferSize = rowSize * height;
+    }
+
+    Params params;
+    params.spatial = (int32_t) std::lround(MAX_SPATIAL * this->strength);
+    params.temporal = (int32_t) std::lround(MAX_TEMPORAL * this->strength);
+    params.threshold = (int32_t) std::lround(MIN_THRESHOLD + (MAX_THRESHOLD - MIN_THRESHOLD) * this->strength) * (this->wide ? 257 : 1);
+    params.slope = (int32_t) (((int64_t) params.temporal << 16) / params.threshold);
+
+    const uint8_t* source = (const uint8_t*) src;
+    uint8_t* dst = this->buffers[0];
+    const uint8_t* previous = this->hasReference ? this->buffers[1] : nullptr;
+
+    parallelRows(height, MIN_ROWS_PER_RANGE, 0, [&](uint32_t, uint32_t y0, uint32_t y1)
+    {
+        if (this->wide)
+            this->processRows<uint16_t>(params, source, srcPitch, (const uint16_t*) previous, (uint16_t*) dst, y0, y1);
+        else
+            this->processRows<uint8_t>(params, source, srcPitch, previous, dst, y0, y1);
+    });
+
+    // The output is the reference of the next frame
+    std::swap(this->buffers[0], this->buffers[1]);
+    this->hasReference = true;
+
+    return this->buffers[1];
+}
+
+template<typename T>
+void Denoiser::processRows(const Params& params, const uint8_t* src, uint64_t srcPitch, const T* previous, T* dst, uint32_t y0, uint32_t y1) const
+{
+    const uint32_t n = this->width * this->channels;
+    const uint32_t pad = this->channels;
+    const bool avx2 = !this->scalarOnly && cpuSupportsAvx2();
+
+    std::vector<int32_t> rows[3] = { std::vector<int32_t>(n), std::vector<int32_t>(n), std::vector<int32_t>(n) };
+    std::vector<int32_t> vertical(n + 2 * pad);
+    std::vector<int32_t> reference(n);
+    std::vector<int32_t> output(n);
+
+    auto widen = [&](uint32_t y, int32_t* row)
+    {
+#ifdef NVPIPE_HOST_SIMD
+        if (avx2)
+            widenRowAVX2(src + y * srcPitch, this->wide, n, row);
+        else
+#endif
+            widenRow(src + y * srcPitch, this->wide, n, row);
+    };
+
+    // Rows above, at and below the current one (repeated at the borders)
+    int32_t* above = rows[0].data();
+    int32_t* center = rows[1].data();
+    int32_t* below = rows[2].data();
+    widen(y0 > 0 ? y0 - 1 : 0, above);
+    widen(y0, center);
+
+    for (uint32_t y = y0; y < y1; ++y)
+    {
+        const uint32_t next = std::min(y + 1, this->height - 1);
+        widen(next, below);
+
+        const T* previousRow = previous ? previous + (uint64_t) y * n : nullptr;
+        T* dstRow = dst + (uint64_t) y * n;
+
+#ifdef NVPIPE_HOST_SIMD
+        if (avx2)
+        {
+            verticalSumAVX2(above, center, below, n, vertical.data() + pad);
+            padRow(vertical.data() + pad, n, pad);
+            if (previousRow)
+                widenRowAVX2(previousRow, this->wide, n, reference.data());
+            filterRowAVX2(center, vertical.data() + pad, previousRow ? reference.data() : nullptr, n, pad, params, output.data());
+            narrowRowAVX2(output.data(), this->wide, n, dstRow);
+        }
+        else
+#endif
+        {
+            verticalSum(above, center, below, n, vertical.data() + pad);
+            padRow(vertical.data() + pad, n, pad);
+            if (previousRow)
+                widenRow(previousRow, this->wide, n, reference.data());
+            filterRow(center, vertical.data() + pad, previousRow ? reference.data() : nullptr, n, pad, params, output.data());
+            narrowRow(output.data(), this->wide, n, dstRow);
+        }
+
+        // Rotate: the current row becomes the one above, the one below the current
+        int32_t* oldAbove = above;
+        above = center;
+        center = below;
+        below = oldAbove;
+    }
+}
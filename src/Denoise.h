@@ -0,0 +1,118 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "MemoryPool.h"
+
+#include <cstdint>
+
+
+/**
+ * @brief Pre-encode denoiser for host frames: motion-adaptive temporal filter plus light spatial smoothing.
+ *
+ * Each sample is first blended towards a 3x3 binomial blur, then towards the previous output frame.
+ * The temporal weight falls off linearly with the difference to the previous output, so static noisy
+ * areas are averaged over time while moving content is left (almost) untouched, which avoids ghosting.
+ *
+ * Integer arithmetic only; rows are processed in parallel and use AVX2 if supported. Scalar and vectorized
+ * paths produce identical output.
+ */
+class Denoiser
+{
+public:
+    /**
+     * @param channels Interleaved samples per pixel, 4 for BGRA (alpha is passed through unchanged).
+     * @param wide 16-bit instead of 8-bit samples.
+     * @param allocator Host memory for the output and reference frames (NULL: heap). Must outlive the denoiser.
+     */
+    Denoiser(uint32_t channels, bool wide, Allocator* allocator = nullptr);
+    ~Denoiser();
+
+    Denoiser(const Denoiser&) = delete;
+    Denoiser& operator=(const Denoiser&) = delete;
+
+    /**
+     * @brief Sets the filter strength between 0 (pass-through) and 1 (strongest). Values are clamped.
+     */
+    void setStrength(float strength);
+    float getStrength() const { return this->strength; }
+
+    /**
+     * @brief Filters a frame and keeps the result as reference for the next one.
+     * @return Filtered frame with tightly packed rows, valid until the next call.
+     */
+    const void* process(const void* src, uint64_t srcPitch, uint32_t width, uint32_t height);
+
+    /**
+     * @brief Drops the reference frame, e.g., after a scene cut.
+     */
+    void reset();
+
+    /**
+     * @brief Host memory held for the output and reference frames in bytes.
+     */
+    uint64_t getMemorySize() const;
+
+    /**
+     * @brief Disables the vectorized code path, e.g., to verify identical output.
+     */
+    void setScalarOnly(bool scalarOnly) { this->scalarOnly = scalarOnly; }
+
+public:
+    /**
+     * @brief Fixed-point filter parameters derived from the strength.
+     */
+    struct Params
+    {
+        int32_t spatial;    ///< Weight of the blurred sample (1/256)
+        int32_t temporal;   ///< Maximum weight of the previous output (1/256)
+        int32_t threshold;  ///< Differences to the previous output at or above this value disable the temporal filter
+        int32_t slope;      ///< temporal * 65536 / threshold
+    };
+
+private:
+    template<typename T>
+    void processRows(const Params& params, const uint8_t* src, uint64_t srcPitch, const T* previous, T* dst, uint32_t y0, uint32_t y1) const;
+
+    void releaseBuffers();
+
+private:
+    uint32_t channels;
+    bool wide;
+    float strength = 0.0f;
+    bool scalarOnly = false;
+
+    uint32_t width = 0;
+    uint32_t height = 0;
+    bool hasReference = false;
+
+    HostAllocator heap;
+    Allocator* allocator;
+    uint8_t* buffers[2] = { nullptr, nullptr }; ///< Output and reference, swapped after each frame
+    uint64_t bufferSize = 0;
+};
@@ -0,0 +1,109 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <functional>
+#include <vector>
+
+
+/**
+ * @brief NV12 frame behind an NvPipe_Frame handle.
+ *
+ * A frame either references device memory (e.g., a locked decoder surface) or host memory.
+ * The luma plane (width x height bytes) is followed by the interleaved UV plane (width x height/2 bytes),
+ * both using the same pitch. The optional release callback is invoked on destruction and returns
+ * borrowed surfaces to their owner.
+ */
+class Frame
+{
+public:
+    enum class Memory
+    {
+        Host,
+        Device
+    };
+
+public:
+    Frame(Memory memory, uint8_t* data, uint64_t pitch, uint32_t width, uint32_t height, std::function<void()> release = nullptr)
+        : memory(memory), data(data), pitch(pitch), width(width), height(height), release(release)
+    {
+    }
+
+    Frame(const Frame&) = delete;
+    Frame& operator=(const Frame&) = delete;
+
+    ~Frame()
+    {
+        if (this->release)
+            this->release();
+    }
+
+    /**
+     * @brief Creates a frame backed by its own host memory.
+     */
+    static Frame* createHost(uint32_t width, uint32_t height)
+    {
+        std::vector<uint8_t>* storage = new std::vector<uint8_t>(width * (height + height / 2));
+        return new Frame(Memory::Host, storage->data(), width, width, height, [storage]() { delete storage; });
+    }
+
+    uint8_t* luma() const { return this->data; }
+    uint8_t* chroma() const { return this->data + this->pitch * this->height; }
+
+    /**
+     * @brief Copies both NV12 planes to a destination surface.
+     * @param copy2D Callable (dst, dstPitch, src, srcPitch, widthInBytes, rows) performing the actual 2D copy.
+     */
+    template<typename Copy2D>
+    void copyTo(uint8_t* dstLuma, uint64_t dstLumaPitch, uint8_t* dstChroma, uint64_t dstChromaPitch, Copy2D copy2D) const
+    {
+        copy2D(dstLuma, dstLumaPitch, this->luma(), this->pitch, this->width, this->height);
+        copy2D(dstChroma, dstChromaPitch, this->chroma(), this->pitch, this->width, this->height / 2);
+    }
+
+    /**
+     * @brief Host implementation of the 2D copy used by copyTo().
+     */
+    static void copyHost(uint8_t* dst, uint64_t dstPitch, const uint8_t* src, uint64_t srcPitch, uint64_t widthInBytes, uint64_t rows)
+    {
+        for (uint64_t y = 0; y < rows; ++y)
+            memcpy(dst + y * dstPitch, src + y * srcPitch, widthInBytes);
+    }
+
+public:
+    const Memory memory;
+    uint8_t* const data;
+    const uint64_t pitch;
+    const uint32_t width;
+    const uint32_t height;
+
+private:
+    std::function<void()> release;
+};
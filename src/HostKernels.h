@@ -0,0 +1,169 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+#if (defined(__x86_64__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER)) && !defined(__CUDACC__)
+#define NVPIPE_HOST_SIMD
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define NVPIPE_TARGET_AVX2
+#else
+#define NVPIPE_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+
+/**
+ * Helpers shared by the host row kernels (denoiser, resizer, YUV conversion): AVX2 detection, row-parallel
+ * execution and widening of 8/16-bit samples. AVX2 kernels are compiled with NVPIPE_TARGET_AVX2 and only
+ * called if cpuSupportsAvx2(), so the rest of the code does not require AVX2.
+ */
+
+/**
+ * @brief True if the CPU and operating system support AVX2.
+ */
+inline bool cpuSupportsAvx2()
+{
+#if defined(NVPIPE_HOST_SIMD) && (defined(__GNUC__) || defined(__clang__))
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+#elif defined(NVPIPE_HOST_SIMD)
+    static const bool supported = []()
+    {
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+        __cpuid(info, 1);
+        const bool osAvx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && ((_xgetbv(0) & 6) == 6);
+        __cpuidex(info, 7, 0);
+        return osAvx && (info[1] & (1 << 5)) != 0;
+    }();
+    return supported;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Workers of parallelRows(), one per hardware thread besides the caller. Started on first use.
+ */
+inline WorkerPool& getRowWorkers()
+{
+    static WorkerPool workers(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return workers;
+}
+
+/**
+ * @brief Maximum number of ranges parallelRows() splits rows into.
+ */
+inline uint32_t getMaxRowRanges()
+{
+    return getRowWorkers().getNumThreads() + 1;
+}
+
+/**
+ * @brief Runs fn(range, begin, end) on contiguous ranges of the rows [0, count) in parallel and waits for completion.
+ *
+ * The calling thread takes part. Concurrent and nested calls are safe, as each caller works on its own ranges.
+ * @param minRowsPerRange A range is only split off if it has at least this many rows.
+ * @param maxRanges Maximum number of ranges, 0 for getMaxRowRanges().
+ * @return Number of ranges.
+ */
+inline uint32_t parallelRows(uint32_t count, uint32_t minRowsPerRange, uint32_t maxRanges, const std::function<void(uint32_t, uint32_t, uint32_t)>& fn)
+{
+    uint32_t numRanges = std::min(getMaxRowRanges(), std::max(1u, count / std::max(1u, minRowsPerRange)));
+    if (maxRanges > 0)
+        numRanges = std::min(numRanges, maxRanges);
+
+    if (numRanges == 1)
+    {
+        fn(0, 0, count);
+        return 1;
+    }
+
+    getRowWorkers().run(numRanges, [&](uint32_t i)
+    {
+        fn(i, (uint32_t) ((uint64_t) count * i / numRanges), (uint32_t) ((uint64_t) count * (i + 1) / numRanges));
+    });
+
+    return numRanges;
+}
+
+/**
+ * @brief Converts n samples of 8 (wide = false) or 16 bits to 32 bits.
+ */
+inline void widenRow(const void* src, bool wide, uint32_t n, int32_t* dst)
+{
+    if (wide)
+    {
+        const uint16_t* s = (const uint16_t*) src;
+        for (uint32_t i = 0; i < n; ++i)
+            dst[i] = s[i];
+    }
+    else
+    {
+        const uint8_t* s = (const uint8_t*) src;
+        for (uint32_t i = 0; i < n; ++i)
+            dst[i] = s[i];
+    }
+}
+
+#ifdef NVPIPE_HOST_SIMD
+
+/**
+ * @brief AVX2 version of widenRow(), only call if cpuSupportsAvx2().
+ */
+NVPIPE_TARGET_AVX2 inline void widenRowAVX2(const void* src, bool wide, uint32_t n, int32_t* dst)
+{
+    uint32_t i = 0;
+    if (wide)
+    {
+        const uint16_t* s = (const uint16_t*) src;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_si256((__m256i*) (dst + i), _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*) (s + i))));
+    }
+    else
+    {
+        const uint8_t* s = (const uint8_t*) src;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_si256((__m256i*) (dst + i), _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) (s + i))));
+    }
+
+    widenRow(wide ? (const void*) ((const uint16_t*) src + i) : (const void*) ((const uint8_t*) src + i), wide, n - i, dst + i);
+}
+
+#endif
@@ -0,0 +1,308 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "HostMemory.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <sstream>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+namespace
+{
+
+#ifdef __linux__
+
+// From <linux/mempolicy.h>, to avoid a dependency on libnuma
+const int NVPIPE_MPOL_PREFERRED = 1;
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+const uint64_t TRANSPARENT_HUGE_PAGE_SIZE = 2ull << 20;
+
+uint32_t log2Of(uint64_t value)
+{
+    uint32_t log2 = 0;
+    while (value >> (log2 + 1))
+        ++log2;
+    return log2;
+}
+
+#endif
+
+std::string toLower(std::string s)
+{
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return (char) std::tolower(c); });
+    return s;
+}
+
+}
+
+
+bool NumaTopology::readLine(const std::string& path, std::string& line) const
+{
+    std::ifstream in(this->root + "/" + path);
+    if (!in)
+        return false;
+
+    std::getline(in, line);
+    return true;
+}
+
+std::vector<int> NumaTopology::parseList(const std::string& list)
+{
+    std::vector<int> values;
+
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ','))
+    {
+        const size_t dash = range.find('-');
+        char* end = nullptr;
+        const long first = std::strtol(range.c_str(), &end, 10);
+        if (end == range.c_str())
+            continue;
+
+        const long last = (dash == std::string::npos) ? first : std::strtol(range.c_str() + dash + 1, nullptr, 10);
+        for (long v = first; v <= last; ++v)
+            values.push_back((int) v);
+    }
+
+    return values;
+}
+
+int NumaTopology::getNodeOfPciDevice(const std::string& busId) const
+{
+    // sysfs uses lower-case hex digits; CUDA reports a 4 digit domain, which sysfs also uses
+    std::string line;
+    if (!this->readLine("bus/pci/devices/" + toLower(busId) + "/numa_node", line))
+        return -1;
+
+    char* end = nullptr;
+    const long node = std::strtol(line.c_str(), &end, 10);
+    if (end == line.c_str() || node < 0)
+        return -1;
+
+    // A single node system reports node 0, binding would only add overhead
+    if (this->getOnlineNodes().size() <= 1)
+        return -1;
+
+    return (int) node;
+}
+
+std::vector<int> NumaTopology::getOnlineNodes() const
+{
+    std::string line;
+    if (!this->readLine("devices/system/node/online", line))
+        return {};
+
+    return parseList(line);
+}
+
+std::vector<uint64_t> NumaTopology::getHugePageSizes() const
+{
+    std::vector<uint64_t> sizes;
+
+#ifdef __linux__
+    DIR* dir = opendir((this->root + "/kernel/mm/hugepages").c_str());
+    if (!dir)
+        return sizes;
+
+    // Entries are named "hugepages-<size>kB"
+    while (dirent* entry = readdir(dir))
+    {
+        const std::string name = entry->d_name;
+        const std::string prefix = "hugepages-";
+        if (name.compare(0, prefix.size(), prefix) != 0)
+            continue;
+
+        const uint64_t kilobytes = std::strtoull(name.c_str() + prefix.size(), nullptr, 10);
+        if (kilobytes > 0)
+            sizes.push_back(kilobytes << 10);
+    }
+    closedir(dir);
+
+    std::sort(sizes.begin(), sizes.end());
+#endif
+
+    return sizes;
+}
+
+uint64_t NumaTopology::getFreeHugePages(uint64_t pageSize, int node) const
+{
+    const std::string pool = "hugepages/hugepages-" + std::to_string(pageSize >> 10) + "kB/free_hugepages";
+    const std::string path = (node < 0) ? "kernel/mm/" + pool : "devices/system/node/node" + std::to_string(node) + "/" + pool;
+
+    std::string line;
+    if (!this->readLine(path, line))
+        return 0;
+
+    return std::strtoull(line.c_str(), nullptr, 10);
+}
+
+bool NumaTopology::isTransparentHugePagesEnabled() const
+{
+    // The selected mode is in brackets, e.g., "always [madvise] never"
+    std::string line;
+    if (!this->readLine("kernel/mm/transparent_hugepage/enabled", line))
+        return false;
+
+    return line.find("[always]") != std::string::npos || line.find("[madvise]") != std::string::npos;
+}
+
+
+NumaHostAllocator::NumaHostAllocator(int node, HugePages hugePages, uint64_t hugePageSize)
+    : node(node), hugePages(hugePages), hugePageSize(hugePageSize)
+{
+}
+
+NumaHostAllocator::~NumaHostAllocator()
+{
+    // Mappings still in use are owned by their users from now on
+}
+
+void* NumaHostAllocator::map(uint64_t size, Mapping& mapping)
+{
+#ifdef __linux__
+    mapping = { size, false, false };
+    void* ptr = MAP_FAILED;
+
+    const uint64_t explicitPageSize = this->hugePageSize ? this->hugePageSize : TRANSPARENT_HUGE_PAGE_SIZE;
+    const bool explicitPages = this->hugePages == HugePages::Explicit && size >= explicitPageSize;
+    if (explicitPages)
+    {
+        // hugetlbfs mappings must be a multiple of the page size
+        const uint64_t hugeSize = (size + explicitPageSize - 1) / explicitPageSize * explicitPageSize;
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+        if (this->hugePageSize)
+            flags |= (int) (log2Of(this->hugePageSize) << MAP_HUGE_SHIFT);
+
+        ptr = mmap(nullptr, hugeSize, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (ptr != MAP_FAILED)
+            mapping = { hugeSize, true, false };
+    }
+
+    if (ptr == MAP_FAILED)
+    {
+        ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED)
+            throw std::bad_alloc();
+
+#ifdef MADV_HUGEPAGE
+        if (this->hugePages != HugePages::None && size >= TRANSPARENT_HUGE_PAGE_SIZE)
+            madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+    }
+
+    bool fallback = explicitPages && !mapping.hugePages;
+
+    // Pages are placed when first touched, so the policy must be set before anyone writes to the buffer
+    if (this->node >= 0)
+    {
+        const size_t bitsPerWord = 8 * sizeof(unsigned long);
+        std::vector<unsigned long> mask(this->node / bitsPerWord + 1, 0);
+        mask[this->node / bitsPerWord] = 1ul << (this->node % bitsPerWord);
+
+        mapping.bound = syscall(SYS_mbind, ptr, mapping.size, NVPIPE_MPOL_PREFERRED, mask.data(), mask.size() * bitsPerWord + 1, 0) == 0;
+        fallback |= !mapping.bound;
+    }
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (fallback)
+        this->statistics.fallbacks++;
+    return ptr;
+#else
+    mapping = { size, false, false };
+    void* ptr = std::malloc(size);
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+#endif
+}
+
+void* NumaHostAllocator::allocate(uint64_t size)
+{
+    Mapping mapping;
+    void* ptr = this->map(std::max<uint64_t>(size, 1), mapping);
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->mappings[ptr] = mapping;
+    this->statistics.allocations++;
+    if (mapping.hugePages)
+        this->statistics.hugePageBytes += mapping.size;
+    if (mapping.bound)
+        this->statistics.boundBytes += mapping.size;
+
+    return ptr;
+}
+
+void NumaHostAllocator::free(void* ptr)
+{
+    if (!ptr)
+        return;
+
+    Mapping mapping;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        auto it = this->mappings.find(ptr);
+        if (it == this->mappings.end())
+            return; // not allocated by this allocator
+
+        mapping = it->second;
+        this->mappings.erase(it);
+
+        if (mapping.hugePages)
+            this->statistics.hugePageBytes -= mapping.size;
+        if (mapping.bound)
+            this->statistics.boundBytes -= mapping.size;
+    }
+
+#ifdef __linux__
+    munmap(ptr, mapping.size);
+#else
+    std::free(ptr);
+#endif
+}
+
+HostAllocatorStatistics NumaHostAllocator::getStatistics() const
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->statistics;
+}
@@ -0,0 +1,157 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "MemoryPool.h"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+/**
+ * @brief Huge page backing of host buffers.
+ */
+enum class HugePages
+{
+    None,        ///< Regular pages
+    Transparent, ///< Regular mappings, advised for transparent huge pages (THP)
+    Explicit     ///< Pages from the hugetlbfs pool, falls back to transparent huge pages if the pool is exhausted
+};
+
+
+/**
+ * @brief NUMA and huge page information read from sysfs.
+ *
+ * The root directory is configurable, so the parsing can be tested against a fake sysfs tree.
+ * Missing files mean "unknown" (node -1, no huge pages) rather than errors.
+ */
+class NumaTopology
+{
+public:
+    explicit NumaTopology(const std::string& sysfsRoot = "/sys") : root(sysfsRoot) {}
+
+    /**
+     * @brief NUMA node of a PCI device, e.g., a GPU, or -1 if unknown or the system has a single node.
+     * @param busId PCI bus id in the domain:bus:device.function notation (case-insensitive), e.g., "0000:3B:00.0".
+     */
+    int getNodeOfPciDevice(const std::string& busId) const;
+
+    /**
+     * @brief Online NUMA nodes.
+     */
+    std::vector<int> getOnlineNodes() const;
+
+    /**
+     * @brief Sizes of the configured hugetlbfs pools in bytes, ascending.
+     */
+    std::vector<uint64_t> getHugePageSizes() const;
+
+    /**
+     * @brief Free pages of a hugetlbfs pool, optionally of a single node (node < 0: all nodes).
+     */
+    uint64_t getFreeHugePages(uint64_t pageSize, int node = -1) const;
+
+    /**
+     * @brief True if transparent huge pages are enabled ("always" or "madvise").
+     */
+    bool isTransparentHugePagesEnabled() const;
+
+    /**
+     * @brief Parses a sysfs list such as "0-3,8,10-11".
+     */
+    static std::vector<int> parseList(const std::string& list);
+
+private:
+    bool readLine(const std::string& path, std::string& line) const;
+
+private:
+    std::string root;
+};
+
+
+/**
+ * @brief Counters of a NumaHostAllocator.
+ */
+struct HostAllocatorStatistics
+{
+    uint64_t allocations = 0;     ///< Calls to allocate()
+    uint64_t hugePageBytes = 0;   ///< Bytes currently mapped from the hugetlbfs pool
+    uint64_t boundBytes = 0;      ///< Bytes currently bound to the NUMA node
+    uint64_t fallbacks = 0;       ///< Explicit huge page or binding requests that fell back to regular memory
+};
+
+
+/**
+ * @brief Host memory on a given NUMA node, optionally backed by huge pages.
+ *
+ * Allocations are separate anonymous mappings with a preferred-node memory policy, so pages are placed
+ * on the node when first touched (and elsewhere only if the node is out of memory). Huge pages reduce
+ * TLB misses of large sequential copies, e.g., of staging frames. Without NUMA or mmap support (non-Linux),
+ * this is a plain heap allocator. Thread-safe.
+ */
+class NumaHostAllocator : public Allocator
+{
+public:
+    /**
+     * @param node NUMA node, or -1 to leave placement to the operating system.
+     * @param hugePages Huge page backing.
+     * @param hugePageSize Page size of the hugetlbfs pool for HugePages::Explicit (0: system default).
+     */
+    NumaHostAllocator(int node, HugePages hugePages, uint64_t hugePageSize = 0);
+    ~NumaHostAllocator() override;
+
+    void* allocate(uint64_t size) override;
+    void free(void* ptr) override;
+
+    int getNode() const { return this->node; }
+    HugePages getHugePages() const { return this->hugePages; }
+
+    HostAllocatorStatistics getStatistics() const;
+
+private:
+    struct Mapping
+    {
+        uint64_t size;
+        bool hugePages;
+        bool bound;
+    };
+
+    void* map(uint64_t size, Mapping& mapping);
+
+private:
+    const int node;
+    const HugePages hugePages;
+    const uint64_t hugePageSize;
+
+    mutable std::mutex mutex;
+    std::unordered_map<void*, Mapping> mappings;
+    HostAllocatorStatistics statistics;
+};
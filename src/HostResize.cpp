@@ -0,0 +1,397 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "HostResize.h"
+#include "HostKernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace
+{
+
+/**
+ * @brief Builds the filter for one axis.
+ *
+ * Bilinear samples output i at source position i * ratio + offset, with source sample j centered at j.
+ * This mirrors the unnormalized texture coordinates of Resize.cu (texel centers at j + 0.5) including its
+ * clamping at the borders and the 8-bit quantization of the interpolation weight.
+ * Area averages the source interval [i * ratio, (i + 1) * ratio) weighted by coverage.
+ */
+HostResizer::FilterTable buildTable(uint32_t srcSize, uint32_t dstSize, double ratio, double offset, uint32_t channels, ResizeFilter filter)
+{
+    const int one = 1 << HostResizer::FilterTable::WEIGHT_BITS;
+    const bool area = (filter == ResizeFilter::Area && srcSize > dstSize);
+
+    HostResizer::FilterTable table;
+    table.taps = area ? (uint32_t) std::ceil(ratio) + 1 : 2;
+    table.size = dstSize * channels;
+    table.indices.resize(table.taps * table.size);
+    table.weights.resize(table.taps * table.size);
+
+    std::vector<int32_t> index(table.taps);
+    std::vector<int32_t> weight(table.taps);
+
+    for (uint32_t i = 0; i < dstSize; ++i)
+    {
+        std::fill(weight.begin(), weight.end(), 0);
+
+        if (area)
+        {
+            const double a = i * ratio;
+            const double b = std::min((i + 1) * ratio, (double) srcSize);
+            const int32_t first = (int32_t) std::floor(a);
+            const int32_t last = std::min((int32_t) std::ceil(b), (int32_t) srcSize) - 1;
+
+            uint32_t largest = 0;
+            int32_t sum = 0;
+            for (uint32_t k = 0; k < table.taps; ++k)
+            {
+                const int32_t j = std::min(first + (int32_t) k, last);
+                index[k] = j;
+                if (first + (int32_t) k <= last)
+                {
+                    const double coverage = std::min(b, j + 1.0) - std::max(a, (double) j);
+                    weight[k] = (int32_t) std::lround(coverage / (b - a) * one);
+                    sum += weight[k];
+                    if (weight[k] > weight[largest])
+                        largest = k;
+                }
+            }
+
+            // Rounding residual goes to the largest tap so that flat areas stay flat
+            weight[largest] += one - sum;
+        }
+        else
+        {
+            const double p = i * ratio + offset;
+            const double j = std::floor(p);
+            const int32_t w = (int32_t) std::lround((p - j) * one);
+
+            index[0] = std::min(std::max((int32_t) j, 0), (int32_t) srcSize - 1);
+            index[1] = std::min(std::max((int32_t) j + 1, 0), (int32_t) srcSize - 1);
+            weight[0] = one - w;
+            weight[1] = w;
+        }
+
+        for (uint32_t k = 0; k < table.taps; ++k)
+        {
+            for (uint32_t c = 0; c < channels; ++c)
+            {
+                table.indices[k * table.size + i * channels + c] = index[k] * (int32_t) channels + (int32_t) c;
+                table.weights[k * table.size + i * channels + c] = weight[k];
+            }
+        }
+    }
+
+    return table;
+}
+
+HostResizer::Plan buildPlan(uint32_t srcWidth, uint32_t srcHeight, uint32_t dstWidth, uint32_t dstHeight, double ratioX, double ratioY,
+                            double offsetX, double offsetY, uint32_t channels, ResizeFilter filter)
+{
+    HostResizer::Plan plan;
+    if (srcWidth == 0 || srcHeight == 0 || dstWidth == 0 || dstHeight == 0)
+        return plan;
+
+    plan.srcWidth = srcWidth;
+    plan.srcHeight = srcHeight;
+    plan.dstWidth = dstWidth;
+    plan.dstHeight = dstHeight;
+    plan.channels = channels;
+    plan.horizontal = buildTable(srcWidth, dstWidth, ratioX, offsetX, channels, filter);
+    plan.vertical = buildTable(srcHeight, dstHeight, ratioY, offsetY, 1, filter);
+
+    return plan;
+}
+
+
+// Scalar row kernels, identical results to the AVX2 kernels
+
+void filterRow(const int32_t* src, const HostResizer::FilterTable& table, int shift, int32_t* dst)
+{
+    const int32_t round = shift > 0 ? 1 << (shift - 1) : 0;
+
+    for (uint32_t i = 0; i < table.size; ++i)
+    {
+        int32_t sum = round;
+        for (uint32_t k = 0; k < table.taps; ++k)
+            sum += table.weights[k * table.size + i] * src[table.indices[k * table.size + i]];
+        dst[i] = sum >> shift;
+    }
+}
+
+void blendRows(const int32_t* const* rows, const int32_t* weights, uint32_t taps, uint32_t n, int shift, bool wide, void* dst)
+{
+    const int32_t round = 1 << (shift - 1);
+    const int32_t maxValue = wide ? 65535 : 255;
+
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        int32_t sum = round;
+        for (uint32_t k = 0; k < taps; ++k)
+            sum += weights[k] * rows[k][i];
+
+        const int32_t value = std::min(sum >> shift, maxValue);
+        if (wide)
+            ((uint16_t*) dst)[i] = (uint16_t) value;
+        else
+            ((uint8_t*) dst)[i] = (uint8_t) value;
+    }
+}
+
+
+#ifdef NVPIPE_HOST_SIMD
+
+// AVX2 row kernels, only called if cpuSupportsAvx2()
+
+NVPIPE_TARGET_AVX2 void filterRowAVX2(const int32_t* src, const HostResizer::FilterTable& table, int shift, int32_t* dst)
+{
+    const int32_t round = shift > 0 ? 1 << (shift - 1) : 0;
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    const int32_t* indices = table.indices.data();
+    const int32_t* weights = table.weights.data();
+
+    uint32_t i = 0;
+    for (; i + 8 <= table.size; i += 8)
+    {
+        __m256i sum = _mm256_set1_epi32(round);
+        for (uint32_t k = 0; k < table.taps; ++k)
+        {
+            const __m256i index = _mm256_loadu_si256((const __m256i*) (indices + k * table.size + i));
+            const __m256i weight = _mm256_loadu_si256((const __m256i*) (weights + k * table.size + i));
+            sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(weight, _mm256_i32gather_epi32(src, index, 4)));
+        }
+        _mm256_storeu_si256((__m256i*) (dst + i), _mm256_sra_epi32(sum, count));
+    }
+
+    for (; i < table.size; ++i)
+    {
+        int32_t sum = round;
+        for (uint32_t k = 0; k < table.taps; ++k)
+            sum += weights[k * table.size + i] * src[indices[k * table.size + i]];
+        dst[i] = sum >> shift;
+    }
+}
+
+NVPIPE_TARGET_AVX2 void blendRowsAVX2(const int32_t* const* rows, const int32_t* weights, uint32_t taps, uint32_t n, int shift, bool wide, void* dst)
+{
+    const int32_t round = 1 << (shift - 1);
+    const __m128i count = _mm_cvtsi32_si128(shift);
+
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i sum = _mm256_set1_epi32(round);
+        for (uint32_t k = 0; k < taps; ++k)
+            sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(_mm256_set1_epi32(weights[k]), _mm256_loadu_si256((const __m256i*) (rows[k] + i))));
+        sum = _mm256_sra_epi32(sum, count);
+
+        // Weights are non-negative, so saturating packs only clamp at the top
+        const __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+        if (wide)
+            _mm_storeu_si128((__m128i*) ((uint16_t*) dst + i), packed);
+        else
+            _mm_storel_epi64((__m128i*) ((uint8_t*) dst + i), _mm_packus_epi16(packed, packed));
+    }
+
+    const int32_t maxValue = wide ? 65535 : 255;
+    for (; i < n; ++i)
+    {
+        int32_t sum = round;
+        for (uint32_t k = 0; k < taps; ++k)
+            sum += weights[k] * rows[k][i];
+
+        const int32_t value = std::min(sum >> shift, maxValue);
+        if (wide)
+            ((uint16_t*) dst)[i] = (uint16_t) value;
+        else
+            ((uint8_t*) dst)[i] = (uint8_t) value;
+    }
+}
+
+#endif
+
+}
+
+
+HostResizer::HostResizer(uint32_t srcWidth, uint32_t srcHeight, uint32_t dstWidth, uint32_t dstHeight, ResizeFilter filter) : filter(filter)
+{
+    if (srcWidth == 0 || srcHeight == 0 || dstWidth == 0 || dstHeight == 0)
+        return;
+
+    // ResizeNv12/ResizeP016 and ScaleYUV420 sample luma at the same positions
+    const double ratioX = (double) srcWidth / dstWidth;
+    const double ratioY = (double) srcHeight / dstHeight;
+    this->luma = buildPlan(srcWidth, srcHeight, dstWidth, dstHeight, ratioX, ratioY, -0.5, -0.5, 1, filter);
+
+    // ResizeNv12/ResizeP016 use the luma scale for chroma and sample rows at their centers (+0.5f in the kernel)
+    this->chromaNv12 = buildPlan(srcWidth / 2, srcHeight / 2, dstWidth / 2, dstHeight / 2, ratioX, ratioY, -0.5, 0.0, 2, filter);
+
+    // ScaleYUV420 scales the rounded-up chroma planes independently
+    const uint32_t chromaSrcWidth = (srcWidth + 1) / 2;
+    const uint32_t chromaSrcHeight = (srcHeight + 1) / 2;
+    const uint32_t chromaDstWidth = (dstWidth + 1) / 2;
+    const uint32_t chromaDstHeight = (dstHeight + 1) / 2;
+    const double chromaRatioX = (double) chromaSrcWidth / chromaDstWidth;
+    const double chromaRatioY = (double) chromaSrcHeight / chromaDstHeight;
+    this->chroma = buildPlan(chromaSrcWidth, chromaSrcHeight, chromaDstWidth, chromaDstHeight, chromaRatioX, chromaRatioY, -0.5, -0.5, 1, filter);
+    this->chromaUV = buildPlan(chromaSrcWidth, chromaSrcHeight, chromaDstWidth, chromaDstHeight, chromaRatioX, chromaRatioY, -0.5, -0.5, 2, filter);
+}
+
+void HostResizer::resizeNv12(const uint8_t* src, uint64_t srcPitch, uint8_t* dst, uint64_t dstPitch, uint8_t* dstUV) const
+{
+    if (!dstUV)
+        dstUV = dst + dstPitch * this->luma.dstHeight;
+
+    this->resizeSemiplanar(false, src, src + srcPitch * this->luma.srcHeight, srcPitch, srcPitch, dst, dstUV, dstPitch, dstPitch);
+}
+
+void HostResizer::resizeP016(const uint8_t* src, uint64_t srcPitch, uint8_t* dst, uint64_t dstPitch, uint8_t* dstUV) const
+{
+    if (!dstUV)
+        dstUV = dst + dstPitch * this->luma.dstHeight;
+
+    this->resizeSemiplanar(true, src, src + srcPitch * this->luma.srcHeight, srcPitch, srcPitch, dst, dstUV, dstPitch, dstPitch);
+}
+
+void HostResizer::resizeSemiplanar(bool wide, const uint8_t* srcY, const uint8_t* srcUV, uint64_t srcPitch, uint64_t srcChromaPitch,
+                                   uint8_t* dstY, uint8_t* dstUV, uint64_t dstPitch, uint64_t dstChromaPitch) const
+{
+    if (wide)
+    {
+        this->run<uint16_t>(this->luma, srcY, srcPitch, dstY, dstPitch);
+        this->run<uint16_t>(this->chromaNv12, srcUV, srcChromaPitch, dstUV, dstChromaPitch);
+    }
+    else
+    {
+        this->run<uint8_t>(this->luma, srcY, srcPitch, dstY, dstPitch);
+        this->run<uint8_t>(this->chromaNv12, srcUV, srcChromaPitch, dstUV, dstChromaPitch);
+    }
+}
+
+void HostResizer::scaleYuv420(const uint8_t* srcY, const uint8_t* srcU, const uint8_t* srcV, uint64_t srcPitch, uint64_t srcChromaPitch,
+                              uint8_t* dstY, uint8_t* dstU, uint8_t* dstV, uint64_t dstPitch, uint64_t dstChromaPitch, bool semiplanar) const
+{
+    this->run<uint8_t>(this->luma, srcY, srcPitch, dstY, dstPitch);
+
+    if (semiplanar)
+    {
+        this->run<uint8_t>(this->chromaUV, srcU, srcChromaPitch, dstU, dstChromaPitch);
+    }
+    else
+    {
+        this->run<uint8_t>(this->chroma, srcU, srcChromaPitch, dstU, dstChromaPitch);
+        this->run<uint8_t>(this->chroma, srcV, srcChromaPitch, dstV, dstChromaPitch);
+    }
+}
+
+template<typename T>
+void HostResizer::run(const Plan& plan, const uint8_t* src, uint64_t srcPitch, uint8_t* dst, uint64_t dstPitch) const
+{
+    if (plan.dstHeight == 0)
+        return;
+
+    // 8-bit rows keep full precision between the passes, 16-bit rows are rounded to sample precision
+    const bool wide = sizeof(T) == 2;
+    const int horizontalShift = wide ? FilterTable::WEIGHT_BITS : 0;
+    const int verticalShift = 2 * FilterTable::WEIGHT_BITS - horizontalShift;
+
+    const uint32_t srcRowSize = plan.srcWidth * plan.channels;
+    const uint32_t dstRowSize = plan.dstWidth * plan.channels;
+    const uint32_t taps = plan.vertical.taps;
+    const bool avx2 = !this->scalarOnly && cpuSupportsAvx2();
+
+    parallelRows(plan.dstHeight, 16, this->maxThreads, [&](uint32_t, uint32_t begin, uint32_t end)
+    {
+        std::vector<int32_t> widened(srcRowSize);
+
+        // Horizontally filtered source rows; consecutive output rows share most of them
+        std::vector<std::vector<int32_t>> filtered(taps + 1, std::vector<int32_t>(dstRowSize));
+        std::vector<int64_t> filteredRow(taps + 1, -1);
+
+        std::vector<const int32_t*> rows(taps);
+        std::vector<int32_t> weights(taps);
+
+        for (uint32_t y = begin; y < end; ++y)
+        {
+            const int32_t* index = &plan.vertical.indices[y];
+            const int32_t* weight = &plan.vertical.weights[y];
+
+            for (uint32_t k = 0; k < taps; ++k)
+            {
+                const int64_t row = index[k * plan.vertical.size];
+
+                uint32_t slot = 0;
+                while (slot <= taps && filteredRow[slot] != row)
+                    ++slot;
+
+                if (slot > taps)
+                {
+                    // Evict the lowest row that this output row does not need
+                    slot = taps + 1;
+                    for (uint32_t s = 0; s <= taps; ++s)
+                    {
+                        bool needed = false;
+                        for (uint32_t j = 0; j < taps; ++j)
+                            needed |= (filteredRow[s] == index[j * plan.vertical.size]);
+
+                        if (!needed && (slot > taps || filteredRow[s] < filteredRow[slot]))
+                            slot = s;
+                    }
+
+                    const uint8_t* srcRow = src + row * srcPitch;
+#ifdef NVPIPE_HOST_SIMD
+                    if (avx2)
+                    {
+                        widenRowAVX2(srcRow, wide, srcRowSize, widened.data());
+                        filterRowAVX2(widened.data(), plan.horizontal, horizontalShift, filtered[slot].data());
+                    }
+                    else
+#endif
+                    {
+                        widenRow(srcRow, wide, srcRowSize, widened.data());
+                        filterRow(widened.data(), plan.horizontal, horizontalShift, filtered[slot].data());
+                    }
+                    filteredRow[slot] = row;
+                }
+
+                rows[k] = filtered[slot].data();
+                weights[k] = weight[k * plan.vertical.size];
+            }
+
+            uint8_t* dstRow = dst + y * dstPitch;
+#ifdef NVPIPE_HOST_SIMD
+            if (avx2)
+                blendRowsAVX2(rows.data(), weights.data(), taps, dstRowSize, verticalShift, wide, dstRow);
+            else
+#endif
+                blendRows(rows.data(), weights.data(), taps, dstRowSize, verticalShift, wide, dstRow);
+        }
+    });
+}
@@ -0,0 +1,136 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+
+/**
+ * @brief Resampling filters of the host resizer.
+ */
+enum class ResizeFilter
+{
+    Bilinear, ///< Same sampling positions and 8-bit weights as the texture unit in Resize.cu
+    Area      ///< Box filter weighted by pixel coverage for downscaling; axes that are upscaled use bilinear
+};
+
+
+/**
+ * @brief CPU counterpart of ResizeNv12, ResizeP016 and ScaleYUV420 (NvCodec/Utils/Resize.cu).
+ *
+ * Frames are resampled separably with fixed-point filter tables that are built once per scale factor
+ * in the constructor, so a resizer can be reused for every frame of a stream. Rows are processed in parallel
+ * and the row kernels use AVX2 if supported. Scalar and vectorized paths produce identical output.
+ *
+ * Bilinear output matches the GPU within one or two code values (the GPU rescales the normalized texture value
+ * by 2^bits instead of 2^bits - 1 and truncates, the host rounds).
+ */
+class HostResizer
+{
+public:
+    HostResizer(uint32_t srcWidth, uint32_t srcHeight, uint32_t dstWidth, uint32_t dstHeight, ResizeFilter filter = ResizeFilter::Bilinear);
+
+    /**
+     * @brief Resizes an NV12 frame (luma followed by interleaved UV rows, same pitch).
+     * @param dstUV Chroma destination, or nullptr to write it after dstHeight luma rows of dst.
+     */
+    void resizeNv12(const uint8_t* src, uint64_t srcPitch, uint8_t* dst, uint64_t dstPitch, uint8_t* dstUV = nullptr) const;
+
+    /**
+     * @brief Resizes a P016 frame (16-bit NV12). Pitches are in bytes.
+     */
+    void resizeP016(const uint8_t* src, uint64_t srcPitch, uint8_t* dst, uint64_t dstPitch, uint8_t* dstUV = nullptr) const;
+
+    /**
+     * @brief Resizes an NV12 (wide = false) or P016 (wide = true) frame whose chroma plane is stored separately.
+     */
+    void resizeSemiplanar(bool wide, const uint8_t* srcY, const uint8_t* srcUV, uint64_t srcPitch, uint64_t srcChromaPitch,
+                          uint8_t* dstY, uint8_t* dstUV, uint64_t dstPitch, uint64_t dstChromaPitch) const;
+
+    /**
+     * @brief Resizes an I420 frame, or a semi-planar one with U/V interleaved in the U plane (V is ignored).
+     */
+    void scaleYuv420(const uint8_t* srcY, const uint8_t* srcU, const uint8_t* srcV, uint64_t srcPitch, uint64_t srcChromaPitch,
+                     uint8_t* dstY, uint8_t* dstU, uint8_t* dstV, uint64_t dstPitch, uint64_t dstChromaPitch, bool semiplanar = false) const;
+
+    /**
+     * @brief Disables the vectorized code path, e.g., to verify identical output.
+     */
+    void setScalarOnly(bool scalarOnly) { this->scalarOnly = scalarOnly; }
+
+    /**
+     * @brief Limits the number of threads including the caller, 0 for one per hardware thread.
+     */
+    void setMaxThreads(uint32_t maxThreads) { this->maxThreads = maxThreads; }
+
+    ResizeFilter getFilter() const { return this->filter; }
+
+public:
+    /**
+     * @brief Fixed-point filter for one axis: output i is the sum over k of weights[k][i] * source[indices[k][i]].
+     *
+     * Taps are stored tap-major so that the row kernels load consecutive outputs. Indices are clamped to the source
+     * and already multiplied by the number of interleaved channels.
+     */
+    struct FilterTable
+    {
+        static const int WEIGHT_BITS = 8;
+
+        uint32_t taps = 0;
+        uint32_t size = 0;             ///< Number of outputs (times channels)
+        std::vector<int32_t> indices;  ///< taps * size
+        std::vector<int32_t> weights;  ///< taps * size, each output sums to 1 << WEIGHT_BITS
+    };
+
+    /**
+     * @brief One resampling pass: plane geometry plus horizontal and vertical tables.
+     */
+    struct Plan
+    {
+        uint32_t srcWidth = 0, srcHeight = 0; ///< In samples, interleaved channels not included
+        uint32_t dstWidth = 0, dstHeight = 0;
+        uint32_t channels = 1;
+        FilterTable horizontal;
+        FilterTable vertical;
+    };
+
+private:
+    template<typename T>
+    void run(const Plan& plan, const uint8_t* src, uint64_t srcPitch, uint8_t* dst, uint64_t dstPitch) const;
+
+private:
+    ResizeFilter filter;
+    bool scalarOnly = false;
+    uint32_t maxThreads = 0;
+
+    Plan luma;        ///< Y plane (all entry points)
+    Plan chromaNv12;  ///< Interleaved UV of ResizeNv12/ResizeP016
+    Plan chroma;      ///< Single chroma plane of ScaleYUV420
+    Plan chromaUV;    ///< Interleaved chroma plane of ScaleYUV420
+};
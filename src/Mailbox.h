@@ -0,0 +1,100 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <utility>
+
+
+/**
+ * @brief Single-slot mailbox in which the most recent item wins.
+ *
+ * Producers never wait for the consumer: posting replaces an item that has not been taken yet.
+ * The replaced item is handed back to the producer so its storage can be recycled.
+ */
+template<typename T>
+class Mailbox
+{
+public:
+    /**
+     * @brief Posts an item, replacing any unconsumed one.
+     * @param item Item to post. Receives the replaced item if one was pending.
+     * @return True if a pending item was replaced.
+     */
+    bool post(T& item)
+    {
+        bool replaced;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            replaced = this->full;
+            std::swap(this->slot, item);
+            this->full = true;
+        }
+        this->condition.notify_one();
+
+        return replaced;
+    }
+
+    /**
+     * @brief Waits for the next item.
+     * @param item Receives the item. Its previous value is left in the slot for recycling.
+     * @return False if the mailbox was closed.
+     */
+    bool take(T& item)
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->condition.wait(lock, [this]() { return this->full || this->closed; });
+
+        if (!this->full)
+            return false;
+
+        std::swap(this->slot, item);
+        this->full = false;
+        return true;
+    }
+
+    /**
+     * @brief Wakes up and terminates a waiting consumer.
+     */
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->closed = true;
+        }
+        this->condition.notify_all();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable condition;
+    T slot = T();
+    bool full = false;
+    bool closed = false;
+};
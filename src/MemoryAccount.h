@@ -0,0 +1,98 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+
+/**
+ * @brief Current and peak value of a byte counter.
+ */
+struct MemoryCounter
+{
+    void add(int64_t bytes)
+    {
+        const uint64_t value = this->current.fetch_add((uint64_t) bytes, std::memory_order_relaxed) + (uint64_t) bytes;
+
+        uint64_t peak = this->peak.load(std::memory_order_relaxed);
+        while (value > peak && !this->peak.compare_exchange_weak(peak, value, std::memory_order_relaxed))
+            ;
+    }
+
+    std::atomic<uint64_t> current{0};
+    std::atomic<uint64_t> peak{0};
+};
+
+
+/**
+ * @brief Device and host memory held by an encoder or decoder instance.
+ *
+ * All changes are also applied to the process-wide total. Memory still accounted when an
+ * instance is destroyed is removed from the total.
+ */
+class MemoryAccount
+{
+public:
+    MemoryAccount() = default;
+    MemoryAccount(const MemoryAccount&) = delete;
+    MemoryAccount& operator=(const MemoryAccount&) = delete;
+
+    ~MemoryAccount()
+    {
+        if (this == &getTotal())
+            return;
+
+        getTotal().device.add(-(int64_t) this->device.current.load());
+        getTotal().host.add(-(int64_t) this->host.current.load());
+    }
+
+    void addDevice(int64_t bytes)
+    {
+        this->device.add(bytes);
+        if (this != &getTotal())
+            getTotal().device.add(bytes);
+    }
+
+    void addHost(int64_t bytes)
+    {
+        this->host.add(bytes);
+        if (this != &getTotal())
+            getTotal().host.add(bytes);
+    }
+
+    static MemoryAccount& getTotal()
+    {
+        static MemoryAccount total;
+        return total;
+    }
+
+public:
+    MemoryCounter device;
+    MemoryCounter host;
+};
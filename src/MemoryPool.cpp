@@ -0,0 +1,201 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "MemoryPool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <new>
+
+
+void* HostAllocator::allocate(uint64_t size)
+{
+    void* ptr = std::malloc(size);
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void HostAllocator::free(void* ptr)
+{
+    std::free(ptr);
+}
+
+
+CachingAllocator::CachingAllocator(std::unique_ptr<Allocator> backing, uint64_t maxCachedBytes)
+    : backing(std::move(backing)), maxCachedBytes(maxCachedBytes)
+{
+}
+
+CachingAllocator::~CachingAllocator()
+{
+    this->release();
+
+    // Blocks still in use are owned by their users from now on
+}
+
+uint64_t CachingAllocator::getSizeClass(uint64_t size)
+{
+    if (size <= MIN_BLOCK_SIZE)
+        return MIN_BLOCK_SIZE;
+
+    // Four classes per power of two
+    uint32_t log2 = 0;
+    while ((size - 1) >> (log2 + 1))
+        ++log2;
+
+    const uint64_t step = 1ull << (log2 - 2);
+    return (size + step - 1) & ~(step - 1);
+}
+
+void* CachingAllocator::allocate(uint64_t size)
+{
+    const uint64_t sizeClass = getSizeClass(size);
+    void* ptr = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->statistics.allocations++;
+
+        auto it = this->cached.find(sizeClass);
+        if (it != this->cached.end() && !it->second.empty())
+        {
+            ptr = it->second.back();
+            it->second.pop_back();
+
+            this->statistics.hits++;
+            this->statistics.cachedBytes -= sizeClass;
+            this->statistics.liveBytes += sizeClass;
+            this->live[ptr] = sizeClass;
+        }
+    }
+
+    if (ptr)
+    {
+        this->notify(-(int64_t) sizeClass);
+        return ptr;
+    }
+
+    // Miss: allocate outside of the lock, the backing allocation may be slow
+    ptr = this->backing->allocate(sizeClass);
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->live[ptr] = sizeClass;
+    this->statistics.liveBytes += sizeClass;
+    this->statistics.peakBytes = std::max(this->statistics.peakBytes, this->statistics.liveBytes + this->statistics.cachedBytes);
+
+    return ptr;
+}
+
+void CachingAllocator::free(void* ptr)
+{
+    if (!ptr)
+        return;
+
+    uint64_t sizeClass = 0;
+    bool cache = false;
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        auto it = this->live.find(ptr);
+        if (it == this->live.end())
+        {
+            // Not allocated by this pool or freed twice. Releasing it could corrupt the backing allocator, so it is only reported.
+            this->statistics.invalidFrees++;
+            assert(false && "CachingAllocator::free: pointer not allocated by this pool");
+            return;
+        }
+
+        sizeClass = it->second;
+        this->live.erase(it);
+        this->statistics.liveBytes -= sizeClass;
+
+        cache = this->statistics.cachedBytes + sizeClass <= this->maxCachedBytes;
+        if (cache)
+        {
+            this->cached[sizeClass].push_back(ptr);
+            this->statistics.cachedBytes += sizeClass;
+        }
+        else
+        {
+            this->statistics.evictions++;
+        }
+    }
+
+    if (cache)
+        this->notify(sizeClass);
+    else
+        this->backing->free(ptr);
+}
+
+uint64_t CachingAllocator::release()
+{
+    std::unordered_map<uint64_t, std::vector<void*>> blocks;
+    uint64_t released = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        std::swap(blocks, this->cached);
+        released = this->statistics.cachedBytes;
+        this->statistics.cachedBytes = 0;
+    }
+
+    for (auto& c : blocks)
+        for (void* ptr : c.second)
+            this->backing->free(ptr);
+
+    if (released > 0)
+        this->notify(-(int64_t) released);
+
+    return released;
+}
+
+PoolStatistics CachingAllocator::getStatistics() const
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->statistics;
+}
+
+void CachingAllocator::setCacheCallback(std::function<void(int64_t)> callback)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->cacheCallback = callback;
+}
+
+void CachingAllocator::notify(int64_t cachedBytesDelta)
+{
+    std::function<void(int64_t)> callback;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        callback = this->cacheCallback;
+    }
+
+    if (callback)
+        callback(cachedBytesDelta);
+}
@@ -0,0 +1,132 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+
+/**
+ * @brief Interface for raw memory allocation.
+ */
+class Allocator
+{
+public:
+    virtual ~Allocator() = default;
+
+    /**
+     * @brief Allocates size bytes. Throws std::bad_alloc (or an implementation specific exception) on failure.
+     */
+    virtual void* allocate(uint64_t size) = 0;
+    virtual void free(void* ptr) = 0;
+};
+
+
+/**
+ * @brief Plain host memory, e.g., to test the caching allocator without a GPU.
+ */
+class HostAllocator : public Allocator
+{
+public:
+    void* allocate(uint64_t size) override;
+    void free(void* ptr) override;
+};
+
+
+/**
+ * @brief Counters of a CachingAllocator.
+ */
+struct PoolStatistics
+{
+    uint64_t allocations = 0; ///< Calls to allocate()
+    uint64_t hits = 0;        ///< Allocations served from the cache
+    uint64_t evictions = 0;   ///< Freed blocks returned to the backing allocator because the cache was full
+    uint64_t liveBytes = 0;   ///< Bytes handed out (rounded to size classes)
+    uint64_t cachedBytes = 0; ///< Bytes kept for reuse
+    uint64_t peakBytes = 0;   ///< Maximum of liveBytes + cachedBytes
+    uint64_t invalidFrees = 0; ///< Calls to free() with a pointer not allocated by the pool (a bug of the caller)
+
+    double getHitRate() const
+    {
+        return this->allocations ? (double) this->hits / this->allocations : 0.0;
+    }
+};
+
+
+/**
+ * @brief Thread-safe, size-classed caching sub-allocator.
+ *
+ * Sizes are rounded up to classes with four steps per power of two (at most 25% overhead),
+ * so buffers of slightly different sizes, e.g., after a resize, share blocks. Freed blocks are
+ * kept per class for reuse up to maxCachedBytes and only returned to the backing allocator
+ * when the cache is full or on release(). This avoids the implicit device synchronization and
+ * fragmentation of frequent cudaMalloc/cudaFree calls.
+ */
+class CachingAllocator : public Allocator
+{
+public:
+    static const uint64_t MIN_BLOCK_SIZE = 4096;
+
+    CachingAllocator(std::unique_ptr<Allocator> backing, uint64_t maxCachedBytes);
+    ~CachingAllocator() override;
+
+    void* allocate(uint64_t size) override;
+    void free(void* ptr) override;
+
+    /**
+     * @brief Returns all cached blocks to the backing allocator.
+     * @return Released bytes.
+     */
+    uint64_t release();
+
+    PoolStatistics getStatistics() const;
+
+    /**
+     * @brief Called with the change of the cached bytes (outside of the lock), e.g., for memory accounting.
+     */
+    void setCacheCallback(std::function<void(int64_t)> callback);
+
+    static uint64_t getSizeClass(uint64_t size);
+
+private:
+    void notify(int64_t cachedBytesDelta);
+
+private:
+    std::unique_ptr<Allocator> backing;
+    const uint64_t maxCachedBytes;
+
+    mutable std::mutex mutex;
+    std::unordered_map<void*, uint64_t> live;                 ///< Block -> size class
+    std::unordered_map<uint64_t, std::vector<void*>> cached;  ///< Size class -> free blocks
+    PoolStatistics statistics;
+    std::function<void(int64_t)> cacheCallback;
+};
@@ -0,0 +1,257 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Metrics.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+
+const double Histogram::BOUNDS[Histogram::NUM_BUCKETS] = { 0.0005, 0.001, 0.002, 0.004, 0.008, 0.016, 0.033, 0.066, 0.133, 0.25, 0.5, 1.0 };
+
+
+StreamMetrics::StreamMetrics(const std::string& role, const std::string& codec) : role(role), codec(codec)
+{
+}
+
+void StreamMetrics::setName(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(this->nameMutex);
+    this->name = name;
+}
+
+std::string StreamMetrics::getName() const
+{
+    std::lock_guard<std::mutex> lock(this->nameMutex);
+    return this->name;
+}
+
+
+MetricsRegistry& MetricsRegistry::instance()
+{
+    static MetricsRegistry registry;
+    return registry;
+}
+
+std::shared_ptr<StreamMetrics> MetricsRegistry::add(const std::string& role, const std::string& codec)
+{
+    std::shared_ptr<StreamMetrics> metrics = std::make_shared<StreamMetrics>(role, codec);
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    metrics->setName(role + std::to_string(this->nextId++));
+    this->streams.push_back(metrics);
+
+    return metrics;
+}
+
+void MetricsRegistry::remove(const std::shared_ptr<StreamMetrics>& metrics)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->streams.erase(std::remove(this->streams.begin(), this->streams.end(), metrics), this->streams.end());
+}
+
+namespace
+{
+
+std::string escapeLabel(const std::string& value)
+{
+    std::string escaped;
+    for (char c : value)
+    {
+        if (c == '\\' || c == '"')
+            escaped += '\\';
+
+        if (c == '\n')
+            escaped += "\\n";
+        else
+            escaped += c;
+    }
+    return escaped;
+}
+
+void writeCounter(std::ostringstream& out, const char* name, const char* help, const std::vector<std::pair<std::string, std::shared_ptr<StreamMetrics>>>& streams, std::atomic<uint64_t> StreamMetrics::* counter)
+{
+    out << "# TYPE nvpipe_" << name << " counter\n";
+    out << "# HELP nvpipe_" << name << " " << help << "\n";
+    for (auto& s : streams)
+        out << "nvpipe_" << name << "_total{" << s.first << "} " << ((*s.second).*counter).load(std::memory_order_relaxed) << "\n";
+}
+
+}
+
+std::string MetricsRegistry::exportOpenMetrics() const
+{
+    std::vector<std::pair<std::string, std::shared_ptr<StreamMetrics>>> streams;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        for (auto& s : this->streams)
+            streams.emplace_back("stream=\"" + escapeLabel(s->getName()) + "\",role=\"" + s->role + "\",codec=\"" + s->codec + "\"", s);
+    }
+
+    std::ostringstream out;
+    writeCounter(out, "frames", "Frames encoded or decoded.", streams, &StreamMetrics::frames);
+    writeCounter(out, "bytes", "Compressed bytes produced or consumed.", streams, &StreamMetrics::bytes);
+    writeCounter(out, "idr_frames", "IDR frames produced.", streams, &StreamMetrics::idrFrames);
+    writeCounter(out, "dropped_frames", "Frames superseded before being encoded or delivered.", streams, &StreamMetrics::droppedFrames);
+    writeCounter(out, "late_frames", "Frames dropped because they would have missed their deadline.", streams, &StreamMetrics::lateFrames);
+    writeCounter(out, "recreates", "Codec sessions created, e.g., due to resolution changes.", streams, &StreamMetrics::recreates);
+    writeCounter(out, "timeouts", "Frames dropped because encoding or decoding exceeded the timeout.", streams, &StreamMetrics::timeouts);
+
+    out << "# TYPE nvpipe_target_bitrate gauge\n";
+    out << "# HELP nvpipe_target_bitrate Configured encoder bitrate in bit per second.\n";
+    for (auto& s : streams)
+        if (s.second->role == "encoder")
+            out << "nvpipe_target_bitrate{" << s.first << "} " << s.second->bitrate.load(std::memory_order_relaxed) << "\n";
+
+    out << "# TYPE nvpipe_latency_seconds histogram\n";
+    out << "# HELP nvpipe_latency_seconds Time spent encoding or decoding a frame.\n";
+    for (auto& s : streams)
+    {
+        const Histogram& h = s.second->latency;
+
+        uint64_t count = 0;
+        for (uint32_t i = 0; i < Histogram::NUM_BUCKETS; ++i)
+        {
+            count += h.buckets[i].load(std::memory_order_relaxed);
+            out << "nvpipe_latency_seconds_bucket{" << s.first << ",le=\"" << Histogram::BOUNDS[i] << "\"} " << count << "\n";
+        }
+        count += h.buckets[Histogram::NUM_BUCKETS].load(std::memory_order_relaxed);
+
+        out << "nvpipe_latency_seconds_bucket{" << s.first << ",le=\"+Inf\"} " << count << "\n";
+        out << "nvpipe_latency_seconds_sum{" << s.first << "} " << 1.0e-9 * h.sumNs.load(std::memory_order_relaxed) << "\n";
+        out << "nvpipe_latency_seconds_count{" << s.first << "} " << count << "\n";
+    }
+
+    out << "# EOF\n";
+    return out.str();
+}
+
+
+#ifdef _WIN32
+
+MetricsServer::MetricsServer(uint16_t port)
+{
+    throw std::runtime_error("Metrics server is not supported on this platform");
+}
+
+MetricsServer::~MetricsServer()
+{
+}
+
+void MetricsServer::run()
+{
+}
+
+#else
+
+MetricsServer::MetricsServer(uint16_t port)
+{
+    this->socket = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (this->socket < 0)
+        throw std::runtime_error("Failed to create metrics server socket");
+
+    int reuse = 1;
+    setsockopt(this->socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    // Only reachable from the local machine
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(this->socket, (sockaddr*) &address, sizeof(address)) < 0 || listen(this->socket, 8) < 0)
+    {
+        close(this->socket);
+        throw std::runtime_error("Failed to bind metrics server to port " + std::to_string(port));
+    }
+
+    this->thread = std::unique_ptr<std::thread>(new std::thread(&MetricsServer::run, this));
+}
+
+MetricsServer::~MetricsServer()
+{
+    this->stopped = true;
+    this->thread->join();
+    close(this->socket);
+}
+
+void MetricsServer::run()
+{
+    while (!this->stopped)
+    {
+        // Wake up periodically to notice shutdown
+        pollfd fd = { this->socket, POLLIN, 0 };
+        if (poll(&fd, 1, 200) <= 0)
+            continue;
+
+        int client = accept(this->socket, nullptr, nullptr);
+        if (client < 0)
+            continue;
+
+        // Read the request line; headers and body are ignored
+        char request[1024];
+        ssize_t received = 0;
+        pollfd clientFd = { client, POLLIN, 0 };
+        if (poll(&clientFd, 1, 1000) > 0)
+            received = recv(client, request, sizeof(request) - 1, 0);
+
+        std::string response;
+        if (received > 0 && std::string(request, received).compare(0, 13, "GET /metrics ") == 0)
+        {
+            const std::string body = MetricsRegistry::instance().exportOpenMetrics();
+            response = "HTTP/1.1 200 OK\r\n"
+                       "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+                       "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                       "Connection: close\r\n\r\n" + body;
+        }
+        else
+        {
+            response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        }
+
+        for (size_t sent = 0; sent < response.size(); )
+        {
+            ssize_t n = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0)
+                break;
+            sent += n;
+        }
+
+        close(client);
+    }
+}
+
+#endif
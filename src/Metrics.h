@@ -0,0 +1,133 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/**
+ * @brief Lock-free histogram with fixed, exponentially spaced buckets.
+ */
+class Histogram
+{
+public:
+    static const uint32_t NUM_BUCKETS = 12;
+    static const double BOUNDS[NUM_BUCKETS]; ///< Upper bucket bounds in seconds
+
+    void observe(double seconds)
+    {
+        uint32_t i = 0;
+        while (i < NUM_BUCKETS && seconds > BOUNDS[i])
+            ++i;
+
+        this->buckets[i].fetch_add(1, std::memory_order_relaxed);
+        this->sumNs.fetch_add((uint64_t) (seconds * 1.0e9), std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> buckets[NUM_BUCKETS + 1] = {}; ///< Last bucket counts observations above all bounds
+    std::atomic<uint64_t> sumNs{0};
+};
+
+
+/**
+ * @brief Health metrics of a single encode or decode stream.
+ *
+ * Updated with relaxed atomics on the hot path. Text is only generated when the registry is scraped.
+ */
+struct StreamMetrics
+{
+    StreamMetrics(const std::string& role, const std::string& codec);
+
+    void setName(const std::string& name);
+    std::string getName() const;
+
+    const std::string role;
+    const std::string codec;
+
+    std::atomic<uint64_t> frames{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> idrFrames{0};
+    std::atomic<uint64_t> droppedFrames{0};
+    std::atomic<uint64_t> lateFrames{0};
+    std::atomic<uint64_t> recreates{0};
+    std::atomic<uint64_t> timeouts{0};
+    std::atomic<uint64_t> bitrate{0};
+    Histogram latency;
+
+private:
+    mutable std::mutex nameMutex;
+    std::string name;
+};
+
+
+/**
+ * @brief Process-wide registry of all live streams.
+ */
+class MetricsRegistry
+{
+public:
+    static MetricsRegistry& instance();
+
+    std::shared_ptr<StreamMetrics> add(const std::string& role, const std::string& codec);
+    void remove(const std::shared_ptr<StreamMetrics>& metrics);
+
+    /**
+     * @brief Renders all streams in the OpenMetrics text exposition format.
+     */
+    std::string exportOpenMetrics() const;
+
+private:
+    mutable std::mutex mutex;
+    std::vector<std::shared_ptr<StreamMetrics>> streams;
+    uint64_t nextId = 0;
+};
+
+
+/**
+ * @brief Minimal HTTP endpoint serving the registry on localhost (POSIX only).
+ */
+class MetricsServer
+{
+public:
+    MetricsServer(uint16_t port);
+    ~MetricsServer();
+
+private:
+    void run();
+
+private:
+    int socket = -1;
+    std::atomic<bool> stopped{false};
+    std::unique_ptr<std::thread> thread;
+};
@@ -12,6 +12,7 @@
 #include <iostream>
 #include <algorithm>
 #include <chrono>
+#include <thread>
 
 #include "nvcuvid.h"
 #include "../Utils/NvCodecUtils.h"
@@ -212,7 +213,7 @@ int NvDecoder::HandleVideoSequence(CUVIDEOFORMAT *pVideoFormat)
     videoDecodeCreateInfo.OutputFormat = pVideoFormat->bit_depth_luma_minus8 ? cudaVideoSurfaceFormat_P016 : cudaVideoSurfaceFormat_NV12;
     videoDecodeCreateInfo.bitDepthMinus8 = pVideoFormat->bit_depth_luma_minus8;
     videoDecodeCreateInfo.DeinterlaceMode = cudaVideoDeinterlaceMode_Weave;
-    videoDecodeCreateInfo.ulNumOutputSurfaces = 2;
+    videoDecodeCreateInfo.ulNumOutputSurfaces = m_nNumOutputSurfaces;
     // With PreferCUVID, JPEG is still decoded by CUDA while video is decoded by NVDEC hardware
     videoDecodeCreateInfo.ulCreationFlags = cudaVideoCreate_PreferCUVID;
     videoDecodeCreateInfo.ulNumDecodeSurfaces = nDecodeSurface;
@@ -270,6 +271,10 @@ int NvDecoder::HandleVideoSequence(CUVIDEOFORMAT *pVideoFormat)
 
     CUDA_DRVAPI_CALL(cuCtxPushCurrent(m_cuContext));
     NVDEC_API_CALL(cuvidCreateDecoder(&m_hDecoder, &videoDecodeCreateInfo));
+
+    // NvPipe tweak: estimate of the surface memory allocated by the driver
+    m_nSurfaceBytes = ((uint64_t) nDecodeSurface * m_nMaxWidth * m_nMaxHeight + 2ull * videoDecodeCreateInfo.ulTargetWidth * videoDecodeCreateInfo.ulTargetHeight)
+        * (m_nBitDepthMinus8 ? 2 : 1) * 3 / 2;
     CUDA_DRVAPI_CALL(cuCtxPopCurrent(NULL));
     STOP_TIMER("Session Initialization Time: ");
     return nDecodeSurface;
@@ -404,6 +409,13 @@ int NvDecoder::setReconfigParams(const Rect *pCropRect, const Dim *pResizeDim)
         }
     }
 
+    // NvPipe tweak: mapped surfaces do not survive the reconfiguration
+    UnmapFrames();
+    if (m_bZeroCopy && !m_bLockRequested)
+    {
+        m_nDecodedFrame = 0;
+    }
+
     // Clear existing output buffers of different size
     uint8_t *pFrame = NULL;
     while (!m_vpFrame.empty())
@@ -412,9 +424,7 @@ int NvDecoder::setReconfigParams(const Rect *pCropRect, const Dim *pResizeDim)
         m_vpFrame.pop_back();
         if (m_bUseDeviceFrame)
         {
-            CUDA_DRVAPI_CALL(cuCtxPushCurrent(m_cuContext));
-            CUDA_DRVAPI_CALL(cuMemFree((CUdeviceptr)pFrame));
-            CUDA_DRVAPI_CALL(cuCtxPopCurrent(NULL));
+            FreeDeviceFrame(pFrame);
         }
         else
         {
@@ -444,6 +454,26 @@ int NvDecoder::HandlePictureDecode(CUVIDPICPARAMS *pPicParams) {
 *  0: fail, >=1: suceeded 
 */
 int NvDecoder::HandlePictureDisplay(CUVIDPARSERDISPINFO *pDispInfo) {
+    // NvPipe tweak: drop the picture if it is not decoded before the deadline (mapping would block until it is)
+    if (m_nTimeoutMs > 0)
+    {
+        while (true)
+        {
+            CUVIDGETDECODESTATUS status;
+            memset(&status, 0, sizeof(status));
+            if (cuvidGetDecodeStatus(m_hDecoder, pDispInfo->picture_index, &status) != CUDA_SUCCESS || status.decodeStatus != cuvidDecodeStatus_InProgress)
+            {
+                break;
+            }
+            if (std::chrono::steady_clock::now() >= m_deadline)
+            {
+                m_nTimedOutFrame++;
+                return 1;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+
     CUVIDPROCPARAMS videoProcessingParameters = {};
     videoProcessingParameters.progressive_frame = pDispInfo->progressive_frame;
     videoProcessingParameters.second_field = pDispInfo->repeat_first_field + 1;
@@ -463,6 +493,13 @@ int NvDecoder::HandlePictureDisplay(CUVIDPARSERDISPINFO *pDispInfo) {
     {
         printf("Decode Error occurred for picture %d\n", m_nPicNumInDecodeOrder[pDispInfo->picture_index]);
     }
+
+    if (m_bZeroCopy && !m_bLockRequested)
+    {
+        // NvPipe tweak: hand out the mapped surface instead of a copy
+        return HandleMappedFrame(dpSrcFrame, nSrcPitch, pDispInfo->timestamp);
+    }
+
     uint8_t *pDecodedFrame = nullptr;
     {
         std::lock_guard<std::mutex> lock(m_mtxVPFrame);
@@ -471,22 +508,37 @@ int NvDecoder::HandlePictureDisplay(CUVIDPARSERDISPINFO *pDispInfo) {
             // Not enough frames in stock
             m_nFrameAlloc++;
             uint8_t *pFrame = NULL;
-            if (m_bUseDeviceFrame)
+            if (m_bUseDeviceFrame && m_fnFrameAlloc)
+            {
+                // NvPipe tweak: external allocator, e.g., a memory pool shared between decoders
+                size_t nFrameSize = GetFrameSize();
+                if (m_bDeviceFramePitched)
+                {
+                    m_nDeviceFramePitch = (m_nWidth * (m_nBitDepthMinus8 ? 2 : 1) + 255) & ~(size_t) 255;
+                    nFrameSize = m_nDeviceFramePitch * (m_nHeight * 3 / 2);
+                }
+                pFrame = (uint8_t *) m_fnFrameAlloc(nFrameSize);
+                m_nFrameBytes += nFrameSize;
+            }
+            else if (m_bUseDeviceFrame)
             {
                 CUDA_DRVAPI_CALL(cuCtxPushCurrent(m_cuContext));
                 if (m_bDeviceFramePitched)
                 {
                     CUDA_DRVAPI_CALL(cuMemAllocPitch((CUdeviceptr *)&pFrame, &m_nDeviceFramePitch, m_nWidth * (m_nBitDepthMinus8 ? 2 : 1), m_nHeight * 3 / 2, 16));
+                    m_nFrameBytes += (uint64_t) m_nDeviceFramePitch * (m_nHeight * 3 / 2);
                 }
                 else 
                 {
                     CUDA_DRVAPI_CALL(cuMemAlloc((CUdeviceptr *)&pFrame, GetFrameSize()));
+                    m_nFrameBytes += GetFrameSize();
                 }
                 CUDA_DRVAPI_CALL(cuCtxPopCurrent(NULL));
             }
             else 
             {
                 pFrame = new uint8_t[GetFrameSize()];
+                m_nFrameBytes += GetFrameSize();
             }
             m_vpFrame.push_back(pFrame);
         }
@@ -553,6 +605,14 @@ NvDecoder::~NvDecoder() {
         cuvidDestroyVideoParser(m_hParser);
     }
 
+    // NvPipe tweak: unmap frames still handed out in zero-copy mode
+    UnmapFrames();
+    if (m_evMappedReleased) {
+        cuCtxPushCurrent(m_cuContext);
+        cuEventDestroy(m_evMappedReleased);
+        cuCtxPopCurrent(NULL);
+    }
+
     if (m_hDecoder) {
         if (m_pMutex) m_pMutex->lock();
         cuvidDestroyDecoder(m_hDecoder);
@@ -568,11 +628,7 @@ NvDecoder::~NvDecoder() {
     {
         if (m_bUseDeviceFrame)
         {
-            if (m_pMutex) m_pMutex->lock();
-            cuCtxPushCurrent(m_cuContext);
-            cuMemFree((CUdeviceptr)pFrame);
-            cuCtxPopCurrent(NULL);
-            if (m_pMutex) m_pMutex->unlock();
+            FreeDeviceFrame(pFrame);
         }
         else
         {
@@ -592,6 +648,9 @@ bool NvDecoder::Decode(const uint8_t *pData, int nSize, uint8_t ***pppFrame, int
     }
 
     m_nDecodedFrame = 0;
+    m_nTimedOutFrame = 0;
+    UnmapFrames();
+    m_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_nTimeoutMs);
     CUVIDSOURCEDATAPACKET packet = {0};
     packet.payload = pData;
     packet.payload_size = nSize;
@@ -612,7 +671,17 @@ bool NvDecoder::Decode(const uint8_t *pData, int nSize, uint8_t ***pppFrame, int
         {
             m_vpFrameRet.clear();
             std::lock_guard<std::mutex> lock(m_mtxVPFrame);
-            m_vpFrameRet.insert(m_vpFrameRet.begin(), m_vpFrame.begin(), m_vpFrame.begin() + m_nDecodedFrame);
+            if (m_bZeroCopy && !m_bLockRequested)
+            {
+                for (CUdeviceptr dpFrame : m_vMappedFrame)
+                {
+                    m_vpFrameRet.push_back((uint8_t *)dpFrame);
+                }
+            }
+            else
+            {
+                m_vpFrameRet.insert(m_vpFrameRet.begin(), m_vpFrame.begin(), m_vpFrame.begin() + m_nDecodedFrame);
+            }
             *pppFrame = &m_vpFrameRet[0];
         }
         if (ppTimestamp) 
@@ -627,9 +696,121 @@ bool NvDecoder::Decode(const uint8_t *pData, int nSize, uint8_t ***pppFrame, int
     return true;
 }
 
+uint64_t NvDecoder::ReleaseFrames()
+{
+    std::lock_guard<std::mutex> lock(m_mtxVPFrame);
+
+    // All frames are the same size, locked frames are not in the stock
+    const uint64_t nFrameSize = m_nFrameAlloc ? m_nFrameBytes / m_nFrameAlloc : 0;
+    const int nReleased = (int) m_vpFrame.size();
+
+    for (uint8_t *pFrame : m_vpFrame)
+    {
+        if (m_bUseDeviceFrame)
+        {
+            FreeDeviceFrame(pFrame);
+        }
+        else
+        {
+            delete[] pFrame;
+        }
+    }
+    m_vpFrame.clear();
+    m_vpFrameRet.clear();
+
+    m_nFrameAlloc -= nReleased;
+    m_nFrameBytes -= nReleased * nFrameSize;
+    return nReleased * nFrameSize;
+}
+
+void NvDecoder::FreeDeviceFrame(uint8_t *pFrame)
+{
+    if (m_fnFrameFree)
+    {
+        m_fnFrameFree(pFrame);
+        return;
+    }
+
+    if (m_pMutex) m_pMutex->lock();
+    cuCtxPushCurrent(m_cuContext);
+    cuMemFree((CUdeviceptr)pFrame);
+    cuCtxPopCurrent(NULL);
+    if (m_pMutex) m_pMutex->unlock();
+}
+
+int NvDecoder::HandleMappedFrame(CUdeviceptr dpFrame, unsigned int nPitch, int64_t timestamp)
+{
+    // Only a few surfaces can be mapped at the same time, older pictures of the same Decode() call are superseded
+    if ((int)m_vMappedFrame.size() >= m_nNumOutputSurfaces)
+    {
+        NVDEC_API_CALL(cuvidUnmapVideoFrame(m_hDecoder, m_vMappedFrame.front()));
+        m_vMappedFrame.erase(m_vMappedFrame.begin());
+        m_vTimestamp.erase(m_vTimestamp.begin());
+    }
+
+    m_vMappedFrame.push_back(dpFrame);
+    m_vTimestamp.resize(m_vMappedFrame.size());
+    m_vTimestamp.back() = timestamp;
+    m_nMappedFramePitch = (int)nPitch;
+    m_nDecodedFrame = (int)m_vMappedFrame.size();
+    return 1;
+}
+
+void NvDecoder::UnmapFrames()
+{
+    if (m_vMappedFrame.empty())
+    {
+        return;
+    }
+
+    // Conversions reading the surfaces have usually finished by now, so this rarely blocks
+    if (m_bMappedReleased)
+    {
+        cuCtxPushCurrent(m_cuContext);
+        cuEventSynchronize(m_evMappedReleased);
+        cuCtxPopCurrent(NULL);
+    }
+
+    for (CUdeviceptr dpFrame : m_vMappedFrame)
+    {
+        cuvidUnmapVideoFrame(m_hDecoder, dpFrame);
+    }
+    m_vMappedFrame.clear();
+    m_bMappedReleased = false;
+}
+
+void NvDecoder::ReleaseMappedFrames(CUstream stream)
+{
+    if (m_vMappedFrame.empty())
+    {
+        return;
+    }
+
+    CUDA_DRVAPI_CALL(cuCtxPushCurrent(m_cuContext));
+    if (!m_evMappedReleased)
+    {
+        CUDA_DRVAPI_CALL(cuEventCreate(&m_evMappedReleased, CU_EVENT_DISABLE_TIMING));
+    }
+    CUDA_DRVAPI_CALL(cuEventRecord(m_evMappedReleased, stream));
+    CUDA_DRVAPI_CALL(cuCtxPopCurrent(NULL));
+    m_bMappedReleased = true;
+}
+
 bool NvDecoder::DecodeLockFrame(const uint8_t *pData, int nSize, uint8_t ***pppFrame, int *pnFrameReturned, uint32_t flags, int64_t **ppTimestamp, int64_t timestamp, CUstream stream)
 {
-    bool ret = Decode(pData, nSize, pppFrame, pnFrameReturned, flags, ppTimestamp, timestamp, stream);
+    // NvPipe tweak: locked frames are always copies, mapped surfaces must be returned soon
+    m_bLockRequested = true;
+    bool ret = false;
+    try
+    {
+        ret = Decode(pData, nSize, pppFrame, pnFrameReturned, flags, ppTimestamp, timestamp, stream);
+    }
+    catch (...)
+    {
+        m_bLockRequested = false;
+        throw;
+    }
+    m_bLockRequested = false;
     std::lock_guard<std::mutex> lock(m_mtxVPFrame);
     m_vpFrame.erase(m_vpFrame.begin(), m_vpFrame.begin() + m_nDecodedFrame);
     return true;
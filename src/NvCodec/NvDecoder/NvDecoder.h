@@ -19,6 +19,8 @@
 #include <iostream>
 #include <sstream>
 #include <string.h>
+#include <chrono>
+#include <functional>
 #include "nvcuvid.h"
 
 /**
@@ -156,7 +158,81 @@ public:
     */
     int setReconfigParams(const Rect * pCropRect, const Dim * pResizeDim);
 
+    /**
+    *   @brief  NvPipe tweak: Bounds the time a Decode() call waits for the hardware. Pictures that are not decoded
+    *   before the deadline are dropped instead of being returned. A timeout of 0 (default) waits indefinitely.
+    */
+    void SetDecodeTimeout(uint32_t nTimeoutMs) { m_nTimeoutMs = nTimeoutMs; }
+
+    /**
+    *   @brief  NvPipe tweak: Returns the number of pictures dropped by the last Decode() call because of the timeout.
+    */
+    int GetNumTimedOutFrames() const { return m_nTimedOutFrame; }
+
+    /**
+    *   @brief  NvPipe tweak: Returns the memory of the allocated output frames in bytes.
+    */
+    uint64_t GetFrameBytes() const { return m_nFrameBytes; }
+
+    /**
+    *   @brief  NvPipe tweak: Returns an estimate of the device memory of the driver's decode and output surfaces in bytes.
+    */
+    uint64_t GetSurfaceBytes() const { return m_nSurfaceBytes; }
+
+    /**
+    *   @brief  NvPipe tweak: Frees output frames that are neither returned by the last Decode() call nor locked.
+    *   Frames are allocated again on demand.
+    *   @return Released bytes.
+    */
+    uint64_t ReleaseFrames();
+
+    /**
+    *   @brief  NvPipe tweak: Allocates device output frames through the given functions instead of cuMemAlloc/cuMemFree,
+    *   e.g., from a shared memory pool. Must be set before the first frame is decoded. Pitched frames are aligned to 256 bytes.
+    */
+    void SetFrameAllocator(std::function<void*(size_t)> fnAlloc, std::function<void(void*)> fnFree) { m_fnFrameAlloc = fnAlloc; m_fnFrameFree = fnFree; }
+
+    /**
+    *   @brief  NvPipe tweak: Zero-copy mode. Decode() returns the mapped decoder output surfaces instead of copying them
+    *   into frame buffers. Mapped frames have the pitch GetMappedFramePitch() and the chroma plane starts GetSurfaceHeight()
+    *   rows after the luma plane. They are unmapped by the next Decode() call, which first waits for the work queued before
+    *   ReleaseMappedFrames(). DecodeLockFrame() always copies, since locked frames may be held indefinitely.
+    */
+    void SetZeroCopy(bool bZeroCopy) { m_bZeroCopy = bZeroCopy; }
+
+    /**
+    *   @brief  NvPipe tweak: Returns the pitch of the frames returned in zero-copy mode.
+    */
+    int GetMappedFramePitch() const { return m_nMappedFramePitch; }
+
+    /**
+    *   @brief  NvPipe tweak: Returns the height of the decoder surfaces (coded height, may exceed the frame height).
+    */
+    int GetSurfaceHeight() const { return m_nSurfaceHeight; }
+
+    /**
+    *   @brief  NvPipe tweak: Marks the mapped frames of the last Decode() call as consumed once the work queued on the stream so far
+    *   has finished. Does not block.
+    */
+    void ReleaseMappedFrames(CUstream stream = 0);
+
 private:
+    /**
+    *   @brief  NvPipe tweak: Frees a device output frame, does not throw
+    */
+    void FreeDeviceFrame(uint8_t *pFrame);
+
+    /**
+    *   @brief  NvPipe tweak: Keeps a mapped surface for return by Decode() in zero-copy mode
+    */
+    int HandleMappedFrame(CUdeviceptr dpFrame, unsigned int nPitch, int64_t timestamp);
+
+    /**
+    *   @brief  NvPipe tweak: Unmaps the frames of the previous Decode() call in zero-copy mode
+    */
+    void UnmapFrames();
+
+
     /**
     *   @brief  Callback function to be registered for getting a callback when decoding of sequence starts
     */
@@ -233,4 +309,22 @@ private:
     unsigned int m_nMaxWidth = 0, m_nMaxHeight = 0;
     bool m_bReconfigExternal = false;
     bool m_bReconfigExtPPChange = false;
+
+    uint64_t m_nFrameBytes = 0;
+    std::function<void*(size_t)> m_fnFrameAlloc;
+    std::function<void(void*)> m_fnFrameFree;
+    uint64_t m_nSurfaceBytes = 0;
+
+    // NvPipe tweak: zero-copy mode, bounded by the number of output surfaces the driver can map at once
+    const int m_nNumOutputSurfaces = 2;
+    bool m_bZeroCopy = false;
+    bool m_bLockRequested = false;
+    std::vector<CUdeviceptr> m_vMappedFrame;
+    int m_nMappedFramePitch = 0;
+    CUevent m_evMappedReleased = NULL;
+    bool m_bMappedReleased = false;
+
+    uint32_t m_nTimeoutMs = 0;
+    int m_nTimedOutFrame = 0;
+    std::chrono::steady_clock::time_point m_deadline;
 };
@@ -14,6 +14,9 @@
 #endif
 #include "NvEncoder/NvEncoder.h"
 
+#include <algorithm>
+#include <thread>
+
 #ifndef _WIN32
 #include <cstring>
 static inline bool operator==(const GUID &guid1, const GUID &guid2) {
@@ -375,6 +378,14 @@ void NvEncoder::EncodeFrame(std::vector<std::vector<uint8_t>> &vPacket, NV_ENC_P
     {
         NVENC_THROW_ERROR("Encoder device not found", NV_ENC_ERR_NO_ENCODE_DEVICE);
     }
+
+    // NvPipe tweak: collect (and drop) the output of timed out frames before their buffers are reused
+    if (m_iToSend - m_iGot >= m_nEncoderBuffer)
+    {
+        GetEncodedPacket(m_vBitstreamOutputBuffer, vPacket, false);
+        vPacket.clear();
+    }
+
     int i = m_iToSend % m_nEncoderBuffer;
     NV_ENC_MAP_INPUT_RESOURCE mapInputResource = { NV_ENC_MAP_INPUT_RESOURCE_VER };
     mapInputResource.registeredResource = m_vRegisteredResources[i];
@@ -468,24 +479,28 @@ void NvEncoder::EndEncode(std::vector<std::vector<uint8_t>> &vPacket)
 
 void NvEncoder::GetEncodedPacket(std::vector<NV_ENC_OUTPUT_PTR> &vOutputBuffer, std::vector<std::vector<uint8_t>> &vPacket, bool bOutputDelay)
 {
+    const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_nTimeoutMs);
+
     unsigned i = 0;
     int iEnd = bOutputDelay ? m_iToSend - m_nOutputDelay : m_iToSend;
     for (; m_iGot < iEnd; m_iGot++)
     {
-        WaitForCompletionEvent(m_iGot % m_nEncoderBuffer);
         NV_ENC_LOCK_BITSTREAM lockBitstreamData = { NV_ENC_LOCK_BITSTREAM_VER };
         lockBitstreamData.outputBitstream = vOutputBuffer[m_iGot % m_nEncoderBuffer];
-        lockBitstreamData.doNotWait = false;
-        NVENC_API_CALL(m_nvenc.nvEncLockBitstream(m_hEncoder, &lockBitstreamData));
-  
-        uint8_t *pData = (uint8_t *)lockBitstreamData.bitstreamBufferPtr;
-        if (vPacket.size() < i + 1)
+        LockBitstream(lockBitstreamData, m_iGot % m_nEncoderBuffer, deadline);
+
+        // NvPipe tweak: output of timed out frames is dropped
+        if (m_iGot >= m_iDiscard)
         {
-            vPacket.push_back(std::vector<uint8_t>());
+            uint8_t *pData = (uint8_t *)lockBitstreamData.bitstreamBufferPtr;
+            if (vPacket.size() < i + 1)
+            {
+                vPacket.push_back(std::vector<uint8_t>());
+            }
+            vPacket[i].clear();
+            vPacket[i].insert(vPacket[i].end(), &pData[0], &pData[lockBitstreamData.bitstreamSizeInBytes]);
+            i++;
         }
-        vPacket[i].clear();
-        vPacket[i].insert(vPacket[i].end(), &pData[0], &pData[lockBitstreamData.bitstreamSizeInBytes]);
-        i++;
 
         NVENC_API_CALL(m_nvenc.nvEncUnlockBitstream(m_hEncoder, lockBitstreamData.outputBitstream));
 
@@ -623,6 +638,54 @@ void NvEncoder::UnregisterResources()
 }
 
 
+void NvEncoder::LockBitstream(NV_ENC_LOCK_BITSTREAM &lockBitstreamData, int iEvent, std::chrono::steady_clock::time_point deadline)
+{
+    if (m_nTimeoutMs == 0)
+    {
+        WaitForCompletionEvent(iEvent);
+        lockBitstreamData.doNotWait = false;
+        NVENC_API_CALL(m_nvenc.nvEncLockBitstream(m_hEncoder, &lockBitstreamData));
+        return;
+    }
+
+#if defined(_WIN32)
+    const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+    const DWORD result = WaitForSingleObject(m_vpCompletionEvent[iEvent], (DWORD) std::max<long long>(remaining, 0));
+    if (result == WAIT_FAILED)
+    {
+        NVENC_THROW_ERROR("Failed to encode frame", NV_ENC_ERR_GENERIC);
+    }
+    if (result == WAIT_TIMEOUT)
+    {
+        m_iDiscard = m_iToSend;
+        NVENC_THROW_ERROR("Encode timed out", NV_ENC_ERR_ENCODER_BUSY);
+    }
+    lockBitstreamData.doNotWait = false;
+    NVENC_API_CALL(m_nvenc.nvEncLockBitstream(m_hEncoder, &lockBitstreamData));
+#else
+    // Poll, the driver returns NV_ENC_ERR_LOCK_BUSY until the frame is encoded
+    lockBitstreamData.doNotWait = true;
+    while (true)
+    {
+        const NVENCSTATUS status = m_nvenc.nvEncLockBitstream(m_hEncoder, &lockBitstreamData);
+        if (status == NV_ENC_SUCCESS)
+        {
+            return;
+        }
+        if (status != NV_ENC_ERR_LOCK_BUSY)
+        {
+            NVENC_THROW_ERROR("nvEncLockBitstream failed", status);
+        }
+        if (std::chrono::steady_clock::now() >= deadline)
+        {
+            m_iDiscard = m_iToSend;
+            NVENC_THROW_ERROR("Encode timed out", NV_ENC_ERR_ENCODER_BUSY);
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+#endif
+}
+
 void NvEncoder::WaitForCompletionEvent(int iEvent)
 {
 #if defined(_WIN32)
@@ -800,7 +863,7 @@ int NvEncoder::GetCapabilityValue(GUID guidCodec, NV_ENC_CAPS capsToQuery)
     }
     NV_ENC_CAPS_PARAM capsParam = { NV_ENC_CAPS_PARAM_VER };
     capsParam.capsToQuery = capsToQuery;
-    int v;
+    int v = 0; // NvPipe tweak: report 0 instead of garbage if the query fails (e.g., unsupported codec)
     m_nvenc.nvEncGetEncodeCaps(m_hEncoder, guidCodec, &capsParam, &v);
     return v;
 }
@@ -19,6 +19,7 @@
 #include <iostream>
 #include <sstream>
 #include <string.h>
+#include <chrono>
 
 /**
 * @brief Exception class for error reporting from NvEncodeAPI calls.
@@ -141,6 +142,15 @@ public:
     */
     int GetCapabilityValue(GUID guidCodec, NV_ENC_CAPS capsToQuery);
 
+    /**
+    *  @brief  NvPipe tweak: Bounds the time EncodeFrame() waits for the hardware.
+    *  If the output is not ready in time, EncodeFrame() throws an NVENCException with
+    *  NV_ENC_ERR_ENCODER_BUSY. The output of all frames submitted so far is discarded
+    *  once it becomes available, so the next frame should be an IDR frame.
+    *  A timeout of 0 (default) waits indefinitely.
+    */
+    void SetCompletionTimeout(uint32_t nTimeoutMs) { m_nTimeoutMs = nTimeoutMs; }
+
     /**
     *  @brief  This function is used to get the current device on which encoder is running.
     */
@@ -299,6 +309,11 @@ private:
     */
     void WaitForCompletionEvent(int iEvent);
 
+    /**
+    *  @brief NvPipe tweak: Locks an output bitstream, waiting at most until the deadline.
+    */
+    void LockBitstream(NV_ENC_LOCK_BITSTREAM &lockBitstreamData, int iEvent, std::chrono::steady_clock::time_point deadline);
+
     /**
     *  @brief This is a private function which is used to check if there is any
               buffering done by encoder.
@@ -404,4 +419,6 @@ private:
     int32_t m_iGot = 0;
     int32_t m_nEncoderBuffer = 0;
     int32_t m_nOutputDelay = 0;
+    uint32_t m_nTimeoutMs = 0;
+    int32_t m_iDiscard = 0; // output of frames before this index timed out and is dropped
 };
@@ -71,6 +71,7 @@ void NvEncoderCuda::AllocateInputBuffers(int32_t numInputBuffers)
                 &m_cudaPitch,
                 GetWidthInBytes(GetPixelFormat(), GetMaxEncodeWidth()),
                 GetMaxEncodeHeight() + chromaHeight, 16));
+            m_nInputBufferBytes += (uint64_t) m_cudaPitch * (GetMaxEncodeHeight() + chromaHeight);
             inputFrames.push_back((void*)pDeviceFrame);
         }
         CUDA_DRVAPI_CALL(cuCtxPopCurrent(NULL));
@@ -123,6 +124,7 @@ void NvEncoderCuda::ReleaseCudaResources()
         }
     }
     m_vReferenceFrames.clear();
+    m_nInputBufferBytes = 0;
 
     cuCtxPopCurrent(NULL);
     m_cuContext = nullptr;
@@ -28,6 +28,11 @@ public:
         uint32_t nExtraOutputDelay = 3, bool bMotionEstimationOnly = false);
     virtual ~NvEncoderCuda();
 
+    /**
+    *  @brief NvPipe tweak: Returns the device memory allocated for input buffers in bytes.
+    */
+    uint64_t GetInputBufferBytes() const { return m_nInputBufferBytes; }
+
     /**
     *  @brief This is a static function to copy input data from host memory to device memory.
     *  This function assumes YUV plane is a single contiguous memory segment.
@@ -82,5 +87,6 @@ private:
     void ReleaseCudaResources();
 private:
     size_t m_cudaPitch = 0;
+    uint64_t m_nInputBufferBytes = 0;
     CUcontext m_cuContext;
 };
@@ -102,7 +102,7 @@ __device__ inline Rgb YuvToRgbForPixel(YuvUnit y, YuvUnit u, YuvUnit v) {
 }
 
 template<class YuvUnitx2, class Rgb, class RgbIntx2>
-__global__ static void YuvToRgbKernel(uint8_t *pYuv, int nYuvPitch, uint8_t *pRgb, int nRgbPitch, int nWidth, int nHeight) {
+__global__ static void YuvToRgbKernel(uint8_t *pYuv, int nYuvPitch, uint8_t *pRgb, int nRgbPitch, int nWidth, int nHeight, int nSurfaceHeight) {
     int x = (threadIdx.x + blockIdx.x * blockDim.x) * 2;
     int y = (threadIdx.y + blockIdx.y * blockDim.y) * 2;
     if (x + 1 >= nWidth || y + 1 >= nHeight) {
@@ -114,7 +114,8 @@ __global__ static void YuvToRgbKernel(uint8_t *pYuv, int nYuvPitch, uint8_t *pRg
 
     YuvUnitx2 l0 = *(YuvUnitx2 *)pSrc;
     YuvUnitx2 l1 = *(YuvUnitx2 *)(pSrc + nYuvPitch);
-    YuvUnitx2 ch = *(YuvUnitx2 *)(pSrc + (nHeight - y / 2) * nYuvPitch);
+    // NvPipe tweak: the chroma plane follows the whole surface, which may be higher than the frame
+    YuvUnitx2 ch = *(YuvUnitx2 *)(pSrc + (nSurfaceHeight - y / 2) * nYuvPitch);
 
     *(RgbIntx2 *)pDst = RgbIntx2 {
         YuvToRgbForPixel<Rgb>(l0.x, ch.x, ch.y).d, 
@@ -172,32 +173,32 @@ union BGRA64 {
     } c;
 };
 
-void Nv12ToBgra32(uint8_t *dpNv12, int nNv12Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix) {
+void Nv12ToBgra32(uint8_t *dpNv12, int nNv12Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix, int nNv12Height) {
     SetMatYuv2Rgb(iMatrix);
     YuvToRgbKernel<uchar2, BGRA32, uint2>
         <<<dim3((nWidth + 63) / 32 / 2, (nHeight + 3) / 2 / 2), dim3(32, 2)>>>
-        (dpNv12, nNv12Pitch, dpBgra, nBgraPitch, nWidth, nHeight);
+        (dpNv12, nNv12Pitch, dpBgra, nBgraPitch, nWidth, nHeight, nNv12Height ? nNv12Height : nHeight);
 }
 
 void Nv12ToBgra64(uint8_t *dpNv12, int nNv12Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix) {
     SetMatYuv2Rgb(iMatrix);
     YuvToRgbKernel<uchar2, BGRA64, ulonglong2>
         <<<dim3((nWidth + 63) / 32 / 2, (nHeight + 3) / 2 / 2), dim3(32, 2)>>>
-        (dpNv12, nNv12Pitch, dpBgra, nBgraPitch, nWidth, nHeight);
+        (dpNv12, nNv12Pitch, dpBgra, nBgraPitch, nWidth, nHeight, nHeight);
 }
 
 void P016ToBgra32(uint8_t *dpP016, int nP016Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix) {
     SetMatYuv2Rgb(iMatrix);
     YuvToRgbKernel<ushort2, BGRA32, uint2>
         <<<dim3((nWidth + 63) / 32 / 2, (nHeight + 3) / 2 / 2), dim3(32, 2)>>>
-        (dpP016, nP016Pitch, dpBgra, nBgraPitch, nWidth, nHeight);
+        (dpP016, nP016Pitch, dpBgra, nBgraPitch, nWidth, nHeight, nHeight);
 }
 
 void P016ToBgra64(uint8_t *dpP016, int nP016Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix) {
     SetMatYuv2Rgb(iMatrix);
     YuvToRgbKernel<ushort2, BGRA64, ulonglong2>
         <<<dim3((nWidth + 63) / 32 / 2, (nHeight + 3) / 2 / 2), dim3(32, 2)>>>
-        (dpP016, nP016Pitch, dpBgra, nBgraPitch, nWidth, nHeight);
+        (dpP016, nP016Pitch, dpBgra, nBgraPitch, nWidth, nHeight, nHeight);
 }
 
 void Nv12ToBgrPlanar(uint8_t *dpNv12, int nNv12Pitch, uint8_t *dpBgrp, int nBgrpPitch, int nWidth, int nHeight, int iMatrix) {
@@ -271,3 +272,11 @@ void Bgra64ToP016(uint8_t *dpBgra, int nBgraPitch, uint8_t *dpP016, int nP016Pit
         <<<dim3((nWidth + 63) / 32 / 2, (nHeight + 3) / 2 / 2), dim3(32, 2)>>>
         (dpBgra, nBgraPitch, dpP016, nP016Pitch, nWidth, nHeight);
 }
+
+// NvPipe tweak: 8-bit counterpart of Bgra64ToP016, the inverse of Nv12ToBgra32 for the same matrix
+void Bgra32ToNv12(uint8_t *dpBgra, int nBgraPitch, uint8_t *dpNv12, int nNv12Pitch, int nWidth, int nHeight, int iMatrix) {
+    SetMatRgb2Yuv(iMatrix);
+    RgbToYuvKernel<uchar2, BGRA32, uint2>
+        <<<dim3((nWidth + 63) / 32 / 2, (nHeight + 3) / 2 / 2), dim3(32, 2)>>>
+        (dpBgra, nBgraPitch, dpNv12, nNv12Pitch, nWidth, nHeight);
+}
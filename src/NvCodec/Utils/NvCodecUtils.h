@@ -18,6 +18,12 @@
 #include <string.h>
 #include "Logger.h"
 #include <thread>
+#include <vector>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <algorithm>
+#include "../../HostKernels.h"
 
 extern simplelogger::Logger *logger;
 
@@ -212,60 +218,275 @@ private:
     uint32_t nSize = 0;
 };
 
+// NvPipe tweak: vectorized (SSE2/AVX2), row-parallel YuvConverter with caller-provided scratch and pitch support.
+// AVX2 detection and the row workers are shared with the other host kernels (HostKernels.h).
+namespace YuvConverterKernels {
+
+template<typename T>
+inline void InterleaveScalar(const T *pU, const T *pV, T *pUV, int n) {
+    for (int x = 0; x < n; x++) {
+        pUV[x * 2] = pU[x];
+        pUV[x * 2 + 1] = pV[x];
+    }
+}
+
+template<typename T>
+inline void DeinterleaveScalar(const T *pUV, T *pU, T *pV, int n) {
+    for (int x = 0; x < n; x++) {
+        pU[x] = pUV[x * 2];
+        pV[x] = pUV[x * 2 + 1];
+    }
+}
+
+#ifdef NVPIPE_HOST_SIMD
+
+inline void InterleaveSse2(const uint8_t *pU, const uint8_t *pV, uint8_t *pUV, int n) {
+    int x = 0;
+    for (; x + 16 <= n; x += 16) {
+        __m128i u = _mm_loadu_si128((const __m128i *)(pU + x));
+        __m128i v = _mm_loadu_si128((const __m128i *)(pV + x));
+        _mm_storeu_si128((__m128i *)(pUV + 2 * x), _mm_unpacklo_epi8(u, v));
+        _mm_storeu_si128((__m128i *)(pUV + 2 * x + 16), _mm_unpackhi_epi8(u, v));
+    }
+    InterleaveScalar(pU + x, pV + x, pUV + 2 * x, n - x);
+}
+
+inline void InterleaveSse2(const uint16_t *pU, const uint16_t *pV, uint16_t *pUV, int n) {
+    int x = 0;
+    for (; x + 8 <= n; x += 8) {
+        __m128i u = _mm_loadu_si128((const __m128i *)(pU + x));
+        __m128i v = _mm_loadu_si128((const __m128i *)(pV + x));
+        _mm_storeu_si128((__m128i *)(pUV + 2 * x), _mm_unpacklo_epi16(u, v));
+        _mm_storeu_si128((__m128i *)(pUV + 2 * x + 8), _mm_unpackhi_epi16(u, v));
+    }
+    InterleaveScalar(pU + x, pV + x, pUV + 2 * x, n - x);
+}
+
+inline void DeinterleaveSse2(const uint8_t *pUV, uint8_t *pU, uint8_t *pV, int n) {
+    const __m128i mask = _mm_set1_epi16(0x00FF);
+    int x = 0;
+    for (; x + 16 <= n; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(pUV + 2 * x));
+        __m128i b = _mm_loadu_si128((const __m128i *)(pUV + 2 * x + 16));
+        _mm_storeu_si128((__m128i *)(pU + x), _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+        _mm_storeu_si128((__m128i *)(pV + x), _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+    DeinterleaveScalar(pUV + 2 * x, pU + x, pV + x, n - x);
+}
+
+inline void DeinterleaveSse2(const uint16_t *pUV, uint16_t *pU, uint16_t *pV, int n) {
+    // SSE2 has no unsigned 32 to 16 bit pack, so samples are biased into the signed range and back
+    const __m128i bias = _mm_set1_epi16((short)0x8000);
+    int x = 0;
+    for (; x + 8 <= n; x += 8) {
+        __m128i a = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(pUV + 2 * x)), bias);
+        __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(pUV + 2 * x + 8)), bias);
+        __m128i u = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16), _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+        __m128i v = _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+        _mm_storeu_si128((__m128i *)(pU + x), _mm_xor_si128(u, bias));
+        _mm_storeu_si128((__m128i *)(pV + x), _mm_xor_si128(v, bias));
+    }
+    DeinterleaveScalar(pUV + 2 * x, pU + x, pV + x, n - x);
+}
+
+NVPIPE_TARGET_AVX2 inline void InterleaveAvx2(const uint8_t *pU, const uint8_t *pV, uint8_t *pUV, int n) {
+    int x = 0;
+    for (; x + 32 <= n; x += 32) {
+        __m256i u = _mm256_loadu_si256((const __m256i *)(pU + x));
+        __m256i v = _mm256_loadu_si256((const __m256i *)(pV + x));
+        __m256i lo = _mm256_unpacklo_epi8(u, v), hi = _mm256_unpackhi_epi8(u, v);
+        // Unpacking works within 128 bit lanes
+        _mm256_storeu_si256((__m256i *)(pUV + 2 * x), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *)(pUV + 2 * x + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    InterleaveSse2(pU + x, pV + x, pUV + 2 * x, n - x);
+}
+
+NVPIPE_TARGET_AVX2 inline void InterleaveAvx2(const uint16_t *pU, const uint16_t *pV, uint16_t *pUV, int n) {
+    int x = 0;
+    for (; x + 16 <= n; x += 16) {
+        __m256i u = _mm256_loadu_si256((const __m256i *)(pU + x));
+        __m256i v = _mm256_loadu_si256((const __m256i *)(pV + x));
+        __m256i lo = _mm256_unpacklo_epi16(u, v), hi = _mm256_unpackhi_epi16(u, v);
+        _mm256_storeu_si256((__m256i *)(pUV + 2 * x), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *)(pUV + 2 * x + 16), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    InterleaveSse2(pU + x, pV + x, pUV + 2 * x, n - x);
+}
+
+NVPIPE_TARGET_AVX2 inline void DeinterleaveAvx2(const uint8_t *pUV, uint8_t *pU, uint8_t *pV, int n) {
+    const __m256i mask = _mm256_set1_epi16(0x00FF);
+    int x = 0;
+    for (; x + 32 <= n; x += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(pUV + 2 * x));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(pUV + 2 * x + 32));
+        // Packing works within 128 bit lanes, restore the order of the 64 bit quarters
+        __m256i u = _mm256_packus_epi16(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+        __m256i v = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+        _mm256_storeu_si256((__m256i *)(pU + x), _mm256_permute4x64_epi64(u, 0xD8));
+        _mm256_storeu_si256((__m256i *)(pV + x), _mm256_permute4x64_epi64(v, 0xD8));
+    }
+    DeinterleaveSse2(pUV + 2 * x, pU + x, pV + x, n - x);
+}
+
+NVPIPE_TARGET_AVX2 inline void DeinterleaveAvx2(const uint16_t *pUV, uint16_t *pU, uint16_t *pV, int n) {
+    const __m256i mask = _mm256_set1_epi32(0x0000FFFF);
+    int x = 0;
+    for (; x + 16 <= n; x += 16) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(pUV + 2 * x));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(pUV + 2 * x + 16));
+        __m256i u = _mm256_packus_epi32(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+        __m256i v = _mm256_packus_epi32(_mm256_srli_epi32(a, 16), _mm256_srli_epi32(b, 16));
+        _mm256_storeu_si256((__m256i *)(pU + x), _mm256_permute4x64_epi64(u, 0xD8));
+        _mm256_storeu_si256((__m256i *)(pV + x), _mm256_permute4x64_epi64(v, 0xD8));
+    }
+    DeinterleaveSse2(pUV + 2 * x, pU + x, pV + x, n - x);
+}
+
+#endif
+
+// Other sample types are converted by the scalar loops, 8 and 16 bit samples are vectorized if possible
+template<typename T>
+inline void InterleaveRow(const T *pU, const T *pV, T *pUV, int n) {
+    InterleaveScalar(pU, pV, pUV, n);
+}
+
+template<typename T>
+inline void DeinterleaveRow(const T *pUV, T *pU, T *pV, int n) {
+    DeinterleaveScalar(pUV, pU, pV, n);
+}
+
+#ifdef NVPIPE_HOST_SIMD
+
+inline void InterleaveRow(const uint8_t *pU, const uint8_t *pV, uint8_t *pUV, int n) {
+    cpuSupportsAvx2() ? InterleaveAvx2(pU, pV, pUV, n) : InterleaveSse2(pU, pV, pUV, n);
+}
+
+inline void InterleaveRow(const uint16_t *pU, const uint16_t *pV, uint16_t *pUV, int n) {
+    cpuSupportsAvx2() ? InterleaveAvx2(pU, pV, pUV, n) : InterleaveSse2(pU, pV, pUV, n);
+}
+
+inline void DeinterleaveRow(const uint8_t *pUV, uint8_t *pU, uint8_t *pV, int n) {
+    cpuSupportsAvx2() ? DeinterleaveAvx2(pUV, pU, pV, n) : DeinterleaveSse2(pUV, pU, pV, n);
+}
+
+inline void DeinterleaveRow(const uint16_t *pUV, uint16_t *pU, uint16_t *pV, int n) {
+    cpuSupportsAvx2() ? DeinterleaveAvx2(pUV, pU, pV, n) : DeinterleaveSse2(pUV, pU, pV, n);
+}
+
+#endif
+
+} // namespace YuvConverterKernels
+
+/**
+*   @brief  Converts the chroma planes of 4:2:0 frames between planar (I420) and UV-interleaved (NV12) layout.
+*   8 and 16 bit samples are processed with SSE2/AVX2 where available, rows are split across threads.
+*   Planar chroma planes have half the luma pitch and follow each other; the interleaved plane has the luma pitch.
+*/
 template<typename T>
 class YuvConverter {
 public:
-    YuvConverter(int nWidth, int nHeight) : nWidth(nWidth), nHeight(nHeight) {
-        pQuad = new T[nWidth * nHeight / 4];
+    /**
+    *   @param  pScratch    Optional buffer of GetScratchSize() elements for in-place conversions, allocated if NULL
+    *   @param  nThreads    Maximum number of threads including the caller, 0 for up to four depending on the hardware
+    */
+    YuvConverter(int nWidth, int nHeight, T *pScratch = NULL, int nThreads = 0) : nWidth(nWidth), nHeight(nHeight), pScratch(pScratch),
+        nThreads(nThreads > 0 ? nThreads : 4) {
+        if (!pScratch) {
+            pOwnScratch = new T[GetScratchSize(nWidth, nHeight)];
+            this->pScratch = pOwnScratch;
+        }
     }
     ~YuvConverter() {
-        delete pQuad;
+        delete[] pOwnScratch;
+    }
+    YuvConverter(const YuvConverter &) = delete;
+    YuvConverter &operator=(const YuvConverter &) = delete;
+
+    static size_t GetScratchSize(int nWidth, int nHeight) {
+        return (size_t)nWidth * (nHeight / 2);
     }
+
+    /**
+    *   @brief  Converts an I420 frame to NV12 in place. nPitch is the luma pitch in elements (0: width).
+    */
     void PlanarToUVInterleaved(T *pFrame, int nPitch = 0) {
         if (nPitch == 0) {
             nPitch = nWidth;
         }
-        T *puv = pFrame + nPitch * nHeight;
-        if (nPitch == nWidth) {
-            memcpy(pQuad, puv, nWidth * nHeight / 4 * sizeof(T));
-        } else {
-            for (int i = 0; i < nHeight / 2; i++) {
-                memcpy(pQuad + nWidth / 2 * i, puv + nPitch / 2 * i, nWidth / 2 * sizeof(T));
+        const int nChromaWidth = nWidth / 2, nChromaHeight = nHeight / 2;
+        T *puv = pFrame + (size_t)nPitch * nHeight;
+        T *pu = puv, *pv = puv + (size_t)(nPitch / 2) * nChromaHeight;
+
+        // The interleaved rows overlap both planes, so they are read from a copy
+        T *pQuadU = pScratch, *pQuadV = pScratch + (size_t)nChromaWidth * nChromaHeight;
+        Run(nChromaHeight, 2 * nChromaWidth * sizeof(T), [&](int y0, int y1) {
+            for (int y = y0; y < y1; y++) {
+                memcpy(pQuadU + (size_t)y * nChromaWidth, pu + (size_t)y * (nPitch / 2), nChromaWidth * sizeof(T));
+                memcpy(pQuadV + (size_t)y * nChromaWidth, pv + (size_t)y * (nPitch / 2), nChromaWidth * sizeof(T));
             }
-        }
-        T *pv = puv + (nPitch / 2) * (nHeight / 2);
-        for (int y = 0; y < nHeight / 2; y++) {
-            for (int x = 0; x < nWidth / 2; x++) {
-                puv[y * nPitch + x * 2] = pQuad[y * nWidth / 2 + x];
-                puv[y * nPitch + x * 2 + 1] = pv[y * nPitch / 2 + x];
-            }
-        }
+        });
+        InterleaveUV(pQuadU, pQuadV, nChromaWidth, puv, nPitch);
     }
+
+    /**
+    *   @brief  Converts an NV12 frame to I420 in place. nPitch is the luma pitch in elements (0: width).
+    */
     void UVInterleavedToPlanar(T *pFrame, int nPitch = 0) {
         if (nPitch == 0) {
             nPitch = nWidth;
         }
-        T *puv = pFrame + nPitch * nHeight, 
-            *pu = puv, 
-            *pv = puv + nPitch * nHeight / 4;
-        for (int y = 0; y < nHeight / 2; y++) {
-            for (int x = 0; x < nWidth / 2; x++) {
-                pu[y * nPitch / 2 + x] = puv[y * nPitch + x * 2];
-                pQuad[y * nWidth / 2 + x] = puv[y * nPitch + x * 2 + 1];
+        const int nChromaHeight = nHeight / 2;
+        T *puv = pFrame + (size_t)nPitch * nHeight;
+
+        Run(nChromaHeight, nWidth * sizeof(T), [&](int y0, int y1) {
+            for (int y = y0; y < y1; y++) {
+                memcpy(pScratch + (size_t)y * nWidth, puv + (size_t)y * nPitch, nWidth * sizeof(T));
             }
-        }
-        if (nPitch == nWidth) {
-            memcpy(pv, pQuad, nWidth * nHeight / 4 * sizeof(T));
-        } else {
-            for (int i = 0; i < nHeight / 2; i++) {
-                memcpy(pv + nPitch / 2 * i, pQuad + nWidth / 2 * i, nWidth / 2 * sizeof(T));
+        });
+        DeinterleaveUV(pScratch, nWidth, puv, puv + (size_t)(nPitch / 2) * nChromaHeight, nPitch / 2);
+    }
+
+    /**
+    *   @brief  Interleaves separate U and V planes (pitch nPlanarPitch) into pUV (pitch nUVPitch), no scratch needed
+    */
+    void InterleaveUV(const T *pU, const T *pV, int nPlanarPitch, T *pUV, int nUVPitch) {
+        Run(nHeight / 2, nWidth * sizeof(T), [&](int y0, int y1) {
+            for (int y = y0; y < y1; y++) {
+                YuvConverterKernels::InterleaveRow(pU + (size_t)y * nPlanarPitch, pV + (size_t)y * nPlanarPitch, pUV + (size_t)y * nUVPitch, nWidth / 2);
             }
-        }
+        });
+    }
+
+    /**
+    *   @brief  Splits pUV (pitch nUVPitch) into separate U and V planes (pitch nPlanarPitch), no scratch needed
+    */
+    void DeinterleaveUV(const T *pUV, int nUVPitch, T *pU, T *pV, int nPlanarPitch) {
+        Run(nHeight / 2, nWidth * sizeof(T), [&](int y0, int y1) {
+            for (int y = y0; y < y1; y++) {
+                YuvConverterKernels::DeinterleaveRow(pUV + (size_t)y * nUVPitch, pU + (size_t)y * nPlanarPitch, pV + (size_t)y * nPlanarPitch, nWidth / 2);
+            }
+        });
     }
 
 private:
-    T *pQuad;
+    /**
+    *   @brief  Runs fnRows(iFirst, iEnd) over nRows rows of nRowBytes bytes (read and written) each on the shared row workers
+    */
+    template<typename F>
+    void Run(int nRows, size_t nRowBytes, F fnRows) {
+        // A range is only worth it for enough rows and bytes, waking a worker costs several microseconds
+        const size_t nMinBytesPerRange = 256 * 1024;
+        const uint32_t nMinRows = (uint32_t)std::max<size_t>(16, (nMinBytesPerRange + nRowBytes - 1) / std::max<size_t>(1, nRowBytes));
+        parallelRows((uint32_t)nRows, nMinRows, (uint32_t)nThreads, [&](uint32_t, uint32_t iFirst, uint32_t iEnd) {
+            fnRows((int)iFirst, (int)iEnd);
+        });
+    }
+
     int nWidth, nHeight;
+    T *pScratch;
+    T *pOwnScratch = NULL;
+    int nThreads;
 };
 
 class StopWatch {
@@ -290,7 +511,8 @@ inline void CheckInputFile(const char *szInFilePath) {
     }
 }
 
-void Nv12ToBgra32(uint8_t *dpNv12, int nNv12Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 0);
+// NvPipe tweak: nNv12Height is the number of rows before the chroma plane, if it differs from nHeight (e.g., mapped decoder surfaces)
+void Nv12ToBgra32(uint8_t *dpNv12, int nNv12Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 0, int nNv12Height = 0);
 void Nv12ToBgra64(uint8_t *dpNv12, int nNv12Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 0);
 
 void P016ToBgra32(uint8_t *dpP016, int nP016Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 4);
@@ -300,6 +522,8 @@ void Nv12ToBgrPlanar(uint8_t *dpNv12, int nNv12Pitch, uint8_t *dpBgrp, int nBgrp
 void P016ToBgrPlanar(uint8_t *dpP016, int nP016Pitch, uint8_t *dpBgrp, int nBgrpPitch, int nWidth, int nHeight, int iMatrix = 4);
 
 void Bgra64ToP016(uint8_t *dpBgra, int nBgraPitch, uint8_t *dpP016, int nP016Pitch, int nWidth, int nHeight, int iMatrix = 4);
+// NvPipe tweak: the chroma plane follows nHeight rows of the NV12 surface
+void Bgra32ToNv12(uint8_t *dpBgra, int nBgraPitch, uint8_t *dpNv12, int nNv12Pitch, int nWidth, int nHeight, int iMatrix = 0);
 
 void ConvertUInt8ToUInt16(uint8_t *dpUInt8, uint16_t *dpUInt16, int nSrcPitch, int nDestPitch, int nWidth, int nHeight);
 void ConvertUInt16ToUInt8(uint16_t *dpUInt16, uint8_t *dpUInt8, int nSrcPitch, int nDestPitch, int nWidth, int nHeight);
@@ -37,11 +37,35 @@
 
 #include "NvCodec/Utils/NvCodecUtils.h"
 
+#include "Denoise.h"
+#include "Frame.h"
+#include "HostMemory.h"
+#include "HostResize.h"
+#include "Mailbox.h"
+#include "MemoryAccount.h"
+#include "MemoryPool.h"
+#include "Metrics.h"
+#include "RateController.h"
+#include "Recorder.h"
+#include "Refine.h"
+#include "Trace.h"
+#include "Volume.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
 #include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cstdio>
 #include <iostream>
+#include <map>
 #include <string>
 #include <sstream>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include <cuda.h>
 #include <cuda_runtime_api.h>
@@ -50,14 +74,23 @@
 #include <cuda_gl_interop.h>
 #endif
 
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 
 class Exception
 {
 public:
-    Exception(const std::string& msg) : message(msg) {}
+    Exception(const std::string& msg, bool timeout = false) : message(msg), timeout(timeout) {}
     std::string getErrorString() const { return message; }
+    bool isTimeout() const { return timeout; }
 public:
     std::string message;
+    bool timeout;
 };
 
 
@@ -82,7 +115,7 @@ inline bool isDevicePointer(const void* ptr)
 
 inline uint64_t getFrameSize(NvPipe_Format format, uint32_t width, uint32_t height)
 {
-    if (format == NVPIPE_BGRA32)
+    if (format == NVPIPE_BGRA32 || format == NVPIPE_BGRA32_ALPHA)
         return width * height * 4;
     else if (format == NVPIPE_UINT4)
         return width * height / 2;
@@ -97,6 +130,284 @@ inline uint64_t getFrameSize(NvPipe_Format format, uint32_t width, uint32_t heig
 }
 
 
+/**
+ * @brief Backing store of the device memory pools.
+ */
+class CudaAllocator : public Allocator
+{
+public:
+    void* allocate(uint64_t size) override
+    {
+        void* ptr = nullptr;
+        CUDA_THROW(cudaMalloc(&ptr, size),
+                   "Failed to allocate device memory");
+        return ptr;
+    }
+
+    void free(void* ptr) override
+    {
+        cudaFree(ptr);
+    }
+};
+
+
+/**
+ * @brief Process-wide caching allocators for device scratch and frame buffers, one per CUDA device.
+ *
+ * Shared by all encoder and decoder instances, so resizing streams and short-lived sessions reuse
+ * blocks instead of calling cudaMalloc/cudaFree (which synchronize the device). Cached blocks count
+ * towards the process-wide memory total.
+ */
+class DeviceMemoryPools
+{
+public:
+    static const uint64_t MAX_CACHED_BYTES = 512ull << 20;
+
+    static DeviceMemoryPools& instance()
+    {
+        // Intentionally leaked: blocks may still be returned from static destructors of applications
+        static DeviceMemoryPools* pools = new DeviceMemoryPools();
+        return *pools;
+    }
+
+    /**
+     * @brief Returns the pool of the current device. Blocks must be freed to the pool they came from.
+     */
+    CachingAllocator& get()
+    {
+        int device = 0;
+        CUDA_THROW(cudaGetDevice(&device),
+                   "Failed to get current device");
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        std::unique_ptr<CachingAllocator>& pool = this->pools[device];
+        if (!pool)
+        {
+            pool.reset(new CachingAllocator(std::unique_ptr<Allocator>(new CudaAllocator()), MAX_CACHED_BYTES));
+            pool->setCacheCallback([](int64_t bytes) { MemoryAccount::getTotal().addDevice(bytes); });
+        }
+
+        return *pool;
+    }
+
+    uint64_t release()
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        uint64_t released = 0;
+        for (auto& it : this->pools)
+        {
+            // Free on the device the blocks belong to
+            int current = 0;
+            cudaGetDevice(&current);
+            cudaSetDevice(it.first);
+            released += it.second->release();
+            cudaSetDevice(current);
+        }
+
+        return released;
+    }
+
+    PoolStatistics getStatistics()
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        PoolStatistics total;
+        for (auto& it : this->pools)
+        {
+            const PoolStatistics s = it.second->getStatistics();
+            total.allocations += s.allocations;
+            total.hits += s.hits;
+            total.evictions += s.evictions;
+            total.liveBytes += s.liveBytes;
+            total.cachedBytes += s.cachedBytes;
+            total.peakBytes += s.peakBytes;
+        }
+
+        return total;
+    }
+
+private:
+    std::mutex mutex;
+    std::map<int, std::unique_ptr<CachingAllocator>> pools;
+};
+
+
+/**
+ * @brief Page-locks the blocks of a host allocator, so that copies to and from the device use DMA directly.
+ *
+ * Blocks are registered after the wrapped allocator placed them, which keeps its NUMA binding and huge pages.
+ * If registration fails (e.g., RLIMIT_MEMLOCK is exhausted), the block is returned pageable.
+ */
+class PinnedHostAllocator : public Allocator
+{
+public:
+    explicit PinnedHostAllocator(std::unique_ptr<Allocator> allocator) : allocator(std::move(allocator)) {}
+
+    void* allocate(uint64_t size) override
+    {
+        void* ptr = this->allocator->allocate(size);
+
+        if (cudaHostRegister(ptr, size, cudaHostRegisterPortable) == cudaSuccess)
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->registered.insert(ptr);
+        }
+        else
+        {
+            cudaGetLastError(); // Pageable memory still works, only copies are slower
+        }
+
+        return ptr;
+    }
+
+    void free(void* ptr) override
+    {
+        bool pinned;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            pinned = this->registered.erase(ptr) > 0;
+        }
+
+        if (pinned)
+            cudaHostUnregister(ptr);
+        this->allocator->free(ptr);
+    }
+
+private:
+    std::unique_ptr<Allocator> allocator;
+    std::mutex mutex;
+    std::unordered_set<void*> registered;
+};
+
+
+/**
+ * @brief Process-wide caching allocators for host staging and scratch buffers, one per CUDA device.
+ *
+ * Blocks are placed on the NUMA node of the device's PCIe root (or the node set by the policy), so
+ * copies to and from the device do not cross the socket interconnect, are backed by huge pages and are page-locked.
+ * Changing the policy starts new pools; blocks of the previous ones stay valid and return to them.
+ */
+class HostMemoryPools
+{
+public:
+    static const uint64_t MAX_CACHED_BYTES = 256ull << 20;
+
+    static HostMemoryPools& instance()
+    {
+        // Intentionally leaked: blocks may still be returned from static destructors of applications
+        static HostMemoryPools* pools = new HostMemoryPools();
+        return *pools;
+    }
+
+    void setPolicy(const NvPipe_HostMemoryPolicy& policy)
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        this->policy = policy;
+        for (auto& it : this->pools)
+        {
+            it.second->release();
+            this->retired.push_back(std::move(it.second));
+        }
+        this->pools.clear();
+    }
+
+    /**
+     * @brief Returns the pool of the current device. Blocks must be freed to the pool they came from.
+     */
+    CachingAllocator& get()
+    {
+        int device = 0;
+        CUDA_THROW(cudaGetDevice(&device),
+                   "Failed to get current device");
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        std::unique_ptr<CachingAllocator>& pool = this->pools[device];
+        if (!pool)
+        {
+            const NumaTopology topology;
+            // Smallest huge page size that still has free pages, large pages would waste memory on small buffers
+            uint64_t hugePageSize = 0;
+            for (uint64_t size : topology.getHugePageSizes())
+            {
+                if (topology.getFreeHugePages(size) > 0)
+                {
+                    hugePageSize = size;
+                    break;
+                }
+            }
+
+            HugePages hugePages = HugePages::None;
+            if (this->policy.hugePages == NVPIPE_HUGE_PAGES_TRANSPARENT)
+                hugePages = HugePages::Transparent;
+            else if (this->policy.hugePages == NVPIPE_HUGE_PAGES_EXPLICIT)
+                hugePages = HugePages::Explicit;
+
+            std::unique_ptr<Allocator> numa(new NumaHostAllocator(this->getNode(topology, device), hugePages, hugePageSize));
+            pool.reset(new CachingAllocator(std::unique_ptr<Allocator>(new PinnedHostAllocator(std::move(numa))), MAX_CACHED_BYTES));
+            pool->setCacheCallback([](int64_t bytes) { MemoryAccount::getTotal().addHost(bytes); });
+        }
+
+        return *pool;
+    }
+
+    uint64_t release()
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        uint64_t released = 0;
+        for (auto& it : this->pools)
+            released += it.second->release();
+        for (auto& pool : this->retired)
+            released += pool->release();
+
+        return released;
+    }
+
+private:
+    int getNode(const NumaTopology& topology, int device) const
+    {
+        if (this->policy.numaNode != NVPIPE_NUMA_NODE_AUTO)
+            return std::max(this->policy.numaNode, -1);
+
+        char busId[32];
+        if (cudaDeviceGetPCIBusId(busId, sizeof(busId), device) != cudaSuccess)
+            return -1;
+
+        return topology.getNodeOfPciDevice(busId);
+    }
+
+private:
+    std::mutex mutex;
+    NvPipe_HostMemoryPolicy policy = { NVPIPE_NUMA_NODE_AUTO, NVPIPE_HUGE_PAGES_TRANSPARENT };
+    std::map<int, std::unique_ptr<CachingAllocator>> pools;
+    std::vector<std::unique_ptr<CachingAllocator>> retired;
+};
+
+
+/**
+ * @brief Host block from a pool, returned when going out of scope.
+ */
+class HostBuffer
+{
+public:
+    HostBuffer(CachingAllocator& pool, uint64_t size) : pool(pool), ptr((uint8_t*) pool.allocate(size)) {}
+    ~HostBuffer() { this->pool.free(this->ptr); }
+
+    HostBuffer(const HostBuffer&) = delete;
+    HostBuffer& operator=(const HostBuffer&) = delete;
+
+    uint8_t* data() const { return this->ptr; }
+
+private:
+    CachingAllocator& pool;
+    uint8_t* ptr;
+};
+
+
 __global__
 void uint4_to_nv12(const uint8_t* src, uint32_t srcPitch, uint8_t* dst, uint32_t dstPitch, uint32_t width, uint32_t height)
 {
@@ -144,6 +455,64 @@ void nv12_to_uint4(const uint8_t* src, uint32_t srcPitch, uint8_t* dst, uint32_t
     }
 }
 
+__global__
+void bgra32_alpha_to_nv12(const uint8_t* src, uint32_t srcPitch, uint8_t* dst, uint32_t dstPitch, uint32_t width, uint32_t height)
+{
+    const uint32_t x = blockIdx.x * blockDim.x + threadIdx.x;
+    const uint32_t y = blockIdx.y * blockDim.y + threadIdx.y;
+
+    if (x < width && y < height)
+    {
+        const uint32_t i = y * srcPitch + 4 * x + 3;
+        const uint32_t j = y * dstPitch + width + x;
+
+        // Copy alpha to the Y channel of the right tile (the color is converted into the left tile)
+        dst[j] = src[i];
+
+        // Neutral UV channel, a blank one would bleed into the color tile through the deblocking filter
+        if (y < height / 2)
+        {
+            uint8_t* UV = dst + dstPitch * (height + y);
+            UV[width + x] = 128;
+        }
+    }
+}
+
+__global__
+void nv12_alpha_to_bgra32(const uint8_t* src, uint32_t srcPitch, uint8_t* dst, uint32_t dstPitch, uint32_t width, uint32_t height)
+{
+    const uint32_t x = blockIdx.x * blockDim.x + threadIdx.x;
+    const uint32_t y = blockIdx.y * blockDim.y + threadIdx.y;
+
+    if (x < width && y < height)
+    {
+        const uint32_t i = y * srcPitch + width + x;
+        const uint32_t j = y * dstPitch + 4 * x + 3;
+
+        // Restore alpha from the Y channel of the right tile
+        dst[j] = src[i];
+    }
+}
+
+__global__
+void plane_differs_keep(const uint8_t* src, uint32_t srcPitch, uint8_t* previous, uint32_t previousPitch, uint32_t rowBytes, uint32_t rows, uint32_t* differs)
+{
+    // one thread per byte
+    const uint32_t x = blockIdx.x * blockDim.x + threadIdx.x;
+    const uint32_t y = blockIdx.y * blockDim.y + threadIdx.y;
+
+    if (x < rowBytes && y < rows)
+    {
+        // Compare with and replace the previous frame in one pass
+        const uint8_t value = src[y * srcPitch + x];
+        if (value != previous[y * previousPitch + x])
+        {
+            previous[y * previousPitch + x] = value;
+            *differs = 1;
+        }
+    }
+}
+
 __global__
 void uint8_to_nv12(const uint8_t* src, uint32_t srcPitch, uint8_t* dst, uint32_t dstPitch, uint32_t width, uint32_t height)
 {
@@ -385,14 +754,31 @@ public:
         this->bitrate = bitrate;
         this->targetFrameRate = targetFrameRate;
 
-        this->recreate(1920, 1080);
+        this->pool = &DeviceMemoryPools::instance().get();
+        this->hostPool = &HostMemoryPools::instance().get();
+
+        this->metrics = MetricsRegistry::instance().add("encoder", (codec == NVPIPE_HEVC) ? "hevc" : "h264");
+        this->metrics->bitrate = bitrate;
+
+        try
+        {
+            this->recreate(1920, 1080);
+        }
+        catch (Exception&)
+        {
+            MetricsRegistry::instance().remove(this->metrics);
+            throw;
+        }
     }
 
     ~Encoder()
     {
-        // Free temporary device memory
-        if (this->deviceBuffer)
-            cudaFree(this->deviceBuffer);
+        MetricsRegistry::instance().remove(this->metrics);
+
+        // Return temporary device memory to the pool
+        this->releaseDeviceBuffer();
+        this->releasePreviousInput();
+        this->setDenoise(0.0f);
     }
 
     void setBitrate(uint64_t bitrate, uint32_t targetFrameRate)
@@ -417,30 +803,163 @@ public:
 
         this->bitrate = bitrate;
         this->targetFrameRate = targetFrameRate;
+        this->encoderBitrate = bitrate;
+        this->refinePlanner.setBitrate(bitrate);
+        this->idrPending = true;
+        this->metrics->bitrate = bitrate;
+
+        if (this->variableFrameRate)
+            this->rateController.configure(bitrate, targetFrameRate, (double) RateController::WINDOW_FRAMES / targetFrameRate);
+    }
+
+    void setTimeout(uint32_t milliseconds)
+    {
+        this->timeoutMs = milliseconds;
+        this->encoder->SetCompletionTimeout(milliseconds);
+        if (this->refineEncoder)
+            this->refineEncoder->SetCompletionTimeout(milliseconds);
+    }
+
+    void setDenoise(float strength)
+    {
+        if (strength <= 0.0f)
+        {
+            if (this->denoiser)
+                this->memory.addHost(-(int64_t) this->denoiser->getMemorySize());
+            this->denoiser.reset();
+            return;
+        }
+
+        if (this->format != NVPIPE_BGRA32 && this->format != NVPIPE_BGRA32_ALPHA && this->format != NVPIPE_UINT8 && this->format != NVPIPE_UINT16)
+            throw Exception("Denoising is only supported for BGRA32, UINT8 and UINT16 formats");
+
+        if (!this->denoiser)
+            this->denoiser = std::unique_ptr<Denoiser>(new Denoiser((this->format == NVPIPE_BGRA32 || this->format == NVPIPE_BGRA32_ALPHA) ? 4 : 1, this->format == NVPIPE_UINT16, this->hostPool));
+
+        this->denoiser->setStrength(strength);
     }
 
     uint64_t encode(const void* src, uint64_t srcPitch, uint8_t *dst, uint64_t dstSize, uint32_t width, uint32_t height, bool forceIFrame)
+    {
+        this->upload(src, srcPitch, width, height);
+
+        // Encode
+        return this->encode(dst, dstSize, forceIFrame);
+    }
+
+    uint64_t encodeTimestamped(const void* src, uint64_t srcPitch, uint8_t *dst, uint64_t dstSize, uint32_t width, uint32_t height, uint64_t timestampUs, bool forceIFrame)
+    {
+        this->upload(src, srcPitch, width, height);
+        this->planFrame(timestampUs);
+
+        // Encode
+        const uint64_t size = this->encode(dst, dstSize, forceIFrame);
+        this->rateController.commit(size);
+
+        return size;
+    }
+
+    uint64_t encodeVolume(const void* src, uint64_t rowPitch, uint64_t slicePitch, const NvPipe_Volume& volume, uint8_t* dst, uint64_t dstSize)
+    {
+        const VolumeLayout layout(this->format, volume);
+        const std::string error = layout.validate();
+        if (!error.empty())
+            throw Exception(error);
+
+        if (isDevicePointer(src))
+            throw Exception("Volumes must be passed in host memory");
+
+        if (rowPitch == 0)
+            rowPitch = layout.getRowPitch();
+        if (slicePitch == 0)
+            slicePitch = rowPitch * volume.height;
+
+        VolumeIndex index(layout);
+        uint64_t offset = index.getSize();
+        if (offset > dstSize)
+            throw Exception("Encode output buffer overflow");
+
+        // Slices are not a sequence in time, so the temporal denoiser is bypassed
+        std::unique_ptr<Denoiser> denoiser = std::move(this->denoiser);
+
+        try
+        {
+            HostBuffer frame(*this->hostPool, layout.getFrameSize());
+            const std::vector<VolumeBrick>& bricks = layout.getBricks();
+
+            for (size_t i = 0; i < bricks.size(); ++i)
+            {
+                const VolumeBrick& brick = bricks[i];
+                index.bricks[i].offset = offset;
+
+                // Every brick starts with an IDR frame so it can be decoded on its own
+                for (uint32_t s = 0; s < layout.getNumSlices(brick); ++s)
+                {
+                    layout.extractSlice((const uint8_t*) src, rowPitch, slicePitch, brick, s, frame.data());
+
+                    const uint64_t size = this->encode(frame.data(), layout.getFramePitch(), dst + offset, dstSize - offset, layout.getFrameWidth(), layout.getFrameHeight(), s == 0);
+                    index.sliceSizes[brick.firstSlice + s] = (uint32_t) size;
+                    offset += size;
+                }
+
+                index.bricks[i].size = offset - index.bricks[i].offset;
+            }
+        }
+        catch (...)
+        {
+            this->denoiser = std::move(denoiser);
+            throw;
+        }
+
+        this->denoiser = std::move(denoiser);
+
+        index.write(dst);
+
+        return offset;
+    }
+
+    void upload(const void* src, uint64_t srcPitch, uint32_t width, uint32_t height)
     {
         // Recreate encoder if size changed
         if (this->format == NVPIPE_UINT16)
             this->recreate(width * 2, height); // split into two adjecent tiles in Y channel
         else if (this->format == NVPIPE_UINT32)
             this->recreate(width * 4, height); // split into four adjecent tiles in Y channel
+        else if (this->format == NVPIPE_BGRA32_ALPHA)
+        {
+            // Chroma of the color tile must not straddle the alpha tile
+            if ((width & 1) || (height & 1))
+                throw Exception("The BGRA32_ALPHA format requires an even frame width and height");
+
+            this->recreate(width * 2, height); // color tile and alpha tile (in Y channel) side by side
+        }
         else
             this->recreate(width, height);
 
+        // Classified once, the query is a driver call
+        const bool srcOnDevice = isDevicePointer(src);
+
+        // Optional pre-encode denoising of host frames, device frames are encoded as they are
+        if (this->denoiser && !srcOnDevice)
+        {
+            const uint64_t denoiserMemory = this->denoiser->getMemorySize();
+            src = this->denoiser->process(src, srcPitch, width, height);
+            srcPitch = getFrameSize(this->format, width, 1);
+            this->memory.addHost((int64_t) this->denoiser->getMemorySize() - (int64_t) denoiserMemory);
+        }
+
         // RGBA can be directly copied from host or device
-        if (this->format == NVPIPE_BGRA32)
+        if (this->format == NVPIPE_BGRA32 && this->bufferFormat == NV_ENC_BUFFER_FORMAT_ARGB)
         {
             const NvEncInputFrame* f = this->encoder->GetNextInputFrame();
-            CUDA_THROW(cudaMemcpy2D(f->inputPtr, f->pitch, src, srcPitch, width * 4, height, isDevicePointer(src) ? cudaMemcpyDeviceToDevice : cudaMemcpyHostToDevice),
+            CUDA_THROW(cudaMemcpy2D(f->inputPtr, f->pitch, src, srcPitch, width * 4, height, srcOnDevice ? cudaMemcpyDeviceToDevice : cudaMemcpyHostToDevice),
                        "Failed to copy input frame");
         }
         // Other formats need to be copied to the device and converted
         else
         {
             // Copy to device if necessary
-            bool copyToDevice = !isDevicePointer(src);
+            bool copyToDevice = !srcOnDevice;
             if (copyToDevice)
             {
                 this->recreateDeviceBuffer(width, height);
@@ -483,33 +1002,193 @@ public:
 
                 uint32_to_nv12<<<gridSize, blockSize>>>((uint8_t*) (copyToDevice ? this->deviceBuffer : src), srcPitch, (uint8_t*) f->inputPtr, f->pitch, width, height);
             }
-        }
+            else if (this->format == NVPIPE_BGRA32)
+            {
+                // NV12 session of the same size, created for frame handles
+                Bgra32ToNv12((uint8_t*) (copyToDevice ? this->deviceBuffer : src), (int) srcPitch, (uint8_t*) f->inputPtr, (int) f->pitch, width, height, 0);
+            }
+            else if (this->format == NVPIPE_BGRA32_ALPHA)
+            {
+                uint8_t* bgra = (uint8_t*) (copyToDevice ? this->deviceBuffer : src);
 
-        // Encode
-        return this->encode(dst, dstSize, forceIFrame);
-    }
+                // Color into the left tile (chroma plane follows the full encoder height)
+                Bgra32ToNv12(bgra, (int) srcPitch, (uint8_t*) f->inputPtr, (int) f->pitch, width, height, 0);
 
-#ifdef NVPIPE_WITH_OPENGL
+                // one thread per pixel (copy alpha into the right tile)
+                dim3 gridSize(width / 16 + 1, height / 2 + 1);
+                dim3 blockSize(16, 2);
 
-    uint64_t encodeTexture(uint32_t texture, uint32_t target, uint8_t* dst, uint64_t dstSize, uint32_t width, uint32_t height, bool forceIFrame)
+                bgra32_alpha_to_nv12<<<gridSize, blockSize>>>(bgra, srcPitch, (uint8_t*) f->inputPtr, f->pitch, width, height);
+            }
+        }
+    }
+
+    const std::vector<std::vector<uint8_t>>& encodePackets(bool forceIFrame)
     {
-        if (this->format != NVPIPE_BGRA32)
-            throw Exception("The OpenGL interface only supports the BGRA32 format");
+        const auto start = std::chrono::steady_clock::now();
 
-        // Recreate encoder if size changed
-        this->recreate(width, height);
+        // The reference of the next frame may have been dropped
+        forceIFrame |= this->resync;
 
-        // Map texture and copy input to encoder
-        cudaGraphicsResource_t resource = this->registry.getTextureGraphicsResource(texture, target, width, height, cudaGraphicsRegisterFlagsReadOnly);
-        CUDA_THROW(cudaGraphicsMapResources(1, &resource),
-                   "Failed to map texture graphics resource");
+        if (this->framePlanned)
+            this->framePlanned = false;
+        else if (this->variableFrameRate)
+            this->endVariableFrameRate();
+
+        // Progressive mode picks the session (and rate) depending on whether the input changed
+        NvEncoderCuda* session = this->encoder.get();
+        if (this->compression == NVPIPE_PROGRESSIVE)
+            session = this->refine(forceIFrame);
+
+        try
+        {
+            if (forceIFrame)
+            {
+                NV_ENC_PIC_PARAMS params = {};
+                params.encodePicFlags = NV_ENC_PIC_FLAG_FORCEIDR | NV_ENC_PIC_FLAG_OUTPUT_SPSPPS;
+
+                session->EncodeFrame(this->packets, &params);
+            }
+            else
+            {
+                session->EncodeFrame(this->packets);
+            }
+        }
+        catch (NVENCException& e)
+        {
+            if (e.getErrorCode() == NV_ENC_ERR_ENCODER_BUSY)
+            {
+                this->framesTimedOut++;
+                this->metrics->timeouts++;
+                this->resync = true;
+                throw Exception("Encode timed out after " + std::to_string(this->timeoutMs) + " ms (frame dropped)", true);
+            }
+
+            throw Exception("Encode failed (" + e.getErrorString() + ")");
+        }
+
+        this->framesEncoded++;
+        this->resync = false;
+
+        uint64_t bytes = 0;
+        for (auto& p : this->packets)
+            bytes += p.size();
+
+        this->metrics->frames.fetch_add(1, std::memory_order_relaxed);
+        this->metrics->bytes.fetch_add(bytes, std::memory_order_relaxed);
+        if (forceIFrame || this->idrPending)
+            this->metrics->idrFrames.fetch_add(1, std::memory_order_relaxed);
+        this->metrics->latency.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        this->idrPending = false;
+
+        return this->packets;
+    }
+
+    NvPipe_Format getFormat() const
+    {
+        return this->format;
+    }
+
+    uint32_t getTargetFrameRate() const
+    {
+        return this->targetFrameRate;
+    }
+
+    StreamMetrics& getMetrics()
+    {
+        return *this->metrics;
+    }
+
+    MemoryAccount& getMemory()
+    {
+        return this->memory;
+    }
+
+    CachingAllocator& getPool()
+    {
+        return *this->pool;
+    }
+
+    CachingAllocator& getHostPool()
+    {
+        return *this->hostPool;
+    }
+
+    uint64_t trim()
+    {
+        // The conversion buffer is reallocated on demand, the next progressive frame counts as changed
+        return this->releaseDeviceBuffer() + this->releasePreviousInput();
+    }
+
+    uint64_t encode(const Frame* frame, uint8_t* dst, uint64_t dstSize, bool forceIFrame)
+    {
+        // NV12 frames are passed through as they are, independent of the configured format
+        this->recreate(frame->width, frame->height, this->getSessionFormat(frame->width, frame->height, NV_ENC_BUFFER_FORMAT_NV12));
+
+        const NvEncInputFrame* f = this->encoder->GetNextInputFrame();
+        const cudaMemcpyKind kind = (frame->memory == Frame::Memory::Device) ? cudaMemcpyDeviceToDevice : cudaMemcpyHostToDevice;
+        auto copy = [kind](uint8_t* dst, uint64_t dstPitch, const uint8_t* src, uint64_t srcPitch, uint64_t widthInBytes, uint64_t rows)
+        {
+            CUDA_THROW(cudaMemcpy2D(dst, dstPitch, src, srcPitch, widthInBytes, rows, kind),
+                       "Failed to copy input frame");
+        };
+
+        if (this->bufferFormat == NV_ENC_BUFFER_FORMAT_NV12)
+        {
+            frame->copyTo((uint8_t*) f->inputPtr, f->pitch, (uint8_t*) f->inputPtr + f->chromaOffsets[0], f->chromaPitch, copy);
+        }
+        else
+        {
+            // ARGB session of the same size, created for BGRA frames: convert on the device
+            uint8_t* nv12 = frame->data;
+            uint64_t pitch = frame->pitch;
+            if (frame->memory == Frame::Memory::Host)
+            {
+                this->recreateDeviceBuffer(frame->width, frame->height);
+                nv12 = (uint8_t*) this->deviceBuffer;
+                pitch = frame->width;
+                frame->copyTo(nv12, pitch, nv12 + pitch * frame->height, pitch, copy);
+            }
+
+            Nv12ToBgra32(nv12, (int) pitch, (uint8_t*) f->inputPtr, (int) f->pitch, frame->width, frame->height, 0);
+        }
+
+        // Encode
+        return this->encode(dst, dstSize, forceIFrame);
+    }
+
+#ifdef NVPIPE_WITH_OPENGL
+
+    uint64_t encodeTexture(uint32_t texture, uint32_t target, uint8_t* dst, uint64_t dstSize, uint32_t width, uint32_t height, bool forceIFrame)
+    {
+        if (this->format != NVPIPE_BGRA32)
+            throw Exception("The OpenGL interface only supports the BGRA32 format");
+
+        // Recreate encoder if size changed
+        this->recreate(width, height);
+
+        // Map texture and copy input to encoder
+        cudaGraphicsResource_t resource = this->registry.getTextureGraphicsResource(texture, target, width, height, cudaGraphicsRegisterFlagsReadOnly);
+        CUDA_THROW(cudaGraphicsMapResources(1, &resource),
+                   "Failed to map texture graphics resource");
         cudaArray_t array;
         CUDA_THROW(cudaGraphicsSubResourceGetMappedArray(&array, resource, 0, 0),
                    "Failed get texture graphics resource array");
 
-        const NvEncInputFrame* f = this->encoder->GetNextInputFrame();
-        CUDA_THROW(cudaMemcpy2DFromArray(f->inputPtr, f->pitch, array, 0, 0, width * 4, height, cudaMemcpyDeviceToDevice),
-                   "Failed to copy from texture array");
+        if (this->bufferFormat == NV_ENC_BUFFER_FORMAT_ARGB)
+        {
+            const NvEncInputFrame* f = this->encoder->GetNextInputFrame();
+            CUDA_THROW(cudaMemcpy2DFromArray(f->inputPtr, f->pitch, array, 0, 0, width * 4, height, cudaMemcpyDeviceToDevice),
+                       "Failed to copy from texture array");
+        }
+        else
+        {
+            // NV12 session of NvPipe_EncodeFrame: stage the texture and convert it like any BGRA device frame
+            this->recreateDeviceBuffer(width, height);
+            CUDA_THROW(cudaMemcpy2DFromArray(this->deviceBuffer, width * 4, array, 0, 0, width * 4, height, cudaMemcpyDeviceToDevice),
+                       "Failed to copy from texture array");
+            this->upload(this->deviceBuffer, width * 4, width, height);
+        }
 
         // Encode
         uint64_t size = this->encode(dst, dstSize, forceIFrame);
@@ -523,8 +1202,8 @@ public:
 
     uint64_t encodePBO(uint32_t pbo, uint8_t* dst, uint64_t dstSize, uint32_t width, uint32_t height, bool forceIFrame)
     {
-        if (this->format != NVPIPE_BGRA32)
-            throw Exception("The OpenGL interface only supports the BGRA32 format");
+        if (this->format != NVPIPE_BGRA32 && this->format != NVPIPE_BGRA32_ALPHA)
+            throw Exception("The OpenGL PBO interface only supports the BGRA32 formats");
 
         // Map PBO and copy input to encoder
         cudaGraphicsResource_t resource = this->registry.getPBOGraphicsResource(pbo, width, height, cudaGraphicsRegisterFlagsReadOnly);
@@ -549,13 +1228,104 @@ public:
 
 private:
     void recreate(uint32_t width, uint32_t height)
+    {
+        this->recreate(width, height, this->getSessionFormat(width, height, (this->format == NVPIPE_BGRA32) ? NV_ENC_BUFFER_FORMAT_ARGB : NV_ENC_BUFFER_FORMAT_NV12));
+    }
+
+    /**
+     * @brief Input format of the session for a frame size.
+     *
+     * BGRA32 encoders take BGRA frames (ARGB session) and NV12 frame handles (NV12 session). A session of the
+     * same size is kept whichever format it was created for, and the input is converted to it, so alternating
+     * between both does not recreate the session and force an IDR frame each time.
+     */
+    NV_ENC_BUFFER_FORMAT getSessionFormat(uint32_t width, uint32_t height, NV_ENC_BUFFER_FORMAT preferred) const
+    {
+        if (this->encoder && width == this->width && height == this->height)
+            return this->bufferFormat;
+
+        return preferred;
+    }
+
+    void planFrame(uint64_t timestampUs)
+    {
+        // Lossless encoding has no rate control
+        if (this->compression == NVPIPE_LOSSLESS)
+            return;
+
+        if (!this->variableFrameRate)
+        {
+            this->rateController = RateController();
+            this->rateController.configure(this->bitrate, this->targetFrameRate, (double) RateController::WINDOW_FRAMES / this->targetFrameRate);
+            this->variableFrameRate = true;
+        }
+
+        const uint64_t rate = this->rateController.getReconfigureBitrate(this->rateController.plan(timestampUs), this->encoderBitrate);
+        if (rate)
+            this->reconfigureRate(rate);
+
+        this->framePlanned = true;
+    }
+
+    /**
+     * @brief Frames without a timestamp are encoded at the configured bitrate again.
+     */
+    void endVariableFrameRate()
+    {
+        this->variableFrameRate = false;
+
+        // During progressive refinement, the lossy rate is restored when the input changes
+        if (this->refinePlanner.isRefining())
+            this->refinePlanner.setBitrate(this->bitrate);
+        else if (this->encoderBitrate != this->bitrate)
+            this->reconfigureRate(this->bitrate);
+    }
+
+    void reconfigureRate(uint64_t rate)
+    {
+        NV_ENC_CONFIG config = { NV_ENC_CONFIG_VER };
+
+        NV_ENC_RECONFIGURE_PARAMS reconfigureParams;
+        memset(&reconfigureParams, 0, sizeof(reconfigureParams));
+        reconfigureParams.version = NV_ENC_RECONFIGURE_PARAMS_VER;
+        reconfigureParams.reInitEncodeParams.encodeConfig = &config;
+
+        // Keep the session and the references, only the rate control changes
+        encoder->GetInitializeParams(&reconfigureParams.reInitEncodeParams);
+        config.rcParams.averageBitRate = (uint32_t) std::min<uint64_t>(rate, UINT32_MAX);
+        config.rcParams.maxBitRate = config.rcParams.averageBitRate;
+        config.rcParams.vbvBufferSize = config.rcParams.averageBitRate * reconfigureParams.reInitEncodeParams.frameRateDen / reconfigureParams.reInitEncodeParams.frameRateNum; // one frame
+        config.rcParams.vbvInitialDelay = config.rcParams.vbvBufferSize;
+
+        try
+        {
+            encoder->Reconfigure(&reconfigureParams);
+        }
+        catch (NVENCException& e)
+        {
+            throw Exception("Failed to reconfigure rate control (" + e.getErrorString() + ")");
+        }
+
+        this->encoderBitrate = rate;
+    }
+
+    void updateSessionMemory()
+    {
+        uint64_t bytes = this->encoder ? this->encoder->GetInputBufferBytes() : 0;
+        bytes += this->refineEncoder ? this->refineEncoder->GetInputBufferBytes() : 0;
+        this->memory.addDevice((int64_t) bytes - (int64_t) this->sessionBytes);
+        this->sessionBytes = bytes;
+    }
+
+    void recreate(uint32_t width, uint32_t height, NV_ENC_BUFFER_FORMAT bufferFormat)
     {
         // Only recreate if necessary
-        if (width == this->width && height == this->height)
+        if (width == this->width && height == this->height && bufferFormat == this->bufferFormat)
             return;
 
         this->width = width;
         this->height = height;
+        this->bufferFormat = bufferFormat;
 
         // Ensure we have a CUDA context
         CUDA_THROW(cudaDeviceSynchronize(),
@@ -563,77 +1333,223 @@ private:
         CUcontext cudaContext;
         cuCtxGetCurrent(&cudaContext);
 
-        // Create encoder
+        // Create encoder. Progressive mode keeps a lossless session for static input next to the lossy one.
         try
         {
-            NV_ENC_BUFFER_FORMAT bufferFormat = (this->format == NVPIPE_BGRA32) ? NV_ENC_BUFFER_FORMAT_ARGB : NV_ENC_BUFFER_FORMAT_NV12;
-            this->encoder = std::unique_ptr<NvEncoderCuda>(new NvEncoderCuda(cudaContext, width, height, bufferFormat, 0));
+            this->refineEncoder.reset();
+            this->createSession(cudaContext, this->encoder, this->compression == NVPIPE_LOSSLESS);
 
-            NV_ENC_INITIALIZE_PARAMS initializeParams = { NV_ENC_INITIALIZE_PARAMS_VER };
-            NV_ENC_CONFIG encodeConfig = { NV_ENC_CONFIG_VER };
-            initializeParams.encodeConfig = &encodeConfig;
+            if (this->compression == NVPIPE_PROGRESSIVE)
+                this->createSession(cudaContext, this->refineEncoder, true);
+        }
+        catch (NVENCException& e)
+        {
+            this->updateSessionMemory();
+            throw Exception("Failed to create encoder (" + e.getErrorString() + ")");
+        }
 
-            GUID codecGUID = (this->codec == NVPIPE_HEVC) ? NV_ENC_CODEC_HEVC_GUID : NV_ENC_CODEC_H264_GUID;
+        this->updateSessionMemory();
+        this->encoderBitrate = this->bitrate;
 
-            GUID presetGUID = NV_ENC_PRESET_LOW_LATENCY_HQ_GUID;
-            if (this->compression == NVPIPE_LOSSLESS)
-                presetGUID = NV_ENC_PRESET_LOSSLESS_DEFAULT_GUID; // NV_ENC_PRESET_LOSSLESS_HP_GUID
+        // Input of the new size is compared from scratch
+        this->releasePreviousInput();
+        this->refinePlanner.reset();
 
-            encoder->CreateDefaultEncoderParams(&initializeParams, codecGUID, presetGUID);
+        // A new session always starts with an IDR frame
+        this->idrPending = true;
+        this->metrics->recreates++;
+    }
 
-            initializeParams.encodeWidth = width;
-            initializeParams.encodeHeight = height;
-            initializeParams.frameRateNum = this->targetFrameRate;
-            initializeParams.frameRateDen = 1;
-            initializeParams.enablePTD = 1;
+    void createSession(CUcontext cudaContext, std::unique_ptr<NvEncoderCuda>& session, bool lossless)
+    {
+        session = std::unique_ptr<NvEncoderCuda>(new NvEncoderCuda(cudaContext, this->width, this->height, this->bufferFormat, 0));
 
-            encodeConfig.gopLength = NVENC_INFINITE_GOPLENGTH; // No B-frames
-            encodeConfig.frameIntervalP = 1;
+        NV_ENC_INITIALIZE_PARAMS initializeParams = { NV_ENC_INITIALIZE_PARAMS_VER };
+        NV_ENC_CONFIG encodeConfig = { NV_ENC_CONFIG_VER };
+        initializeParams.encodeConfig = &encodeConfig;
 
-            if (this->codec == NVPIPE_H264)
-                encodeConfig.encodeCodecConfig.h264Config.idrPeriod = NVENC_INFINITE_GOPLENGTH;
-            else if (this->codec == NVPIPE_HEVC)
-                encodeConfig.encodeCodecConfig.hevcConfig.idrPeriod = NVENC_INFINITE_GOPLENGTH;
+        GUID codecGUID = (this->codec == NVPIPE_HEVC) ? NV_ENC_CODEC_HEVC_GUID : NV_ENC_CODEC_H264_GUID;
 
-            if (this->compression == NVPIPE_LOSSY)
-            {
-                encodeConfig.rcParams.averageBitRate = this->bitrate;
-                encodeConfig.rcParams.rateControlMode = NV_ENC_PARAMS_RC_CBR_LOWDELAY_HQ;
-                encodeConfig.rcParams.vbvBufferSize = encodeConfig.rcParams.averageBitRate * initializeParams.frameRateDen / initializeParams.frameRateNum; // bitrate / framerate = one frame
-                encodeConfig.rcParams.maxBitRate = encodeConfig.rcParams.averageBitRate;
-                encodeConfig.rcParams.vbvInitialDelay = encodeConfig.rcParams.vbvBufferSize;
-            }
+        GUID presetGUID = NV_ENC_PRESET_LOW_LATENCY_HQ_GUID;
+        if (lossless)
+            presetGUID = NV_ENC_PRESET_LOSSLESS_DEFAULT_GUID; // NV_ENC_PRESET_LOSSLESS_HP_GUID
 
-            encoder->CreateEncoder(&initializeParams);
-        }
-        catch (NVENCException& e)
+        session->CreateDefaultEncoderParams(&initializeParams, codecGUID, presetGUID);
+
+        initializeParams.encodeWidth = this->width;
+        initializeParams.encodeHeight = this->height;
+        initializeParams.frameRateNum = this->targetFrameRate;
+        initializeParams.frameRateDen = 1;
+        initializeParams.enablePTD = 1;
+
+        encodeConfig.gopLength = NVENC_INFINITE_GOPLENGTH; // No B-frames
+        encodeConfig.frameIntervalP = 1;
+
+        if (this->codec == NVPIPE_H264)
+            encodeConfig.encodeCodecConfig.h264Config.idrPeriod = NVENC_INFINITE_GOPLENGTH;
+        else if (this->codec == NVPIPE_HEVC)
+            encodeConfig.encodeCodecConfig.hevcConfig.idrPeriod = NVENC_INFINITE_GOPLENGTH;
+
+        if (!lossless)
         {
-            throw Exception("Failed to create encoder (" + e.getErrorString() + ")");
+            encodeConfig.rcParams.averageBitRate = this->bitrate;
+            encodeConfig.rcParams.rateControlMode = NV_ENC_PARAMS_RC_CBR_LOWDELAY_HQ;
+            encodeConfig.rcParams.vbvBufferSize = encodeConfig.rcParams.averageBitRate * initializeParams.frameRateDen / initializeParams.frameRateNum; // bitrate / framerate = one frame
+            encodeConfig.rcParams.maxBitRate = encodeConfig.rcParams.averageBitRate;
+            encodeConfig.rcParams.vbvInitialDelay = encodeConfig.rcParams.vbvBufferSize;
         }
+
+        session->CreateEncoder(&initializeParams);
+        session->SetCompletionTimeout(this->timeoutMs);
     }
 
-    uint64_t encode(uint8_t* dst, uint64_t dstSize, bool forceIFrame)
+    /**
+     * @brief Planes of an encoder input frame (luma and interleaved chroma for NV12).
+     */
+    struct InputPlane
     {
-        std::vector<std::vector<uint8_t>> packets;
+        uint8_t* data;
+        uint32_t pitch;
+        uint32_t rowBytes;
+        uint32_t rows;
+    };
 
-        try
-        {
-            if (forceIFrame)
-            {
-                NV_ENC_PIC_PARAMS params = {};
-                params.encodePicFlags = NV_ENC_PIC_FLAG_FORCEIDR | NV_ENC_PIC_FLAG_OUTPUT_SPSPPS;
+    std::vector<InputPlane> getInputPlanes(const NvEncInputFrame* f) const
+    {
+        if (this->bufferFormat == NV_ENC_BUFFER_FORMAT_ARGB)
+            return { { (uint8_t*) f->inputPtr, f->pitch, this->width * 4, this->height } };
 
-                this->encoder->EncodeFrame(packets, &params);
-            }
-            else
+        return { { (uint8_t*) f->inputPtr, f->pitch, this->width, this->height },
+                 { (uint8_t*) f->inputPtr + f->chromaOffsets[0], f->chromaPitch, this->width, (this->height + 1) / 2 } };
+    }
+
+    /**
+     * @brief Compares the uploaded input with the previous one on the device, which also keeps it for the next frame.
+     *
+     * The change flag is read back asynchronously and evaluated with the next frame instead of blocking the host,
+     * so the result lags one frame: it tells whether the previous input differed from the one before. The first
+     * changed frame after static input is thus still sent (exactly) by the lossless session, and refinement of static
+     * input starts one frame later.
+     */
+    bool inputChanged(const NvEncInputFrame* f)
+    {
+        const std::vector<InputPlane> planes = this->getInputPlanes(f);
+
+        uint64_t size = 0;
+        for (const InputPlane& p : planes)
+            size += (uint64_t) p.rowBytes * p.rows;
+
+        bool changed = true;
+
+        const bool hasPrevious = this->previousInput && this->previousInputSize == size;
+        if (hasPrevious)
+        {
+            // Result of the previous frame, usually complete by now
+            if (this->inputComparePending)
             {
-                this->encoder->EncodeFrame(packets);
+                CUDA_THROW(cudaEventSynchronize(this->inputCompared),
+                           "Failed to wait for change flag");
+                changed = (*this->inputDiffersHost != 0);
             }
         }
-        catch (NVENCException& e)
+        else
         {
-            throw Exception("Encode failed (" + e.getErrorString() + ")");
+            this->releasePreviousInput();
+
+            this->previousInput = this->pool->allocate(size);
+            this->inputDiffers = this->pool->allocate(sizeof(uint32_t));
+            this->previousInputSize = size;
+            this->memory.addDevice(size + sizeof(uint32_t));
+
+            CUDA_THROW(cudaMallocHost((void**) &this->inputDiffersHost, sizeof(uint32_t)),
+                       "Failed to allocate change flag");
+            CUDA_THROW(cudaEventCreateWithFlags(&this->inputCompared, cudaEventDisableTiming),
+                       "Failed to create change event");
+        }
+
+        CUDA_THROW(cudaMemsetAsync(this->inputDiffers, 0, sizeof(uint32_t)),
+                   "Failed to clear change flag");
+
+        uint8_t* previous = (uint8_t*) this->previousInput;
+        for (const InputPlane& p : planes)
+        {
+            // one thread per byte
+            dim3 gridSize(p.rowBytes / 64 + 1, p.rows / 4 + 1);
+            dim3 blockSize(64, 4);
+
+            plane_differs_keep<<<gridSize, blockSize>>>(p.data, p.pitch, previous, p.rowBytes, p.rowBytes, p.rows, (uint32_t*) this->inputDiffers);
+            previous += (uint64_t) p.rowBytes * p.rows;
+        }
+
+        CUDA_THROW(cudaMemcpyAsync(this->inputDiffersHost, this->inputDiffers, sizeof(uint32_t), cudaMemcpyDeviceToHost),
+                   "Failed to read change flag");
+        CUDA_THROW(cudaEventRecord(this->inputCompared),
+                   "Failed to record change event");
+
+        // Without a previous frame, the comparison only fills it
+        this->inputComparePending = hasPrevious;
+
+        return changed;
+    }
+
+    uint64_t releasePreviousInput()
+    {
+        if (!this->previousInput)
+            return 0;
+
+        const uint64_t released = this->previousInputSize + sizeof(uint32_t);
+
+        // The last comparison may still be in flight
+        if (this->inputCompared)
+        {
+            cudaEventSynchronize(this->inputCompared);
+            cudaEventDestroy(this->inputCompared);
         }
+        cudaFreeHost(this->inputDiffersHost);
+
+        this->pool->free(this->previousInput);
+        this->pool->free(this->inputDiffers);
+        this->memory.addDevice(-(int64_t) released);
+
+        this->previousInput = nullptr;
+        this->inputDiffers = nullptr;
+        this->inputDiffersHost = nullptr;
+        this->inputCompared = nullptr;
+        this->inputComparePending = false;
+        this->previousInputSize = 0;
+
+        return released;
+    }
+
+    /**
+     * @brief Progressive mode: selects the session for the uploaded frame, see RefinePlanner.
+     */
+    NvEncoderCuda* refine(bool& forceIFrame)
+    {
+        const NvEncInputFrame* f = this->encoder->GetNextInputFrame();
+
+        const RefinePlanner::Decision decision = this->refinePlanner.next(this->inputChanged(f), this->encoderBitrate);
+        if (decision.bitrate > 0)
+            this->reconfigureRate(decision.bitrate);
+        if (decision.forceIFrame)
+            forceIFrame = true;
+
+        if (!decision.lossless)
+            return this->encoder.get();
+
+        // The lossless session encodes the same input
+        const std::vector<InputPlane> src = this->getInputPlanes(f);
+        const std::vector<InputPlane> dst = this->getInputPlanes(this->refineEncoder->GetNextInputFrame());
+        for (size_t i = 0; i < src.size(); ++i)
+            CUDA_THROW(cudaMemcpy2D(dst[i].data, dst[i].pitch, src[i].data, src[i].pitch, src[i].rowBytes, src[i].rows, cudaMemcpyDeviceToDevice),
+                       "Failed to copy refinement frame");
+
+        return this->refineEncoder.get();
+    }
+
+    uint64_t encode(uint8_t* dst, uint64_t dstSize, bool forceIFrame)
+    {
+        const std::vector<std::vector<uint8_t>>& packets = this->encodePackets(forceIFrame);
 
         // Copy output
         uint64_t size = 0;
@@ -660,13 +1576,28 @@ private:
 
         if (this->deviceBufferSize < requiredSize)
         {
-            if (this->deviceBuffer)
-                cudaFree(this->deviceBuffer);
+            this->releaseDeviceBuffer();
 
+            this->deviceBuffer = this->pool->allocate(requiredSize);
             this->deviceBufferSize = requiredSize;
-            CUDA_THROW(cudaMalloc(&this->deviceBuffer, this->deviceBufferSize),
-                       "Failed to allocate temporary device memory");
+            this->memory.addDevice(requiredSize);
+        }
+    }
+
+    uint64_t releaseDeviceBuffer()
+    {
+        const uint64_t released = this->deviceBufferSize;
+
+        if (this->deviceBuffer)
+        {
+            this->pool->free(this->deviceBuffer);
+            this->memory.addDevice(-(int64_t) released);
         }
+
+        this->deviceBuffer = nullptr;
+        this->deviceBufferSize = 0;
+
+        return released;
     }
 
 private:
@@ -677,112 +1608,484 @@ private:
     uint32_t targetFrameRate;
     uint32_t width = 0;
     uint32_t height = 0;
+    NV_ENC_BUFFER_FORMAT bufferFormat = NV_ENC_BUFFER_FORMAT_UNDEFINED;
 
     std::unique_ptr<NvEncoderCuda> encoder;
-
+    std::vector<std::vector<uint8_t>> packets;
+
+    // Progressive mode: lossless session and change detection, see refine()
+    std::unique_ptr<NvEncoderCuda> refineEncoder;
+    RefinePlanner refinePlanner;
+    void* previousInput = nullptr;
+    void* inputDiffers = nullptr;
+    uint32_t* inputDiffersHost = nullptr; // pinned
+    cudaEvent_t inputCompared = nullptr;
+    bool inputComparePending = false;
+    uint64_t previousInputSize = 0;
+    bool idrPending = true;
+    bool resync = false;
+    uint32_t timeoutMs = 0;
+
+    // Timestamped encoding budgets bits over time, see RateController
+    RateController rateController;
+    bool variableFrameRate = false;
+    bool framePlanned = false; // the next encoded frame was planned by the rate controller
+    uint64_t encoderBitrate = 0;
+
+    MemoryAccount memory;
+    uint64_t sessionBytes = 0;
+
+    std::shared_ptr<StreamMetrics> metrics;
+
+    CachingAllocator* pool = nullptr;
+    CachingAllocator* hostPool = nullptr;
     void* deviceBuffer = nullptr;
     uint64_t deviceBufferSize = 0;
 
+    std::unique_ptr<Denoiser> denoiser;
+
 #ifdef NVPIPE_WITH_OPENGL
     GraphicsResourceRegistry registry;
 #endif
-};
-#endif
 
+public:
+    std::atomic<uint64_t> framesEncoded{0};
+    std::atomic<uint64_t> framesTimedOut{0};
+};
 
-#ifdef NVPIPE_WITH_DECODER
 /**
- * @brief Decoder implementation.
+ * @brief Frame buffer exchanged between producer and encode worker of an EncoderMailbox.
  */
-class Decoder
+struct MailboxFrame
 {
-public:
-    Decoder(NvPipe_Format format, NvPipe_Codec codec)
-    {
-        this->format = format;
-        this->codec = codec;
-
-        this->recreate(1920, 1080);
-    }
+    MailboxFrame(MemoryAccount& memory, CachingAllocator& pool, CachingAllocator& hostPool) : memory(memory), pool(pool), hostPool(hostPool) {}
 
-    ~Decoder()
+    ~MailboxFrame()
     {
-        // Free temporary device memory
-        if (this->deviceBuffer)
-            cudaFree(this->deviceBuffer);
+        this->release();
     }
 
-    uint64_t decode(const uint8_t* src, uint64_t srcSize, void* dst, uint32_t width, uint32_t height)
+    void reserve(uint64_t size, bool device)
     {
-        // Recreate decoder if size changed
-        if (this->format == NVPIPE_UINT16)
-            this->recreate(width * 2, height); // split into two adjecent tiles in Y channel
-        else if (this->format == NVPIPE_UINT32)
-            this->recreate(width * 4, height); // split into four adjecent tiles in Y channel
+        if (this->capacity >= size && this->device == device)
+            return;
+
+        this->release();
+
+        this->data = device ? this->pool.allocate(size) : this->hostPool.allocate(size);
+
+        this->capacity = size;
+        this->device = device;
+
+        if (device)
+            this->memory.addDevice(size);
         else
-            this->recreate(width, height);
+            this->memory.addHost(size);
+    }
 
-        // Decode
-        uint8_t* decoded = this->decode(src, srcSize);
+    void release()
+    {
+        if (!this->data)
+            return;
 
-        if (nullptr != decoded)
+        if (this->device)
         {
-            // Allocate temporary device buffer if we need to copy to the host eventually
-            bool copyToHost = !isDevicePointer(dst);
-            if (copyToHost)
-                this->recreateDeviceBuffer(width, height);
+            this->pool.free(this->data);
+            this->memory.addDevice(-(int64_t) this->capacity);
+        }
+        else
+        {
+            this->hostPool.free(this->data);
+            this->memory.addHost(-(int64_t) this->capacity);
+        }
 
-            // Convert to output format
-            uint8_t* dstDevice = (uint8_t*) (copyToHost ? this->deviceBuffer : dst);
+        this->data = nullptr;
+        this->capacity = 0;
+    }
 
-            if (this->format == NVPIPE_BGRA32)
-            {
-                Nv12ToBgra32(decoded, width, dstDevice, width * 4, width, height);
+    MemoryAccount& memory;
+    CachingAllocator& pool;
+    CachingAllocator& hostPool;
+    void* data = nullptr;
+    uint64_t capacity = 0;
+    bool device = false;
+
+    uint64_t pitch = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    bool forceIFrame = false;
+    bool hasDeadline = false;
+    std::chrono::steady_clock::time_point deadline;
+};
+
+
+/**
+ * @brief Non-blocking frame mailbox in front of an encoder.
+ *
+ * Producers post frames without waiting for the encoder. A worker thread always encodes the newest frame,
+ * superseded frames are dropped. Frames which would miss their deadline (one frame interval at the target
+ * frame rate after posting) are dropped as well, which keeps the latency bounded under overload.
+ */
+class EncoderMailbox
+{
+public:
+    EncoderMailbox(Encoder* encoder, NvPipe_PacketCallback callback, void* userData)
+        : encoder(encoder), callback(callback), userData(userData)
+    {
+        // The worker encodes within the context of the creating thread
+        cuCtxGetCurrent(&this->context);
+
+        this->worker = std::thread(&EncoderMailbox::run, this);
+    }
+
+    ~EncoderMailbox()
+    {
+        this->mailbox.close();
+        this->worker.join();
+    }
+
+    void post(const void* src, uint64_t srcPitch, uint32_t width, uint32_t height, bool forceIFrame)
+    {
+        // Report errors of previous frames
+        {
+            std::lock_guard<std::mutex> lock(this->errorMutex);
+            if (!this->error.empty())
+            {
+                std::string message;
+                std::swap(message, this->error);
+                throw Exception(message);
             }
-            else if (this->format == NVPIPE_UINT4)
+        }
+
+        // Copy to staging frame (recycled from previous posts)
+        if (!this->staging)
+            this->staging.reset(new MailboxFrame(this->encoder->getMemory(), this->encoder->getPool(), this->encoder->getHostPool()));
+
+        const uint64_t rowSize = getFrameSize(this->encoder->getFormat(), width, 1);
+        const bool device = isDevicePointer(src);
+
+        this->staging->reserve(rowSize * height, device);
+        CUDA_THROW(cudaMemcpy2D(this->staging->data, rowSize, src, srcPitch, rowSize, height, device ? cudaMemcpyDeviceToDevice : cudaMemcpyHostToHost),
+                   "Failed to copy frame to mailbox");
+
+        this->staging->pitch = rowSize;
+        this->staging->width = width;
+        this->staging->height = height;
+        this->staging->forceIFrame = forceIFrame;
+
+        const uint32_t targetFrameRate = this->encoder->getTargetFrameRate();
+        this->staging->hasDeadline = targetFrameRate > 0;
+        if (this->staging->hasDeadline)
+            this->staging->deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(1000000 / targetFrameRate);
+
+        // Swap in, staging now holds a frame that can be reused
+        if (this->mailbox.post(this->staging))
+        {
+            this->framesDropped++;
+            this->encoder->getMetrics().droppedFrames++;
+
+            // Do not lose a requested I-frame
+            if (this->staging->forceIFrame)
+                this->forceNextIFrame = true;
+        }
+    }
+
+    uint64_t trim()
+    {
+        // The staging frame is allocated again by the next post
+        const uint64_t released = this->staging ? this->staging->capacity : 0;
+        this->staging.reset();
+        return released;
+    }
+
+    /**
+     * @brief Keeps the worker from using the encoder, e.g., while its buffers are released.
+     */
+    std::unique_lock<std::mutex> lockEncoder()
+    {
+        return std::unique_lock<std::mutex>(this->encoderMutex);
+    }
+
+private:
+    void run()
+    {
+        cuCtxSetCurrent(this->context);
+
+        std::unique_ptr<MailboxFrame> frame;
+        std::vector<uint8_t> output;
+        std::chrono::steady_clock::duration encodeDuration(0);
+
+        while (this->mailbox.take(frame))
+        {
+            const bool forceIFrame = frame->forceIFrame || this->forceNextIFrame.exchange(false);
+
+            // Drop frame if the encode would finish after its deadline
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            if (frame->hasDeadline && start + encodeDuration > frame->deadline)
             {
-                // one thread per TWO pixels (merge 2x4 bit to one byte per thread)
-                dim3 gridSize(width / 16 / 2 + 1, height / 2 + 1);
-                dim3 blockSize(16, 2);
+                this->framesLate++;
+                this->encoder->getMetrics().lateFrames++;
 
-                nv12_to_uint4<<<gridSize, blockSize>>>(decoded, this->decoder->GetDeviceFramePitch(), dstDevice, width / 2, width, height);
+                if (forceIFrame)
+                    this->forceNextIFrame = true;
+
+                continue;
             }
-            else if (this->format == NVPIPE_UINT8)
+
+            try
             {
-                // one thread per pixel (copy 8 bit)
-                dim3 gridSize(width / 16 + 1, height / 2 + 1);
-                dim3 blockSize(16, 2);
+                {
+                    std::lock_guard<std::mutex> lock(this->encoderMutex);
 
-                nv12_to_uint8<<<gridSize, blockSize>>>(decoded, this->decoder->GetDeviceFramePitch(), dstDevice, width, width, height);
+                    this->encoder->upload(frame->data, frame->pitch, frame->width, frame->height);
+                    const std::vector<std::vector<uint8_t>>& packets = this->encoder->encodePackets(forceIFrame);
+
+                    output.clear();
+                    for (auto& p : packets)
+                        output.insert(output.end(), p.begin(), p.end());
+                }
+
+                // Running estimate of the encode duration
+                encodeDuration = (3 * encodeDuration + (std::chrono::steady_clock::now() - start)) / 4;
+
+                // Without the lock, so the callback may change encoder settings
+                this->callback(output.data(), output.size(), this->userData);
             }
-            else if (this->format == NVPIPE_UINT16)
+            catch (Exception& e)
             {
-                // one thread per pixel (merge 2x8 bit into 16 bit pixels)
-                dim3 gridSize(width / 16 + 1, height / 2 + 1);
-                dim3 blockSize(16, 2);
-
-                nv12_to_uint16<<<gridSize, blockSize>>>(decoded, this->decoder->GetDeviceFramePitch(), dstDevice, width * 2, width, height);
+                std::lock_guard<std::mutex> lock(this->errorMutex);
+                this->error = e.getErrorString();
             }
-            else if (this->format == NVPIPE_UINT32)
+            catch (std::exception& e)
             {
-                // one thread per pixel (merge 4x8 bit into 32 bit pixels)
-                dim3 gridSize(width / 16 + 1, height / 2 + 1);
-                dim3 blockSize(16, 2);
-
-                nv12_to_uint32<<<gridSize, blockSize>>>(decoded, this->decoder->GetDeviceFramePitch(), dstDevice, width * 4, width, height);
+                // E.g., std::bad_alloc, which must not terminate the process on the worker thread
+                std::lock_guard<std::mutex> lock(this->errorMutex);
+                this->error = e.what();
             }
+        }
+    }
+
+private:
+    Encoder* encoder;
+    NvPipe_PacketCallback callback;
+    void* userData;
+    CUcontext context = nullptr;
+
+    Mailbox<std::unique_ptr<MailboxFrame>> mailbox;
+    std::unique_ptr<MailboxFrame> staging;
+    std::atomic<bool> forceNextIFrame{false};
+    std::thread worker;
+    std::mutex encoderMutex; // held by the worker while it uses the encoder
+
+    std::mutex errorMutex;
+    std::string error;
+
+public:
+    std::atomic<uint64_t> framesDropped{0};
+    std::atomic<uint64_t> framesLate{0};
+};
+#endif
+
+
+#ifdef NVPIPE_WITH_DECODER
+/**
+ * @brief Decoder implementation.
+ */
+class Decoder
+{
+public:
+    Decoder(NvPipe_Format format, NvPipe_Codec codec)
+    {
+        this->format = format;
+        this->codec = codec;
+
+        this->pool = &DeviceMemoryPools::instance().get();
+        this->hostPool = &HostMemoryPools::instance().get();
+
+        this->metrics = MetricsRegistry::instance().add("decoder", (codec == NVPIPE_HEVC) ? "hevc" : "h264");
+
+        try
+        {
+            this->recreate(1920, 1080);
+        }
+        catch (Exception&)
+        {
+            MetricsRegistry::instance().remove(this->metrics);
+            throw;
+        }
+    }
+
+    ~Decoder()
+    {
+        MetricsRegistry::instance().remove(this->metrics);
+
+        // Return temporary device memory to the pool
+        this->releaseDeviceBuffer();
+    }
+
+    void setTimeout(uint32_t milliseconds)
+    {
+        this->timeoutMs = milliseconds;
+        this->decoder->SetDecodeTimeout(milliseconds);
+    }
+
+    MemoryAccount& getMemory()
+    {
+        return this->memory;
+    }
+
+    uint64_t trim()
+    {
+        // Conversion buffer and unused output frames are reallocated on demand
+        uint64_t released = this->releaseDeviceBuffer();
+        released += this->decoder->ReleaseFrames();
+        this->updateSessionMemory();
+
+        return released;
+    }
+
+    uint64_t decode(const uint8_t* src, uint64_t srcSize, void* dst, uint32_t width, uint32_t height)
+    {
+        // Recreate decoder if size changed
+        if (this->format == NVPIPE_UINT16)
+            this->recreate(width * 2, height); // split into two adjecent tiles in Y channel
+        else if (this->format == NVPIPE_UINT32)
+            this->recreate(width * 4, height); // split into four adjecent tiles in Y channel
+        else if (this->format == NVPIPE_BGRA32_ALPHA)
+            this->recreate(width * 2, height); // color tile and alpha tile (in Y channel) side by side
+        else
+            this->recreate(width, height);
+
+        // Decode
+        uint8_t* decoded = this->decode(src, srcSize);
 
-            // Copy to host if necessary
-            if (copyToHost)
-                CUDA_THROW(cudaMemcpy(dst, this->deviceBuffer, getFrameSize(this->format, width, height), cudaMemcpyDeviceToHost),
-                           "Failed to copy output to host memory");
+        if (nullptr != decoded)
+        {
+            // Convert straight from the mapped decoder surface, it is unmapped by the next decode
+            const uint64_t size = this->convert(decoded, this->decoder->GetMappedFramePitch(), this->decoder->GetSurfaceHeight(), dst, width, height);
+            this->decoder->ReleaseMappedFrames();
 
-            return getFrameSize(this->format, width, height);
+            return size;
         }
 
         return 0;
     }
 
+    uint64_t decodeVolume(const uint8_t* src, uint64_t srcSize, void* dst, uint64_t rowPitch, uint64_t slicePitch, int64_t brickIndex)
+    {
+        VolumeIndex index;
+        const std::string error = VolumeIndex::read(src, srcSize, index);
+        if (!error.empty())
+            throw Exception(error);
+
+        if (index.format != this->format)
+            throw Exception("Volume format does not match the decoder format");
+
+        if (isDevicePointer(dst))
+            throw Exception("Volumes must be decoded to host memory");
+
+        const VolumeLayout layout(index.format, index.volume);
+        const std::vector<VolumeBrick>& bricks = layout.getBricks();
+
+        if (brickIndex >= (int64_t) bricks.size())
+            throw Exception("Invalid brick index");
+
+        if (rowPitch == 0)
+            rowPitch = layout.getRowPitch();
+        if (slicePitch == 0)
+            slicePitch = rowPitch * index.volume.height;
+
+        HostBuffer frame(*this->hostPool, layout.getFrameSize());
+        uint64_t decodedSize = 0;
+
+        const size_t first = (brickIndex < 0) ? 0 : (size_t) brickIndex;
+        const size_t last = (brickIndex < 0) ? bricks.size() : first + 1;
+
+        for (size_t i = first; i < last; ++i)
+        {
+            const VolumeBrick& brick = bricks[i];
+            const uint8_t* slice = src + index.bricks[i].offset;
+
+            for (uint32_t s = 0; s < layout.getNumSlices(brick); ++s)
+            {
+                const uint32_t size = index.sliceSizes[brick.firstSlice + s];
+
+                if (this->decode(slice, size, frame.data(), layout.getFrameWidth(), layout.getFrameHeight()) == 0)
+                    throw Exception("Failed to decode volume slice");
+
+                layout.insertSlice(frame.data(), brick, s, (uint8_t*) dst, rowPitch, slicePitch);
+                slice += size;
+            }
+
+            decodedSize += layout.getBrickBytes(brick);
+        }
+
+        return decodedSize;
+    }
+
+    Frame* decodeFrame(const uint8_t* src, uint64_t srcSize, uint32_t width, uint32_t height)
+    {
+        // Recreate decoder if size changed
+        if (this->format == NVPIPE_UINT16 || this->format == NVPIPE_BGRA32_ALPHA)
+            this->recreate(width * 2, height);
+        else if (this->format == NVPIPE_UINT32)
+            this->recreate(width * 4, height);
+        else
+            this->recreate(width, height);
+
+        // Decode into a locked surface which stays valid until the frame is released.
+        // The release callback keeps the decoder alive in case it is recreated in the meantime.
+        uint8_t* decoded = this->decode(src, srcSize, true);
+
+        std::shared_ptr<NvDecoder> decoder = this->decoder;
+        return new Frame(Frame::Memory::Device, decoded, decoder->GetDeviceFramePitch(), decoder->GetWidth(), decoder->GetHeight(), [decoder, decoded]()
+        {
+            uint8_t* frame = decoded;
+            decoder->UnlockFrame(&frame, 1);
+        });
+    }
+
+    void queueDecode(const uint8_t* src, uint64_t srcSize, uint32_t width, uint32_t height)
+    {
+        // Every packet is decoded to keep the references intact, but conversion is deferred until the frame is fetched
+        std::unique_ptr<Frame> frame(this->decodeFrame(src, srcSize, width, height));
+
+        {
+            std::lock_guard<std::mutex> lock(this->latestMutex);
+
+            if (this->latestFrame)
+            {
+                this->framesDropped++;
+                this->metrics->droppedFrames++;
+            }
+
+            std::swap(this->latestFrame, frame);
+            this->latestWidth = width;
+            this->latestHeight = height;
+        }
+
+        // Superseded frame (if any) is released outside the lock
+    }
+
+    uint64_t fetchLatestFrame(void* dst)
+    {
+        std::unique_ptr<Frame> frame;
+        uint32_t width, height;
+
+        {
+            std::lock_guard<std::mutex> lock(this->latestMutex);
+
+            frame = std::move(this->latestFrame);
+            width = this->latestWidth;
+            height = this->latestHeight;
+        }
+
+        if (!frame)
+            return 0;
+
+        return this->convert(frame->data, frame->pitch, frame->height, dst, width, height);
+    }
+
 #ifdef NVPIPE_WITH_OPENGL
 
     uint64_t decodeTexture(const uint8_t* src, uint64_t srcSize, uint32_t texture, uint32_t target, uint32_t width, uint32_t height)
@@ -800,7 +2103,8 @@ public:
         {
             // Convert to RGBA
             this->recreateDeviceBuffer(width, height);
-            Nv12ToBgra32(decoded, width, (uint8_t*) this->deviceBuffer, width * 4, width, height);
+            Nv12ToBgra32(decoded, this->decoder->GetMappedFramePitch(), (uint8_t*) this->deviceBuffer, width * 4, width, height, 0, this->decoder->GetSurfaceHeight());
+            this->decoder->ReleaseMappedFrames();
 
             // Copy output to texture
             cudaGraphicsResource_t resource = this->registry.getTextureGraphicsResource(texture, target, width, height, cudaGraphicsRegisterFlagsWriteDiscard);
@@ -814,6 +2118,8 @@ public:
             CUDA_THROW(cudaGraphicsUnmapResources(1, &resource),
                        "Failed to unmap texture graphics resource");
 
+            this->framesDelivered++;
+
             return width * height * 4;
         }
 
@@ -822,8 +2128,8 @@ public:
 
     uint64_t decodePBO(const uint8_t* src, uint64_t srcSize, uint32_t pbo, uint32_t width, uint32_t height)
     {
-        if (this->format != NVPIPE_BGRA32)
-            throw Exception("The OpenGL interface only supports the BGRA32 format");
+        if (this->format != NVPIPE_BGRA32 && this->format != NVPIPE_BGRA32_ALPHA)
+            throw Exception("The OpenGL PBO interface only supports the BGRA32 formats");
 
         // Map PBO for output
         cudaGraphicsResource_t resource = this->registry.getPBOGraphicsResource(pbo, width, height, cudaGraphicsRegisterFlagsWriteDiscard);
@@ -847,6 +2153,81 @@ public:
 #endif
 
 private:
+    uint64_t convert(uint8_t* decoded, uint32_t pitch, uint32_t surfaceHeight, void* dst, uint32_t width, uint32_t height)
+    {
+        // Allocate temporary device buffer if we need to copy to the host eventually
+        bool copyToHost = !isDevicePointer(dst);
+        if (copyToHost)
+            this->recreateDeviceBuffer(width, height);
+
+        // Convert to output format
+        uint8_t* dstDevice = (uint8_t*) (copyToHost ? this->deviceBuffer : dst);
+
+        if (this->format == NVPIPE_BGRA32)
+        {
+            Nv12ToBgra32(decoded, pitch, dstDevice, width * 4, width, height, 0, surfaceHeight);
+        }
+        else if (this->format == NVPIPE_BGRA32_ALPHA)
+        {
+            // Color from the left tile
+            Nv12ToBgra32(decoded, pitch, dstDevice, width * 4, width, height, 0, surfaceHeight);
+
+            // one thread per pixel (copy alpha from the right tile)
+            dim3 gridSize(width / 16 + 1, height / 2 + 1);
+            dim3 blockSize(16, 2);
+
+            nv12_alpha_to_bgra32<<<gridSize, blockSize>>>(decoded, pitch, dstDevice, width * 4, width, height);
+        }
+        else if (this->format == NVPIPE_UINT4)
+        {
+            // one thread per TWO pixels (merge 2x4 bit to one byte per thread)
+            dim3 gridSize(width / 16 / 2 + 1, height / 2 + 1);
+            dim3 blockSize(16, 2);
+
+            nv12_to_uint4<<<gridSize, blockSize>>>(decoded, pitch, dstDevice, width / 2, width, height);
+        }
+        else if (this->format == NVPIPE_UINT8)
+        {
+            // one thread per pixel (copy 8 bit)
+            dim3 gridSize(width / 16 + 1, height / 2 + 1);
+            dim3 blockSize(16, 2);
+
+            nv12_to_uint8<<<gridSize, blockSize>>>(decoded, pitch, dstDevice, width, width, height);
+        }
+        else if (this->format == NVPIPE_UINT16)
+        {
+            // one thread per pixel (merge 2x8 bit into 16 bit pixels)
+            dim3 gridSize(width / 16 + 1, height / 2 + 1);
+            dim3 blockSize(16, 2);
+
+            nv12_to_uint16<<<gridSize, blockSize>>>(decoded, pitch, dstDevice, width * 2, width, height);
+        }
+        else if (this->format == NVPIPE_UINT32)
+        {
+            // one thread per pixel (merge 4x8 bit into 32 bit pixels)
+            dim3 gridSize(width / 16 + 1, height / 2 + 1);
+            dim3 blockSize(16, 2);
+
+            nv12_to_uint32<<<gridSize, blockSize>>>(decoded, pitch, dstDevice, width * 4, width, height);
+        }
+
+        // Copy to host if necessary
+        if (copyToHost)
+            CUDA_THROW(cudaMemcpy(dst, this->deviceBuffer, getFrameSize(this->format, width, height), cudaMemcpyDeviceToHost),
+                       "Failed to copy output to host memory");
+
+        this->framesDelivered++;
+
+        return getFrameSize(this->format, width, height);
+    }
+
+    void updateSessionMemory()
+    {
+        const uint64_t bytes = this->decoder ? this->decoder->GetFrameBytes() + this->decoder->GetSurfaceBytes() : 0;
+        this->memory.addDevice((int64_t) bytes - (int64_t) this->sessionBytes);
+        this->sessionBytes = bytes;
+    }
+
     void recreate(uint32_t width, uint32_t height)
     {
         // Only recreate if necessary
@@ -865,37 +2246,85 @@ private:
         // Create decoder
         try
         {
-            this->decoder = std::unique_ptr<NvDecoder>(new NvDecoder(cudaContext, width, height, true, (this->codec == NVPIPE_HEVC) ? cudaVideoCodec_HEVC : cudaVideoCodec_H264, nullptr, true));
+            this->decoder = std::shared_ptr<NvDecoder>(new NvDecoder(cudaContext, width, height, true, (this->codec == NVPIPE_HEVC) ? cudaVideoCodec_HEVC : cudaVideoCodec_H264, nullptr, true));
+            this->decoder->SetDecodeTimeout(this->timeoutMs);
+            this->decoder->SetZeroCopy(true);
+
+            CachingAllocator* pool = this->pool;
+            this->decoder->SetFrameAllocator([pool](size_t size) { return pool->allocate(size); },
+                                             [pool](void* ptr) { pool->free(ptr); });
         }
         catch (NVDECException& e)
         {
+            this->updateSessionMemory();
             throw Exception("Failed to create decoder (" + e.getErrorString() + ")");
         }
+
+        this->updateSessionMemory();
+
+        this->metrics->recreates++;
     }
 
-    uint8_t* decode(const uint8_t* src, uint64_t srcSize)
+    uint8_t* decode(const uint8_t* src, uint64_t srcSize, bool lockFrame = false)
     {
+        const auto start = std::chrono::steady_clock::now();
+
         int numFramesDecoded = 0;
+        int numFramesTimedOut = 0;
         uint8_t **decodedFrames;
         int64_t *timeStamps;
 
         try
         {
             // Some cuvid implementations have one frame latency. Refeed frame into pipeline in this case.
+            // A timed out frame was decoded nevertheless and must not be refed.
             const uint32_t DECODE_TRIES = 3;
-            for (uint32_t i = 0; (i < DECODE_TRIES) && (numFramesDecoded <= 0); ++i)
-                this->decoder->Decode(src, srcSize, &decodedFrames, &numFramesDecoded, CUVID_PKT_ENDOFPICTURE, &timeStamps, this->n++);
+            for (uint32_t i = 0; (i < DECODE_TRIES) && (numFramesDecoded <= 0) && (numFramesTimedOut == 0); ++i)
+            {
+                if (lockFrame)
+                {
+                    this->decoder->DecodeLockFrame(src, srcSize, &decodedFrames, &numFramesDecoded, CUVID_PKT_ENDOFPICTURE, &timeStamps, this->n++);
+
+                    // Only the most recent frame stays locked
+                    if (numFramesDecoded > 1)
+                        this->decoder->UnlockFrame(decodedFrames, numFramesDecoded - 1);
+                }
+                else
+                {
+                    this->decoder->Decode(src, srcSize, &decodedFrames, &numFramesDecoded, CUVID_PKT_ENDOFPICTURE, &timeStamps, this->n++);
+                }
+
+                numFramesTimedOut = this->decoder->GetNumTimedOutFrames();
+            }
         }
         catch (NVDECException& e)
         {
             throw Exception("Decode failed (" + e.getErrorString() + ")");
         }
 
+        // Output frames and surfaces are allocated while decoding
+        this->updateSessionMemory();
+
+        if (numFramesTimedOut > 0)
+        {
+            this->framesTimedOut += numFramesTimedOut;
+            this->metrics->timeouts += numFramesTimedOut;
+
+            if (numFramesDecoded <= 0)
+                throw Exception("Decode timed out after " + std::to_string(this->timeoutMs) + " ms (frame dropped)", true);
+        }
+
         if (numFramesDecoded <= 0)
         {
             throw Exception("No frame decoded (Decoder expects encoded bitstream for a single complete frame. Accumulating partial data or combining multiple frames is not supported.)");
         }
 
+        this->framesDecoded++;
+
+        this->metrics->frames.fetch_add(1, std::memory_order_relaxed);
+        this->metrics->bytes.fetch_add(srcSize, std::memory_order_relaxed);
+        this->metrics->latency.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
         return decodedFrames[numFramesDecoded - 1];
     }
 
@@ -906,13 +2335,28 @@ private:
 
         if (this->deviceBufferSize < requiredSize)
         {
-            if (this->deviceBuffer)
-                cudaFree(this->deviceBuffer);
+            this->releaseDeviceBuffer();
 
+            this->deviceBuffer = this->pool->allocate(requiredSize);
             this->deviceBufferSize = requiredSize;
-            CUDA_THROW(cudaMalloc(&this->deviceBuffer, this->deviceBufferSize),
-                       "Failed to allocate temporary device memory");
+            this->memory.addDevice(requiredSize);
+        }
+    }
+
+    uint64_t releaseDeviceBuffer()
+    {
+        const uint64_t released = this->deviceBufferSize;
+
+        if (this->deviceBuffer)
+        {
+            this->pool->free(this->deviceBuffer);
+            this->memory.addDevice(-(int64_t) released);
         }
+
+        this->deviceBuffer = nullptr;
+        this->deviceBufferSize = 0;
+
+        return released;
     }
 
 private:
@@ -921,15 +2365,39 @@ private:
     uint32_t width = 0;
     uint32_t height = 0;
 
-    std::unique_ptr<NvDecoder> decoder;
+    std::shared_ptr<NvDecoder> decoder;
     int64_t n = 0;
+    uint32_t timeoutMs = 0;
+
+    MemoryAccount memory;
+    uint64_t sessionBytes = 0;
 
+    CachingAllocator* pool = nullptr;
+    CachingAllocator* hostPool = nullptr;
     void* deviceBuffer = nullptr;
     uint64_t deviceBufferSize = 0;
 
+    std::mutex latestMutex;
+    std::unique_ptr<Frame> latestFrame;
+    uint32_t latestWidth = 0;
+    uint32_t latestHeight = 0;
+
+    std::shared_ptr<StreamMetrics> metrics;
+
 #ifdef NVPIPE_WITH_OPENGL
     GraphicsResourceRegistry registry;
 #endif
+
+public:
+    StreamMetrics& getMetrics()
+    {
+        return *this->metrics;
+    }
+
+    std::atomic<uint64_t> framesDecoded{0};
+    std::atomic<uint64_t> framesDelivered{0};
+    std::atomic<uint64_t> framesDropped{0};
+    std::atomic<uint64_t> framesTimedOut{0};
 };
 
 #endif
@@ -946,201 +2414,595 @@ struct Instance
 {
 #ifdef NVPIPE_WITH_ENCODER
     std::unique_ptr<Encoder> encoder;
+    std::unique_ptr<EncoderMailbox> mailbox; // destroyed before the encoder
 #endif
 
 #ifdef NVPIPE_WITH_DECODER
     std::unique_ptr<Decoder> decoder;
 #endif
 
+    std::unique_ptr<Recorder> recorder;
+
+    // Errors may be reported on different threads, e.g., by QueueDecode and FetchLatestFrame or by recorder streams
+    std::mutex errorMutex;
     std::string error;
+    NvPipe_Status status = NVPIPE_SUCCESS;
 };
 
-std::string sharedError; // shared error code for create functions (NOT threadsafe)
-
+/**
+ * @brief Reports the error of a call on an instance.
+ */
+void setError(Instance* instance, const std::string& error, NvPipe_Status status = NVPIPE_ERROR)
+{
+    std::lock_guard<std::mutex> lock(instance->errorMutex);
+    instance->error = error;
+    instance->status = status;
+}
 
 #ifdef NVPIPE_WITH_ENCODER
+/**
+ * @brief Keeps the mailbox worker, if any, from encoding while settings of the encoder change.
+ */
+std::unique_lock<std::mutex> lockEncoder(Instance* instance)
+{
+    return instance->mailbox ? instance->mailbox->lockEncoder() : std::unique_lock<std::mutex>();
+}
+#endif
 
-NVPIPE_EXPORT NvPipe* NvPipe_CreateEncoder(NvPipe_Format format, NvPipe_Codec codec, NvPipe_Compression compression, uint64_t bitrate, uint32_t targetFrameRate)
+// Error of calls without an instance (create functions, metrics server, ...), which may come from any thread
+std::mutex sharedErrorMutex;
+std::string sharedError;
+NvPipe_Status sharedStatus = NVPIPE_SUCCESS;
+
+void setSharedError(const std::string& error)
 {
-    Instance* instance = new Instance();
+    std::lock_guard<std::mutex> lock(sharedErrorMutex);
+    sharedError = error;
+    sharedStatus = NVPIPE_ERROR;
+}
 
-    try
-    {
+WorkerPool& getBatchPool()
+{
+    // Batch jobs mostly wait for uploads and codec sessions, so a few workers overlap sessions even on small machines
+    static WorkerPool pool(std::max(4u, std::thread::hardware_concurrency()) - 1);
+    return pool;
+}
+
+/**
+ * @brief Runs a batch of jobs on the worker pool, jobs of the same instance sequentially in array order.
+ */
+template<typename Job, typename Function>
+uint32_t runBatch(Job* jobs, uint32_t count, Function execute)
+{
+    if (!jobs || count == 0)
+        return 0;
+
+    std::vector<std::vector<uint32_t>> groups;
+    std::unordered_map<NvPipe*, size_t> groupOfInstance;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        auto it = groupOfInstance.emplace(jobs[i].nvp, groups.size()).first;
+        if (it->second == groups.size())
+            groups.emplace_back();
+
+        groups[it->second].push_back(i);
+    }
+
+    // Workers run in the context of the calling thread, which need not be the primary context of the device
+    CUcontext context = nullptr;
+    cuCtxGetCurrent(&context);
+
+    getBatchPool().run((uint32_t) groups.size(), [&](uint32_t g)
+    {
+        cuCtxSetCurrent(context);
+
+        for (uint32_t i : groups[g])
+            execute(jobs[i]);
+    });
+
+    uint32_t succeeded = 0;
+    for (uint32_t i = 0; i < count; ++i)
+        if (jobs[i].status == NVPIPE_SUCCESS)
+            ++succeeded;
+
+    return succeeded;
+}
+
+
+/**
+ * @brief Records C API calls with arguments, timings and optional payloads into a binary trace (see Trace.h).
+ */
+class TraceRecorder
+{
+public:
+    ~TraceRecorder()
+    {
+        this->stop();
+    }
+
+    void start(const std::string& path, bool includePayloads)
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->close();
+
+        this->file = fopen(path.c_str(), "wb");
+        if (!this->file)
+            throw Exception("Failed to open trace file " + path);
+
+        TraceHeader header;
+        memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+        header.version = TRACE_VERSION;
+        header.includesPayloads = includePayloads;
+        fwrite(&header, sizeof(header), 1, this->file);
+
+        this->payloads = includePayloads;
+        this->startTime = std::chrono::steady_clock::now();
+        this->active = true;
+    }
+
+    void stop()
+    {
+        this->active = false;
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->close();
+    }
+
+    bool isActive() const
+    {
+        return this->active.load(std::memory_order_relaxed);
+    }
+
+    bool includesPayloads() const
+    {
+        return this->payloads;
+    }
+
+    uint64_t getTimestamp(std::chrono::steady_clock::time_point time) const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time - this->startTime).count();
+    }
+
+    void write(TraceRecord& record, const std::vector<uint8_t>& payload)
+    {
+        // Compress outside the lock, keep raw data if it does not shrink
+        std::vector<uint8_t> compressed;
+        if (!payload.empty())
+            traceCompress(payload.data(), payload.size(), compressed);
+
+        const bool rle = !payload.empty() && compressed.size() < payload.size();
+        const std::vector<uint8_t>& stored = rle ? compressed : payload;
+
+        record.payloadType = (uint32_t) (payload.empty() ? TracePayload::None : (rle ? TracePayload::RLE : TracePayload::Raw));
+        record.payloadSize = stored.size();
+        record.payloadRawSize = payload.size();
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (!this->file)
+            return;
+
+        fwrite(&record, sizeof(record), 1, this->file);
+        if (!stored.empty())
+            fwrite(stored.data(), 1, stored.size(), this->file);
+    }
+
+private:
+    void close()
+    {
+        if (this->file)
+            fclose(this->file);
+        this->file = nullptr;
+    }
+
+private:
+    std::mutex mutex;
+    FILE* file = nullptr;
+    std::atomic<bool> active{false};
+    bool payloads = false;
+    std::chrono::steady_clock::time_point startTime;
+};
+
+TraceRecorder traceRecorder;
+
+
+/**
+ * @brief Traces a single C API call. Does nothing unless tracing is active.
+ */
+class TraceScope
+{
+public:
+    TraceScope(TraceOp op, NvPipe* nvp, std::initializer_list<uint64_t> args = {}) : active(traceRecorder.isActive())
+    {
+        if (!this->active)
+            return;
+
+        memset(&this->record, 0, sizeof(this->record));
+        this->record.op = (uint32_t) op;
+        this->record.instance = (uint64_t) (uintptr_t) nvp;
+
+        uint32_t i = 0;
+        for (uint64_t a : args)
+            this->record.args[i++] = a;
+
+        this->start = std::chrono::steady_clock::now();
+    }
+
+    ~TraceScope()
+    {
+        if (!this->active)
+            return;
+
+        const auto end = std::chrono::steady_clock::now();
+        this->record.timestampNs = traceRecorder.getTimestamp(this->start);
+        this->record.durationNs = std::chrono::duration_cast<std::chrono::nanoseconds>(end - this->start).count();
+
+        traceRecorder.write(this->record, this->payload);
+    }
+
+    /**
+     * @brief Captures a (pitched) host or device buffer if payloads are recorded. Not included in the call duration.
+     */
+    void setPayload(const void* src, uint64_t srcPitch, uint64_t rowSize, uint64_t rows)
+    {
+        if (!this->active || !traceRecorder.includesPayloads() || !src)
+            return;
+
+        this->payload.resize(rowSize * rows);
+        if (cudaSuccess != cudaMemcpy2D(this->payload.data(), rowSize, src, srcPitch, rowSize, rows, isDevicePointer(src) ? cudaMemcpyDeviceToHost : cudaMemcpyHostToHost))
+            this->payload.clear();
+
+        this->start = std::chrono::steady_clock::now();
+    }
+
+    void setFormat(NvPipe_Format format)
+    {
+        this->record.args[5] = format;
+    }
+
+    /**
+     * @brief Records whether a buffer is in device memory. The pointer query only runs while tracing.
+     */
+    void setDevicePointer(uint32_t arg, const void* ptr)
+    {
+        if (this->active)
+            this->record.args[arg] = isDevicePointer(ptr);
+    }
+
+    void setInstance(NvPipe* nvp)
+    {
+        this->record.instance = (uint64_t) (uintptr_t) nvp;
+    }
+
+    template<typename T>
+    T result(T value)
+    {
+        this->record.result = (uint64_t) value;
+        return value;
+    }
+
+private:
+    bool active;
+    TraceRecord record;
+    std::vector<uint8_t> payload;
+    std::chrono::steady_clock::time_point start;
+};
+
+
+NVPIPE_EXPORT bool NvPipe_StartTrace(const char* path, bool includePayloads)
+{
+    try
+    {
+        traceRecorder.start(path, includePayloads);
+    }
+    catch (Exception& e)
+    {
+        setSharedError(e.getErrorString());
+        return false;
+    }
+
+    return true;
+}
+
+NVPIPE_EXPORT void NvPipe_StopTrace()
+{
+    traceRecorder.stop();
+}
+
+
+#ifdef NVPIPE_WITH_ENCODER
+
+NVPIPE_EXPORT NvPipe* NvPipe_CreateEncoder(NvPipe_Format format, NvPipe_Codec codec, NvPipe_Compression compression, uint64_t bitrate, uint32_t targetFrameRate)
+{
+    TraceScope trace(TraceOp::CreateEncoder, nullptr, { (uint64_t) format, (uint64_t) codec, (uint64_t) compression, bitrate, targetFrameRate });
+
+    Instance* instance = new Instance();
+
+    try
+    {
         instance->encoder = std::unique_ptr<Encoder>(new Encoder(format, codec, compression, bitrate, targetFrameRate));
     }
     catch (Exception& e)
     {
-        sharedError = e.getErrorString();
+        setSharedError(e.getErrorString());
         delete instance;
         return nullptr;
     }
 
-    return instance;
+    trace.setInstance(instance);
+    return trace.result(instance);
 }
 
 NVPIPE_EXPORT void NvPipe_SetBitrate(NvPipe* nvp, uint64_t bitrate, uint32_t targetFrameRate)
 {
+    TraceScope trace(TraceOp::SetBitrate, nvp, { bitrate, targetFrameRate });
+
     Instance* instance = static_cast<Instance*>(nvp);
     if (!instance->encoder)
     {
-        instance->error = "Invalid NvPipe encoder.";
+        setError(instance, "Invalid NvPipe encoder.");
         return;
     }
 
     try
     {
+        std::unique_lock<std::mutex> lock = lockEncoder(instance);
         return instance->encoder->setBitrate(bitrate, targetFrameRate);
     }
     catch (Exception& e)
     {
-        instance->error = e.getErrorString();
+        setError(instance, e.getErrorString(), e.isTimeout() ? NVPIPE_TIMEOUT : NVPIPE_ERROR);
     }
 }
 
-NVPIPE_EXPORT uint64_t NvPipe_Encode(NvPipe* nvp, const void* src, uint64_t srcPitch, uint8_t* dst, uint64_t dstSize, uint32_t width, uint32_t height, bool forceIFrame)
+NVPIPE_EXPORT bool NvPipe_SetDenoise(NvPipe* nvp, float strength)
 {
+    TraceScope trace(TraceOp::SetDenoise, nvp, { (uint64_t) (std::min(std::max(strength, 0.0f), 1.0f) * 1000.0f + 0.5f) });
+
     Instance* instance = static_cast<Instance*>(nvp);
     if (!instance->encoder)
     {
-        instance->error = "Invalid NvPipe encoder.";
-        return 0;
+        setError(instance, "Invalid NvPipe encoder.");
+        return false;
     }
 
     try
     {
-        return instance->encoder->encode(src, srcPitch, dst, dstSize, width, height, forceIFrame);
+        // The mailbox worker uses the denoiser in Encoder::upload
+        std::unique_lock<std::mutex> lock = lockEncoder(instance);
+        instance->encoder->setDenoise(strength);
+        return true;
     }
     catch (Exception& e)
     {
-        instance->error = e.getErrorString();
-        return 0;
+        setError(instance, e.getErrorString());
+        return false;
     }
 }
 
-#ifdef NVPIPE_WITH_OPENGL
+static void encodeJob(NvPipe_EncodeJob& job)
+{
+    TraceScope trace(TraceOp::Encode, job.nvp, { job.srcPitch, job.dstSize, job.width, job.height, job.forceIFrame });
+    trace.setDevicePointer(6, job.src);
 
-NVPIPE_EXPORT uint64_t NvPipe_EncodeTexture(NvPipe* nvp, uint32_t texture, uint32_t target, uint8_t* dst, uint64_t dstSize, uint32_t width, uint32_t height, bool forceIFrame)
+    job.size = 0;
+
+    Instance* instance = static_cast<Instance*>(job.nvp);
+    if (!instance || !instance->encoder)
+    {
+        if (instance)
+            setError(instance, "Invalid NvPipe encoder.");
+        job.status = NVPIPE_ERROR;
+        return;
+    }
+
+    trace.setFormat(instance->encoder->getFormat());
+    trace.setPayload(job.src, job.srcPitch, getFrameSize(instance->encoder->getFormat(), job.width, 1), job.height);
+
+    try
+    {
+        job.size = trace.result(instance->encoder->encode(job.src, job.srcPitch, job.dst, job.dstSize, job.width, job.height, job.forceIFrame));
+        job.status = NVPIPE_SUCCESS;
+    }
+    catch (Exception& e)
+    {
+        job.status = e.isTimeout() ? NVPIPE_TIMEOUT : NVPIPE_ERROR;
+        setError(instance, e.getErrorString(), job.status);
+    }
+}
+
+NVPIPE_EXPORT uint64_t NvPipe_Encode(NvPipe* nvp, const void* src, uint64_t srcPitch, uint8_t* dst, uint64_t dstSize, uint32_t width, uint32_t height, bool forceIFrame)
+{
+    NvPipe_EncodeJob job = { nvp, src, srcPitch, dst, dstSize, width, height, forceIFrame, 0, NVPIPE_SUCCESS };
+    encodeJob(job);
+
+    return job.size;
+}
+
+NVPIPE_EXPORT uint32_t NvPipe_EncodeBatch(NvPipe_EncodeJob* jobs, uint32_t count)
+{
+    return runBatch(jobs, count, encodeJob);
+}
+
+NVPIPE_EXPORT uint64_t NvPipe_EncodeTimestamped(NvPipe* nvp, const void* src, uint64_t srcPitch, uint8_t* dst, uint64_t dstSize, uint32_t width, uint32_t height, uint64_t timestampUs, bool forceIFrame)
 {
+    TraceScope trace(TraceOp::EncodeTimestamped, nvp, { srcPitch, dstSize, width, height, forceIFrame, 0, timestampUs });
+
     Instance* instance = static_cast<Instance*>(nvp);
     if (!instance->encoder)
     {
-        instance->error = "Invalid NvPipe encoder.";
+        setError(instance, "Invalid NvPipe encoder.");
         return 0;
     }
 
+    trace.setFormat(instance->encoder->getFormat());
+    trace.setPayload(src, srcPitch, getFrameSize(instance->encoder->getFormat(), width, 1), height);
+
     try
     {
-        return instance->encoder->encodeTexture(texture, target, dst, dstSize, width, height, forceIFrame);
+        return trace.result(instance->encoder->encodeTimestamped(src, srcPitch, dst, dstSize, width, height, timestampUs, forceIFrame));
     }
     catch (Exception& e)
     {
-        instance->error = e.getErrorString();
+        setError(instance, e.getErrorString(), e.isTimeout() ? NVPIPE_TIMEOUT : NVPIPE_ERROR);
         return 0;
     }
 }
 
-NVPIPE_EXPORT uint64_t NvPipe_EncodePBO(NvPipe* nvp, uint32_t pbo, uint8_t* dst, uint64_t dstSize, uint32_t width, uint32_t height, bool forceIFrame)
+NVPIPE_EXPORT uint64_t NvPipe_EncodeVolume(NvPipe* nvp, const void* src, uint64_t rowPitch, uint64_t slicePitch, const NvPipe_Volume* volume, uint8_t* dst, uint64_t dstSize)
 {
+    TraceScope trace(TraceOp::EncodeVolume, nvp, { rowPitch, slicePitch, dstSize, volume ? volume->width : 0u, volume ? volume->height : 0u, volume ? volume->depth : 0u, volume ? (uint64_t) volume->axis : 0u });
+
     Instance* instance = static_cast<Instance*>(nvp);
     if (!instance->encoder)
     {
-        instance->error = "Invalid NvPipe encoder.";
+        setError(instance, "Invalid NvPipe encoder.");
+        return 0;
+    }
+
+    if (!volume)
+    {
+        setError(instance, "Invalid volume description.");
         return 0;
     }
 
     try
     {
-        return instance->encoder->encodePBO(pbo, dst, dstSize, width, height, forceIFrame);
+        return trace.result(instance->encoder->encodeVolume(src, rowPitch, slicePitch, *volume, dst, dstSize));
     }
     catch (Exception& e)
     {
-        instance->error = e.getErrorString();
+        setError(instance, e.getErrorString(), e.isTimeout() ? NVPIPE_TIMEOUT : NVPIPE_ERROR);
         return 0;
     }
 }
 
-#endif
+NVPIPE_EXPORT uint64_t NvPipe_EncodeFrame(NvPipe* nvp, const NvPipe_Frame* frame, uint8_t* dst, uint64_t dstSize, bool forceIFrame)
+{
+    TraceScope trace(TraceOp::EncodeFrame, nvp, { dstSize, frame ? static_cast<const Frame*>(frame)->width : 0u, frame ? static_cast<const Frame*>(frame)->height : 0u, forceIFrame });
 
-#endif
+    Instance* instance = static_cast<Instance*>(nvp);
+    if (!instance->encoder)
+    {
+        setError(instance, "Invalid NvPipe encoder.");
+        return 0;
+    }
 
-#ifdef NVPIPE_WITH_DECODER
+    if (!frame)
+    {
+        setError(instance, "Invalid NvPipe frame.");
+        return 0;
+    }
 
-NVPIPE_EXPORT NvPipe* NvPipe_CreateDecoder(NvPipe_Format format, NvPipe_Codec codec)
+    try
+    {
+        return trace.result(instance->encoder->encode(static_cast<const Frame*>(frame), dst, dstSize, forceIFrame));
+    }
+    catch (Exception& e)
+    {
+        setError(instance, e.getErrorString(), e.isTimeout() ? NVPIPE_TIMEOUT : NVPIPE_ERROR);
+        return 0;
+    }
+}
+
+NVPIPE_EXPORT bool NvPipe_StartMailbox(NvPipe* nvp, NvPipe_PacketCallback callback, void* userData)
 {
-    Instance* instance = new Instance();
+    Instance* instance = static_cast<Instance*>(nvp);
+    if (!instance->encoder)
+    {
+        setError(instance, "Invalid NvPipe encoder.");
+        return false;
+    }
 
     try
     {
-        instance->decoder = std::unique_ptr<Decoder>(new Decoder(format, codec));
+        instance->mailbox.reset();
+        instance->mailbox = std::unique_ptr<EncoderMailbox>(new EncoderMailbox(instance->encoder.get(), callback, userData));
     }
-    catch (Exception& e)
+    catch (std::exception& e)
     {
-        sharedError = e.getErrorString();
-        delete instance;
-        return nullptr;
+        // E.g., std::system_error if the worker thread cannot be started
+        setError(instance, e.what());
+        return false;
     }
 
-    return instance;
+    return true;
 }
 
-NVPIPE_EXPORT uint64_t NvPipe_Decode(NvPipe* nvp, const uint8_t* src, uint64_t srcSize, void* dst, uint32_t width, uint32_t height)
+NVPIPE_EXPORT bool NvPipe_PostFrame(NvPipe* nvp, const void* src, uint64_t srcPitch, uint32_t width, uint32_t height, bool forceIFrame)
 {
+    TraceScope trace(TraceOp::PostFrame, nvp, { srcPitch, 0, width, height, forceIFrame });
+    trace.setDevicePointer(6, src);
+
     Instance* instance = static_cast<Instance*>(nvp);
-    if (!instance->decoder)
+    if (!instance->mailbox)
     {
-        instance->error = "Invalid NvPipe decoder.";
-        return 0;
+        setError(instance, "NvPipe encoder mailbox not started.");
+        return false;
     }
 
+    trace.setFormat(instance->encoder->getFormat());
+    trace.setPayload(src, srcPitch, getFrameSize(instance->encoder->getFormat(), width, 1), height);
+
     try
     {
-        return instance->decoder->decode(src, srcSize, dst, width, height);
+        instance->mailbox->post(src, srcPitch, width, height, forceIFrame);
+        return trace.result(true);
     }
     catch (Exception& e)
     {
-        instance->error = e.getErrorString();
-        return 0;
+        setError(instance, e.getErrorString(), e.isTimeout() ? NVPIPE_TIMEOUT : NVPIPE_ERROR);
+        return false;
     }
 }
 
+NVPIPE_EXPORT void NvPipe_StopMailbox(NvPipe* nvp)
+{
+    Instance* instance = static_cast<Instance*>(nvp);
+    instance->mailbox.reset();
+}
+
 #ifdef NVPIPE_WITH_OPENGL
 
-NVPIPE_EXPORT uint64_t NvPipe_DecodeTexture(NvPipe* nvp, const uint8_t* src, uint64_t srcSize, uint32_t texture, uint32_t target, uint32_t width, uint32_t height)
+NVPIPE_EXPORT uint64_t NvPipe_EncodeTexture(NvPipe* nvp, uint32_t texture, uint32_t target, uint8_t* dst, uint64_t dstSize, uint32_t width, uint32_t height, bool forceIFrame)
 {
+    TraceScope trace(TraceOp::EncodeTexture, nvp, { texture, target, dstSize, width, height, forceIFrame });
+
     Instance* instance = static_cast<Instance*>(nvp);
-    if (!instance->decoder)
+    if (!instance->encoder)
     {
-        instance->error = "Invalid NvPipe decoder.";
+        setError(instance, "Invalid NvPipe encoder.");
         return 0;
     }
 
     try
     {
-        return instance->decoder->decodeTexture(src, srcSize, texture, target, width, height);
+        return trace.result(instance->encoder->encodeTexture(texture, target, dst, dstSize, width, height, forceIFrame));
     }
     catch (Exception& e)
     {
-        instance->error = e.getErrorString();
+        setError(instance, e.getErrorString(), e.isTimeout() ? NVPIPE_TIMEOUT : NVPIPE_ERROR);
         return 0;
     }
 }
 
-NVPIPE_EXPORT uint64_t NvPipe_DecodePBO(NvPipe* nvp, const uint8_t* src, uint64_t srcSize, uint32_t pbo, uint32_t width, uint32_t height)
+NVPIPE_EXPORT uint64_t NvPipe_EncodePBO(NvPipe* nvp, uint32_t pbo, uint8_t* dst, uint64_t dstSize, uint32_t width, uint32_t height, bool forceIFrame)
 {
+    TraceScope trace(TraceOp::EncodePBO, nvp, { pbo, dstSize, width, height, forceIFrame });
+
     Instance* instance = static_cast<Instance*>(nvp);
-    if (!instance->decoder)
+    if (!instance->encoder)
     {
-        instance->error = "Invalid NvPipe decoder.";
+        setError(instance, "Invalid NvPipe encoder.");
         return 0;
     }
 
     try
     {
-        return instance->decoder->decodePBO(src, srcSize, pbo, width, height);
+        return trace.result(instance->encoder->encodePBO(pbo, dst, dstSize, width, height, forceIFrame));
     }
     catch (Exception& e)
     {
-        instance->error = e.getErrorString();
+        setError(instance, e.getErrorString(), e.isTimeout() ? NVPIPE_TIMEOUT : NVPIPE_ERROR);
         return 0;
     }
 }
@@ -1149,19 +3011,885 @@ NVPIPE_EXPORT uint64_t NvPipe_DecodePBO(NvPipe* nvp, const uint8_t* src, uint64_
 
 #endif
 
-NVPIPE_EXPORT void NvPipe_Destroy(NvPipe* nvp)
+#ifdef NVPIPE_WITH_DECODER
+
+NVPIPE_EXPORT NvPipe* NvPipe_CreateDecoder(NvPipe_Format format, NvPipe_Codec codec)
 {
-    Instance* instance = static_cast<Instance*>(nvp);
-    delete instance;
+    TraceScope trace(TraceOp::CreateDecoder, nullptr, { (uint64_t) format, (uint64_t) codec });
+
+    Instance* instance = new Instance();
+
+    try
+    {
+        instance->decoder = std::unique_ptr<Decoder>(new Decoder(format, codec));
+    }
+    catch (Exception& e)
+    {
+        setSharedError(e.getErrorString());
+        delete instance;
+        return nullptr;
+    }
+
+    trace.setInstance(instance);
+    return trace.result(instance);
 }
 
-NVPIPE_EXPORT const char* NvPipe_GetError(NvPipe* nvp)
+static void decodeJob(NvPipe_DecodeJob& job)
 {
-    if (nullptr == nvp)
-        return sharedError.c_str();
+    TraceScope trace(TraceOp::Decode, job.nvp, { job.width, job.height });
+    trace.setDevicePointer(2, job.dst);
+    trace.setPayload(job.src, job.srcSize, job.srcSize, 1);
+
+    job.size = 0;
+
+    Instance* instance = static_cast<Instance*>(job.nvp);
+    if (!instance || !instance->decoder)
+    {
+        if (instance)
+            setError(instance, "Invalid NvPipe decoder.");
+        job.status = NVPIPE_ERROR;
+        return;
+    }
+
+    try
+    {
+        job.size = trace.result(instance->decoder->decode(job.src, job.srcSize, job.dst, job.width, job.height));
+        job.status = NVPIPE_SUCCESS;
+    }
+    catch (Exception& e)
+    {
+        job.status = e.isTimeout() ? NVPIPE_TIMEOUT : NVPIPE_ERROR;
+        setError(instance, e.getErrorString(), job.status);
+    }
+}
+
+NVPIPE_EXPORT uint64_t NvPipe_Decode(NvPipe* nvp, const uint8_t* src, uint64_t srcSize, void* dst, uint32_t width, uint32_t height)
+{
+    NvPipe_DecodeJob job = { nvp, src, srcSize, dst, width, height, 0, NVPIPE_SUCCESS };
+    decodeJob(job);
+
+    return job.size;
+}
+
+NVPIPE_EXPORT uint32_t NvPipe_DecodeBatch(NvPipe_DecodeJob* jobs, uint32_t count)
+{
+    return runBatch(jobs, count, decodeJob);
+}
+
+static uint64_t decodeVolume(NvPipe* nvp, TraceScope& trace, const uint8_t* src, uint64_t srcSize, int64_t brick, void* dst, uint64_t rowPitch, uint64_t slicePitch)
+{
+    Instance* instance = static_cast<Instance*>(nvp);
+    if (!instance->decoder)
+    {
+        setError(instance, "Invalid NvPipe decoder.");
+        return 0;
+    }
+
+    try
+    {
+        return trace.result(instance->decoder->decodeVolume(src, srcSize, dst, rowPitch, slicePitch, brick));
+    }
+    catch (Exception& e)
+    {
+        setError(instance, e.getErrorString(), e.isTimeout() ? NVPIPE_TIMEOUT : NVPIPE_ERROR);
+        return 0;
+    }
+}
+
+NVPIPE_EXPORT uint64_t NvPipe_DecodeVolume(NvPipe* nvp, const uint8_t* src, uint64_t srcSize, void* dst, uint64_t rowPitch, uint64_t slicePitch)
+{
+    TraceScope trace(TraceOp::DecodeVolume, nvp, { srcSize, rowPitch, slicePitch, UINT64_MAX });
+
+    return decodeVolume(nvp, trace, src, srcSize, -1, dst, rowPitch, slicePitch);
+}
+
+NVPIPE_EXPORT uint64_t NvPipe_DecodeVolumeBrick(NvPipe* nvp, const uint8_t* src, uint64_t srcSize, uint32_t brick, void* dst, uint64_t rowPitch, uint64_t slicePitch)
+{
+    TraceScope trace(TraceOp::DecodeVolume, nvp, { srcSize, rowPitch, slicePitch, brick });
+
+    return decodeVolume(nvp, trace, src, srcSize, brick, dst, rowPitch, slicePitch);
+}
+
+NVPIPE_EXPORT NvPipe_Frame* NvPipe_DecodeFrame(NvPipe* nvp, const uint8_t* src, uint64_t srcSize, uint32_t width, uint32_t height)
+{
+    TraceScope trace(TraceOp::DecodeFrame, nvp, { width, height });
+    trace.setPayload(src, srcSize, srcSize, 1);
+
+    Instance* instance = static_cast<Instance*>(nvp);
+    if (!instance->decoder)
+    {
+        setError(instance, "Invalid NvPipe decoder.");
+        return nullptr;
+    }
+
+    try
+    {
+        return trace.result(instance->decoder->decodeFrame(src, srcSize, width, height));
+    }
+    catch (Exception& e)
+    {
+        setError(instance, e.getErrorString(), e.isTimeout() ? NVPIPE_TIMEOUT : NVPIPE_ERROR);
+        return nullptr;
+    }
+}
+
+NVPIPE_EXPORT bool NvPipe_QueueDecode(NvPipe* nvp, const uint8_t* src, uint64_t srcSize, uint32_t width, uint32_t height)
+{
+    TraceScope trace(TraceOp::QueueDecode, nvp, { width, height });
+    trace.setPayload(src, srcSize, srcSize, 1);
+
+    Instance* instance = static_cast<Instance*>(nvp);
+    if (!instance->decoder)
+    {
+        setError(instance, "Invalid NvPipe decoder.");
+        return false;
+    }
+
+    try
+    {
+        instance->decoder->queueDecode(src, srcSize, width, height);
+        return trace.result(true);
+    }
+    catch (Exception& e)
+    {
+        setError(instance, e.getErrorString(), e.isTimeout() ? NVPIPE_TIMEOUT : NVPIPE_ERROR);
+        return false;
+    }
+}
+
+NVPIPE_EXPORT uint64_t NvPipe_FetchLatestFrame(NvPipe* nvp, void* dst)
+{
+    TraceScope trace(TraceOp::FetchLatestFrame, nvp);
+    trace.setDevicePointer(0, dst);
+
+    Instance* instance = static_cast<Instance*>(nvp);
+    if (!instance->decoder)
+    {
+        setError(instance, "Invalid NvPipe decoder.");
+        return 0;
+    }
+
+    try
+    {
+        return trace.result(instance->decoder->fetchLatestFrame(dst));
+    }
+    catch (Exception& e)
+    {
+        setError(instance, e.getErrorString(), e.isTimeout() ? NVPIPE_TIMEOUT : NVPIPE_ERROR);
+        return 0;
+    }
+}
+
+#ifdef NVPIPE_WITH_OPENGL
+
+NVPIPE_EXPORT uint64_t NvPipe_DecodeTexture(NvPipe* nvp, const uint8_t* src, uint64_t srcSize, uint32_t texture, uint32_t target, uint32_t width, uint32_t height)
+{
+    TraceScope trace(TraceOp::DecodeTexture, nvp, { width, height, texture, target });
+    trace.setPayload(src, srcSize, srcSize, 1);
+
+    Instance* instance = static_cast<Instance*>(nvp);
+    if (!instance->decoder)
+    {
+        setError(instance, "Invalid NvPipe decoder.");
+        return 0;
+    }
+
+    try
+    {
+        return trace.result(instance->decoder->decodeTexture(src, srcSize, texture, target, width, height));
+    }
+    catch (Exception& e)
+    {
+        setError(instance, e.getErrorString(), e.isTimeout() ? NVPIPE_TIMEOUT : NVPIPE_ERROR);
+        return 0;
+    }
+}
+
+NVPIPE_EXPORT uint64_t NvPipe_DecodePBO(NvPipe* nvp, const uint8_t* src, uint64_t srcSize, uint32_t pbo, uint32_t width, uint32_t height)
+{
+    TraceScope trace(TraceOp::DecodePBO, nvp, { width, height, pbo });
+    trace.setPayload(src, srcSize, srcSize, 1);
+
+    Instance* instance = static_cast<Instance*>(nvp);
+    if (!instance->decoder)
+    {
+        setError(instance, "Invalid NvPipe decoder.");
+        return 0;
+    }
+
+    try
+    {
+        return trace.result(instance->decoder->decodePBO(src, srcSize, pbo, width, height));
+    }
+    catch (Exception& e)
+    {
+        setError(instance, e.getErrorString(), e.isTimeout() ? NVPIPE_TIMEOUT : NVPIPE_ERROR);
+        return 0;
+    }
+}
+
+#endif
+
+#endif
+
+NVPIPE_EXPORT NvPipe_Frame* NvPipe_WrapFrame(void* nv12, uint64_t pitch, uint32_t width, uint32_t height)
+{
+    return new Frame(isDevicePointer(nv12) ? Frame::Memory::Device : Frame::Memory::Host, (uint8_t*) nv12, pitch, width, height);
+}
+
+NVPIPE_EXPORT void NvPipe_GetFrameSize(const NvPipe_Frame* frame, uint32_t* width, uint32_t* height)
+{
+    const Frame* f = static_cast<const Frame*>(frame);
+    *width = f->width;
+    *height = f->height;
+}
+
+NVPIPE_EXPORT void NvPipe_ReleaseFrame(NvPipe_Frame* frame)
+{
+    delete static_cast<Frame*>(frame);
+}
+
+NVPIPE_EXPORT void NvPipe_SetTimeout(NvPipe* nvp, uint32_t milliseconds)
+{
+    TraceScope trace(TraceOp::SetTimeout, nvp, { milliseconds });
+
+    Instance* instance = static_cast<Instance*>(nvp);
+
+#ifdef NVPIPE_WITH_ENCODER
+    if (instance->encoder)
+    {
+        std::unique_lock<std::mutex> lock = lockEncoder(instance);
+        instance->encoder->setTimeout(milliseconds);
+    }
+#endif
+
+#ifdef NVPIPE_WITH_DECODER
+    if (instance->decoder)
+        instance->decoder->setTimeout(milliseconds);
+#endif
+}
+
+NVPIPE_EXPORT NvPipe_Status NvPipe_GetLastStatus(NvPipe* nvp)
+{
+    if (nullptr == nvp)
+    {
+        std::lock_guard<std::mutex> lock(sharedErrorMutex);
+        return sharedStatus;
+    }
+
+    Instance* instance = static_cast<Instance*>(nvp);
+    std::lock_guard<std::mutex> lock(instance->errorMutex);
+    return instance->status;
+}
+
+NVPIPE_EXPORT void NvPipe_GetMemoryUsage(NvPipe* nvp, NvPipe_MemoryUsage* usage)
+{
+    memset(usage, 0, sizeof(NvPipe_MemoryUsage));
+
+    const MemoryAccount* account = nullptr;
+    if (nullptr == nvp)
+    {
+        account = &MemoryAccount::getTotal();
+    }
+    else
+    {
+        Instance* instance = static_cast<Instance*>(nvp);
+
+#ifdef NVPIPE_WITH_ENCODER
+        if (instance->encoder)
+            account = &instance->encoder->getMemory(); // includes the mailbox
+#endif
+
+#ifdef NVPIPE_WITH_DECODER
+        if (instance->decoder)
+            account = &instance->decoder->getMemory();
+#endif
+    }
+
+    if (account)
+    {
+        usage->deviceBytes = account->device.current;
+        usage->peakDeviceBytes = account->device.peak;
+        usage->hostBytes = account->host.current;
+        usage->peakHostBytes = account->host.peak;
+    }
+}
+
+NVPIPE_EXPORT uint64_t NvPipe_Trim(NvPipe* nvp)
+{
+    if (nullptr == nvp)
+        return DeviceMemoryPools::instance().release() + HostMemoryPools::instance().release();
+
+    Instance* instance = static_cast<Instance*>(nvp);
+    uint64_t released = 0;
+
+#ifdef NVPIPE_WITH_ENCODER
+    if (instance->mailbox)
+    {
+        released += instance->mailbox->trim();
+
+        // The worker may be uploading into the buffers released by the encoder
+        std::unique_lock<std::mutex> lock = instance->mailbox->lockEncoder();
+        released += instance->encoder->trim();
+    }
+    else if (instance->encoder)
+    {
+        released += instance->encoder->trim();
+    }
+#endif
+
+#ifdef NVPIPE_WITH_DECODER
+    if (instance->decoder)
+        released += instance->decoder->trim();
+#endif
+
+    return released;
+}
+
+NVPIPE_EXPORT void NvPipe_GetPoolStatistics(NvPipe_PoolStatistics* statistics)
+{
+    const PoolStatistics s = DeviceMemoryPools::instance().getStatistics();
+
+    statistics->allocations = s.allocations;
+    statistics->hits = s.hits;
+    statistics->evictions = s.evictions;
+    statistics->liveBytes = s.liveBytes;
+    statistics->cachedBytes = s.cachedBytes;
+    statistics->hitRate = s.getHitRate();
+}
+
+NVPIPE_EXPORT void NvPipe_GetStatistics(NvPipe* nvp, NvPipe_Statistics* statistics)
+{
+    Instance* instance = static_cast<Instance*>(nvp);
+    memset(statistics, 0, sizeof(NvPipe_Statistics));
+
+#ifdef NVPIPE_WITH_ENCODER
+    if (instance->encoder)
+    {
+        statistics->framesEncoded = instance->encoder->framesEncoded;
+        statistics->framesTimedOut = instance->encoder->framesTimedOut;
+    }
+
+    if (instance->mailbox)
+    {
+        statistics->framesDropped = instance->mailbox->framesDropped;
+        statistics->framesLate = instance->mailbox->framesLate;
+    }
+#endif
+
+#ifdef NVPIPE_WITH_DECODER
+    if (instance->decoder)
+    {
+        statistics->framesDecoded = instance->decoder->framesDecoded;
+        statistics->framesDelivered = instance->decoder->framesDelivered;
+        statistics->framesDropped = instance->decoder->framesDropped;
+        statistics->framesTimedOut = instance->decoder->framesTimedOut;
+    }
+#endif
+}
+
+NVPIPE_EXPORT void NvPipe_SetStreamName(NvPipe* nvp, const char* name)
+{
+    Instance* instance = static_cast<Instance*>(nvp);
+
+#ifdef NVPIPE_WITH_ENCODER
+    if (instance->encoder)
+        instance->encoder->getMetrics().setName(name);
+#endif
+
+#ifdef NVPIPE_WITH_DECODER
+    if (instance->decoder)
+        instance->decoder->getMetrics().setName(name);
+#endif
+}
+
+NVPIPE_EXPORT uint64_t NvPipe_ExportMetrics(char* buffer, uint64_t size)
+{
+    const std::string text = MetricsRegistry::instance().exportOpenMetrics();
+
+    if (buffer && size > 0)
+    {
+        const uint64_t n = std::min<uint64_t>(text.size(), size - 1);
+        memcpy(buffer, text.data(), n);
+        buffer[n] = '\0';
+    }
+
+    return text.size();
+}
+
+std::mutex metricsServerMutex;
+std::unique_ptr<MetricsServer> metricsServer;
+
+NVPIPE_EXPORT bool NvPipe_StartMetricsServer(uint16_t port)
+{
+    std::lock_guard<std::mutex> lock(metricsServerMutex);
+    metricsServer.reset();
+
+    try
+    {
+        metricsServer = std::unique_ptr<MetricsServer>(new MetricsServer(port));
+    }
+    catch (std::exception& e)
+    {
+        setSharedError(e.what());
+        return false;
+    }
+
+    return true;
+}
+
+NVPIPE_EXPORT void NvPipe_StopMetricsServer()
+{
+    std::lock_guard<std::mutex> lock(metricsServerMutex);
+    metricsServer.reset();
+}
+
+/**
+ * @brief Per-device capability cache.
+ *
+ * Queries open encoder probe sessions and are therefore expensive; capabilities don't change during the process lifetime.
+ */
+class CapabilityCache
+{
+public:
+    NvPipe_Capabilities get(int device, NvPipe_Codec codec)
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        if (device < 0)
+            CUDA_THROW(cudaGetDevice(&device),
+                       "Failed to get current device");
+
+        const auto key = std::make_pair(device, codec);
+        auto it = this->cache.find(key);
+        if (it != this->cache.end())
+            return it->second;
+
+        // A probe that found no free encode session says nothing about the device, so it is not cached
+        bool complete = true;
+        const NvPipe_Capabilities capabilities = this->query(device, codec, complete);
+        if (complete)
+            this->cache[key] = capabilities;
+        return capabilities;
+    }
+
+private:
+    /// Sessions opened at most to count the free ones; boards without a session limit report this value
+    static const uint32_t MAX_PROBED_ENCODE_SESSIONS = 32;
+
+    NvPipe_Capabilities query(int device, NvPipe_Codec codec, bool& complete)
+    {
+        NvPipe_Capabilities capabilities;
+        memset(&capabilities, 0, sizeof(capabilities));
+
+        int previousDevice;
+        CUDA_THROW(cudaGetDevice(&previousDevice),
+                   "Failed to get current device");
+        CUDA_THROW(cudaSetDevice(device),
+                   "Failed to select device");
+
+        // Restore the caller's device on all paths
+        std::shared_ptr<void> restore(nullptr, [previousDevice](void*) { cudaSetDevice(previousDevice); });
+
+        // Ensure we have a CUDA context
+        CUDA_THROW(cudaFree(0),
+                   "Failed to initialize device");
+        CUcontext cudaContext;
+        cuCtxGetCurrent(&cudaContext);
+
+#ifdef NVPIPE_WITH_ENCODER
+        std::unique_ptr<NvEncoderCuda> probe;
+        try
+        {
+            // Opening a session does not allocate frames, so this is cheap compared to a failed create
+            probe.reset(new NvEncoderCuda(cudaContext, 64, 64, NV_ENC_BUFFER_FORMAT_NV12, 0));
+        }
+        catch (NVENCException&)
+        {
+            // No encoder on this device, or all sessions are in use (e.g., the limit of consumer boards)
+            complete = false;
+        }
+
+        if (probe)
+        {
+            const GUID codecGUID = (codec == NVPIPE_HEVC) ? NV_ENC_CODEC_HEVC_GUID : NV_ENC_CODEC_H264_GUID;
+
+            capabilities.maxEncodeWidth = probe->GetCapabilityValue(codecGUID, NV_ENC_CAPS_WIDTH_MAX);
+            capabilities.maxEncodeHeight = probe->GetCapabilityValue(codecGUID, NV_ENC_CAPS_HEIGHT_MAX);
+            capabilities.maxEncodeMBCount = probe->GetCapabilityValue(codecGUID, NV_ENC_CAPS_MB_NUM_MAX);
+            capabilities.encodeLossless = probe->GetCapabilityValue(codecGUID, NV_ENC_CAPS_SUPPORT_LOSSLESS_ENCODE) != 0;
+            capabilities.encodeYuv444 = probe->GetCapabilityValue(codecGUID, NV_ENC_CAPS_SUPPORT_YUV444_ENCODE) != 0;
+            capabilities.encodeSupported = capabilities.maxEncodeWidth > 0 && capabilities.maxEncodeHeight > 0;
+
+            // NVENC does not report a session limit, so sessions are opened until the driver refuses one.
+            // All probe sessions are closed again before returning.
+            std::vector<std::unique_ptr<NvEncoderCuda>> sessions;
+            sessions.reserve(MAX_PROBED_ENCODE_SESSIONS);
+            sessions.push_back(std::move(probe));
+            try
+            {
+                while (sessions.size() < MAX_PROBED_ENCODE_SESSIONS)
+                    sessions.emplace_back(new NvEncoderCuda(cudaContext, 64, 64, NV_ENC_BUFFER_FORMAT_NV12, 0));
+            }
+            catch (NVENCException&)
+            {
+                // Session limit reached (or out of resources for another session)
+            }
+
+            capabilities.maxEncodeSessions = (uint32_t) sessions.size();
+        }
+#endif
+
+#ifdef NVPIPE_WITH_DECODER
+        CUVIDDECODECAPS decodeCaps;
+        memset(&decodeCaps, 0, sizeof(decodeCaps));
+        decodeCaps.eCodecType = (codec == NVPIPE_HEVC) ? cudaVideoCodec_HEVC : cudaVideoCodec_H264;
+        decodeCaps.eChromaFormat = cudaVideoChromaFormat_420;
+        decodeCaps.nBitDepthMinus8 = 0;
+
+        if (cuvidGetDecoderCaps(&decodeCaps) == CUDA_SUCCESS && decodeCaps.bIsSupported)
+        {
+            capabilities.decodeSupported = true;
+            capabilities.minDecodeWidth = decodeCaps.nMinWidth;
+            capabilities.minDecodeHeight = decodeCaps.nMinHeight;
+            capabilities.maxDecodeWidth = decodeCaps.nMaxWidth;
+            capabilities.maxDecodeHeight = decodeCaps.nMaxHeight;
+            capabilities.maxDecodeMBCount = decodeCaps.nMaxMBCount;
+
+            decodeCaps.eChromaFormat = cudaVideoChromaFormat_444;
+            decodeCaps.bIsSupported = 0;
+            capabilities.decodeYuv444 = (cuvidGetDecoderCaps(&decodeCaps) == CUDA_SUCCESS && decodeCaps.bIsSupported);
+        }
+#endif
+
+        return capabilities;
+    }
+
+private:
+    std::mutex mutex;
+    std::map<std::pair<int, NvPipe_Codec>, NvPipe_Capabilities> cache;
+};
+
+CapabilityCache capabilityCache;
+
+NVPIPE_EXPORT bool NvPipe_GetCapabilities(int device, NvPipe_Codec codec, NvPipe_Capabilities* capabilities)
+{
+    try
+    {
+        *capabilities = capabilityCache.get(device, codec);
+    }
+    catch (Exception& e)
+    {
+        setSharedError(e.getErrorString());
+        return false;
+    }
+
+    return true;
+}
+
+NVPIPE_EXPORT bool NvPipe_SetHostMemoryPolicy(const NvPipe_HostMemoryPolicy* policy)
+{
+    if (!policy || policy->numaNode < NVPIPE_NUMA_NODE_NONE || policy->hugePages < NVPIPE_HUGE_PAGES_NONE || policy->hugePages > NVPIPE_HUGE_PAGES_EXPLICIT)
+    {
+        setSharedError("Invalid host memory policy.");
+        return false;
+    }
+
+    HostMemoryPools::instance().setPolicy(*policy);
+    return true;
+}
+
+NVPIPE_EXPORT bool NvPipe_SetThreadAffinity(uint32_t cpu)
+{
+#ifdef _WIN32
+    const bool pinned = cpu < 8 * sizeof(DWORD_PTR) && SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+#elif defined(__linux__)
+    bool pinned = false;
+    if (cpu < CPU_SETSIZE)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pinned = pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+    }
+#else
+    const bool pinned = false;
+#endif
+
+    if (!pinned)
+    {
+        setSharedError("Failed to pin thread to CPU " + std::to_string(cpu) + ".");
+    }
+
+    return pinned;
+}
+
+NVPIPE_EXPORT uint64_t NvPipe_GetMaxCompressedSize(NvPipe_Format format, NvPipe_Codec codec, uint32_t width, uint32_t height)
+{
+    // Width of the encoded NV12 frame, see Encoder::upload()
+    uint64_t encodedWidth = width;
+    if (format == NVPIPE_UINT16 || format == NVPIPE_BGRA32_ALPHA)
+        encodedWidth *= 2;
+    else if (format == NVPIPE_UINT32)
+        encodedWidth *= 4;
+
+    // Frames are coded in macroblocks (H.264) or CTUs of up to 64x64 pixels (HEVC). The H.264 level limits allow
+    // 128 bits on top of the raw size of a macroblock (4%), HEVC is given the same relative margin.
+    const uint64_t block = (codec == NVPIPE_HEVC) ? 64 : 16;
+    const uint64_t numBlocks = ((encodedWidth + block - 1) / block) * ((height + block - 1) / block);
+    const uint64_t rawBlockBytes = block * block * 3 / 2;
+
+    // Parameter sets, SEI and slice headers
+    const uint64_t headerBytes = 4096;
+
+    return numBlocks * (rawBlockBytes + rawBlockBytes / 24) + headerBytes;
+}
+
+NVPIPE_EXPORT bool NvPipe_GetVolumeInfo(const uint8_t* src, uint64_t srcSize, NvPipe_Format* format, NvPipe_Volume* volume, uint32_t* numBricks)
+{
+    VolumeIndex index;
+    const std::string error = VolumeIndex::read(src, srcSize, index);
+    if (!error.empty())
+    {
+        setSharedError(error);
+        return false;
+    }
+
+    if (format)
+        *format = index.format;
+    if (volume)
+        *volume = index.volume;
+    if (numBricks)
+        *numBricks = (uint32_t) index.bricks.size();
+
+    return true;
+}
+
+NVPIPE_EXPORT bool NvPipe_ResizeHost(NvPipe_YuvLayout layout, const NvPipe_HostImage* src, const NvPipe_HostImage* dst, NvPipe_ResizeFilter filter)
+{
+    if (!src || !dst || !src->planes[0] || !dst->planes[0] || src->pitches[0] == 0 || dst->pitches[0] == 0)
+    {
+        setSharedError("Invalid host frame.");
+        return false;
+    }
+
+    if (src->width == 0 || src->height == 0 || dst->width == 0 || dst->height == 0)
+    {
+        setSharedError("Invalid frame size: " + std::to_string(src->width) + "x" + std::to_string(src->height) + " to "
+                       + std::to_string(dst->width) + "x" + std::to_string(dst->height) + ".");
+        return false;
+    }
+
+    if (layout != NVPIPE_YUV_NV12 && layout != NVPIPE_YUV_P016 && layout != NVPIPE_YUV_I420)
+    {
+        setSharedError("Invalid YUV layout.");
+        return false;
+    }
+
+    const ResizeFilter resizeFilter = (filter == NVPIPE_RESIZE_AREA) ? ResizeFilter::Area : ResizeFilter::Bilinear;
+
+    // Filter tables depend on the geometry only, so a stream of equally sized frames reuses them
+    struct CachedResizer
+    {
+        uint32_t srcWidth = 0, srcHeight = 0, dstWidth = 0, dstHeight = 0;
+        std::unique_ptr<HostResizer> resizer;
+    };
+    thread_local CachedResizer cache;
+
+    if (!cache.resizer || cache.resizer->getFilter() != resizeFilter || cache.srcWidth != src->width || cache.srcHeight != src->height
+            || cache.dstWidth != dst->width || cache.dstHeight != dst->height)
+    {
+        cache.resizer.reset(new HostResizer(src->width, src->height, dst->width, dst->height, resizeFilter));
+        cache.srcWidth = src->width;
+        cache.srcHeight = src->height;
+        cache.dstWidth = dst->width;
+        cache.dstHeight = dst->height;
+    }
+
+    // Missing chroma planes directly follow the previous plane, missing pitches follow NvPipe_Encode() and ScaleYUV420
+    auto resolve = [layout](const NvPipe_HostImage* image, uint8_t* planes[3], uint64_t pitches[3])
+    {
+        const uint32_t chromaHeight = (layout == NVPIPE_YUV_I420) ? (image->height + 1) / 2 : image->height / 2;
+        for (uint32_t i = 0; i < 3; ++i)
+        {
+            pitches[i] = image->pitches[i];
+            if (i > 0 && pitches[i] == 0)
+                pitches[i] = (layout == NVPIPE_YUV_I420) ? (image->pitches[0] + 1) / 2 : image->pitches[0];
+
+            planes[i] = (uint8_t*) image->planes[i];
+            if (i > 0 && !planes[i])
+                planes[i] = planes[i - 1] + pitches[i - 1] * (i == 1 ? image->height : chromaHeight);
+        }
+    };
+
+    uint8_t* srcPlanes[3];
+    uint8_t* dstPlanes[3];
+    uint64_t srcPitches[3];
+    uint64_t dstPitches[3];
+    resolve(src, srcPlanes, srcPitches);
+    resolve(dst, dstPlanes, dstPitches);
+
+    if (layout == NVPIPE_YUV_I420)
+    {
+        if (srcPitches[1] != srcPitches[2] || dstPitches[1] != dstPitches[2])
+        {
+            setSharedError("U and V planes must have the same pitch.");
+            return false;
+        }
+
+        cache.resizer->scaleYuv420(srcPlanes[0], srcPlanes[1], srcPlanes[2], srcPitches[0], srcPitches[1],
+                                   dstPlanes[0], dstPlanes[1], dstPlanes[2], dstPitches[0], dstPitches[1]);
+    }
+    else
+    {
+        cache.resizer->resizeSemiplanar(layout == NVPIPE_YUV_P016, srcPlanes[0], srcPlanes[1], srcPitches[0], srcPitches[1],
+                                        dstPlanes[0], dstPlanes[1], dstPitches[0], dstPitches[1]);
+    }
+
+    return true;
+}
+
+NVPIPE_EXPORT NvPipe* NvPipe_CreateRecorder(const NvPipe_RecorderSettings* settings)
+{
+    RecorderConfig config;
+    if (settings)
+    {
+        if (settings->blockSize)
+            config.blockSize = settings->blockSize;
+        if (settings->preallocateBytes)
+            config.preallocateBytes = settings->preallocateBytes;
+        if (settings->maxQueuedBlocks)
+            config.maxQueuedBlocks = settings->maxQueuedBlocks;
+        config.directIO = settings->directIO;
+        config.useIoUring = !settings->disableIoUring;
+    }
+
+    Instance* instance = new Instance();
+
+    try
+    {
+        instance->recorder = std::unique_ptr<Recorder>(new Recorder(config));
+    }
+    catch (std::exception& e)
+    {
+        setSharedError(e.what());
+        delete instance;
+        return nullptr;
+    }
+
+    return instance;
+}
+
+/**
+ * @brief Resolves a recorder instance, reporting an invalid one as error.
+ */
+static Recorder* getRecorder(Instance* instance)
+{
+    if (!instance->recorder)
+        setError(instance, "Invalid NvPipe recorder.");
+
+    return instance->recorder.get();
+}
+
+NVPIPE_EXPORT int32_t NvPipe_RecorderAddStream(NvPipe* nvp, const char* path, NvPipe_Codec codec, NvPipe_Format format, uint32_t width, uint32_t height)
+{
+    Instance* instance = static_cast<Instance*>(nvp);
+    Recorder* recorder = getRecorder(instance);
+    if (!recorder)
+        return -1;
+
+    try
+    {
+        return (int32_t) recorder->addStream(path, codec, format, width, height);
+    }
+    catch (std::exception& e)
+    {
+        setError(instance, e.what());
+        return -1;
+    }
+}
+
+NVPIPE_EXPORT bool NvPipe_RecorderWrite(NvPipe* nvp, uint32_t stream, const uint8_t* data, uint64_t size, uint64_t timestampUs, bool keyFrame)
+{
+    Instance* instance = static_cast<Instance*>(nvp);
+    Recorder* recorder = getRecorder(instance);
+    if (!recorder)
+        return false;
+
+    try
+    {
+        recorder->write(stream, data, size, timestampUs, keyFrame);
+    }
+    catch (std::exception& e)
+    {
+        setError(instance, e.what());
+        return false;
+    }
+
+    return true;
+}
+
+NVPIPE_EXPORT bool NvPipe_RecorderCloseStream(NvPipe* nvp, uint32_t stream)
+{
+    Instance* instance = static_cast<Instance*>(nvp);
+    Recorder* recorder = getRecorder(instance);
+    if (!recorder)
+        return false;
+
+    try
+    {
+        recorder->closeStream(stream);
+    }
+    catch (std::exception& e)
+    {
+        setError(instance, e.what());
+        return false;
+    }
+
+    return true;
+}
+
+NVPIPE_EXPORT void NvPipe_GetRecorderStatistics(NvPipe* nvp, NvPipe_RecorderStatistics* statistics)
+{
+    Instance* instance = static_cast<Instance*>(nvp);
+    *statistics = NvPipe_RecorderStatistics();
+
+    if (!instance->recorder)
+        return;
+
+    const RecorderStatistics s = instance->recorder->getStatistics();
+    statistics->frames = s.frames;
+    statistics->bytes = s.bytes;
+    statistics->blocks = s.blocks;
+    statistics->diskBytes = s.diskBytes;
+    statistics->stalls = s.stalls;
+    statistics->ioUring = s.ioUring;
+}
+
+NVPIPE_EXPORT void NvPipe_Destroy(NvPipe* nvp)
+{
+    TraceScope trace(TraceOp::Destroy, nvp);
+
+    Instance* instance = static_cast<Instance*>(nvp);
+    delete instance;
+}
+
+NVPIPE_EXPORT const char* NvPipe_GetError(NvPipe* nvp)
+{
+    // Copied, so the message stays valid while other threads report errors
+    static thread_local std::string error;
+
+    if (nullptr == nvp)
+    {
+        std::lock_guard<std::mutex> lock(sharedErrorMutex);
+        error = sharedError;
+        return error.c_str();
+    }
 
     Instance* instance = static_cast<Instance*>(nvp);
-    return instance->error.c_str();
+    std::lock_guard<std::mutex> lock(instance->errorMutex);
+    error = instance->error;
+    return error.c_str();
 }
 
 
@@ -0,0 +1,367 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef NVPIPE_HPP
+#define NVPIPE_HPP
+
+#if __cplusplus < 201703L && !(defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#error "NvPipe.hpp requires C++17"
+#endif
+
+#include "NvPipe.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+
+/**
+ * C++ interface (header-only, C++17).
+ *
+ * Encoders and decoders are move-only handles which destroy their instance, buffers are passed as non-owning spans,
+ * and results carry size and status without copying error strings. In steady state, encoding into a PacketBuffer
+ * does not allocate: the buffer is sized once from NvPipe_GetMaxCompressedSize() and reused.
+ *
+ * Example:
+ *
+ *     nvpipe::Encoder encoder(NVPIPE_BGRA32, NVPIPE_H264, NVPIPE_LOSSY, 32 * 1000 * 1000, 90);
+ *     nvpipe::PacketBuffer packet;
+ *     if (nvpipe::Result r = encoder.encode(rgba, width * 4, packet, width, height))
+ *         send(packet.view());
+ *     else
+ *         std::cerr << r.error() << std::endl;
+ */
+namespace nvpipe
+{
+
+template<typename T>
+class Span;
+
+namespace detail
+{
+
+template<typename T>
+struct IsSpan : std::false_type {};
+
+template<typename T>
+struct IsSpan<Span<T>> : std::true_type {};
+
+}
+
+
+/**
+ * @brief Non-owning view of a contiguous array (subset of std::span).
+ */
+template<typename T>
+class Span
+{
+public:
+    constexpr Span() = default;
+    constexpr Span(T* data, size_t size) : ptr(data), count(size) {}
+
+    template<size_t N>
+    constexpr Span(T (&array)[N]) : ptr(array), count(N) {}
+
+    /**
+     * @brief Views any contiguous container with data() and size(), e.g., std::vector or std::array.
+     */
+    template<typename Container, typename = std::enable_if_t<!detail::IsSpan<std::remove_cv_t<Container>>::value
+        && std::is_convertible_v<decltype(std::declval<Container&>().data()), T*>>>
+    constexpr Span(Container& container) : ptr(container.data()), count(container.size()) {}
+
+    template<typename U, typename = std::enable_if_t<std::is_convertible_v<U(*)[], T(*)[]>>>
+    constexpr Span(const Span<U>& other) : ptr(other.data()), count(other.size()) {}
+
+    constexpr T* data() const { return this->ptr; }
+    constexpr size_t size() const { return this->count; }
+    constexpr size_t sizeBytes() const { return this->count * sizeof(T); }
+    constexpr bool empty() const { return this->count == 0; }
+
+    constexpr T* begin() const { return this->ptr; }
+    constexpr T* end() const { return this->ptr + this->count; }
+    constexpr T& operator[](size_t i) const { return this->ptr[i]; }
+
+    constexpr Span first(size_t n) const { return Span(this->ptr, n); }
+    constexpr Span subspan(size_t offset, size_t n) const { return Span(this->ptr + offset, n); }
+    constexpr Span subspan(size_t offset) const { return Span(this->ptr + offset, this->count - offset); }
+
+private:
+    T* ptr = nullptr;
+    size_t count = 0;
+};
+
+
+/**
+ * @brief Size of an uncompressed frame in bytes (tightly packed), as the library computes it.
+ * UINT4 packs two pixels per byte; like the encoder, which needs even widths, this does not round up.
+ */
+constexpr uint64_t frameSize(NvPipe_Format format, uint32_t width, uint32_t height)
+{
+    const uint64_t pixels = (uint64_t) width * height;
+    switch (format)
+    {
+    case NVPIPE_BGRA32:
+    case NVPIPE_BGRA32_ALPHA:
+    case NVPIPE_UINT32:
+        return pixels * 4;
+    case NVPIPE_UINT16:
+        return pixels * 2;
+    case NVPIPE_UINT8:
+        return pixels;
+    case NVPIPE_UINT4:
+        return pixels / 2;
+    }
+    return 0;
+}
+
+
+/**
+ * @brief Outcome of an encode or decode call.
+ *
+ * Converts to true on success. The error message is not copied: it points into the instance and stays valid until
+ * the next call on that instance.
+ */
+class [[nodiscard]] Result
+{
+public:
+    constexpr Result() = default;
+    constexpr Result(uint64_t size, NvPipe* nvp) : bytes(size), nvp(nvp), code(size > 0 ? NVPIPE_SUCCESS : NVPIPE_ERROR) {}
+    constexpr Result(NvPipe_Status status, const char* message) : code(status), message(message) {}
+
+    constexpr explicit operator bool() const { return this->code == NVPIPE_SUCCESS; }
+    constexpr uint64_t size() const { return this->bytes; }
+
+    NvPipe_Status status() const
+    {
+        // Failures of the instance distinguish timeouts from errors
+        return (this->code != NVPIPE_SUCCESS && this->nvp) ? NvPipe_GetLastStatus(this->nvp) : this->code;
+    }
+
+    std::string_view error() const
+    {
+        if (this->code == NVPIPE_SUCCESS)
+            return {};
+
+        return this->message ? this->message : NvPipe_GetError(this->nvp);
+    }
+
+private:
+    uint64_t bytes = 0;
+    NvPipe* nvp = nullptr;
+    NvPipe_Status code = NVPIPE_ERROR;
+    const char* message = nullptr;
+};
+
+
+/**
+ * @brief Reusable host buffer for compressed frames. Grows on demand and never shrinks.
+ */
+class PacketBuffer
+{
+public:
+    PacketBuffer() = default;
+    explicit PacketBuffer(uint64_t capacity) { this->reserve(capacity); }
+
+    void reserve(uint64_t capacity)
+    {
+        if (capacity <= this->capacityBytes)
+            return;
+
+        // Uninitialized on purpose, the encoder overwrites what it reports
+        this->storage.reset(new uint8_t[capacity]);
+        this->capacityBytes = capacity;
+        this->sizeBytes = 0;
+    }
+
+    void setSize(uint64_t size) { this->sizeBytes = size <= this->capacityBytes ? size : 0; }
+
+    uint8_t* data() { return this->storage.get(); }
+    const uint8_t* data() const { return this->storage.get(); }
+    uint64_t size() const { return this->sizeBytes; }
+    uint64_t capacity() const { return this->capacityBytes; }
+
+    Span<const uint8_t> view() const { return Span<const uint8_t>(this->storage.get(), this->sizeBytes); }
+    Span<uint8_t> space() { return Span<uint8_t>(this->storage.get(), this->capacityBytes); }
+
+private:
+    std::unique_ptr<uint8_t[]> storage;
+    uint64_t capacityBytes = 0;
+    uint64_t sizeBytes = 0;
+};
+
+
+namespace detail
+{
+
+struct Destroy
+{
+    void operator()(NvPipe* nvp) const { NvPipe_Destroy(nvp); }
+};
+
+using Handle = std::unique_ptr<NvPipe, Destroy>;
+
+}
+
+
+/**
+ * @brief Error message of the last failed create call, see NvPipe_GetError().
+ */
+inline std::string_view createError()
+{
+    return NvPipe_GetError(nullptr);
+}
+
+
+#ifdef NVPIPE_WITH_ENCODER
+
+/**
+ * @brief Move-only encoder handle. Converts to false if creation failed, see createError().
+ */
+class Encoder
+{
+public:
+    Encoder() = default;
+
+    Encoder(NvPipe_Format format, NvPipe_Codec codec, NvPipe_Compression compression, uint64_t bitrate, uint32_t targetFrameRate)
+        : handle(NvPipe_CreateEncoder(format, codec, compression, bitrate, targetFrameRate)), format(format), codec(codec) {}
+
+    explicit operator bool() const { return this->handle != nullptr; }
+    NvPipe* get() const { return this->handle.get(); }
+
+    NvPipe_Format getFormat() const { return this->format; }
+    NvPipe_Codec getCodec() const { return this->codec; }
+
+    /**
+     * @brief Upper bound for the compressed size of one frame, see NvPipe_GetMaxCompressedSize().
+     */
+    uint64_t maxCompressedSize(uint32_t width, uint32_t height) const
+    {
+        return NvPipe_GetMaxCompressedSize(this->format, this->codec, width, height);
+    }
+
+    void setBitrate(uint64_t bitrate, uint32_t targetFrameRate) { NvPipe_SetBitrate(this->handle.get(), bitrate, targetFrameRate); }
+    void setTimeout(uint32_t milliseconds) { NvPipe_SetTimeout(this->handle.get(), milliseconds); }
+
+    /**
+     * @brief Encodes a frame from device or host memory into dst.
+     */
+    Result encode(const void* src, uint64_t srcPitch, Span<uint8_t> dst, uint32_t width, uint32_t height, bool forceIFrame = false)
+    {
+        return Result(NvPipe_Encode(this->handle.get(), src, srcPitch, dst.data(), dst.size(), width, height, forceIFrame), this->handle.get());
+    }
+
+    /**
+     * @brief Encodes a frame from host memory into dst, checking that src holds the whole frame.
+     */
+    Result encode(Span<const uint8_t> src, uint64_t srcPitch, Span<uint8_t> dst, uint32_t width, uint32_t height, bool forceIFrame = false)
+    {
+        const uint64_t rowBytes = frameSize(this->format, width, 1);
+        if (height > 0 && src.size() < (srcPitch ? srcPitch : rowBytes) * (height - 1) + rowBytes)
+            return Result(NVPIPE_ERROR, "Source buffer too small for frame");
+
+        return this->encode(src.data(), srcPitch, dst, width, height, forceIFrame);
+    }
+
+    /**
+     * @brief Encodes a frame into a reusable buffer, which only grows if the frame size increases.
+     */
+    Result encode(Span<const uint8_t> src, uint64_t srcPitch, PacketBuffer& dst, uint32_t width, uint32_t height, bool forceIFrame = false)
+    {
+        dst.reserve(this->maxCompressedSize(width, height));
+        const Result result = this->encode(src, srcPitch, dst.space(), width, height, forceIFrame);
+        dst.setSize(result.size());
+        return result;
+    }
+
+    Result encode(const void* src, uint64_t srcPitch, PacketBuffer& dst, uint32_t width, uint32_t height, bool forceIFrame = false)
+    {
+        dst.reserve(this->maxCompressedSize(width, height));
+        const Result result = this->encode(src, srcPitch, dst.space(), width, height, forceIFrame);
+        dst.setSize(result.size());
+        return result;
+    }
+
+private:
+    detail::Handle handle;
+    NvPipe_Format format = NVPIPE_BGRA32;
+    NvPipe_Codec codec = NVPIPE_H264;
+};
+
+#endif
+
+#ifdef NVPIPE_WITH_DECODER
+
+/**
+ * @brief Move-only decoder handle. Converts to false if creation failed, see createError().
+ */
+class Decoder
+{
+public:
+    Decoder() = default;
+
+    Decoder(NvPipe_Format format, NvPipe_Codec codec)
+        : handle(NvPipe_CreateDecoder(format, codec)), format(format) {}
+
+    explicit operator bool() const { return this->handle != nullptr; }
+    NvPipe* get() const { return this->handle.get(); }
+
+    NvPipe_Format getFormat() const { return this->format; }
+
+    void setTimeout(uint32_t milliseconds) { NvPipe_SetTimeout(this->handle.get(), milliseconds); }
+
+    /**
+     * @brief Decodes a frame to device or host memory.
+     */
+    Result decode(Span<const uint8_t> src, void* dst, uint32_t width, uint32_t height)
+    {
+        return Result(NvPipe_Decode(this->handle.get(), src.data(), src.size(), dst, width, height), this->handle.get());
+    }
+
+    /**
+     * @brief Decodes a frame to host memory, checking that dst can hold the whole frame.
+     */
+    Result decode(Span<const uint8_t> src, Span<uint8_t> dst, uint32_t width, uint32_t height)
+    {
+        if (dst.size() < frameSize(this->format, width, height))
+            return Result(NVPIPE_ERROR, "Destination buffer too small for frame");
+
+        return this->decode(src, (void*) dst.data(), width, height);
+    }
+
+private:
+    detail::Handle handle;
+    NvPipe_Format format = NVPIPE_BGRA32;
+};
+
+#endif
+
+}
+
+#endif
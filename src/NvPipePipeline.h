@@ -0,0 +1,705 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef NVPIPE_PIPELINE_H
+#define NVPIPE_PIPELINE_H
+
+#include "NvPipe.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/**
+ * Staged pipeline framework (header-only, C++11).
+ *
+ * A pipeline consists of sources, stages and sinks, each running on its own thread, connected by bounded
+ * lock-free queues. Full queues block the producing stage (backpressure), so a slow stage throttles
+ * everything upstream instead of growing memory. Every stage records item counts, processing latency,
+ * time blocked on its output and the depth of its input queue.
+ *
+ * Example (capture -> encode -> send):
+ *
+ *     nvpipe::Pipeline pipeline;
+ *     auto frames = pipeline.createQueue<nvpipe::RawFrame>(4);
+ *     auto packets = pipeline.createQueue<nvpipe::Packet>(8);
+ *     pipeline.addSource<nvpipe::RawFrame>("capture", frames, capture);
+ *     pipeline.addStage<nvpipe::RawFrame, nvpipe::Packet>("encode", frames, packets, nvpipe::EncodeStage(encoder, NVPIPE_BGRA32, NVPIPE_H264));
+ *     pipeline.addSink<nvpipe::Packet>("send", packets, send);
+ *     pipeline.start();
+ */
+namespace nvpipe
+{
+
+/**
+ * @brief Alignment keeping the producer and consumer indices of a queue on separate cache lines.
+ */
+static constexpr size_t CACHE_LINE_SIZE = 64;
+
+
+/**
+ * @brief Interface of the bounded queues connecting pipeline stages.
+ */
+template<typename T>
+class BoundedQueue
+{
+public:
+    virtual ~BoundedQueue() {}
+
+    virtual bool tryPush(T& item) = 0;
+    virtual bool tryPop(T& item) = 0;
+    virtual size_t size() const = 0;
+    virtual size_t capacity() const = 0;
+
+    /**
+     * @brief Registers a producer. The queue is finished once all registered producers have called close().
+     */
+    void addProducer() { this->producers++; }
+    void close() { this->producers--; }
+    bool isClosed() const { return this->producers.load(std::memory_order_acquire) <= 0; }
+
+private:
+    std::atomic<int> producers{0};
+};
+
+
+/**
+ * @brief Bounded lock-free single-producer/single-consumer ring buffer.
+ */
+template<typename T>
+class SpscQueue : public BoundedQueue<T>
+{
+public:
+    explicit SpscQueue(size_t capacity) : slots(roundUp(capacity)), mask(slots.size() - 1) {}
+
+    bool tryPush(T& item) override
+    {
+        const size_t tail = this->tail.load(std::memory_order_relaxed);
+        if (tail - this->head.load(std::memory_order_acquire) == this->slots.size())
+            return false;
+
+        this->slots[tail & this->mask] = std::move(item);
+        this->tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T& item) override
+    {
+        const size_t head = this->head.load(std::memory_order_relaxed);
+        if (head == this->tail.load(std::memory_order_acquire))
+            return false;
+
+        item = std::move(this->slots[head & this->mask]);
+        this->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const override
+    {
+        return this->tail.load(std::memory_order_acquire) - this->head.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const override
+    {
+        return this->slots.size();
+    }
+
+private:
+    static size_t roundUp(size_t n)
+    {
+        size_t p = 1;
+        while (p < n)
+            p *= 2;
+        return p;
+    }
+
+private:
+    std::vector<T> slots;
+    const size_t mask;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> head{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail{0};
+};
+
+
+/**
+ * @brief Bounded lock-free multi-producer/single-consumer queue (sequence-numbered ring buffer).
+ */
+template<typename T>
+class MpscQueue : public BoundedQueue<T>
+{
+public:
+    explicit MpscQueue(size_t capacity) : cells(roundUp(capacity)), mask(cells.size() - 1)
+    {
+        for (size_t i = 0; i < this->cells.size(); ++i)
+            this->cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    bool tryPush(T& item) override
+    {
+        size_t pos = this->tail.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell& cell = this->cells[pos & this->mask];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const intptr_t diff = (intptr_t) sequence - (intptr_t) pos;
+
+            if (diff == 0)
+            {
+                if (this->tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.value = std::move(item);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false; // full
+            }
+            else
+            {
+                pos = this->tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(T& item) override
+    {
+        const size_t pos = this->head.load(std::memory_order_relaxed);
+        Cell& cell = this->cells[pos & this->mask];
+        const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+
+        if ((intptr_t) sequence - (intptr_t) (pos + 1) < 0)
+            return false; // empty
+
+        item = std::move(cell.value);
+        cell.sequence.store(pos + this->mask + 1, std::memory_order_release);
+        this->head.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    size_t size() const override
+    {
+        const size_t tail = this->tail.load(std::memory_order_acquire);
+        const size_t head = this->head.load(std::memory_order_acquire);
+        return tail > head ? tail - head : 0;
+    }
+
+    size_t capacity() const override
+    {
+        return this->cells.size();
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    static size_t roundUp(size_t n)
+    {
+        size_t p = 1;
+        while (p < n)
+            p *= 2;
+        return p;
+    }
+
+private:
+    std::vector<Cell> cells;
+    const size_t mask;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> head{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail{0};
+};
+
+
+/**
+ * @brief Snapshot of the metrics of a single stage.
+ */
+struct StageStatistics
+{
+    std::string name;
+    uint64_t items = 0;             ///< Items processed.
+    uint64_t dropped = 0;           ///< Items for which the stage emitted nothing, e.g., failed encodes.
+    double averageLatencyMs = 0.0;  ///< Average processing time per item.
+    double maxLatencyMs = 0.0;      ///< Maximum processing time per item.
+    double blockedMs = 0.0;         ///< Total time spent waiting for space in the output queue (backpressure).
+    size_t queueDepth = 0;          ///< Current depth of the input queue.
+    size_t maxQueueDepth = 0;       ///< Maximum observed depth of the input queue.
+    size_t queueCapacity = 0;       ///< Capacity of the input queue.
+};
+
+
+/**
+ * @brief Type-erased stage thread with metrics and optional CPU affinity.
+ */
+class StageBase
+{
+public:
+    StageBase(const std::string& name, int cpu) : name(name), cpu(cpu) {}
+    virtual ~StageBase() {}
+
+    void start(const std::atomic<bool>* stopFlag)
+    {
+        this->stopFlag = stopFlag;
+        this->thread = std::thread([this]()
+        {
+            this->applyAffinity();
+            this->run();
+        });
+    }
+
+    void join()
+    {
+        if (this->thread.joinable())
+            this->thread.join();
+    }
+
+    StageStatistics getStatistics() const
+    {
+        StageStatistics s;
+        s.name = this->name;
+        s.items = this->items.load(std::memory_order_relaxed);
+        s.dropped = this->dropped.load(std::memory_order_relaxed);
+        s.averageLatencyMs = s.items ? 1.0e-6 * this->totalNs.load(std::memory_order_relaxed) / s.items : 0.0;
+        s.maxLatencyMs = 1.0e-6 * this->maxNs.load(std::memory_order_relaxed);
+        s.blockedMs = 1.0e-6 * this->blockedNs.load(std::memory_order_relaxed);
+        s.queueDepth = this->inputDepth();
+        s.maxQueueDepth = this->maxDepth.load(std::memory_order_relaxed);
+        s.queueCapacity = this->inputCapacity();
+        return s;
+    }
+
+protected:
+    virtual void run() = 0;
+    virtual size_t inputDepth() const { return 0; }
+    virtual size_t inputCapacity() const { return 0; }
+
+    bool stopping() const
+    {
+        return this->stopFlag->load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Spin briefly, then yield, then sleep while waiting on a queue.
+     */
+    static void backoff(uint32_t& attempt)
+    {
+        if (attempt < 64)
+            ;
+        else if (attempt < 256)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        ++attempt;
+    }
+
+    template<typename T>
+    bool push(BoundedQueue<T>& queue, T& item)
+    {
+        if (queue.tryPush(item))
+            return true;
+
+        const auto start = std::chrono::steady_clock::now();
+        uint32_t attempt = 0;
+        bool pushed = false;
+        while (!this->stopping() && !(pushed = queue.tryPush(item)))
+            backoff(attempt);
+
+        this->blockedNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        return pushed;
+    }
+
+    template<typename T>
+    bool pop(BoundedQueue<T>& queue, T& item)
+    {
+        uint32_t attempt = 0;
+        for (;;)
+        {
+            const size_t depth = queue.size();
+            if (depth > this->maxDepth.load(std::memory_order_relaxed))
+                this->maxDepth.store(depth, std::memory_order_relaxed);
+
+            if (queue.tryPop(item))
+                return true;
+
+            // Drain remaining items before terminating on end of stream
+            if (this->stopping() || queue.isClosed())
+                return queue.tryPop(item);
+
+            backoff(attempt);
+        }
+    }
+
+    void record(std::chrono::steady_clock::time_point start)
+    {
+        const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        this->items.fetch_add(1, std::memory_order_relaxed);
+        this->totalNs.fetch_add(ns, std::memory_order_relaxed);
+        if (ns > this->maxNs.load(std::memory_order_relaxed))
+            this->maxNs.store(ns, std::memory_order_relaxed);
+    }
+
+    void recordDrop()
+    {
+        this->dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+private:
+    void applyAffinity()
+    {
+        // Best effort: the stage runs unpinned if the CPU is not available
+        if (this->cpu >= 0)
+            NvPipe_SetThreadAffinity((uint32_t) this->cpu);
+    }
+
+private:
+    std::string name;
+    int cpu;
+    std::thread thread;
+    const std::atomic<bool>* stopFlag = nullptr;
+
+    std::atomic<uint64_t> items{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> totalNs{0};
+    std::atomic<uint64_t> maxNs{0};
+    std::atomic<uint64_t> blockedNs{0};
+    std::atomic<size_t> maxDepth{0};
+};
+
+
+/**
+ * @brief Stage without input. The producer returns false at the end of the stream.
+ */
+template<typename Out>
+class SourceStage : public StageBase
+{
+public:
+    SourceStage(const std::string& name, std::shared_ptr<BoundedQueue<Out>> output, std::function<bool(Out&)> produce, int cpu)
+        : StageBase(name, cpu), output(output), produce(produce)
+    {
+        this->output->addProducer();
+    }
+
+protected:
+    void run() override
+    {
+        Out out;
+        while (!this->stopping())
+        {
+            const auto start = std::chrono::steady_clock::now();
+            if (!this->produce(out))
+                break;
+            this->record(start);
+
+            if (!this->push(*this->output, out))
+                break;
+        }
+
+        this->output->close();
+    }
+
+private:
+    std::shared_ptr<BoundedQueue<Out>> output;
+    std::function<bool(Out&)> produce;
+};
+
+
+/**
+ * @brief Stage transforming items. The processor returns false to emit nothing for an input item.
+ */
+template<typename In, typename Out>
+class TransformStage : public StageBase
+{
+public:
+    TransformStage(const std::string& name, std::shared_ptr<BoundedQueue<In>> input, std::shared_ptr<BoundedQueue<Out>> output, std::function<bool(In&, Out&)> process, int cpu)
+        : StageBase(name, cpu), input(input), output(output), process(process)
+    {
+        this->output->addProducer();
+    }
+
+protected:
+    void run() override
+    {
+        In in;
+        Out out;
+        while (this->pop(*this->input, in))
+        {
+            const auto start = std::chrono::steady_clock::now();
+            const bool emit = this->process(in, out);
+            this->record(start);
+
+            if (!emit)
+                this->recordDrop();
+            else if (!this->push(*this->output, out))
+                break;
+        }
+
+        this->output->close();
+    }
+
+    size_t inputDepth() const override { return this->input->size(); }
+    size_t inputCapacity() const override { return this->input->capacity(); }
+
+private:
+    std::shared_ptr<BoundedQueue<In>> input;
+    std::shared_ptr<BoundedQueue<Out>> output;
+    std::function<bool(In&, Out&)> process;
+};
+
+
+/**
+ * @brief Stage without output.
+ */
+template<typename In>
+class SinkStage : public StageBase
+{
+public:
+    SinkStage(const std::string& name, std::shared_ptr<BoundedQueue<In>> input, std::function<void(In&)> consume, int cpu)
+        : StageBase(name, cpu), input(input), consume(consume)
+    {
+    }
+
+protected:
+    void run() override
+    {
+        In in;
+        while (this->pop(*this->input, in))
+        {
+            const auto start = std::chrono::steady_clock::now();
+            this->consume(in);
+            this->record(start);
+        }
+    }
+
+    size_t inputDepth() const override { return this->input->size(); }
+    size_t inputCapacity() const override { return this->input->capacity(); }
+
+private:
+    std::shared_ptr<BoundedQueue<In>> input;
+    std::function<void(In&)> consume;
+};
+
+
+/**
+ * @brief Owns the stages and their threads.
+ */
+class Pipeline
+{
+public:
+    ~Pipeline()
+    {
+        this->stop();
+    }
+
+    /**
+     * @brief Creates a queue connecting stages. Use a multi-producer queue if several stages push into it.
+     */
+    template<typename T>
+    std::shared_ptr<BoundedQueue<T>> createQueue(size_t capacity, bool multiProducer = false)
+    {
+        if (multiProducer)
+            return std::make_shared<MpscQueue<T>>(capacity);
+        return std::make_shared<SpscQueue<T>>(capacity);
+    }
+
+    template<typename Out>
+    void addSource(const std::string& name, std::shared_ptr<BoundedQueue<Out>> output, std::function<bool(Out&)> produce, int cpu = -1)
+    {
+        this->stages.emplace_back(new SourceStage<Out>(name, output, produce, cpu));
+    }
+
+    template<typename In, typename Out>
+    void addStage(const std::string& name, std::shared_ptr<BoundedQueue<In>> input, std::shared_ptr<BoundedQueue<Out>> output, std::function<bool(In&, Out&)> process, int cpu = -1)
+    {
+        this->stages.emplace_back(new TransformStage<In, Out>(name, input, output, process, cpu));
+    }
+
+    template<typename In>
+    void addSink(const std::string& name, std::shared_ptr<BoundedQueue<In>> input, std::function<void(In&)> consume, int cpu = -1)
+    {
+        this->stages.emplace_back(new SinkStage<In>(name, input, consume, cpu));
+    }
+
+    void start()
+    {
+        this->stopFlag = false;
+        for (auto& stage : this->stages)
+            stage->start(&this->stopFlag);
+    }
+
+    /**
+     * @brief Waits until all sources have finished and all queues are drained.
+     */
+    void join()
+    {
+        for (auto& stage : this->stages)
+            stage->join();
+    }
+
+    /**
+     * @brief Terminates all stages immediately. Queued items are discarded.
+     */
+    void stop()
+    {
+        this->stopFlag = true;
+        this->join();
+    }
+
+    std::vector<StageStatistics> getStatistics() const
+    {
+        std::vector<StageStatistics> statistics;
+        for (auto& stage : this->stages)
+            statistics.push_back(stage->getStatistics());
+        return statistics;
+    }
+
+private:
+    std::vector<std::unique_ptr<StageBase>> stages;
+    std::atomic<bool> stopFlag{false};
+};
+
+
+/**
+ * @brief Uncompressed frame passed between pipeline stages (host memory).
+ */
+struct RawFrame
+{
+    std::vector<uint8_t> data;
+    uint64_t pitch = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    bool forceIFrame = false;
+};
+
+
+/**
+ * @brief Compressed frame passed between pipeline stages.
+ */
+struct Packet
+{
+    std::vector<uint8_t> data;
+    uint32_t width = 0;
+    uint32_t height = 0;
+};
+
+
+/**
+ * @brief Called by the ready-made stages with the error message of a failed frame, which is then dropped.
+ */
+using StageErrorHandler = std::function<void(const char* error)>;
+
+
+#ifdef NVPIPE_WITH_ENCODER
+
+/**
+ * @brief Ready-made stage encoding RawFrames with an NvPipe encoder.
+ */
+class EncodeStage
+{
+public:
+    /**
+     * @param format Format the encoder was created with, used to size the output.
+     * @param codec Codec the encoder was created with, used to size the output.
+     * @param onError Optional handler of encode errors. Failed frames are counted in StageStatistics::dropped either way.
+     */
+    EncodeStage(NvPipe* encoder, NvPipe_Format format, NvPipe_Codec codec, StageErrorHandler onError = nullptr)
+        : encoder(encoder), format(format), codec(codec), onError(onError) {}
+
+    bool operator()(RawFrame& in, Packet& out)
+    {
+        out.data.resize(NvPipe_GetMaxCompressedSize(this->format, this->codec, in.width, in.height));
+        const uint64_t size = NvPipe_Encode(this->encoder, in.data.data(), in.pitch, out.data.data(), out.data.size(), in.width, in.height, in.forceIFrame);
+        if (size == 0)
+        {
+            if (this->onError)
+                this->onError(NvPipe_GetError(this->encoder));
+            return false;
+        }
+
+        out.data.resize(size);
+        out.width = in.width;
+        out.height = in.height;
+        return true;
+    }
+
+private:
+    NvPipe* encoder;
+    NvPipe_Format format;
+    NvPipe_Codec codec;
+    StageErrorHandler onError;
+};
+
+#endif
+
+#ifdef NVPIPE_WITH_DECODER
+
+/**
+ * @brief Ready-made stage decoding Packets with an NvPipe decoder.
+ */
+class DecodeStage
+{
+public:
+    /**
+     * @param bytesPerPixel Output size per pixel of the decoder format, e.g., 4 for NVPIPE_BGRA32.
+     * @param onError Optional handler of decode errors. Failed frames are counted in StageStatistics::dropped either way.
+     */
+    DecodeStage(NvPipe* decoder, double bytesPerPixel, StageErrorHandler onError = nullptr)
+        : decoder(decoder), bytesPerPixel(bytesPerPixel), onError(onError) {}
+
+    bool operator()(Packet& in, RawFrame& out)
+    {
+        out.pitch = (uint64_t) (in.width * this->bytesPerPixel);
+        out.data.resize(out.pitch * in.height);
+        out.width = in.width;
+        out.height = in.height;
+        if (NvPipe_Decode(this->decoder, in.data.data(), in.data.size(), out.data.data(), in.width, in.height) == 0)
+        {
+            if (this->onError)
+                this->onError(NvPipe_GetError(this->decoder));
+            return false;
+        }
+
+        return true;
+    }
+
+private:
+    NvPipe* decoder;
+    double bytesPerPixel;
+    StageErrorHandler onError;
+};
+
+#endif
+
+}
+
+#endif
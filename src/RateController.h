@@ -0,0 +1,164 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+
+/**
+ * @brief Token bucket that budgets encoded bytes over wall-clock time instead of frame count.
+ *
+ * The bucket fills at the target bitrate over the time between frame timestamps and holds at most
+ * `window` seconds of data. A frame may spend a share of what is in the bucket, and its actual size is
+ * deducted afterwards, so overshoots are paid back by the following frames. Frames after an idle period
+ * get a larger budget, while a burst of frames shares the budget of the time it spans.
+ * Over any interval of T seconds the output stays below bitrate * (T + window), plus the overshoot
+ * of a single frame.
+ */
+class RateController
+{
+public:
+    /// The bucket is spent over a few frames, which smooths the budget against timestamp jitter
+    static const uint32_t SPREAD_FRAMES = 3;
+
+    /// Bucket size in frame intervals at the nominal frame rate
+    static const uint32_t WINDOW_FRAMES = 4;
+
+    /// Budgets within this share of the current encoder bitrate do not reconfigure the encoder
+    static const uint32_t DEADBAND_PERCENT = 25;
+
+    /// Minimum time between reconfigures that raise the bitrate, in frame intervals at the nominal frame rate
+    static const uint32_t MIN_RAISE_FRAMES = 30;
+
+    /**
+     * @param bitrate Target bitrate in bits per second.
+     * @param nominalFrameRate Expected average frame rate, used for the minimum frame budget.
+     * @param window Bucket size in seconds.
+     */
+    void configure(uint64_t bitrate, uint32_t nominalFrameRate, double window)
+    {
+        this->bytesPerSecond = bitrate / 8.0;
+        this->nominalFrameRate = std::max(nominalFrameRate, 1u);
+        this->capacity = this->bytesPerSecond * std::max(window, 1.0 / this->nominalFrameRate);
+
+        // Even a frame during a long burst needs a few bytes
+        this->minFrameBytes = this->bytesPerSecond / this->nominalFrameRate / 8.0;
+
+        this->tokens = std::min(this->tokens, this->capacity);
+    }
+
+    /**
+     * @brief Returns the byte budget of the frame captured at the given time.
+     * Timestamps must not decrease, older timestamps are treated as the previous one.
+     */
+    uint64_t plan(uint64_t timestampUs)
+    {
+        if (!this->started)
+        {
+            // The first frame (usually an IDR frame) starts with a full bucket
+            this->tokens = this->capacity;
+            this->started = true;
+        }
+        else if (timestampUs > this->lastTimestampUs)
+        {
+            const double elapsed = 1.0e-6 * (timestampUs - this->lastTimestampUs);
+            this->tokens = std::min(this->tokens + elapsed * this->bytesPerSecond, this->capacity);
+        }
+
+        this->lastTimestampUs = std::max(timestampUs, this->lastTimestampUs);
+
+        return (uint64_t) std::max(this->tokens / SPREAD_FRAMES, this->minFrameBytes);
+    }
+
+    /**
+     * @brief Deducts the actual size of the planned frame.
+     */
+    void commit(uint64_t bytes)
+    {
+        // Debt is bounded so a single huge frame does not starve the stream for long
+        this->tokens = std::max(this->tokens - (double) bytes, -this->capacity);
+    }
+
+    /**
+     * @brief Bitrate at which the encoder produces the given frame budget at the nominal frame rate.
+     */
+    uint64_t getEncoderBitrate(uint64_t budget) const
+    {
+        return budget * 8 * this->nominalFrameRate;
+    }
+
+    /**
+     * @brief Decides whether the encoder is reconfigured for the budget of the last planned frame.
+     *
+     * NVENC has no per-frame size target, so the budget is applied as the bitrate which yields it at the nominal
+     * frame rate. Reconfiguring is not free: small changes are ignored and raises are rate-limited. Cuts are
+     * applied right away, the output bound depends on them.
+     * @param budget Result of plan().
+     * @param encoderBitrate Current bitrate of the encoder.
+     * @return New encoder bitrate, or 0 to keep the current one.
+     */
+    uint64_t getReconfigureBitrate(uint64_t budget, uint64_t encoderBitrate)
+    {
+        const uint64_t rate = this->getEncoderBitrate(budget);
+        if (rate * 100 <= encoderBitrate * (100 + DEADBAND_PERCENT) && rate * 100 >= encoderBitrate * (100 - DEADBAND_PERCENT))
+            return 0;
+
+        const uint64_t intervalUs = MIN_RAISE_FRAMES * 1000000ull / this->nominalFrameRate;
+        if (rate > encoderBitrate && this->raised && this->lastTimestampUs < this->raiseTimestampUs + intervalUs)
+            return 0;
+
+        if (rate > encoderBitrate)
+        {
+            this->raised = true;
+            this->raiseTimestampUs = this->lastTimestampUs;
+        }
+        return rate;
+    }
+
+    double getTokens() const
+    {
+        return this->tokens;
+    }
+
+    double getCapacity() const
+    {
+        return this->capacity;
+    }
+
+private:
+    double bytesPerSecond = 0.0;
+    uint32_t nominalFrameRate = 1;
+    double capacity = 0.0;
+    double minFrameBytes = 0.0;
+    double tokens = 0.0;
+    uint64_t lastTimestampUs = 0;
+    bool started = false;
+    uint64_t raiseTimestampUs = 0;
+    bool raised = false;
+};
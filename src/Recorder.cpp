@@ -0,0 +1,844 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Recorder.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define NVPIPE_IO_URING
+#endif
+#endif
+
+
+namespace
+{
+
+inline uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+/**
+ * @brief Scans the blocks of a recording that has no index.
+ */
+std::string recoverIndex(std::ifstream& in, uint64_t fileSize, std::vector<RecordingIndexEntry>& index)
+{
+    uint64_t offset = RECORDING_ALIGNMENT;
+    std::vector<uint8_t> block;
+
+    while (offset + sizeof(RecordingBlockHeader) <= fileSize)
+    {
+        RecordingBlockHeader header;
+        in.seekg(offset);
+        if (!in.read((char*) &header, sizeof(header)))
+            break;
+
+        // Preallocated space after the last block is zero
+        if (memcmp(header.magic, RECORDING_BLOCK_MAGIC, sizeof(header.magic)) != 0)
+            break;
+
+        if (header.size < header.used || header.used < sizeof(header) || offset + header.size > fileSize)
+            return "Corrupt block at offset " + std::to_string(offset);
+
+        block.resize(header.used);
+        in.seekg(offset);
+        if (!in.read((char*) block.data(), header.used))
+            return "Failed to read block at offset " + std::to_string(offset);
+
+        uint64_t position = sizeof(RecordingBlockHeader);
+        for (uint32_t i = 0; i < header.numFrames; ++i)
+        {
+            RecordingFrameHeader frame;
+            if (position + sizeof(frame) > header.used)
+                return "Corrupt frame in block at offset " + std::to_string(offset);
+
+            memcpy(&frame, block.data() + position, sizeof(frame));
+            position += sizeof(frame);
+            if (position + frame.size > header.used)
+                return "Corrupt frame in block at offset " + std::to_string(offset);
+
+            index.push_back({ offset + position, frame.timestampUs, frame.size, frame.flags });
+            position += frame.size;
+        }
+
+        offset += header.size;
+    }
+
+    return "";
+}
+
+}
+
+
+std::string readRecordingIndex(const std::string& path, RecordingHeader& header, std::vector<RecordingIndexEntry>& index, bool& recovered)
+{
+    index.clear();
+    recovered = false;
+
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return "Failed to open " + path;
+
+    in.seekg(0, std::ios::end);
+    const uint64_t fileSize = (uint64_t) in.tellg();
+    in.seekg(0);
+
+    if (!in.read((char*) &header, sizeof(header)) || memcmp(header.magic, RECORDING_MAGIC, sizeof(header.magic)) != 0)
+        return "Not an NvPipe recording";
+    if (header.version != RECORDING_VERSION)
+        return "Unsupported recording version " + std::to_string(header.version);
+
+    RecordingTrailer trailer;
+    if (fileSize >= RECORDING_ALIGNMENT + sizeof(trailer))
+    {
+        in.seekg(fileSize - sizeof(trailer));
+        if (in.read((char*) &trailer, sizeof(trailer)) && memcmp(trailer.magic, RECORDING_INDEX_MAGIC, sizeof(trailer.magic)) == 0
+            && trailer.indexOffset + trailer.numFrames * sizeof(RecordingIndexEntry) + sizeof(trailer) == fileSize)
+        {
+            index.resize(trailer.numFrames);
+            in.seekg(trailer.indexOffset);
+            if (!in.read((char*) index.data(), index.size() * sizeof(RecordingIndexEntry)))
+                return "Failed to read index";
+
+            return "";
+        }
+    }
+
+    in.clear();
+    recovered = true;
+    return recoverIndex(in, fileSize, index);
+}
+
+
+#ifndef _WIN32
+
+namespace
+{
+
+/**
+ * @brief Synchronous fallback: writes on complete(), coalescing adjacent blocks of a file into one pwritev.
+ */
+class PwritevWriter : public BlockWriter
+{
+public:
+    void submit(const WriteRequest& request) override
+    {
+        this->requests.push_back(request);
+    }
+
+    void complete(std::vector<WriteCompletion>& completions, bool /*wait*/) override
+    {
+        size_t i = 0;
+        while (i < this->requests.size())
+        {
+            // Blocks of a stream are queued in file order, so consecutive requests are often contiguous
+            size_t end = i + 1;
+            while (end < this->requests.size() && end - i < IOV_MAX && this->requests[end].fd == this->requests[i].fd
+                   && this->requests[end].offset == this->requests[end - 1].offset + this->requests[end - 1].size)
+                ++end;
+
+            std::vector<iovec> iov;
+            for (size_t j = i; j < end; ++j)
+                iov.push_back({ (void*) this->requests[j].data, (size_t) this->requests[j].size });
+
+            ssize_t result;
+            do
+                result = pwritev(this->requests[i].fd, iov.data(), (int) iov.size(), (off_t) this->requests[i].offset);
+            while (result < 0 && errno == EINTR);
+            const int error = (result < 0) ? errno : 0;
+
+            // Distribute the written bytes, short writes are continued by the recorder
+            int64_t remaining = (result < 0) ? 0 : result;
+            for (size_t j = i; j < end; ++j)
+            {
+                int64_t r = (result < 0) ? -error : std::min<int64_t>(remaining, (int64_t) this->requests[j].size);
+                remaining -= std::max<int64_t>(r, 0);
+                completions.push_back({ this->requests[j], r });
+            }
+
+            i = end;
+        }
+
+        this->requests.clear();
+    }
+
+    uint32_t getPending() const override { return (uint32_t) this->requests.size(); }
+    uint32_t getCapacity() const override { return UINT32_MAX; }
+    bool isIoUring() const override { return false; }
+
+private:
+    std::vector<WriteRequest> requests;
+};
+
+
+#ifdef NVPIPE_IO_URING
+
+/**
+ * @brief io_uring through raw system calls (no liburing dependency). One IORING_OP_WRITEV per block.
+ */
+class IoUringWriter : public BlockWriter
+{
+public:
+    explicit IoUringWriter(uint32_t entries)
+    {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+
+        this->ring = (int) syscall(__NR_io_uring_setup, entries, &params);
+        if (this->ring < 0)
+            throw std::runtime_error("io_uring_setup failed: " + std::string(strerror(errno)));
+
+        this->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        this->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMap)
+            this->sqRingSize = this->cqRingSize = std::max(this->sqRingSize, this->cqRingSize);
+
+        this->sqRing = mmap(nullptr, this->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->ring, IORING_OFF_SQ_RING);
+        this->cqRing = singleMap ? this->sqRing : mmap(nullptr, this->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->ring, IORING_OFF_CQ_RING);
+        this->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        this->sqes = (io_uring_sqe*) mmap(nullptr, this->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->ring, IORING_OFF_SQES);
+
+        if (this->sqRing == MAP_FAILED || this->cqRing == MAP_FAILED || this->sqes == (io_uring_sqe*) MAP_FAILED)
+        {
+            this->unmap();
+            close(this->ring);
+            throw std::runtime_error("Failed to map io_uring");
+        }
+
+        uint8_t* sq = (uint8_t*) this->sqRing;
+        this->sqHead = (unsigned*) (sq + params.sq_off.head);
+        this->sqTail = (unsigned*) (sq + params.sq_off.tail);
+        this->sqMask = *(unsigned*) (sq + params.sq_off.ring_mask);
+        this->sqArray = (unsigned*) (sq + params.sq_off.array);
+
+        uint8_t* cq = (uint8_t*) this->cqRing;
+        this->cqHead = (unsigned*) (cq + params.cq_off.head);
+        this->cqTail = (unsigned*) (cq + params.cq_off.tail);
+        this->cqMask = *(unsigned*) (cq + params.cq_off.ring_mask);
+        this->cqes = (io_uring_cqe*) (cq + params.cq_off.cqes);
+
+        this->capacity = params.sq_entries;
+        this->slots.resize(this->capacity);
+        this->iovecs.resize(this->capacity);
+        for (uint32_t i = 0; i < this->capacity; ++i)
+            this->freeSlots.push_back(this->capacity - 1 - i);
+    }
+
+    ~IoUringWriter() override
+    {
+        // The recorder drains all writes before destroying the writer
+        this->unmap();
+        close(this->ring);
+    }
+
+    void submit(const WriteRequest& request) override
+    {
+        const uint32_t slot = this->freeSlots.back();
+        this->freeSlots.pop_back();
+
+        this->slots[slot] = request;
+        this->iovecs[slot] = { (void*) request.data, (size_t) request.size };
+
+        const unsigned tail = *this->sqTail;
+        const unsigned index = tail & this->sqMask;
+
+        io_uring_sqe* sqe = &this->sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_WRITEV;
+        sqe->fd = request.fd;
+        sqe->off = request.offset;
+        sqe->addr = (uint64_t) (uintptr_t) &this->iovecs[slot];
+        sqe->len = 1;
+        sqe->user_data = slot;
+
+        this->sqArray[index] = index;
+        __atomic_store_n(this->sqTail, tail + 1, __ATOMIC_RELEASE);
+
+        this->unsubmitted++;
+    }
+
+    void complete(std::vector<WriteCompletion>& completions, bool wait) override
+    {
+        const bool waitForCompletion = wait && this->getPending() > 0 && !this->hasCompletions();
+        if (this->unsubmitted > 0 || waitForCompletion)
+        {
+            int result;
+            do
+                result = (int) syscall(__NR_io_uring_enter, this->ring, this->unsubmitted, waitForCompletion ? 1 : 0, waitForCompletion ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            while (result < 0 && errno == EINTR);
+
+            if (result > 0)
+                this->unsubmitted -= std::min<uint32_t>(this->unsubmitted, (uint32_t) result);
+        }
+
+        unsigned head = *this->cqHead;
+        const unsigned tail = __atomic_load_n(this->cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head)
+        {
+            const io_uring_cqe& cqe = this->cqes[head & this->cqMask];
+            const uint32_t slot = (uint32_t) cqe.user_data;
+            completions.push_back({ this->slots[slot], cqe.res });
+            this->freeSlots.push_back(slot);
+        }
+        __atomic_store_n(this->cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    uint32_t getPending() const override { return this->capacity - (uint32_t) this->freeSlots.size(); }
+    uint32_t getCapacity() const override { return this->capacity; }
+    bool isIoUring() const override { return true; }
+
+private:
+    bool hasCompletions() const
+    {
+        return *this->cqHead != __atomic_load_n(this->cqTail, __ATOMIC_ACQUIRE);
+    }
+
+    void unmap()
+    {
+        if (this->sqes && this->sqes != (io_uring_sqe*) MAP_FAILED)
+            munmap(this->sqes, this->sqesSize);
+        if (this->cqRing && this->cqRing != MAP_FAILED && this->cqRing != this->sqRing)
+            munmap(this->cqRing, this->cqRingSize);
+        if (this->sqRing && this->sqRing != MAP_FAILED)
+            munmap(this->sqRing, this->sqRingSize);
+    }
+
+private:
+    int ring = -1;
+
+    void* sqRing = nullptr;
+    size_t sqRingSize = 0;
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned sqMask = 0;
+    unsigned* sqArray = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqesSize = 0;
+
+    void* cqRing = nullptr;
+    size_t cqRingSize = 0;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    uint32_t capacity = 0;
+    uint32_t unsubmitted = 0;
+    std::vector<WriteRequest> slots;
+    std::vector<iovec> iovecs;
+    std::vector<uint32_t> freeSlots;
+};
+
+#endif
+
+uint8_t* allocateAligned(uint64_t size)
+{
+    void* ptr = nullptr;
+    if (posix_memalign(&ptr, RECORDING_ALIGNMENT, size) != 0)
+        throw std::bad_alloc();
+    return (uint8_t*) ptr;
+}
+
+/**
+ * @brief Synchronous write of a whole buffer, for headers and the index.
+ */
+void writeFully(int fd, const uint8_t* data, uint64_t size, uint64_t offset, const std::string& path)
+{
+    while (size > 0)
+    {
+        const ssize_t result = pwrite(fd, data, size, (off_t) offset);
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result <= 0)
+            throw std::runtime_error("Failed to write " + path + ": " + strerror(result < 0 ? errno : EIO));
+
+        data += result;
+        size -= result;
+        offset += result;
+    }
+}
+
+}
+
+
+std::unique_ptr<BlockWriter> BlockWriter::create(bool useIoUring, uint32_t queueDepth)
+{
+#ifdef NVPIPE_IO_URING
+    if (useIoUring)
+    {
+        // Not available on old kernels or if forbidden, e.g., by a container seccomp profile
+        try
+        {
+            return std::unique_ptr<BlockWriter>(new IoUringWriter(queueDepth));
+        }
+        catch (std::runtime_error&)
+        {
+        }
+    }
+#endif
+
+    return std::unique_ptr<BlockWriter>(new PwritevWriter());
+}
+
+
+Recorder::Recorder(const RecorderConfig& config) : config(config)
+{
+    if (this->config.blockSize < RECORDING_ALIGNMENT || this->config.maxQueuedBlocks == 0)
+        throw std::runtime_error("Invalid recorder configuration");
+
+    this->writer = BlockWriter::create(config.useIoUring, std::max(config.maxQueuedBlocks, 8u));
+    this->thread = std::thread(&Recorder::run, this);
+}
+
+Recorder::~Recorder()
+{
+    for (size_t i = 0; i < this->streams.size(); ++i)
+    {
+        try
+        {
+            this->closeStream((uint32_t) i);
+        }
+        catch (std::exception&)
+        {
+            // Errors can only be reported by closing streams explicitly
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->wake.notify_all();
+    this->thread.join();
+
+    for (Block* b : this->freeBlocks)
+        this->releaseBlock(b);
+}
+
+uint32_t Recorder::addStream(const std::string& path, uint32_t codec, uint32_t format, uint32_t width, uint32_t height)
+{
+    std::unique_ptr<Stream> stream(new Stream());
+    stream->path = path;
+
+    // Direct I/O bypasses the page cache, which only works on file systems that support it
+    const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+#ifdef O_DIRECT
+    if (this->config.directIO)
+        stream->fd = open(path.c_str(), flags | O_DIRECT, 0644);
+#endif
+    if (stream->fd < 0)
+        stream->fd = open(path.c_str(), flags, 0644);
+    if (stream->fd < 0)
+        throw std::runtime_error("Failed to create " + path + ": " + strerror(errno));
+
+    // Header block
+    std::unique_ptr<uint8_t, void(*)(void*)> block(allocateAligned(RECORDING_ALIGNMENT), std::free);
+    memset(block.get(), 0, RECORDING_ALIGNMENT);
+
+    RecordingHeader header;
+    memcpy(header.magic, RECORDING_MAGIC, sizeof(header.magic));
+    header.version = RECORDING_VERSION;
+    header.codec = codec;
+    header.format = format;
+    header.width = width;
+    header.height = height;
+    header.alignment = (uint32_t) RECORDING_ALIGNMENT;
+    memcpy(block.get(), &header, sizeof(header));
+
+    try
+    {
+        writeFully(stream->fd, block.get(), RECORDING_ALIGNMENT, 0, path);
+    }
+    catch (std::exception&)
+    {
+        close(stream->fd);
+        throw;
+    }
+
+    stream->nextOffset = RECORDING_ALIGNMENT;
+    stream->allocated = RECORDING_ALIGNMENT;
+
+    std::lock_guard<std::mutex> lock(this->streamsMutex);
+    this->streams.push_back(std::move(stream));
+    return (uint32_t) (this->streams.size() - 1);
+}
+
+Recorder::Stream* Recorder::getStream(uint32_t stream)
+{
+    std::lock_guard<std::mutex> lock(this->streamsMutex);
+    if (stream >= this->streams.size())
+        throw std::runtime_error("Invalid recorder stream");
+
+    return this->streams[stream].get();
+}
+
+Recorder::Block* Recorder::acquireBlock(uint64_t size)
+{
+    // Frames larger than a block get a block of their own
+    if (size > this->config.blockSize)
+    {
+        Block* block = new Block();
+        block->capacity = alignUp(size, RECORDING_ALIGNMENT);
+        block->data = allocateAligned(block->capacity);
+        return block;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (!this->freeBlocks.empty())
+        {
+            Block* block = this->freeBlocks.back();
+            this->freeBlocks.pop_back();
+            return block;
+        }
+    }
+
+    Block* block = new Block();
+    block->capacity = alignUp(this->config.blockSize, RECORDING_ALIGNMENT);
+    block->data = allocateAligned(block->capacity);
+    return block;
+}
+
+void Recorder::releaseBlock(Block* block)
+{
+    std::free(block->data);
+    delete block;
+}
+
+void Recorder::write(uint32_t id, const uint8_t* data, uint64_t size, uint64_t timestampUs, bool keyFrame)
+{
+    Stream* stream = this->getStream(id);
+
+    if (size > UINT32_MAX)
+        throw std::runtime_error("Frame too large for recording");
+
+    std::lock_guard<std::mutex> lock(stream->mutex);
+    if (stream->closed)
+        throw std::runtime_error("Recorder stream is closed");
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (!stream->error.empty())
+            throw std::runtime_error(stream->error);
+    }
+
+    const uint64_t required = sizeof(RecordingFrameHeader) + size;
+
+    Block*& block = stream->current;
+    if (block && block->used + required > block->capacity)
+    {
+        this->queueBlock(stream, block);
+        block = nullptr;
+    }
+
+    if (!block)
+    {
+        block = this->acquireBlock(sizeof(RecordingBlockHeader) + required);
+        block->used = sizeof(RecordingBlockHeader);
+        block->numFrames = 0;
+        block->firstEntry = stream->index.size();
+        block->stream = stream;
+    }
+
+    const RecordingFrameHeader frame = { timestampUs, (uint32_t) size, keyFrame ? RECORDING_FRAME_KEY : 0u };
+    memcpy(block->data + block->used, &frame, sizeof(frame));
+    memcpy(block->data + block->used + sizeof(frame), data, size);
+
+    // Offsets are relative to the block until it is placed in the file
+    stream->index.push_back({ block->used + sizeof(frame), timestampUs, (uint32_t) size, frame.flags });
+    block->used += required;
+    block->numFrames++;
+
+    this->frames++;
+    this->bytes += size;
+
+    if (block->used + sizeof(RecordingFrameHeader) >= block->capacity)
+    {
+        this->queueBlock(stream, block);
+        block = nullptr;
+    }
+}
+
+void Recorder::queueBlock(Stream* stream, Block* block)
+{
+    // Called with the stream locked
+    block->size = alignUp(block->used, RECORDING_ALIGNMENT);
+    memset(block->data + block->used, 0, block->size - block->used);
+
+    RecordingBlockHeader header;
+    memcpy(header.magic, RECORDING_BLOCK_MAGIC, sizeof(header.magic));
+    header.sequence = stream->sequence++;
+    header.size = block->size;
+    header.used = block->used;
+    header.numFrames = block->numFrames;
+    header.reserved = 0;
+    memcpy(block->data, &header, sizeof(header));
+
+    block->offset = stream->nextOffset;
+    block->written = 0;
+    stream->nextOffset += block->size;
+
+    for (size_t i = block->firstEntry; i < stream->index.size(); ++i)
+        stream->index[i].offset += block->offset;
+
+    std::unique_lock<std::mutex> lock(this->mutex);
+    if (this->queuedBlocks >= this->config.maxQueuedBlocks)
+    {
+        this->stalls++;
+        this->drained.wait(lock, [this]() { return this->queuedBlocks < this->config.maxQueuedBlocks; });
+    }
+
+    this->queue.push_back(block);
+    this->queuedBlocks++;
+    stream->inFlight++;
+    lock.unlock();
+
+    this->wake.notify_one();
+}
+
+void Recorder::closeStream(uint32_t id)
+{
+    Stream* stream = this->getStream(id);
+
+    std::lock_guard<std::mutex> lock(stream->mutex);
+    if (stream->closed)
+        return;
+
+    stream->closed = true;
+
+    if (stream->current)
+    {
+        this->queueBlock(stream, stream->current);
+        stream->current = nullptr;
+    }
+
+    this->finishStream(stream);
+}
+
+void Recorder::finishStream(Stream* stream)
+{
+    std::string error;
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->drained.wait(lock, [stream]() { return stream->inFlight == 0; });
+        error = stream->error;
+    }
+
+    try
+    {
+        if (!error.empty())
+            throw std::runtime_error(error);
+
+        // Index and trailer end the file; the buffer is aligned for direct I/O, the padding is truncated
+        const uint64_t indexBytes = stream->index.size() * sizeof(RecordingIndexEntry);
+        const uint64_t size = indexBytes + sizeof(RecordingTrailer);
+        std::unique_ptr<uint8_t, void(*)(void*)> buffer(allocateAligned(alignUp(size, RECORDING_ALIGNMENT)), std::free);
+        memset(buffer.get(), 0, alignUp(size, RECORDING_ALIGNMENT));
+        memcpy(buffer.get(), stream->index.data(), indexBytes);
+
+        RecordingTrailer trailer;
+        memcpy(trailer.magic, RECORDING_INDEX_MAGIC, sizeof(trailer.magic));
+        trailer.indexOffset = stream->nextOffset;
+        trailer.numFrames = stream->index.size();
+        memcpy(buffer.get() + indexBytes, &trailer, sizeof(trailer));
+
+        writeFully(stream->fd, buffer.get(), alignUp(size, RECORDING_ALIGNMENT), stream->nextOffset, stream->path);
+
+        // Drops the alignment padding and the preallocated space
+        if (ftruncate(stream->fd, (off_t) (stream->nextOffset + size)) != 0 || fdatasync(stream->fd) != 0)
+            throw std::runtime_error("Failed to finish " + stream->path + ": " + strerror(errno));
+    }
+    catch (std::exception&)
+    {
+        close(stream->fd);
+        stream->fd = -1;
+        throw;
+    }
+
+    close(stream->fd);
+    stream->fd = -1;
+    std::vector<RecordingIndexEntry>().swap(stream->index);
+}
+
+void Recorder::run()
+{
+    std::vector<Block*> batch;
+    std::vector<WriteCompletion> completions;
+
+    while (true)
+    {
+        batch.clear();
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->wake.wait(lock, [this]() { return this->stopping || !this->queue.empty() || this->writer->getPending() > 0; });
+
+            if (this->stopping && this->queue.empty() && this->writer->getPending() == 0)
+                return;
+
+            while (!this->queue.empty() && batch.size() + this->writer->getPending() < this->writer->getCapacity())
+            {
+                batch.push_back(this->queue.front());
+                this->queue.pop_front();
+            }
+        }
+
+        for (Block* block : batch)
+        {
+            Stream* stream = block->stream;
+
+            // Reserve file space in large steps, so that writes do not extend the file
+            if (block->offset + block->size > stream->allocated)
+            {
+                const uint64_t end = alignUp(block->offset + block->size, std::max<uint64_t>(this->config.preallocateBytes, RECORDING_ALIGNMENT));
+#ifdef __linux__
+                fallocate(stream->fd, 0, (off_t) stream->allocated, (off_t) (end - stream->allocated)); // best effort
+#endif
+                stream->allocated = end;
+            }
+
+            this->writer->submit({ stream->fd, block->offset, block->data, block->size, block });
+        }
+
+        // Without new blocks, wait for the writes in flight
+        completions.clear();
+        this->writer->complete(completions, batch.empty());
+
+        for (const WriteCompletion& c : completions)
+            this->completeWrite(c);
+    }
+}
+
+void Recorder::completeWrite(const WriteCompletion& completion)
+{
+    Block* block = (Block*) completion.request.userData;
+    Stream* stream = block->stream;
+
+    std::string error;
+    if (completion.result < 0)
+        error = "Failed to write " + stream->path + ": " + strerror((int) -completion.result);
+    else if (completion.result == 0)
+        error = "Failed to write " + stream->path + ": no progress";
+    else
+    {
+        block->written += (uint64_t) completion.result;
+
+        // Continue short writes
+        if (block->written < block->size)
+        {
+            this->writer->submit({ stream->fd, block->offset + block->written, block->data + block->written, block->size - block->written, block });
+            return;
+        }
+
+        this->blocks++;
+        this->diskBytes += block->size;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (!error.empty() && stream->error.empty())
+            stream->error = error;
+
+        stream->inFlight--;
+        this->queuedBlocks--;
+
+        if (block->capacity == alignUp(this->config.blockSize, RECORDING_ALIGNMENT))
+        {
+            this->freeBlocks.push_back(block);
+            block = nullptr;
+        }
+    }
+    this->drained.notify_all();
+
+    if (block)
+        this->releaseBlock(block);
+}
+
+RecorderStatistics Recorder::getStatistics() const
+{
+    RecorderStatistics statistics;
+    statistics.frames = this->frames;
+    statistics.bytes = this->bytes;
+    statistics.blocks = this->blocks;
+    statistics.diskBytes = this->diskBytes;
+    statistics.stalls = this->stalls;
+    statistics.ioUring = this->writer->isIoUring();
+    return statistics;
+}
+
+#else
+
+Recorder::Recorder(const RecorderConfig& config) : config(config)
+{
+    throw std::runtime_error("Recorder is not supported on this platform");
+}
+
+Recorder::~Recorder()
+{
+}
+
+uint32_t Recorder::addStream(const std::string& path, uint32_t codec, uint32_t format, uint32_t width, uint32_t height)
+{
+    return 0;
+}
+
+void Recorder::write(uint32_t stream, const uint8_t* data, uint64_t size, uint64_t timestampUs, bool keyFrame)
+{
+}
+
+void Recorder::closeStream(uint32_t stream)
+{
+}
+
+RecorderStatistics Recorder::getStatistics() const
+{
+    return RecorderStatistics();
+}
+
+std::unique_ptr<BlockWriter> BlockWriter::create(bool useIoUring, uint32_t queueDepth)
+{
+    return nullptr;
+}
+
+#endif
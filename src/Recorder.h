@@ -0,0 +1,278 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/**
+ * Recording file format (NvPipe_CreateRecorder).
+ *
+ * A recording starts with a RecordingHeader, padded to RECORDING_ALIGNMENT, followed by blocks. Every block starts
+ * with a RecordingBlockHeader and holds whole frames, each a RecordingFrameHeader followed by the compressed data;
+ * the rest of the block is zero padding up to the alignment. On close, one RecordingIndexEntry per frame and a
+ * RecordingTrailer are appended, so the trailer ends the file. Blocks are self-describing: the index of a recording
+ * that was not closed is recovered by scanning the blocks.
+ */
+
+static const char RECORDING_MAGIC[8] = { 'N', 'V', 'P', 'R', 'E', 'C', 'R', 'D' };
+static const char RECORDING_BLOCK_MAGIC[8] = { 'N', 'V', 'P', 'B', 'L', 'O', 'C', 'K' };
+static const char RECORDING_INDEX_MAGIC[8] = { 'N', 'V', 'P', 'I', 'N', 'D', 'E', 'X' };
+static const uint32_t RECORDING_VERSION = 1;
+static const uint64_t RECORDING_ALIGNMENT = 4096;  ///< Block offsets and sizes, suitable for O_DIRECT
+static const uint32_t RECORDING_FRAME_KEY = 1;     ///< Frame flag: I-frame
+
+#pragma pack(push, 1)
+
+struct RecordingHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t codec;          ///< NvPipe_Codec
+    uint32_t format;         ///< NvPipe_Format
+    uint32_t width, height;
+    uint32_t alignment;      ///< RECORDING_ALIGNMENT
+};
+
+struct RecordingBlockHeader
+{
+    char magic[8];
+    uint64_t sequence;       ///< Block number within the stream
+    uint64_t size;           ///< Bytes of the block including header and padding
+    uint64_t used;           ///< Bytes of the block up to the end of the last frame
+    uint32_t numFrames;
+    uint32_t reserved;
+};
+
+struct RecordingFrameHeader
+{
+    uint64_t timestampUs;
+    uint32_t size;
+    uint32_t flags;          ///< RECORDING_FRAME_KEY
+};
+
+struct RecordingIndexEntry
+{
+    uint64_t offset;         ///< Compressed data of the frame, relative to the start of the file
+    uint64_t timestampUs;
+    uint32_t size;
+    uint32_t flags;
+};
+
+struct RecordingTrailer
+{
+    char magic[8];
+    uint64_t indexOffset;
+    uint64_t numFrames;
+};
+
+#pragma pack(pop)
+
+
+/**
+ * @brief Reads the header and frame index of a recording.
+ * @param recovered Set if the recording was not closed and the index was rebuilt from the blocks.
+ * @return Error message, empty on success.
+ */
+std::string readRecordingIndex(const std::string& path, RecordingHeader& header, std::vector<RecordingIndexEntry>& index, bool& recovered);
+
+
+/**
+ * @brief Positional write of a block, identified by userData.
+ */
+struct WriteRequest
+{
+    int fd;
+    uint64_t offset;
+    const uint8_t* data;
+    uint64_t size;
+    void* userData;
+};
+
+struct WriteCompletion
+{
+    WriteRequest request;
+    int64_t result;          ///< Bytes written or -errno
+};
+
+
+/**
+ * @brief Asynchronous positional writes, used by the I/O thread of the recorder only.
+ */
+class BlockWriter
+{
+public:
+    virtual ~BlockWriter() = default;
+
+    /**
+     * @brief Queues a write. At most getCapacity() writes may be pending.
+     */
+    virtual void submit(const WriteRequest& request) = 0;
+
+    /**
+     * @brief Starts queued writes and collects finished ones.
+     * @param wait Block until at least one write has finished (if any is pending).
+     */
+    virtual void complete(std::vector<WriteCompletion>& completions, bool wait) = 0;
+
+    virtual uint32_t getPending() const = 0;
+    virtual uint32_t getCapacity() const = 0;
+    virtual bool isIoUring() const = 0;
+
+    /**
+     * @brief Creates an io_uring writer if supported by the kernel (and allowed), otherwise a pwritev writer.
+     */
+    static std::unique_ptr<BlockWriter> create(bool useIoUring, uint32_t queueDepth);
+};
+
+
+struct RecorderConfig
+{
+    uint64_t blockSize = 1ull << 20;          ///< Frames are aggregated into blocks of this size (rounded to RECORDING_ALIGNMENT)
+    uint64_t preallocateBytes = 256ull << 20; ///< Files are extended with fallocate in steps of this size
+    uint32_t maxQueuedBlocks = 64;            ///< Blocks waiting for or in I/O over all streams before writers wait
+    bool directIO = false;                    ///< O_DIRECT, falls back to buffered I/O if the file system does not support it
+    bool useIoUring = true;                   ///< Otherwise pwritev
+};
+
+struct RecorderStatistics
+{
+    uint64_t frames = 0;        ///< Frames written
+    uint64_t bytes = 0;         ///< Compressed bytes written
+    uint64_t blocks = 0;        ///< Blocks written to disk
+    uint64_t diskBytes = 0;     ///< Bytes written to disk, including headers and padding
+    uint64_t stalls = 0;        ///< Writes that waited because maxQueuedBlocks were queued
+    bool ioUring = false;       ///< Writes use io_uring instead of pwritev
+};
+
+
+/**
+ * @brief Records compressed frames of many streams, one file per stream, with a single I/O thread.
+ *
+ * Frames are copied into per-stream blocks; full blocks are written asynchronously as one aligned write
+ * (io_uring if available, pwritev otherwise), so the cost per frame is a memcpy instead of a syscall.
+ * Files grow in large fallocate steps, which keeps writes from extending the file one block at a time.
+ * Streams can be written from different threads concurrently; calls on the same stream must be serialized.
+ * Errors are reported as std::runtime_error; I/O errors of a stream surface on its next write or on close.
+ */
+class Recorder
+{
+public:
+    explicit Recorder(const RecorderConfig& config);
+    ~Recorder();
+
+    Recorder(const Recorder&) = delete;
+    Recorder& operator=(const Recorder&) = delete;
+
+    /**
+     * @return Stream id.
+     */
+    uint32_t addStream(const std::string& path, uint32_t codec, uint32_t format, uint32_t width, uint32_t height);
+
+    void write(uint32_t stream, const uint8_t* data, uint64_t size, uint64_t timestampUs, bool keyFrame);
+
+    /**
+     * @brief Writes the remaining frames and the index, then closes the file.
+     */
+    void closeStream(uint32_t stream);
+
+    RecorderStatistics getStatistics() const;
+
+private:
+    struct Stream;
+
+    struct Block
+    {
+        uint8_t* data = nullptr;
+        uint64_t capacity = 0;
+        uint64_t used = 0;
+        uint64_t size = 0;          ///< Bytes to write (used, aligned)
+        uint64_t offset = 0;
+        uint64_t written = 0;
+        uint32_t numFrames = 0;
+        size_t firstEntry = 0;      ///< First index entry of the stream in this block
+        Stream* stream = nullptr;
+    };
+
+    struct Stream
+    {
+        int fd = -1;
+        std::string path;
+        bool closed = false;
+
+        std::mutex mutex;           ///< Current block and index, held by writers of the stream
+        Block* current = nullptr;
+        uint64_t nextOffset = 0;
+        uint64_t sequence = 0;
+        std::vector<RecordingIndexEntry> index;
+
+        uint64_t allocated = 0;     ///< File size reserved with fallocate (I/O thread)
+        uint32_t inFlight = 0;      ///< Queued blocks (recorder mutex)
+        std::string error;          ///< First I/O error (recorder mutex)
+    };
+
+private:
+    Stream* getStream(uint32_t stream);
+    Block* acquireBlock(uint64_t size);
+    void releaseBlock(Block* block);
+    void queueBlock(Stream* stream, Block* block);
+    void finishStream(Stream* stream);
+    void run();
+    void completeWrite(const WriteCompletion& completion);
+
+private:
+    const RecorderConfig config;
+    std::unique_ptr<BlockWriter> writer;
+
+    std::mutex streamsMutex;
+    std::vector<std::unique_ptr<Stream>> streams;
+
+    std::mutex mutex;
+    std::condition_variable wake;      ///< I/O thread: blocks queued or stopping
+    std::condition_variable drained;   ///< Writers: blocks finished
+    std::deque<Block*> queue;
+    uint32_t queuedBlocks = 0;         ///< Queued or in I/O
+    std::vector<Block*> freeBlocks;
+    bool stopping = false;
+
+    std::atomic<uint64_t> frames{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> blocks{0};
+    std::atomic<uint64_t> diskBytes{0};
+    std::atomic<uint64_t> stalls{0};
+
+    std::thread thread;
+};
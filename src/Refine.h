@@ -0,0 +1,114 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+
+/**
+ * @brief Progressive mode: picks the session and the lossy rate of each frame from whether the input changed.
+ *
+ * Changing input goes to the bitrate-limited lossy session. Once a frame repeats, it is refined with
+ * STEPS lossy frames at twice, four times, ... the bitrate and then sent exactly by the lossless session
+ * (starting with an IDR frame), which continues while the input is static. The next change returns to the lossy
+ * session at its previous rate and with an IDR frame, since the decoder references are those of the lossless stream.
+ */
+class RefinePlanner
+{
+public:
+    /// Lossy refinement frames before the lossless one
+    static const uint32_t STEPS = 2;
+
+    struct Decision
+    {
+        bool lossless = false;    ///< Encode with the lossless session
+        bool forceIFrame = false; ///< Encode an IDR frame
+        uint64_t bitrate = 0;     ///< Rate to reconfigure the lossy session to, 0 to keep it
+    };
+
+    /**
+     * @param changed True if the input differs from the previous frame.
+     * @param encoderBitrate Current rate of the lossy session.
+     */
+    Decision next(bool changed, uint64_t encoderBitrate)
+    {
+        Decision decision;
+
+        if (changed)
+        {
+            if (this->frames > STEPS)
+                decision.forceIFrame = true;
+            if (this->frames > 0)
+                decision.bitrate = this->bitrate;
+
+            this->frames = 0;
+            return decision;
+        }
+
+        this->frames = std::min(this->frames + 1, STEPS + 2);
+
+        if (this->frames <= STEPS)
+        {
+            if (this->frames == 1)
+                this->bitrate = encoderBitrate;
+
+            decision.bitrate = this->bitrate << this->frames;
+            return decision;
+        }
+
+        decision.lossless = true;
+        decision.forceIFrame = (this->frames == STEPS + 1);
+        return decision;
+    }
+
+    /**
+     * @brief Forgets the refinement, e.g., after the sessions were recreated.
+     */
+    void reset()
+    {
+        this->frames = 0;
+    }
+
+    bool isRefining() const
+    {
+        return this->frames > 0;
+    }
+
+    /**
+     * @brief Sets the lossy rate restored when the input changes again.
+     */
+    void setBitrate(uint64_t bitrate)
+    {
+        this->bitrate = bitrate;
+    }
+
+private:
+    uint32_t frames = 0;   // consecutive unchanged frames
+    uint64_t bitrate = 0;  // lossy session rate before refinement
+};
@@ -0,0 +1,173 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+
+/**
+ * Binary trace format shared by the API recorder (NvPipe_StartTrace) and the replay tool.
+ *
+ * A trace starts with a TraceHeader, followed by TraceRecords. Each record is followed by its payload,
+ * which is stored raw or run-length encoded (see traceCompress).
+ */
+
+static const char TRACE_MAGIC[8] = { 'N', 'V', 'P', 'T', 'R', 'A', 'C', 'E' };
+static const uint32_t TRACE_VERSION = 1;
+
+enum class TraceOp : uint32_t
+{
+    CreateEncoder = 1,  ///< args: format, codec, compression, bitrate, targetFrameRate
+    SetBitrate,         ///< args: bitrate, targetFrameRate
+    Encode,             ///< args: srcPitch, dstSize, width, height, forceIFrame, format, srcOnDevice; payload: input frame
+    EncodeTexture,      ///< args: texture, target, dstSize, width, height, forceIFrame
+    EncodePBO,          ///< args: pbo, dstSize, width, height, forceIFrame
+    EncodeFrame,        ///< args: dstSize, width, height, forceIFrame
+    PostFrame,          ///< args: srcPitch, 0, width, height, forceIFrame, format, srcOnDevice; payload: input frame
+    CreateDecoder,      ///< args: format, codec
+    Decode,             ///< args: width, height, dstOnDevice; payload: compressed input
+    DecodeTexture,      ///< args: width, height, texture, target; payload: compressed input
+    DecodePBO,          ///< args: width, height, pbo; payload: compressed input
+    DecodeFrame,        ///< args: width, height; payload: compressed input
+    QueueDecode,        ///< args: width, height; payload: compressed input
+    FetchLatestFrame,   ///< args: dstOnDevice
+    Destroy,
+    SetTimeout,         ///< args: milliseconds
+    EncodeTimestamped,  ///< args: srcPitch, dstSize, width, height, forceIFrame, format, timestampUs; payload: input frame (replayed from host memory)
+    SetDenoise,         ///< args: strength * 1000
+    EncodeVolume,       ///< args: rowPitch, slicePitch, dstSize, width, height, depth, axis (not replayed)
+    DecodeVolume        ///< args: srcSize, rowPitch, slicePitch, brick (all bricks: UINT64_MAX) (not replayed)
+};
+
+enum class TracePayload : uint32_t
+{
+    None = 0,
+    Raw,
+    RLE
+};
+
+#pragma pack(push, 1)
+
+struct TraceHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t includesPayloads;
+};
+
+struct TraceRecord
+{
+    uint32_t op;             ///< TraceOp
+    uint32_t payloadType;    ///< TracePayload
+    uint64_t instance;       ///< Handle of the encoder/decoder (result of the create call for create records)
+    uint64_t timestampNs;    ///< Call start relative to start of trace
+    uint64_t durationNs;     ///< Time spent inside the call
+    uint64_t result;         ///< Return value (size, bool or handle)
+    uint64_t args[7];        ///< Call arguments, see TraceOp
+    uint64_t payloadSize;    ///< Stored payload bytes following this record
+    uint64_t payloadRawSize; ///< Payload bytes after decompression
+};
+
+#pragma pack(pop)
+
+
+/**
+ * @brief Byte-oriented run-length encoding (PackBits variant).
+ *
+ * Control byte c < 128 is followed by c + 1 literal bytes; c >= 128 is followed by one byte repeated c - 125 times.
+ * Cheap enough for tracing at frame rate while shrinking the large flat areas typical for rendered content.
+ */
+inline void traceCompress(const uint8_t* src, uint64_t size, std::vector<uint8_t>& dst)
+{
+    dst.clear();
+    dst.reserve(size + size / 128 + 1);
+
+    uint64_t i = 0;
+    while (i < size)
+    {
+        // Measure repeat run
+        uint64_t run = 1;
+        while (i + run < size && run < 130 && src[i + run] == src[i])
+            ++run;
+
+        if (run >= 3)
+        {
+            dst.push_back((uint8_t) (run + 125));
+            dst.push_back(src[i]);
+            i += run;
+            continue;
+        }
+
+        // Collect literals until the next repeat run of at least 3
+        uint64_t literals = 0;
+        while (i + literals < size && literals < 128)
+        {
+            if (i + literals + 2 < size && src[i + literals] == src[i + literals + 1] && src[i + literals] == src[i + literals + 2])
+                break;
+            ++literals;
+        }
+
+        dst.push_back((uint8_t) (literals - 1));
+        dst.insert(dst.end(), src + i, src + i + literals);
+        i += literals;
+    }
+}
+
+/**
+ * @return False if the input is corrupt or does not match the expected size.
+ */
+inline bool traceDecompress(const uint8_t* src, uint64_t size, uint8_t* dst, uint64_t dstSize)
+{
+    uint64_t i = 0;
+    uint64_t o = 0;
+    while (i < size)
+    {
+        const uint8_t c = src[i++];
+        if (c < 128)
+        {
+            const uint64_t n = c + 1;
+            if (i + n > size || o + n > dstSize)
+                return false;
+            memcpy(dst + o, src + i, n);
+            i += n;
+            o += n;
+        }
+        else
+        {
+            const uint64_t n = c - 125;
+            if (i >= size || o + n > dstSize)
+                return false;
+            memset(dst + o, src[i++], n);
+            o += n;
+        }
+    }
+
+    return o == dstSize;
+}
@@ -0,0 +1,372 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Volume.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace
+{
+
+/**
+ * @brief Reads sample x of a row. 4-bit samples are packed two per byte, the even one in the high nibble.
+ */
+inline uint32_t readSample(const uint8_t* row, uint32_t x, uint32_t bits)
+{
+    if (bits == 4)
+        return (x & 1) ? (row[x / 2] & 0xF) : (row[x / 2] >> 4);
+
+    uint32_t value = 0;
+    memcpy(&value, row + x * (bits / 8), bits / 8);
+    return value;
+}
+
+inline void writeSample(uint8_t* row, uint32_t x, uint32_t bits, uint32_t value)
+{
+    if (bits == 4)
+    {
+        uint8_t& b = row[x / 2];
+        b = (x & 1) ? (uint8_t) ((b & 0xF0) | (value & 0xF)) : (uint8_t) ((b & 0x0F) | ((value & 0xF) << 4));
+        return;
+    }
+
+    memcpy(row + x * (bits / 8), &value, bits / 8);
+}
+
+uint32_t getBrickSize(uint32_t brickSize, uint32_t size)
+{
+    return (brickSize == 0) ? size : std::min(brickSize, size);
+}
+
+}
+
+
+VolumeLayout::VolumeLayout(NvPipe_Format format, const NvPipe_Volume& volume) : format(format), volume(volume)
+{
+    if (volume.width == 0 || volume.height == 0 || volume.depth == 0)
+        return;
+
+    const uint32_t bw = getBrickSize(volume.brickWidth, volume.width);
+    const uint32_t bh = getBrickSize(volume.brickHeight, volume.height);
+    const uint32_t bd = getBrickSize(volume.brickDepth, volume.depth);
+
+    if (volume.axis == NVPIPE_AXIS_Z)
+    {
+        this->frameWidth = bw;
+        this->frameHeight = bh;
+    }
+    else if (volume.axis == NVPIPE_AXIS_Y)
+    {
+        this->frameWidth = bw;
+        this->frameHeight = bd;
+    }
+    else
+    {
+        this->frameWidth = bh;
+        this->frameHeight = bd;
+    }
+
+    for (uint32_t z = 0; z < volume.depth; z += bd)
+    {
+        for (uint32_t y = 0; y < volume.height; y += bh)
+        {
+            for (uint32_t x = 0; x < volume.width; x += bw)
+            {
+                VolumeBrick brick;
+                brick.x = x;
+                brick.y = y;
+                brick.z = z;
+                brick.width = std::min(bw, volume.width - x);
+                brick.height = std::min(bh, volume.height - y);
+                brick.depth = std::min(bd, volume.depth - z);
+                brick.firstSlice = this->numSlices;
+
+                this->numSlices += this->getNumSlices(brick);
+                this->bricks.push_back(brick);
+            }
+        }
+    }
+}
+
+std::string VolumeLayout::validate() const
+{
+    if (this->format != NVPIPE_UINT4 && this->format != NVPIPE_UINT8 && this->format != NVPIPE_UINT16 && this->format != NVPIPE_UINT32)
+        return "Volumes require an integer format (UINT4, UINT8, UINT16 or UINT32)";
+
+    if (this->volume.width == 0 || this->volume.height == 0 || this->volume.depth == 0)
+        return "Invalid volume size";
+
+    if (this->volume.axis != NVPIPE_AXIS_X && this->volume.axis != NVPIPE_AXIS_Y && this->volume.axis != NVPIPE_AXIS_Z)
+        return "Invalid volume axis";
+
+    if (this->format == NVPIPE_UINT4 && (this->frameWidth & 1))
+        return "UINT4 volumes require an even slice width";
+
+    return "";
+}
+
+uint32_t VolumeLayout::getNumSlices(const VolumeBrick& brick) const
+{
+    if (this->volume.axis == NVPIPE_AXIS_Z)
+        return brick.depth;
+    else if (this->volume.axis == NVPIPE_AXIS_Y)
+        return brick.height;
+    else
+        return brick.width;
+}
+
+uint32_t VolumeLayout::getBits() const
+{
+    if (this->format == NVPIPE_UINT4)
+        return 4;
+    else if (this->format == NVPIPE_UINT16)
+        return 16;
+    else if (this->format == NVPIPE_UINT32)
+        return 32;
+
+    return 8;
+}
+
+uint64_t VolumeLayout::getFramePitch() const
+{
+    return (uint64_t) this->frameWidth * this->getBits() / 8;
+}
+
+uint64_t VolumeLayout::getFrameSize() const
+{
+    return this->getFramePitch() * this->frameHeight;
+}
+
+uint64_t VolumeLayout::getRowPitch() const
+{
+    return ((uint64_t) this->volume.width * this->getBits() + 7) / 8;
+}
+
+uint64_t VolumeLayout::getSlicePitch() const
+{
+    return this->getRowPitch() * this->volume.height;
+}
+
+uint64_t VolumeLayout::getBrickBytes(const VolumeBrick& brick) const
+{
+    return ((uint64_t) brick.width * brick.height * brick.depth * this->getBits() + 7) / 8;
+}
+
+void VolumeLayout::getSamplePosition(const VolumeBrick& brick, uint32_t s, uint32_t u, uint32_t v, uint32_t& x, uint32_t& y, uint32_t& z) const
+{
+    if (this->volume.axis == NVPIPE_AXIS_Z)
+    {
+        x = brick.x + std::min(u, brick.width - 1);
+        y = brick.y + std::min(v, brick.height - 1);
+        z = brick.z + s;
+    }
+    else if (this->volume.axis == NVPIPE_AXIS_Y)
+    {
+        x = brick.x + std::min(u, brick.width - 1);
+        y = brick.y + s;
+        z = brick.z + std::min(v, brick.depth - 1);
+    }
+    else
+    {
+        x = brick.x + s;
+        y = brick.y + std::min(u, brick.height - 1);
+        z = brick.z + std::min(v, brick.depth - 1);
+    }
+}
+
+void VolumeLayout::extractSlice(const uint8_t* volume, uint64_t rowPitch, uint64_t slicePitch, const VolumeBrick& brick, uint32_t s, uint8_t* frame) const
+{
+    const uint32_t bits = this->getBits();
+    const uint32_t bytes = bits / 8;
+    const uint64_t framePitch = this->getFramePitch();
+    const bool alongX = (this->volume.axis != NVPIPE_AXIS_X);
+    const uint32_t validWidth = alongX ? brick.width : brick.height;
+
+    for (uint32_t v = 0; v < this->frameHeight; ++v)
+    {
+        uint8_t* dst = frame + v * framePitch;
+
+        uint32_t x, y, z;
+        this->getSamplePosition(brick, s, 0, v, x, y, z);
+
+        if (bits == 4)
+        {
+            for (uint32_t u = 0; u < this->frameWidth; ++u)
+            {
+                this->getSamplePosition(brick, s, u, v, x, y, z);
+                writeSample(dst, u, bits, readSample(volume + z * slicePitch + y * rowPitch, x, bits));
+            }
+        }
+        else if (alongX)
+        {
+            // Frame rows are contiguous volume rows, pad with the last sample
+            const uint8_t* src = volume + z * slicePitch + y * rowPitch + (uint64_t) x * bytes;
+            memcpy(dst, src, (uint64_t) validWidth * bytes);
+            for (uint32_t u = validWidth; u < this->frameWidth; ++u)
+                memcpy(dst + (uint64_t) u * bytes, src + (uint64_t) (validWidth - 1) * bytes, bytes);
+        }
+        else
+        {
+            // Frame rows run along y
+            const uint8_t* src = volume + z * slicePitch + y * rowPitch + (uint64_t) x * bytes;
+            for (uint32_t u = 0; u < this->frameWidth; ++u)
+                memcpy(dst + (uint64_t) u * bytes, src + std::min(u, validWidth - 1) * rowPitch, bytes);
+        }
+    }
+}
+
+void VolumeLayout::insertSlice(const uint8_t* frame, const VolumeBrick& brick, uint32_t s, uint8_t* volume, uint64_t rowPitch, uint64_t slicePitch) const
+{
+    const uint32_t bits = this->getBits();
+    const uint32_t bytes = bits / 8;
+    const uint64_t framePitch = this->getFramePitch();
+    const bool alongX = (this->volume.axis != NVPIPE_AXIS_X);
+    const uint32_t validWidth = alongX ? brick.width : brick.height;
+    const uint32_t validHeight = (this->volume.axis == NVPIPE_AXIS_Z) ? brick.height : brick.depth;
+
+    for (uint32_t v = 0; v < validHeight; ++v)
+    {
+        const uint8_t* src = frame + v * framePitch;
+
+        uint32_t x, y, z;
+        this->getSamplePosition(brick, s, 0, v, x, y, z);
+
+        if (bits == 4)
+        {
+            for (uint32_t u = 0; u < validWidth; ++u)
+            {
+                this->getSamplePosition(brick, s, u, v, x, y, z);
+                writeSample(volume + z * slicePitch + y * rowPitch, x, bits, readSample(src, u, bits));
+            }
+        }
+        else if (alongX)
+        {
+            memcpy(volume + z * slicePitch + y * rowPitch + (uint64_t) x * bytes, src, (uint64_t) validWidth * bytes);
+        }
+        else
+        {
+            uint8_t* dst = volume + z * slicePitch + y * rowPitch + (uint64_t) x * bytes;
+            for (uint32_t u = 0; u < validWidth; ++u)
+                memcpy(dst + u * rowPitch, src + (uint64_t) u * bytes, bytes);
+        }
+    }
+}
+
+
+VolumeIndex::VolumeIndex(const VolumeLayout& layout)
+{
+    this->format = layout.getFormat();
+    this->volume = layout.getVolume();
+    this->bricks.resize(layout.getBricks().size(), VolumeBrickEntry{ 0, 0 });
+    this->sliceSizes.resize(layout.getNumSlices(), 0);
+}
+
+uint64_t VolumeIndex::getSize() const
+{
+    return sizeof(VolumeHeader) + this->bricks.size() * sizeof(VolumeBrickEntry) + this->sliceSizes.size() * sizeof(uint32_t);
+}
+
+void VolumeIndex::write(uint8_t* dst) const
+{
+    VolumeHeader header;
+    memcpy(header.magic, VOLUME_MAGIC, sizeof(header.magic));
+    header.version = VOLUME_VERSION;
+    header.format = (uint32_t) this->format;
+    header.width = this->volume.width;
+    header.height = this->volume.height;
+    header.depth = this->volume.depth;
+    header.axis = (uint32_t) this->volume.axis;
+    header.brickWidth = this->volume.brickWidth;
+    header.brickHeight = this->volume.brickHeight;
+    header.brickDepth = this->volume.brickDepth;
+    header.numBricks = (uint32_t) this->bricks.size();
+    header.numSlices = (uint32_t) this->sliceSizes.size();
+
+    memcpy(dst, &header, sizeof(header));
+    dst += sizeof(header);
+    memcpy(dst, this->bricks.data(), this->bricks.size() * sizeof(VolumeBrickEntry));
+    dst += this->bricks.size() * sizeof(VolumeBrickEntry);
+    memcpy(dst, this->sliceSizes.data(), this->sliceSizes.size() * sizeof(uint32_t));
+}
+
+std::string VolumeIndex::read(const uint8_t* src, uint64_t size, VolumeIndex& index)
+{
+    VolumeHeader header;
+    if (!src || size < sizeof(header))
+        return "Volume stream too short";
+
+    memcpy(&header, src, sizeof(header));
+    if (memcmp(header.magic, VOLUME_MAGIC, sizeof(header.magic)) != 0)
+        return "Not a volume stream";
+    if (header.version != VOLUME_VERSION)
+        return "Unsupported volume stream version " + std::to_string(header.version);
+
+    index.format = (NvPipe_Format) header.format;
+    index.volume.width = header.width;
+    index.volume.height = header.height;
+    index.volume.depth = header.depth;
+    index.volume.axis = (NvPipe_Axis) header.axis;
+    index.volume.brickWidth = header.brickWidth;
+    index.volume.brickHeight = header.brickHeight;
+    index.volume.brickDepth = header.brickDepth;
+
+    const VolumeLayout layout(index.format, index.volume);
+    const std::string error = layout.validate();
+    if (!error.empty())
+        return "Invalid volume stream (" + error + ")";
+
+    if (header.numBricks != layout.getBricks().size() || header.numSlices != layout.getNumSlices())
+        return "Invalid volume stream (brick table does not match the volume)";
+
+    index.bricks.resize(header.numBricks);
+    index.sliceSizes.resize(header.numSlices);
+    if (size < index.getSize())
+        return "Volume stream too short";
+
+    src += sizeof(header);
+    memcpy(index.bricks.data(), src, index.bricks.size() * sizeof(VolumeBrickEntry));
+    src += index.bricks.size() * sizeof(VolumeBrickEntry);
+    memcpy(index.sliceSizes.data(), src, index.sliceSizes.size() * sizeof(uint32_t));
+
+    // Every brick must lie within the stream and consist of its slices
+    for (size_t i = 0; i < index.bricks.size(); ++i)
+    {
+        const VolumeBrick& brick = layout.getBricks()[i];
+        const VolumeBrickEntry& entry = index.bricks[i];
+
+        uint64_t sum = 0;
+        for (uint32_t s = 0; s < layout.getNumSlices(brick); ++s)
+            sum += index.sliceSizes[brick.firstSlice + s];
+
+        if (entry.offset < index.getSize() || entry.offset > size || entry.size > size - entry.offset || sum != entry.size)
+            return "Invalid volume stream (brick " + std::to_string(i) + " out of bounds)";
+    }
+
+    return "";
+}
@@ -0,0 +1,175 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "NvPipe.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+/**
+ * Volume stream format (NvPipe_EncodeVolume).
+ *
+ * A stream starts with a VolumeHeader, followed by one VolumeBrickEntry per brick and the compressed size of
+ * every slice (uint32_t, in brick order). The compressed slices follow. Each brick is a frame sequence that starts
+ * with an IDR frame, so bricks can be decoded independently. The brick geometry is derived from the header.
+ */
+
+static const char VOLUME_MAGIC[8] = { 'N', 'V', 'P', 'V', 'O', 'L', 'U', 'M' };
+static const uint32_t VOLUME_VERSION = 1;
+
+#pragma pack(push, 1)
+
+struct VolumeHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t format;         ///< NvPipe_Format
+    uint32_t width, height, depth;
+    uint32_t axis;           ///< NvPipe_Axis
+    uint32_t brickWidth, brickHeight, brickDepth;
+    uint32_t numBricks;
+    uint32_t numSlices;      ///< Over all bricks
+};
+
+struct VolumeBrickEntry
+{
+    uint64_t offset;         ///< First compressed slice, relative to the start of the stream
+    uint64_t size;           ///< Compressed bytes of all slices of the brick
+};
+
+#pragma pack(pop)
+
+
+/**
+ * @brief Box of a volume that is encoded as one frame sequence.
+ */
+struct VolumeBrick
+{
+    uint32_t x, y, z;                ///< Origin in the volume
+    uint32_t width, height, depth;   ///< Extent, smaller than the brick size at the volume border
+    uint32_t firstSlice;             ///< Index of the first slice of this brick in the stream
+};
+
+
+/**
+ * @brief Slicing and bricking of a volume into frame sequences and back.
+ *
+ * Bricks are numbered with x varying fastest, then y, then z. Each brick is cut into slices perpendicular to the
+ * volume axis; a slice becomes one frame of the brick size (border bricks are padded by repeating their last
+ * sample, so all frames of a volume have the same size and the encoder session is reused).
+ * Pure CPU code, independent of the codec.
+ */
+class VolumeLayout
+{
+public:
+    VolumeLayout(NvPipe_Format format, const NvPipe_Volume& volume);
+
+    /**
+     * @brief Returns an error message if the format or geometry is not supported, empty otherwise.
+     */
+    std::string validate() const;
+
+    NvPipe_Format getFormat() const { return this->format; }
+    const NvPipe_Volume& getVolume() const { return this->volume; }
+    const std::vector<VolumeBrick>& getBricks() const { return this->bricks; }
+
+    uint32_t getNumSlices() const { return this->numSlices; }
+    uint32_t getNumSlices(const VolumeBrick& brick) const;
+
+    uint32_t getFrameWidth() const { return this->frameWidth; }
+    uint32_t getFrameHeight() const { return this->frameHeight; }
+    uint64_t getFramePitch() const;
+    uint64_t getFrameSize() const;
+
+    /**
+     * @brief Row and slice pitch of a tightly packed volume in bytes.
+     */
+    uint64_t getRowPitch() const;
+    uint64_t getSlicePitch() const;
+
+    /**
+     * @brief Bytes of the samples covered by a brick (without padding).
+     */
+    uint64_t getBrickBytes(const VolumeBrick& brick) const;
+
+    /**
+     * @brief Copies slice s of a brick from a volume in host memory into a tightly packed frame.
+     */
+    void extractSlice(const uint8_t* volume, uint64_t rowPitch, uint64_t slicePitch, const VolumeBrick& brick, uint32_t s, uint8_t* frame) const;
+
+    /**
+     * @brief Copies the valid part (without padding) of a frame back into slice s of a brick.
+     */
+    void insertSlice(const uint8_t* frame, const VolumeBrick& brick, uint32_t s, uint8_t* volume, uint64_t rowPitch, uint64_t slicePitch) const;
+
+    /**
+     * @brief Maps frame coordinates (u, v) of slice s to volume coordinates, clamped to the brick.
+     */
+    void getSamplePosition(const VolumeBrick& brick, uint32_t s, uint32_t u, uint32_t v, uint32_t& x, uint32_t& y, uint32_t& z) const;
+
+private:
+    uint32_t getBits() const;
+
+private:
+    NvPipe_Format format;
+    NvPipe_Volume volume;
+    std::vector<VolumeBrick> bricks;
+    uint32_t numSlices = 0;
+    uint32_t frameWidth = 0;
+    uint32_t frameHeight = 0;
+};
+
+
+/**
+ * @brief Header, brick table and slice sizes of a volume stream.
+ */
+struct VolumeIndex
+{
+    NvPipe_Format format = NVPIPE_UINT8;
+    NvPipe_Volume volume = {};
+    std::vector<VolumeBrickEntry> bricks;
+    std::vector<uint32_t> sliceSizes;
+
+    /**
+     * @brief Empty index (zero sizes) for a layout.
+     */
+    explicit VolumeIndex(const VolumeLayout& layout);
+    VolumeIndex() = default;
+
+    uint64_t getSize() const;
+    void write(uint8_t* dst) const;
+
+    /**
+     * @brief Parses and checks an index against the stream size.
+     * @return Error message, empty on success.
+     */
+    static std::string read(const uint8_t* src, uint64_t size, VolumeIndex& index);
+};
@@ -0,0 +1,147 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/**
+ * @brief Fixed set of worker threads that execute batches of independent tasks.
+ *
+ * The calling thread works on its batch as well and returns once all tasks are done.
+ * Batches of concurrent callers share the workers in submission order. Tasks must not throw.
+ */
+class WorkerPool
+{
+public:
+    explicit WorkerPool(uint32_t numThreads)
+    {
+        for (uint32_t i = 0; i < numThreads; ++i)
+            this->threads.emplace_back(&WorkerPool::work, this);
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->stopping = true;
+        }
+        this->wake.notify_all();
+
+        for (auto& t : this->threads)
+            t.join();
+    }
+
+    /**
+     * @brief Runs fn(i) for every i in [0, count) and waits for completion.
+     */
+    void run(uint32_t count, const std::function<void(uint32_t)>& fn)
+    {
+        if (count == 0)
+            return;
+
+        Batch batch(fn, count);
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->pending.push_back(&batch);
+        }
+        this->wake.notify_all();
+
+        // Work on the own batch only, so a caller does not wait for tasks of others
+        std::unique_lock<std::mutex> lock(this->mutex);
+        while (batch.next < batch.count)
+            this->execute(&batch, lock);
+
+        this->done.wait(lock, [&batch]() { return batch.remaining == 0; });
+    }
+
+    uint32_t getNumThreads() const
+    {
+        return (uint32_t) this->threads.size();
+    }
+
+private:
+    struct Batch
+    {
+        Batch(const std::function<void(uint32_t)>& fn, uint32_t count) : fn(fn), count(count), remaining(count)
+        {
+        }
+
+        const std::function<void(uint32_t)>& fn;
+        const uint32_t count;
+        uint32_t next = 0;      ///< Next task to start
+        uint32_t remaining;     ///< Tasks not finished yet
+    };
+
+    void work()
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        while (true)
+        {
+            this->wake.wait(lock, [this]() { return this->stopping || !this->pending.empty(); });
+            if (this->stopping)
+                return;
+
+            this->execute(this->pending.front(), lock);
+        }
+    }
+
+    /**
+     * @brief Runs the next task of a batch that has tasks left. Called and returns with the lock held.
+     */
+    void execute(Batch* batch, std::unique_lock<std::mutex>& lock)
+    {
+        const uint32_t i = batch->next++;
+        if (batch->next == batch->count)
+            this->pending.erase(std::find(this->pending.begin(), this->pending.end(), batch));
+
+        lock.unlock();
+        batch->fn(i);
+        lock.lock();
+
+        // The caller may return and destroy the batch once it is done
+        if (--batch->remaining == 0)
+            this->done.notify_all();
+    }
+
+private:
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::deque<Batch*> pending; ///< Batches with tasks that have not been started
+    bool stopping = false;
+};
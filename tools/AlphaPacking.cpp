@@ -0,0 +1,160 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "AlphaPacking.h"
+
+#include <algorithm>
+
+
+namespace
+{
+
+/**
+ * @brief BT.709 studio range matrices, computed like SetMatRgb2Yuv/SetMatYuv2Rgb (ColorSpace.cu).
+ */
+struct Matrices
+{
+    float rgb2yuv[3][3];
+    float yuv2rgb[3][3];
+
+    Matrices()
+    {
+        const float wr = 0.2126f, wb = 0.0722f;
+        const int black = 16, white = 235, max = 255;
+
+        const float toYuv[3][3] = {
+            { wr, 1.0f - wb - wr, wb },
+            { -0.5f * wr / (1.0f - wb), -0.5f * (1 - wb - wr) / (1.0f - wb), 0.5f },
+            { 0.5f, -0.5f * (1.0f - wb - wr) / (1.0f - wr), -0.5f * wb / (1.0f - wr) },
+        };
+        const float toRgb[3][3] = {
+            { 1.0f, 0.0f, (1.0f - wr) / 0.5f },
+            { 1.0f, -wb * (1.0f - wb) / 0.5f / (1 - wb - wr), -wr * (1 - wr) / 0.5f / (1 - wb - wr) },
+            { 1.0f, (1.0f - wb) / 0.5f, 0.0f },
+        };
+
+        for (int i = 0; i < 3; ++i)
+        {
+            for (int j = 0; j < 3; ++j)
+            {
+                this->rgb2yuv[i][j] = (float) (1.0 * (white - black) / max * toYuv[i][j]);
+                this->yuv2rgb[i][j] = (float) (1.0 * max / (white - black) * toRgb[i][j]);
+            }
+        }
+    }
+};
+
+const Matrices& getMatrices()
+{
+    static const Matrices matrices;
+    return matrices;
+}
+
+inline uint8_t toYuv(const float m[3], int r, int g, int b, int offset)
+{
+    // Truncated like the implicit float to uint8_t conversion of the kernel
+    return (uint8_t) (m[0] * r + m[1] * g + m[2] * b + offset);
+}
+
+inline uint8_t toRgb(const float m[3], float y, float u, float v)
+{
+    return (uint8_t) std::min(std::max(m[0] * y + m[1] * u + m[2] * v, 0.0f), 255.0f);
+}
+
+} // namespace
+
+
+void packBgra32Alpha(const uint8_t* bgra, uint64_t bgraPitch, uint32_t width, uint32_t height, uint8_t* nv12, uint64_t nv12Pitch)
+{
+    const Matrices& m = getMatrices();
+
+    for (uint32_t y = 0; y + 1 < height; y += 2)
+    {
+        const uint8_t* src0 = bgra + y * bgraPitch;
+        const uint8_t* src1 = src0 + bgraPitch;
+        uint8_t* y0 = nv12 + y * nv12Pitch;
+        uint8_t* y1 = y0 + nv12Pitch;
+        uint8_t* uv = nv12 + (height + y / 2) * nv12Pitch;
+
+        for (uint32_t x = 0; x + 1 < width; x += 2)
+        {
+            const uint8_t* p[4] = { src0 + 4 * x, src0 + 4 * x + 4, src1 + 4 * x, src1 + 4 * x + 4 };
+
+            y0[x] = toYuv(m.rgb2yuv[0], p[0][2], p[0][1], p[0][0], 16);
+            y0[x + 1] = toYuv(m.rgb2yuv[0], p[1][2], p[1][1], p[1][0], 16);
+            y1[x] = toYuv(m.rgb2yuv[0], p[2][2], p[2][1], p[2][0], 16);
+            y1[x + 1] = toYuv(m.rgb2yuv[0], p[3][2], p[3][1], p[3][0], 16);
+
+            // Chroma of the (truncated) 2x2 average
+            const int r = (p[0][2] + p[1][2] + p[2][2] + p[3][2]) / 4;
+            const int g = (p[0][1] + p[1][1] + p[2][1] + p[3][1]) / 4;
+            const int b = (p[0][0] + p[1][0] + p[2][0] + p[3][0]) / 4;
+            uv[x] = toYuv(m.rgb2yuv[1], r, g, b, 128);
+            uv[x + 1] = toYuv(m.rgb2yuv[2], r, g, b, 128);
+        }
+    }
+
+    // Alpha tile
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        const uint8_t* src = bgra + y * bgraPitch;
+        uint8_t* dst = nv12 + y * nv12Pitch + width;
+
+        for (uint32_t x = 0; x < width; ++x)
+            dst[x] = src[4 * x + 3];
+
+        if (y < height / 2)
+            std::fill_n(nv12 + (height + y) * nv12Pitch + width, width, (uint8_t) 128);
+    }
+}
+
+void unpackBgra32Alpha(const uint8_t* nv12, uint64_t nv12Pitch, uint32_t surfaceHeight, uint32_t width, uint32_t height, uint8_t* bgra, uint64_t bgraPitch)
+{
+    const Matrices& m = getMatrices();
+
+    if (surfaceHeight == 0)
+        surfaceHeight = height;
+
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        const uint8_t* luma = nv12 + y * nv12Pitch;
+        const uint8_t* uv = nv12 + (surfaceHeight + y / 2) * nv12Pitch;
+        uint8_t* dst = bgra + y * bgraPitch;
+
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            const float fy = (float) ((int) luma[x] - 16);
+            const float fu = (float) ((int) uv[x & ~1u] - 128);
+            const float fv = (float) ((int) uv[x | 1u] - 128);
+
+            dst[4 * x + 0] = toRgb(m.yuv2rgb[2], fy, fu, fv);
+            dst[4 * x + 1] = toRgb(m.yuv2rgb[1], fy, fu, fv);
+            dst[4 * x + 2] = toRgb(m.yuv2rgb[0], fy, fu, fv);
+            dst[4 * x + 3] = luma[width + x];
+        }
+    }
+}
@@ -0,0 +1,46 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+
+/**
+ * @brief CPU reference of the NVPIPE_BGRA32_ALPHA packing (Bgra32ToNv12 and bgra32_alpha_to_nv12 in the library).
+ *
+ * The NV12 frame is twice as wide as the input: the BT.709 color is converted into the left tile, alpha is copied
+ * into the Y channel of the right tile, whose UV channel is neutral (128). The chroma plane follows height rows
+ * with the same pitch. Width and height must be even. Replicates the float arithmetic and truncation of the kernels.
+ */
+void packBgra32Alpha(const uint8_t* bgra, uint64_t bgraPitch, uint32_t width, uint32_t height, uint8_t* nv12, uint64_t nv12Pitch);
+
+/**
+ * @brief CPU reference of the unpacking (Nv12ToBgra32 on the left tile, alpha from the right tile).
+ * @param surfaceHeight Rows before the chroma plane (e.g., of a decoder surface), 0 for height.
+ */
+void unpackBgra32Alpha(const uint8_t* nv12, uint64_t nv12Pitch, uint32_t surfaceHeight, uint32_t width, uint32_t height, uint8_t* bgra, uint64_t bgraPitch);
@@ -0,0 +1,685 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "BitstreamAnalyzer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+
+namespace
+{
+
+/**
+ * @brief Reads bits of a NAL unit payload, skipping emulation prevention bytes.
+ */
+class BitReader
+{
+public:
+    BitReader(const uint8_t* data, uint64_t size) : data(data), size(size) {}
+
+    uint32_t u(uint32_t n)
+    {
+        uint32_t v = 0;
+        for (uint32_t i = 0; i < n; ++i)
+            v = (v << 1) | this->bit();
+        return v;
+    }
+
+    void skip(uint32_t n)
+    {
+        for (uint32_t i = 0; i < n; ++i)
+            this->bit();
+    }
+
+    uint32_t ue()
+    {
+        uint32_t zeros = 0;
+        while (!this->bit())
+        {
+            if (++zeros > 31 || this->failed)
+            {
+                this->failed = true;
+                return 0;
+            }
+        }
+        return ((1u << zeros) - 1) + this->u(zeros);
+    }
+
+    int32_t se()
+    {
+        const uint32_t v = this->ue();
+        return (v & 1) ? (int32_t) ((v + 1) / 2) : -(int32_t) (v / 2);
+    }
+
+    bool ok() const
+    {
+        return !this->failed;
+    }
+
+private:
+    uint32_t bit()
+    {
+        if (this->bitsLeft == 0)
+        {
+            if (this->pos >= this->size)
+            {
+                this->failed = true;
+                return 0;
+            }
+
+            // 0x000003 -> 0x0000
+            if (this->zeros >= 2 && this->data[this->pos] == 3)
+            {
+                ++this->pos;
+                this->zeros = 0;
+                if (this->pos >= this->size)
+                {
+                    this->failed = true;
+                    return 0;
+                }
+            }
+
+            this->current = this->data[this->pos++];
+            this->zeros = (this->current == 0) ? this->zeros + 1 : 0;
+            this->bitsLeft = 8;
+        }
+
+        return (this->current >> --this->bitsLeft) & 1;
+    }
+
+private:
+    const uint8_t* data;
+    uint64_t size;
+    uint64_t pos = 0;
+    uint32_t zeros = 0;
+    uint32_t current = 0;
+    uint32_t bitsLeft = 0;
+    bool failed = false;
+};
+
+/**
+ * @brief Finds the next start code in [p, end).
+ * @return Pointer to the first zero byte of the start code, or end. length receives 3 or 4.
+ */
+const uint8_t* findStartCode(const uint8_t* p, const uint8_t* end, uint32_t& length)
+{
+    const uint8_t* q = p + 2;
+    while (q < end)
+    {
+        q = (const uint8_t*) memchr(q, 1, end - q);
+        if (!q)
+            break;
+
+        if (q[-1] == 0 && q[-2] == 0)
+        {
+            const uint8_t* start = q - 2;
+            if (start > p && start[-1] == 0)
+                --start;
+            length = (uint32_t) (q + 1 - start);
+            return start;
+        }
+
+        q += 1;
+    }
+
+    length = 0;
+    return end;
+}
+
+bool isHighProfile(uint32_t profile)
+{
+    return profile == 100 || profile == 110 || profile == 122 || profile == 244 || profile == 44 ||
+           profile == 83 || profile == 86 || profile == 118 || profile == 128 || profile == 138 ||
+           profile == 139 || profile == 134 || profile == 135;
+}
+
+void skipScalingList(BitReader& r, uint32_t size)
+{
+    int32_t last = 8;
+    int32_t next = 8;
+    for (uint32_t j = 0; j < size; ++j)
+    {
+        if (next != 0)
+            next = (last + r.se() + 256) % 256;
+        last = (next == 0) ? last : next;
+    }
+}
+
+void getCropUnits(uint32_t chromaFormat, uint32_t& x, uint32_t& y)
+{
+    x = (chromaFormat == 1 || chromaFormat == 2) ? 2 : 1;
+    y = (chromaFormat == 1) ? 2 : 1;
+}
+
+}
+
+
+BitstreamAnalyzer::BitstreamAnalyzer(StreamCodec codec) : codec(codec)
+{
+}
+
+bool BitstreamAnalyzer::isFramed(const uint8_t* data, uint64_t size)
+{
+    if (size < 12)
+        return false;
+
+    uint64_t n;
+    memcpy(&n, data, sizeof(n));
+    if (n < 4 || n > size - 8)
+        return false;
+
+    const uint8_t* p = data + 8;
+    return (p[0] == 0 && p[1] == 0 && p[2] == 1) || (n >= 5 && p[0] == 0 && p[1] == 0 && p[2] == 0 && p[3] == 1);
+}
+
+void BitstreamAnalyzer::detectCodec(const uint8_t* nal, uint64_t size)
+{
+    if (this->codec != StreamCodec::Unknown || size < 2)
+        return;
+
+    // HEVC has a two byte header with nuh_temporal_id_plus1 > 0 and starts with VPS/SPS/PPS/AUD/IRAP.
+    // Those bytes map to unspecified or reserved H.264 types.
+    const uint32_t hevcType = (nal[0] >> 1) & 0x3F;
+    const bool hevcStart = (hevcType >= 32 && hevcType <= 35) || (hevcType >= 16 && hevcType <= 21);
+    const uint32_t h264Type = nal[0] & 0x1F;
+    const bool h264Start = (h264Type >= 1 && h264Type <= 9);
+
+    if (hevcStart && (nal[1] & 7) != 0 && !h264Start)
+        this->codec = StreamCodec::HEVC;
+    else
+        this->codec = StreamCodec::H264;
+}
+
+BitstreamAnalyzer::NalKind BitstreamAnalyzer::classify(const uint8_t* nal, uint64_t size, bool& firstSliceOfPicture) const
+{
+    firstSliceOfPicture = false;
+
+    if (this->codec == StreamCodec::HEVC)
+    {
+        if (size < 3)
+            return NalKind::Other;
+
+        const uint32_t type = (nal[0] >> 1) & 0x3F;
+        if (type <= 31)
+        {
+            firstSliceOfPicture = (nal[2] & 0x80) != 0;
+            return NalKind::Slice;
+        }
+        if (type >= 32 && type <= 34)
+            return NalKind::ParameterSet;
+        if (type == 35 || type == 39) // AUD, prefix SEI
+            return NalKind::Delimiter;
+        return NalKind::Other;
+    }
+
+    if (size < 2)
+        return NalKind::Other;
+
+    const uint32_t type = nal[0] & 0x1F;
+    if (type == 1 || type == 5)
+    {
+        BitReader r(nal + 1, size - 1);
+        firstSliceOfPicture = (r.ue() == 0); // first_mb_in_slice
+        return NalKind::Slice;
+    }
+    if (type == 7 || type == 8)
+        return NalKind::ParameterSet;
+    if (type == 9 || type == 6) // AUD, SEI
+        return NalKind::Delimiter;
+    return NalKind::Other;
+}
+
+void BitstreamAnalyzer::analyzeAnnexB(const uint8_t* data, uint64_t size)
+{
+    const uint8_t* end = data + size;
+
+    uint32_t length;
+    const uint8_t* start = findStartCode(data, end, length);
+
+    FrameInfo frame;
+    bool frameHasSlice = false;
+    bool frameOpen = false;
+
+    while (start < end)
+    {
+        const uint8_t* nal = start + length;
+        uint32_t nextLength;
+        const uint8_t* next = findStartCode(nal, end, nextLength);
+
+        this->detectCodec(nal, next - nal);
+
+        bool firstSlice;
+        const NalKind kind = this->classify(nal, next - nal, firstSlice);
+
+        // Access unit boundary
+        const bool boundary = frameHasSlice && (kind == NalKind::Delimiter || kind == NalKind::ParameterSet || (kind == NalKind::Slice && firstSlice));
+        if (frameOpen && boundary)
+        {
+            frame.size = (start - data) - frame.offset;
+            this->frames.push_back(frame);
+            frameOpen = false;
+        }
+
+        if (!frameOpen)
+        {
+            frame = FrameInfo();
+            frame.offset = start - data;
+            frameHasSlice = false;
+            frameOpen = true;
+        }
+
+        this->addNal(frame, nal, next - nal);
+        frameHasSlice |= (kind == NalKind::Slice);
+
+        start = next;
+        length = nextLength;
+    }
+
+    if (frameOpen)
+    {
+        frame.size = size - frame.offset;
+        this->frames.push_back(frame);
+    }
+}
+
+void BitstreamAnalyzer::analyzeFramed(const uint8_t* data, uint64_t size)
+{
+    uint64_t pos = 0;
+    while (pos + 8 <= size)
+    {
+        uint64_t n;
+        memcpy(&n, data + pos, sizeof(n));
+        if (n > size - pos - 8)
+            break; // truncated
+
+        const uint8_t* payload = data + pos + 8;
+        const uint8_t* end = payload + n;
+
+        FrameInfo frame;
+        frame.offset = pos;
+        frame.size = n;
+
+        uint32_t length;
+        const uint8_t* start = findStartCode(payload, end, length);
+        while (start < end)
+        {
+            const uint8_t* nal = start + length;
+            uint32_t nextLength;
+            const uint8_t* next = findStartCode(nal, end, nextLength);
+
+            this->detectCodec(nal, next - nal);
+            this->addNal(frame, nal, next - nal);
+
+            start = next;
+            length = nextLength;
+        }
+
+        this->frames.push_back(frame);
+        pos += 8 + n;
+    }
+}
+
+void BitstreamAnalyzer::addNal(FrameInfo& frame, const uint8_t* nal, uint64_t size)
+{
+    if (size == 0)
+        return;
+
+    const uint8_t type = (this->codec == StreamCodec::HEVC) ? (nal[0] >> 1) & 0x3F : nal[0] & 0x1F;
+    if (frame.numNals < FrameInfo::MAX_NALS)
+        frame.nalTypes[frame.numNals] = type;
+    frame.numNals++;
+
+    bool firstSlice;
+    const NalKind kind = this->classify(nal, size, firstSlice);
+    if (kind == NalKind::Slice && frame.sliceType == '?')
+        this->parseSlice(frame, nal, size);
+    else if (kind == NalKind::ParameterSet)
+        this->parseParameterSet(frame, nal, size);
+}
+
+void BitstreamAnalyzer::parseSlice(FrameInfo& frame, const uint8_t* nal, uint64_t size)
+{
+    if (this->codec == StreamCodec::HEVC)
+    {
+        const uint32_t type = (nal[0] >> 1) & 0x3F;
+        frame.keyframe |= (type >= 16 && type <= 23);
+
+        BitReader r(nal + 2, size - 2);
+        const bool first = r.u(1) != 0;
+        if (!first)
+            return; // slice type only parsed from the first slice segment
+
+        if (type >= 16 && type <= 23)
+            r.skip(1); // no_output_of_prior_pics_flag
+
+        const uint32_t ppsId = r.ue();
+        if (ppsId < this->ppsExtraSliceHeaderBits.size())
+            r.skip(this->ppsExtraSliceHeaderBits[ppsId]);
+
+        const uint32_t sliceType = r.ue();
+        if (r.ok())
+            frame.sliceType = (sliceType == 0) ? 'B' : (sliceType == 1) ? 'P' : (sliceType == 2) ? 'I' : '?';
+    }
+    else
+    {
+        frame.keyframe |= ((nal[0] & 0x1F) == 5);
+
+        BitReader r(nal + 1, size - 1);
+        r.ue(); // first_mb_in_slice
+        const uint32_t sliceType = r.ue() % 5;
+        if (r.ok())
+            frame.sliceType = (sliceType == 0 || sliceType == 3) ? 'P' : (sliceType == 1) ? 'B' : 'I';
+    }
+}
+
+void BitstreamAnalyzer::parseParameterSet(FrameInfo& frame, const uint8_t* nal, uint64_t size)
+{
+    uint32_t kind = 0; // 0 VPS, 1 SPS, 2 PPS
+    uint32_t id = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    if (this->codec == StreamCodec::HEVC)
+    {
+        const uint32_t type = (nal[0] >> 1) & 0x3F;
+        BitReader r(nal + 2, size - 2);
+
+        if (type == 32)
+        {
+            kind = 0;
+            id = r.u(4);
+        }
+        else if (type == 33)
+        {
+            kind = 1;
+            r.skip(4); // sps_video_parameter_set_id
+            const uint32_t maxSubLayersMinus1 = r.u(3);
+            r.skip(1);
+
+            // profile_tier_level
+            r.skip(88 + 8);
+            std::vector<uint32_t> profilePresent(maxSubLayersMinus1), levelPresent(maxSubLayersMinus1);
+            for (uint32_t i = 0; i < maxSubLayersMinus1; ++i)
+            {
+                profilePresent[i] = r.u(1);
+                levelPresent[i] = r.u(1);
+            }
+            if (maxSubLayersMinus1 > 0)
+                r.skip(2 * (8 - maxSubLayersMinus1));
+            for (uint32_t i = 0; i < maxSubLayersMinus1; ++i)
+                r.skip((profilePresent[i] ? 88 : 0) + (levelPresent[i] ? 8 : 0));
+
+            id = r.ue();
+            const uint32_t chromaFormat = r.ue();
+            if (chromaFormat == 3)
+                r.skip(1);
+
+            width = r.ue();
+            height = r.ue();
+
+            if (r.u(1)) // conformance_window_flag
+            {
+                uint32_t cropX, cropY;
+                getCropUnits(chromaFormat, cropX, cropY);
+                const uint32_t left = r.ue(), right = r.ue(), top = r.ue(), bottom = r.ue();
+                width -= cropX * (left + right);
+                height -= cropY * (top + bottom);
+            }
+        }
+        else
+        {
+            kind = 2;
+            id = r.ue();
+            r.ue(); // pps_seq_parameter_set_id
+            r.skip(2); // dependent_slice_segments_enabled_flag, output_flag_present_flag
+            const uint32_t extraBits = r.u(3);
+
+            if (r.ok() && id < 64)
+            {
+                if (this->ppsExtraSliceHeaderBits.size() <= id)
+                    this->ppsExtraSliceHeaderBits.resize(id + 1, 0);
+                this->ppsExtraSliceHeaderBits[id] = (uint8_t) extraBits;
+            }
+        }
+
+        if (!r.ok())
+            width = height = 0;
+    }
+    else
+    {
+        const uint32_t type = nal[0] & 0x1F;
+        BitReader r(nal + 1, size - 1);
+
+        if (type == 7)
+        {
+            kind = 1;
+            const uint32_t profile = r.u(8);
+            r.skip(16); // constraint flags, level_idc
+            id = r.ue();
+
+            uint32_t chromaFormat = 1;
+            if (isHighProfile(profile))
+            {
+                chromaFormat = r.ue();
+                if (chromaFormat == 3)
+                    r.skip(1); // separate_colour_plane_flag
+                r.ue(); // bit_depth_luma_minus8
+                r.ue(); // bit_depth_chroma_minus8
+                r.skip(1); // qpprime_y_zero_transform_bypass_flag
+                if (r.u(1)) // seq_scaling_matrix_present_flag
+                {
+                    const uint32_t lists = (chromaFormat != 3) ? 8 : 12;
+                    for (uint32_t i = 0; i < lists; ++i)
+                        if (r.u(1))
+                            skipScalingList(r, (i < 6) ? 16 : 64);
+                }
+            }
+
+            r.ue(); // log2_max_frame_num_minus4
+            const uint32_t pocType = r.ue();
+            if (pocType == 0)
+            {
+                r.ue();
+            }
+            else if (pocType == 1)
+            {
+                r.skip(1);
+                r.se();
+                r.se();
+                const uint32_t cycle = r.ue();
+                for (uint32_t i = 0; i < cycle && r.ok(); ++i)
+                    r.se();
+            }
+
+            r.ue(); // max_num_ref_frames
+            r.skip(1); // gaps_in_frame_num_value_allowed_flag
+            const uint32_t widthInMbs = r.ue() + 1;
+            const uint32_t heightInMapUnits = r.ue() + 1;
+            const uint32_t frameMbsOnly = r.u(1);
+            if (!frameMbsOnly)
+                r.skip(1);
+            r.skip(1); // direct_8x8_inference_flag
+
+            width = widthInMbs * 16;
+            height = heightInMapUnits * 16 * (2 - frameMbsOnly);
+
+            if (r.u(1)) // frame_cropping_flag
+            {
+                uint32_t cropX, cropY;
+                getCropUnits(chromaFormat, cropX, cropY);
+                cropY *= (2 - frameMbsOnly);
+                const uint32_t left = r.ue(), right = r.ue(), top = r.ue(), bottom = r.ue();
+                width -= cropX * (left + right);
+                height -= cropY * (top + bottom);
+            }
+        }
+        else
+        {
+            kind = 2;
+            id = r.ue();
+        }
+
+        if (!r.ok())
+            width = height = 0;
+    }
+
+    if (id >= 64)
+        return;
+
+    // Compare with the previous set of the same type and id
+    std::vector<std::vector<uint8_t>>& sets = this->parameterSets[kind];
+    if (sets.size() <= id)
+        sets.resize(id + 1);
+
+    std::vector<uint8_t>& previous = sets[id];
+    if (previous.size() == size && memcmp(previous.data(), nal, size) == 0)
+        return;
+
+    if (!previous.empty())
+        frame.parameterSetChange = true;
+
+    previous.assign(nal, nal + size);
+
+    static const char* names[] = { "VPS", "SPS", "PPS" };
+    this->changes.push_back({ (uint64_t) this->frames.size(), names[kind], width, height });
+}
+
+StreamSummary BitstreamAnalyzer::summarize(double fps) const
+{
+    StreamSummary s;
+    s.frames = this->frames.size();
+    s.sliceTypeCounts.assign(4, 0);
+    if (s.frames == 0)
+        return s;
+
+    s.minFrameSize = UINT64_MAX;
+    uint64_t keyBytes = 0;
+    uint64_t lastKeyframe = 0;
+    uint64_t intervalSum = 0;
+    uint64_t intervals = 0;
+
+    for (uint64_t i = 0; i < this->frames.size(); ++i)
+    {
+        const FrameInfo& f = this->frames[i];
+        s.totalBytes += f.size;
+        s.minFrameSize = std::min(s.minFrameSize, f.size);
+        s.maxFrameSize = std::max(s.maxFrameSize, f.size);
+
+        uint32_t bucket = 0;
+        while ((2ull << bucket) <= f.size)
+            ++bucket;
+        if (s.sizeHistogram.size() <= bucket)
+            s.sizeHistogram.resize(bucket + 1, 0);
+        s.sizeHistogram[bucket]++;
+
+        s.sliceTypeCounts[(f.sliceType == 'I') ? 0 : (f.sliceType == 'P') ? 1 : (f.sliceType == 'B') ? 2 : 3]++;
+
+        if (f.keyframe)
+        {
+            if (s.keyframes > 0)
+            {
+                const uint64_t interval = i - lastKeyframe;
+                s.minKeyframeInterval = (intervals == 0) ? interval : std::min(s.minKeyframeInterval, interval);
+                s.maxKeyframeInterval = std::max(s.maxKeyframeInterval, interval);
+                intervalSum += interval;
+                ++intervals;
+            }
+
+            lastKeyframe = i;
+            s.keyframes++;
+            keyBytes += f.size;
+            s.maxKeyframeSize = std::max(s.maxKeyframeSize, f.size);
+        }
+    }
+
+    s.averageFrameSize = (double) s.totalBytes / s.frames;
+    s.averageKeyframeInterval = intervals ? (double) intervalSum / intervals : 0.0;
+    s.averageKeyframeSize = s.keyframes ? (double) keyBytes / s.keyframes : 0.0;
+    s.averageOtherFrameSize = (s.frames > s.keyframes) ? (double) (s.totalBytes - keyBytes) / (s.frames - s.keyframes) : 0.0;
+    s.keyframeBurstRatio = (s.averageOtherFrameSize > 0.0) ? s.averageKeyframeSize / s.averageOtherFrameSize : 0.0;
+
+    // Bitrate over sliding one-second windows
+    s.averageMbps = s.totalBytes * 8.0 * fps / s.frames / 1.0e6;
+
+    const uint64_t window = std::max<uint64_t>(1, (uint64_t) std::llround(fps));
+    uint64_t bytes = 0;
+    uint64_t peakBytes = 0;
+    for (uint64_t i = 0; i < this->frames.size(); ++i)
+    {
+        bytes += this->frames[i].size;
+        if (i >= window)
+            bytes -= this->frames[i - window].size;
+        peakBytes = std::max(peakBytes, bytes);
+    }
+    s.peakMbps = peakBytes * 8.0 * fps / std::min<uint64_t>(window, s.frames) / 1.0e6;
+
+    return s;
+}
+
+const char* BitstreamAnalyzer::getNalTypeName(StreamCodec codec, uint8_t type)
+{
+    if (codec == StreamCodec::HEVC)
+    {
+        switch (type)
+        {
+        case 0: case 1: return "TRAIL";
+        case 2: case 3: return "TSA";
+        case 4: case 5: return "STSA";
+        case 6: case 7: return "RADL";
+        case 8: case 9: return "RASL";
+        case 16: case 17: case 18: return "BLA";
+        case 19: case 20: return "IDR";
+        case 21: return "CRA";
+        case 32: return "VPS";
+        case 33: return "SPS";
+        case 34: return "PPS";
+        case 35: return "AUD";
+        case 36: return "EOS";
+        case 37: return "EOB";
+        case 38: return "FD";
+        case 39: case 40: return "SEI";
+        default: return "OTHER";
+        }
+    }
+
+    switch (type)
+    {
+    case 1: return "SLICE";
+    case 2: case 3: case 4: return "DPA";
+    case 5: return "IDR";
+    case 6: return "SEI";
+    case 7: return "SPS";
+    case 8: return "PPS";
+    case 9: return "AUD";
+    case 10: return "EOSEQ";
+    case 11: return "EOS";
+    case 12: return "FD";
+    default: return "OTHER";
+    }
+}
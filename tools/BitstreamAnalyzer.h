@@ -0,0 +1,153 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+/**
+ * @brief Codec of an analyzed stream.
+ */
+enum class StreamCodec
+{
+    Unknown,
+    H264,
+    HEVC
+};
+
+
+/**
+ * @brief Per-frame (access unit) information.
+ */
+struct FrameInfo
+{
+    static const uint32_t MAX_NALS = 8;
+
+    uint64_t offset = 0;        ///< Byte offset in the input
+    uint64_t size = 0;          ///< Bytes including start codes
+    uint32_t numNals = 0;       ///< NAL units in the frame (may exceed MAX_NALS)
+    uint8_t nalTypes[MAX_NALS]; ///< Types of the first NAL units
+    char sliceType = '?';       ///< I, P, B (first slice)
+    bool keyframe = false;      ///< Contains an IDR (or HEVC IRAP) slice
+    bool parameterSetChange = false;
+};
+
+
+/**
+ * @brief Parameter set that differs from the previous one of the same type and id.
+ */
+struct ParameterSetChange
+{
+    uint64_t frame;
+    std::string type; ///< VPS, SPS or PPS
+    uint32_t width;   ///< Coded picture size (SPS only, 0 otherwise)
+    uint32_t height;
+};
+
+
+/**
+ * @brief Summary statistics of an analyzed stream.
+ */
+struct StreamSummary
+{
+    uint64_t frames = 0;
+    uint64_t totalBytes = 0;
+    uint64_t minFrameSize = 0;
+    uint64_t maxFrameSize = 0;
+    double averageFrameSize = 0.0;
+
+    double averageMbps = 0.0;   ///< At the given frame rate
+    double peakMbps = 0.0;      ///< Maximum over sliding one-second windows
+
+    uint64_t keyframes = 0;
+    uint64_t minKeyframeInterval = 0;
+    uint64_t maxKeyframeInterval = 0;
+    double averageKeyframeInterval = 0.0;
+    double averageKeyframeSize = 0.0;
+    uint64_t maxKeyframeSize = 0;
+    double averageOtherFrameSize = 0.0;
+    double keyframeBurstRatio = 0.0; ///< Average keyframe size relative to average non-keyframe size
+
+    std::vector<uint64_t> sizeHistogram; ///< Frame counts per power-of-two size bucket: [2^i, 2^(i+1)) bytes
+    std::vector<uint64_t> sliceTypeCounts; ///< I, P, B, other
+};
+
+
+/**
+ * @brief Parses H.264 and HEVC Annex-B streams on the CPU without decoding pixels.
+ *
+ * Accepts raw Annex-B streams (frames are split at access unit boundaries) and the framed format
+ * written by the examples ([uint64 size][payload] per frame). Start codes are located with memchr,
+ * and only NAL headers, slice headers and parameter sets are parsed.
+ */
+class BitstreamAnalyzer
+{
+public:
+    explicit BitstreamAnalyzer(StreamCodec codec = StreamCodec::Unknown);
+
+    /**
+     * @brief Returns true if the data looks like the [uint64 size][payload] format.
+     */
+    static bool isFramed(const uint8_t* data, uint64_t size);
+
+    void analyzeAnnexB(const uint8_t* data, uint64_t size);
+    void analyzeFramed(const uint8_t* data, uint64_t size);
+
+    StreamCodec getCodec() const { return this->codec; }
+    const std::vector<FrameInfo>& getFrames() const { return this->frames; }
+    const std::vector<ParameterSetChange>& getParameterSetChanges() const { return this->changes; }
+
+    StreamSummary summarize(double fps) const;
+
+    static const char* getNalTypeName(StreamCodec codec, uint8_t type);
+
+private:
+    enum class NalKind
+    {
+        Other,
+        ParameterSet,
+        Slice,
+        Delimiter
+    };
+
+    void detectCodec(const uint8_t* nal, uint64_t size);
+    NalKind classify(const uint8_t* nal, uint64_t size, bool& firstSliceOfPicture) const;
+    void addNal(FrameInfo& frame, const uint8_t* nal, uint64_t size);
+    void parseSlice(FrameInfo& frame, const uint8_t* nal, uint64_t size);
+    void parseParameterSet(FrameInfo& frame, const uint8_t* nal, uint64_t size);
+
+private:
+    StreamCodec codec;
+    std::vector<FrameInfo> frames;
+    std::vector<ParameterSetChange> changes;
+
+    std::vector<std::vector<uint8_t>> parameterSets[3]; ///< Last VPS/SPS/PPS per id
+    std::vector<uint8_t> ppsExtraSliceHeaderBits;       ///< HEVC, per PPS id
+};
@@ -0,0 +1,330 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ContentGenerator.h"
+#include "ContentKernels.h"
+#include "HostKernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace
+{
+
+const int32_t* getSineTable()
+{
+    static const std::vector<int32_t> table = []()
+    {
+        std::vector<int32_t> t(1024);
+        for (uint32_t i = 0; i < t.size(); ++i)
+            t[i] = (int32_t) std::lround(16383.0 * std::sin(2.0 * 3.14159265358979323846 * i / t.size()));
+        return t;
+    }();
+    return table.data();
+}
+
+uint32_t bgra(uint32_t r, uint32_t g, uint32_t b)
+{
+    return 0xFF000000u | (std::min(r, 255u) << 16) | (std::min(g, 255u) << 8) | std::min(b, 255u);
+}
+
+uint32_t lerp(uint32_t a, uint32_t b, uint32_t t, uint32_t n)
+{
+    return (a * (n - t) + b * t) / n;
+}
+
+/**
+ * @brief Maps the most significant byte of a value to a plausible color for the content type.
+ */
+uint32_t paletteColor(ContentType type, uint32_t i)
+{
+    switch (type)
+    {
+    case ContentType::CameraPan:
+        // Terrain: water, sand, grass, rock, snow
+        if (i < 96)
+            return bgra(10, lerp(40, 110, i, 96), lerp(90, 190, i, 96));
+        if (i < 110)
+            return bgra(194, 178, 128);
+        if (i < 170)
+            return bgra(lerp(70, 40, i - 110, 60), lerp(140, 90, i - 110, 60), 40);
+        if (i < 220)
+            return bgra(lerp(110, 150, i - 170, 50), lerp(100, 140, i - 170, 50), lerp(90, 130, i - 170, 50));
+        return bgra(lerp(220, 255, i - 220, 36), lerp(220, 255, i - 220, 36), lerp(230, 255, i - 220, 36));
+
+    case ContentType::ScrollingText:
+        // Gray levels with a blue tint for the title bar
+        if (i == 0x50)
+            return bgra(40, 70, 150);
+        return bgra(i, i, i);
+
+    case ContentType::DepthMap:
+        // Near is bright
+        return bgra(255 - i, 255 - i, 255 - i);
+
+    case ContentType::SparseMask:
+        // Distinct label colors
+        if (i == 0)
+            return bgra(0, 0, 0);
+        return bgra(64 + (contentHash(i) & 191), 64 + ((contentHash(i) >> 8) & 191), 64 + ((contentHash(i) >> 16) & 191));
+
+    case ContentType::ScientificField:
+        // Blue - cyan - yellow - red
+        if (i < 85)
+            return bgra(0, lerp(0, 255, i, 85), 255);
+        if (i < 170)
+            return bgra(lerp(0, 255, i - 85, 85), 255, lerp(255, 0, i - 85, 85));
+        return bgra(255, lerp(255, 0, i - 170, 86), 0);
+
+    case ContentType::Noise:
+        break;
+    }
+
+    return bgra(i, i, i);
+}
+
+}
+
+
+ContentGenerator::ContentGenerator(ContentType type, NvPipe_Format format, uint32_t width, uint32_t height, uint64_t seed)
+    : type(type), format(format), width(width), height(height), seed(contentHash((uint32_t) seed ^ contentHash((uint32_t) (seed >> 32))))
+{
+    this->palette.resize(256);
+    for (uint32_t i = 0; i < 256; ++i)
+        this->palette[i] = paletteColor(type, i);
+}
+
+uint64_t ContentGenerator::getPitch() const
+{
+    if (this->format == NVPIPE_BGRA32 || this->format == NVPIPE_BGRA32_ALPHA || this->format == NVPIPE_UINT32)
+        return this->width * 4;
+    else if (this->format == NVPIPE_UINT16)
+        return this->width * 2;
+    else if (this->format == NVPIPE_UINT8)
+        return this->width;
+    else if (this->format == NVPIPE_UINT4)
+        return (this->width + 1) / 2;
+
+    return 0;
+}
+
+uint64_t ContentGenerator::getFrameSize() const
+{
+    return this->getPitch() * this->height;
+}
+
+ContentGenerator::Params ContentGenerator::getParams(uint32_t frame) const
+{
+    Params p = {};
+    p.type = this->type;
+    p.seed = this->seed;
+    p.frame = frame;
+    p.width = this->width;
+    p.height = this->height;
+    p.sine = getSineTable();
+
+    const uint32_t h = contentHash(this->seed ^ 0x9e3779b9u);
+
+    if (this->type == ContentType::ScrollingText)
+    {
+        p.offsetY = (int32_t) (frame * (1 + (h & 3)));
+        p.panelWidth = (this->width / 5) & ~7u;
+    }
+    else if (this->type == ContentType::CameraPan)
+    {
+        // Positive world coordinates, moving up to 4 pixels per frame
+        p.offsetX = (1 << 20) + (int32_t) (frame * (1 + (h & 3)));
+        p.offsetY = (1 << 20) + (int32_t) frame * ((int32_t) ((h >> 8) % 5) - 2);
+    }
+    else if (this->type == ContentType::DepthMap || this->type == ContentType::SparseMask)
+    {
+        const bool depth = (this->type == ContentType::DepthMap);
+        const int32_t size = std::max<int32_t>(std::min(this->width, this->height), 16);
+
+        p.numObjects = depth ? 10 : 12;
+        for (uint32_t i = 0; i < p.numObjects; ++i)
+        {
+            uint32_t r = contentHash(this->seed + 0x1000 * (i + 1));
+            Object& o = p.objects[i];
+
+            // Depth objects are large, mask blobs small and sparse
+            o.rx = depth ? size / 16 + (int32_t) (r % (size / 6)) : size / 64 + 2 + (int32_t) (r % (size / 24 + 1));
+            r = contentHash(r);
+            o.box = r & 1;
+            o.ry = o.box ? o.rx / 2 + (int32_t) ((r >> 1) % (o.rx + 1)) : o.rx;
+            o.value = depth ? 4000 + (int32_t) ((r >> 8) % 40000) : 1 + (int32_t) (i % 15);
+
+            // Move horizontally with wrap-around, vertically bouncing
+            r = contentHash(r);
+            const int64_t spanX = this->width + 2 * o.rx;
+            const int64_t vx = (int32_t) (r % 9) - 4;
+            o.x = (int32_t) ((((int64_t) (r >> 8) % spanX) + vx * frame) % spanX + spanX) % spanX - o.rx;
+
+            r = contentHash(r);
+            const int64_t rangeY = std::max<int64_t>(this->height - 2 * o.ry, 1);
+            const int64_t travel = ((int64_t) (r >> 8) + (int64_t) (r % 3) * frame) % (2 * rangeY);
+            o.y = (int32_t) (o.ry + (travel < rangeY ? travel : 2 * rangeY - travel));
+        }
+    }
+    else if (this->type == ContentType::ScientificField)
+    {
+        for (uint32_t i = 0; i < Params::NUM_WAVES; ++i)
+        {
+            // Periods between 64 and 1024 pixels, phase velocity up to 1/64 period per frame
+            uint32_t r = contentHash(this->seed + 0x2000 * (i + 1));
+            const uint32_t periodX = 64 + r % 960;
+            r = contentHash(r);
+            const uint32_t periodY = 64 + r % 960;
+            r = contentHash(r);
+
+            p.waves[i].kx = (int32_t) (0xFFFFFFFFu / periodX) * ((r & 1) ? 1 : -1);
+            p.waves[i].ky = (int32_t) (0xFFFFFFFFu / periodY) * ((r & 2) ? 1 : -1);
+            p.waves[i].phase = (int32_t) (r + frame * ((r >> 8) & 0x3FFFFFF));
+        }
+    }
+
+    return p;
+}
+
+void ContentGenerator::generateRows(const Params& params, uint8_t* dst, uint64_t pitch, uint32_t y0, uint32_t y1) const
+{
+    const bool avx2 = !this->scalarOnly && isAvx2Supported();
+    std::vector<uint32_t> values(this->width);
+
+    for (uint32_t y = y0; y < y1; ++y)
+    {
+#ifdef NVPIPE_TOOLS_AVX2
+        if (avx2)
+            generateContentRowAVX2(params, y, values.data());
+        else
+#endif
+            generateContentRow<ScalarVec>(params, y, values.data(), 0, this->width);
+
+        uint8_t* row = dst + y * pitch;
+        const uint32_t* v = values.data();
+
+        if (this->format == NVPIPE_BGRA32)
+        {
+            uint32_t* out = (uint32_t*) row;
+            if (this->type == ContentType::Noise)
+                for (uint32_t x = 0; x < this->width; ++x)
+                    out[x] = v[x] | 0xFF000000u;
+            else
+                for (uint32_t x = 0; x < this->width; ++x)
+                    out[x] = this->palette[v[x] >> 24];
+        }
+        else if (this->format == NVPIPE_BGRA32_ALPHA)
+        {
+            // Coverage follows the palette index, e.g., transparent background of sparse masks
+            uint32_t* out = (uint32_t*) row;
+            if (this->type == ContentType::Noise)
+                std::copy(v, v + this->width, out);
+            else
+                for (uint32_t x = 0; x < this->width; ++x)
+                    out[x] = (this->palette[v[x] >> 24] & 0x00FFFFFFu) | (v[x] & 0xFF000000u);
+        }
+        else if (this->format == NVPIPE_UINT4)
+        {
+            // Even pixel in the higher 4 bits
+            for (uint32_t x = 0; x + 1 < this->width; x += 2)
+                row[x / 2] = (uint8_t) (((v[x] >> 28) << 4) | (v[x + 1] >> 28));
+            if (this->width & 1)
+                row[this->width / 2] = (uint8_t) ((v[this->width - 1] >> 28) << 4);
+        }
+        else if (this->format == NVPIPE_UINT8)
+        {
+            for (uint32_t x = 0; x < this->width; ++x)
+                row[x] = (uint8_t) (v[x] >> 24);
+        }
+        else if (this->format == NVPIPE_UINT16)
+        {
+            uint16_t* out = (uint16_t*) row;
+            for (uint32_t x = 0; x < this->width; ++x)
+                out[x] = (uint16_t) (v[x] >> 16);
+        }
+        else if (this->format == NVPIPE_UINT32)
+        {
+            std::copy(v, v + this->width, (uint32_t*) row);
+        }
+    }
+}
+
+void ContentGenerator::generate(uint32_t frame, void* dst, uint64_t pitch) const
+{
+    if (pitch == 0)
+        pitch = this->getPitch();
+
+    const Params params = this->getParams(frame);
+
+    // Split into row blocks for large frames. Output does not depend on the split.
+    parallelRows(this->height, 64, 0, [&](uint32_t, uint32_t y0, uint32_t y1)
+    {
+        this->generateRows(params, (uint8_t*) dst, pitch, y0, y1);
+    });
+}
+
+bool ContentGenerator::isAvx2Supported()
+{
+#ifdef NVPIPE_TOOLS_AVX2
+    return cpuSupportsAvx2();
+#else
+    return false;
+#endif
+}
+
+const char* ContentGenerator::getName(ContentType type)
+{
+    switch (type)
+    {
+    case ContentType::ScrollingText: return "text";
+    case ContentType::CameraPan: return "pan";
+    case ContentType::Noise: return "noise";
+    case ContentType::DepthMap: return "depth";
+    case ContentType::SparseMask: return "mask";
+    case ContentType::ScientificField: return "field";
+    }
+    return "unknown";
+}
+
+bool ContentGenerator::parseType(const std::string& name, ContentType& type)
+{
+    for (ContentType t : getAllTypes())
+    {
+        if (name == getName(t))
+        {
+            type = t;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<ContentType> ContentGenerator::getAllTypes()
+{
+    return { ContentType::ScrollingText, ContentType::CameraPan, ContentType::Noise, ContentType::DepthMap, ContentType::SparseMask, ContentType::ScientificField };
+}
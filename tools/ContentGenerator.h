@@ -0,0 +1,147 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <NvPipe.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+/**
+ * @brief Synthetic content types.
+ */
+enum class ContentType
+{
+    ScrollingText,   ///< Scrolling document with static UI panels
+    CameraPan,       ///< Smooth multi-octave terrain seen by a panning camera
+    Noise,           ///< Uncorrelated white noise (worst case)
+    DepthMap,        ///< Ground plane with moving objects, sharp depth discontinuities
+    SparseMask,      ///< Mostly empty label image with a few moving blobs
+    ScientificField  ///< Interfering waves, smooth high-dynamic-range scalar field
+};
+
+
+/**
+ * @brief Deterministic, seeded frame generator for benchmarks.
+ *
+ * Every pixel is an integer function of (seed, x, y, frame), so the same frame is reproduced bit-exactly
+ * on every machine, independent of the instruction set (AVX2 or scalar) and the number of threads.
+ *
+ * Each content type produces a 32-bit scalar per pixel, which is mapped to the requested format:
+ * BGRA32 via a per-content color palette (BGRA32_ALPHA: alpha is the palette index), integer formats by keeping
+ * the most significant bits.
+ */
+class ContentGenerator
+{
+public:
+    ContentGenerator(ContentType type, NvPipe_Format format, uint32_t width, uint32_t height, uint64_t seed = 0);
+
+    /**
+     * @brief Generates a frame into host memory.
+     * @param frame Frame index. Content moves as a function of this index.
+     * @param dst Output buffer of at least pitch * height bytes.
+     * @param pitch Row pitch in bytes, 0 for tightly packed rows.
+     */
+    void generate(uint32_t frame, void* dst, uint64_t pitch = 0) const;
+
+    uint64_t getPitch() const;
+    uint64_t getFrameSize() const;
+
+    ContentType getType() const { return this->type; }
+    NvPipe_Format getFormat() const { return this->format; }
+    uint32_t getWidth() const { return this->width; }
+    uint32_t getHeight() const { return this->height; }
+
+    /**
+     * @brief Disables the vectorized code path, e.g., to verify identical output.
+     */
+    void setScalarOnly(bool scalarOnly) { this->scalarOnly = scalarOnly; }
+
+    static bool isAvx2Supported();
+    static const char* getName(ContentType type);
+    static bool parseType(const std::string& name, ContentType& type);
+    static std::vector<ContentType> getAllTypes();
+
+public:
+    /**
+     * @brief Per-frame constants shared by the scalar and vectorized kernels.
+     */
+    struct Object
+    {
+        int32_t x, y;       ///< Current center
+        int32_t rx, ry;     ///< Radii (ellipse) or half extents (box)
+        int32_t box;        ///< Box instead of ellipse
+        int32_t value;      ///< Depth or label
+    };
+
+    struct Wave
+    {
+        int32_t kx, ky, phase;
+    };
+
+    struct Params
+    {
+        ContentType type;
+        uint32_t seed;
+        uint32_t frame;
+        int32_t width, height;
+
+        int32_t offsetX, offsetY; ///< Scroll or camera offset
+        int32_t panelWidth;       ///< Scrolling text: static side panel
+
+        static const uint32_t MAX_OBJECTS = 16;
+        uint32_t numObjects;
+        Object objects[MAX_OBJECTS];
+
+        static const uint32_t NUM_WAVES = 4;
+        Wave waves[NUM_WAVES];
+        const int32_t* sine;      ///< 1024 entries, amplitude 16383
+    };
+
+private:
+    Params getParams(uint32_t frame) const;
+    void generateRows(const Params& params, uint8_t* dst, uint64_t pitch, uint32_t y0, uint32_t y1) const;
+
+private:
+    ContentType type;
+    NvPipe_Format format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t seed;
+    bool scalarOnly = false;
+
+    std::vector<uint32_t> palette; // 256 BGRA entries
+};
+
+
+/**
+ * @brief Generates rows of 32-bit values using AVX2 (ContentGeneratorAVX2.cpp). Only call if isAvx2Supported().
+ */
+void generateContentRowAVX2(const ContentGenerator::Params& params, int32_t y, uint32_t* values);
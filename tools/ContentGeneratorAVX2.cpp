@@ -0,0 +1,72 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Compiled with AVX2 enabled (see CMakeLists.txt). Only called after a runtime CPU check.
+
+#include "ContentKernels.h"
+
+#include <immintrin.h>
+
+
+struct Avx2Vec
+{
+    static const int32_t LANES = 8;
+
+    __m256i v;
+
+    static Avx2Vec set(uint32_t a) { return { _mm256_set1_epi32((int32_t) a) }; }
+    static Avx2Vec ramp(int32_t x) { return { _mm256_add_epi32(_mm256_set1_epi32(x), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)) }; }
+    static Avx2Vec gather(const int32_t* table, Avx2Vec i) { return { _mm256_i32gather_epi32(table, i.v, 4) }; }
+    void store(uint32_t* dst) const { _mm256_storeu_si256((__m256i*) dst, this->v); }
+
+    friend Avx2Vec operator+(Avx2Vec a, Avx2Vec b) { return { _mm256_add_epi32(a.v, b.v) }; }
+    friend Avx2Vec operator-(Avx2Vec a, Avx2Vec b) { return { _mm256_sub_epi32(a.v, b.v) }; }
+    friend Avx2Vec operator*(Avx2Vec a, Avx2Vec b) { return { _mm256_mullo_epi32(a.v, b.v) }; }
+    friend Avx2Vec operator^(Avx2Vec a, Avx2Vec b) { return { _mm256_xor_si256(a.v, b.v) }; }
+    friend Avx2Vec operator&(Avx2Vec a, Avx2Vec b) { return { _mm256_and_si256(a.v, b.v) }; }
+    friend Avx2Vec operator|(Avx2Vec a, Avx2Vec b) { return { _mm256_or_si256(a.v, b.v) }; }
+    friend Avx2Vec operator~(Avx2Vec a) { return { _mm256_xor_si256(a.v, _mm256_set1_epi32(-1)) }; }
+
+    friend Avx2Vec srl(Avx2Vec a, int n) { return { _mm256_srli_epi32(a.v, n) }; }
+    friend Avx2Vec sra(Avx2Vec a, int n) { return { _mm256_srai_epi32(a.v, n) }; }
+    friend Avx2Vec srlv(Avx2Vec a, Avx2Vec n) { return { _mm256_srlv_epi32(a.v, n.v) }; }
+
+    friend Avx2Vec lt(Avx2Vec a, Avx2Vec b) { return { _mm256_cmpgt_epi32(b.v, a.v) }; }
+    friend Avx2Vec eq(Avx2Vec a, Avx2Vec b) { return { _mm256_cmpeq_epi32(a.v, b.v) }; }
+    friend Avx2Vec select(Avx2Vec mask, Avx2Vec a, Avx2Vec b) { return { _mm256_blendv_epi8(b.v, a.v, mask.v) }; }
+    friend Avx2Vec min(Avx2Vec a, Avx2Vec b) { return { _mm256_min_epi32(a.v, b.v) }; }
+    friend Avx2Vec max(Avx2Vec a, Avx2Vec b) { return { _mm256_max_epi32(a.v, b.v) }; }
+};
+
+
+void generateContentRowAVX2(const ContentGenerator::Params& params, int32_t y, uint32_t* values)
+{
+    const int32_t vectorized = params.width - params.width % Avx2Vec::LANES;
+
+    generateContentRow<Avx2Vec>(params, y, values, 0, vectorized);
+    generateContentRow<ScalarVec>(params, y, values, vectorized, params.width);
+}
@@ -0,0 +1,280 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "ContentGenerator.h"
+
+
+/**
+ * Content kernels, written once against a small integer vector interface (see ScalarVec) and instantiated
+ * for scalar and AVX2 lanes. Only wrapping 32-bit integer arithmetic is used, so all instantiations produce
+ * bit-identical output.
+ */
+
+struct ScalarVec
+{
+    static const int32_t LANES = 1;
+
+    uint32_t v;
+
+    static ScalarVec set(uint32_t a) { return { a }; }
+    static ScalarVec ramp(int32_t x) { return { (uint32_t) x }; }
+    static ScalarVec gather(const int32_t* table, ScalarVec i) { return { (uint32_t) table[i.v] }; }
+    void store(uint32_t* dst) const { *dst = this->v; }
+
+    friend ScalarVec operator+(ScalarVec a, ScalarVec b) { return { a.v + b.v }; }
+    friend ScalarVec operator-(ScalarVec a, ScalarVec b) { return { a.v - b.v }; }
+    friend ScalarVec operator*(ScalarVec a, ScalarVec b) { return { a.v * b.v }; }
+    friend ScalarVec operator^(ScalarVec a, ScalarVec b) { return { a.v ^ b.v }; }
+    friend ScalarVec operator&(ScalarVec a, ScalarVec b) { return { a.v & b.v }; }
+    friend ScalarVec operator|(ScalarVec a, ScalarVec b) { return { a.v | b.v }; }
+    friend ScalarVec operator~(ScalarVec a) { return { ~a.v }; }
+
+    friend ScalarVec srl(ScalarVec a, int n) { return { a.v >> n }; }
+    friend ScalarVec sra(ScalarVec a, int n) { return { (uint32_t) ((int32_t) a.v >> n) }; }
+    friend ScalarVec srlv(ScalarVec a, ScalarVec n) { return { a.v >> n.v }; }
+
+    /// Signed comparison, all bits set if true
+    friend ScalarVec lt(ScalarVec a, ScalarVec b) { return { ((int32_t) a.v < (int32_t) b.v) ? 0xFFFFFFFFu : 0u }; }
+    friend ScalarVec eq(ScalarVec a, ScalarVec b) { return { (a.v == b.v) ? 0xFFFFFFFFu : 0u }; }
+    friend ScalarVec select(ScalarVec mask, ScalarVec a, ScalarVec b) { return { (a.v & mask.v) | (b.v & ~mask.v) }; }
+    friend ScalarVec min(ScalarVec a, ScalarVec b) { return ((int32_t) a.v < (int32_t) b.v) ? a : b; }
+    friend ScalarVec max(ScalarVec a, ScalarVec b) { return ((int32_t) a.v > (int32_t) b.v) ? a : b; }
+};
+
+
+inline uint32_t contentHash(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+template<typename V>
+inline V contentHash(V x)
+{
+    x = x ^ srl(x, 16);
+    x = x * V::set(0x7feb352du);
+    x = x ^ srl(x, 15);
+    x = x * V::set(0x846ca68bu);
+    x = x ^ srl(x, 16);
+    return x;
+}
+
+template<typename V>
+inline V absolute(V a)
+{
+    return max(a, V::set(0) - a);
+}
+
+
+/**
+ * @brief Bilinearly interpolated lattice noise with a cell size of 2^shift pixels, range [0, 65535].
+ */
+template<typename V>
+inline V valueNoise(V wx, int32_t wy, int shift, uint32_t salt)
+{
+    const V cx = sra(wx, shift);
+    const V fx = wx & V::set((1u << shift) - 1);
+    const uint32_t cy = (uint32_t) (wy >> shift);
+    const V fy = V::set(wy & ((1 << shift) - 1));
+
+    const V rowA = V::set(contentHash(cy ^ salt));
+    const V rowB = V::set(contentHash((cy + 1) ^ salt));
+
+    const V h00 = srl(contentHash(cx ^ rowA), 16);
+    const V h10 = srl(contentHash((cx + V::set(1)) ^ rowA), 16);
+    const V h01 = srl(contentHash(cx ^ rowB), 16);
+    const V h11 = srl(contentHash((cx + V::set(1)) ^ rowB), 16);
+
+    const V a = h00 + sra((h10 - h00) * fx, shift);
+    const V b = h01 + sra((h11 - h01) * fx, shift);
+    return a + sra((b - a) * fy, shift);
+}
+
+/**
+ * @brief Mask of text pixels in a document with 16 pixel lines and 8 pixel glyph cells.
+ */
+template<typename V>
+inline V textMask(V cx, int32_t wy, uint32_t salt)
+{
+    const uint32_t line = (uint32_t) (wy >> 4);
+    const int32_t py = wy & 15;
+
+    const uint32_t lineHash = contentHash(line ^ salt);
+    const uint32_t lineLength = (lineHash >> 26) + 8;
+    const uint32_t indent = ((lineHash >> 20) & 3) * 2;
+
+    // Empty lines between paragraphs and above/below the glyph box
+    if ((lineHash & 7) == 0 || py < 3 || py >= 13)
+        return V::set(0);
+
+    const V col = sra(cx, 3);
+    const V px = cx & V::set(7);
+
+    const V cellHash = contentHash(col ^ V::set(contentHash(lineHash)));
+    const V glyph = srl(cellHash, 8) & V::set(63);
+    const V glyphBits = contentHash(glyph ^ V::set(salt));
+    const V bitIndex = V::set(((py - 3) >> 1) * 3) + srl(px, 1);
+    const V bit = srlv(glyphBits, bitIndex) & V::set(1);
+
+    V mask = lt(col, V::set(lineLength)) & ~lt(col, V::set(indent));
+    mask = mask & ~lt(cellHash & V::set(7), V::set(1)); // spaces
+    mask = mask & lt(px, V::set(6));                     // glyph spacing
+    mask = mask & eq(bit, V::set(1));
+    mask = mask & ~lt(cx, V::set(0));
+    return mask;
+}
+
+/**
+ * @brief Computes 32-bit values of pixels [x0, x1) of row y. x1 - x0 must be a multiple of V::LANES.
+ */
+template<typename V>
+void generateContentRow(const ContentGenerator::Params& p, int32_t y, uint32_t* values, int32_t x0, int32_t x1)
+{
+    switch (p.type)
+    {
+    case ContentType::Noise:
+    {
+        const V rowKey = V::set(contentHash((uint32_t) y ^ contentHash(p.frame + p.seed)));
+        for (int32_t x = x0; x < x1; x += V::LANES)
+            contentHash(V::ramp(x) ^ rowKey).store(values + x);
+        break;
+    }
+
+    case ContentType::CameraPan:
+    {
+        const int32_t wy = y + p.offsetY;
+        for (int32_t x = x0; x < x1; x += V::LANES)
+        {
+            const V wx = V::ramp(x) + V::set(p.offsetX);
+            V v = valueNoise(wx, wy, 7, p.seed) * V::set(8);
+            v = v + valueNoise(wx, wy, 5, p.seed + 1) * V::set(4);
+            v = v + valueNoise(wx, wy, 3, p.seed + 2) * V::set(2);
+            v = v + valueNoise(wx, wy, 1, p.seed + 3);
+            (v * V::set(4369)).store(values + x); // 15 * 65535 * 4369 < 2^32
+        }
+        break;
+    }
+
+    case ContentType::ScrollingText:
+    {
+        const uint32_t BACKGROUND = 0xF0, TEXT = 0x18, PANEL = 0xC8, PANEL_TEXT = 0x30, BAR = 0x50;
+        const bool bar = y < 24;
+
+        for (int32_t x = x0; x < x1; x += V::LANES)
+        {
+            const V vx = V::ramp(x);
+            const V panel = lt(vx, V::set(p.panelWidth));
+
+            const V text = textMask(vx - V::set(p.panelWidth), y + p.offsetY, p.seed);
+            const V panelText = textMask(vx, y, p.seed + 1);
+
+            V level = select(text, V::set(TEXT), V::set(BACKGROUND));
+            level = select(panel, select(panelText, V::set(PANEL_TEXT), V::set(PANEL)), level);
+            if (bar)
+                level = V::set(BAR);
+
+            (level * V::set(0x01010101)).store(values + x);
+        }
+        break;
+    }
+
+    case ContentType::DepthMap:
+    case ContentType::SparseMask:
+    {
+        const bool depth = (p.type == ContentType::DepthMap);
+
+        // Ground plane below the horizon, far plane above
+        const int32_t horizon = p.height / 3;
+        int32_t background = 0;
+        if (depth)
+            background = (y < horizon) ? 65535 : 60000 - (int32_t) ((int64_t) (y - horizon) * 50000 / (p.height - horizon));
+
+        for (int32_t x = x0; x < x1; x += V::LANES)
+        {
+            const V vx = V::ramp(x);
+            V v = V::set(background);
+
+            for (uint32_t i = 0; i < p.numObjects; ++i)
+            {
+                const ContentGenerator::Object& o = p.objects[i];
+                const int32_t dy = y - o.y;
+                if (dy >= o.ry || -dy >= o.ry)
+                    continue;
+
+                const V dx = min(absolute(vx - V::set(o.x)), V::set(16384));
+                V inside;
+                V value;
+                if (o.box)
+                {
+                    inside = lt(dx, V::set(o.rx));
+                    value = V::set(o.value) + (depth ? sra(vx - V::set(o.x), 2) : V::set(0)); // slanted surface
+                }
+                else
+                {
+                    const V d2 = dx * dx + V::set(dy * dy);
+                    inside = lt(d2, V::set(o.rx * o.rx));
+                    value = V::set(o.value) + (depth ? sra(d2, 6) : V::set(0)); // curved surface
+                }
+
+                if (depth)
+                    inside = inside & lt(value, v); // nearest wins
+                v = select(inside, value, v);
+            }
+
+            (v * V::set(depth ? 0x00010001u : 0x11111111u)).store(values + x);
+        }
+        break;
+    }
+
+    case ContentType::ScientificField:
+    {
+        uint32_t rowPhase[ContentGenerator::Params::NUM_WAVES];
+        for (uint32_t i = 0; i < ContentGenerator::Params::NUM_WAVES; ++i)
+            rowPhase[i] = (uint32_t) p.waves[i].ky * (uint32_t) y + (uint32_t) p.waves[i].phase;
+
+        for (int32_t x = x0; x < x1; x += V::LANES)
+        {
+            const V vx = V::ramp(x);
+            V sum = V::set(65536);
+            for (uint32_t i = 0; i < ContentGenerator::Params::NUM_WAVES; ++i)
+            {
+                const V phase = vx * V::set(p.waves[i].kx) + V::set(rowPhase[i]);
+                sum = sum + V::gather(p.sine, srl(phase, 22));
+            }
+
+            (sum * V::set(1u << 15)).store(values + x);
+        }
+        break;
+    }
+    }
+}
@@ -0,0 +1,323 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "QualityMetrics.h"
+#include "ContentGenerator.h"
+#include "HostKernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+
+namespace
+{
+
+double getPeak(NvPipe_Format format)
+{
+    if (format == NVPIPE_UINT4)
+        return 15.0;
+    else if (format == NVPIPE_UINT16)
+        return 65535.0;
+    else if (format == NVPIPE_UINT32)
+        return 4294967295.0;
+
+    return 255.0;
+}
+
+uint64_t getRowSize(NvPipe_Format format, uint32_t width)
+{
+    if (format == NVPIPE_BGRA32 || format == NVPIPE_BGRA32_ALPHA || format == NVPIPE_UINT32)
+        return width * 4ull;
+    else if (format == NVPIPE_UINT16)
+        return width * 2ull;
+    else if (format == NVPIPE_UINT4)
+        return (width + 1) / 2;
+
+    return width;
+}
+
+void byteErrors(const uint8_t* a, const uint8_t* b, uint64_t n, bool skipAlpha, uint64_t& sse, uint64_t& maxError)
+{
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        if (skipAlpha && (i & 3) == 3)
+            continue;
+
+        const uint64_t d = (a[i] > b[i]) ? a[i] - b[i] : b[i] - a[i];
+        sse += d * d;
+        maxError = std::max(maxError, d);
+    }
+}
+
+void shortErrors(const uint16_t* a, const uint16_t* b, uint64_t n, uint64_t& sse, uint64_t& maxError)
+{
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        const uint64_t d = (a[i] > b[i]) ? a[i] - b[i] : b[i] - a[i];
+        sse += d * d;
+        maxError = std::max(maxError, d);
+    }
+}
+
+void columnSums(const float* const x[4], const float* const y[4], uint32_t width, float* const sums[5])
+{
+    for (uint32_t i = 0; i < width; ++i)
+    {
+        float sx = 0.0f, sy = 0.0f, sxx = 0.0f, syy = 0.0f, sxy = 0.0f;
+        for (uint32_t r = 0; r < 4; ++r)
+        {
+            sx += x[r][i];
+            sy += y[r][i];
+            sxx += x[r][i] * x[r][i];
+            syy += y[r][i] * y[r][i];
+            sxy += x[r][i] * y[r][i];
+        }
+        sums[0][i] = sx;
+        sums[1][i] = sy;
+        sums[2][i] = sxx;
+        sums[3][i] = syy;
+        sums[4][i] = sxy;
+    }
+}
+
+double ssimFromSums(double n, double sx, double sy, double sxx, double syy, double sxy)
+{
+    // Values are normalized to [0, 1]
+    const double C1 = 0.01 * 0.01;
+    const double C2 = 0.03 * 0.03;
+
+    const double mx = sx / n;
+    const double my = sy / n;
+    const double vx = sxx / n - mx * mx;
+    const double vy = syy / n - my * my;
+    const double cov = sxy / n - mx * my;
+
+    return ((2.0 * mx * my + C1) * (2.0 * cov + C2)) / ((mx * mx + my * my + C1) * (vx + vy + C2));
+}
+
+}
+
+
+Quality computeQuality(NvPipe_Format format, const void* reference, const void* test, uint32_t width, uint32_t height, uint64_t pitch, bool allowSimd)
+{
+    const uint64_t rowSize = getRowSize(format, width);
+    if (pitch == 0)
+        pitch = rowSize;
+
+    const bool avx2 = allowSimd && ContentGenerator::isAvx2Supported();
+    const double peak = getPeak(format);
+    const float scale = (float) (1.0 / peak);
+
+    // Pass 1: error statistics and normalized planes for SSIM
+    std::vector<float> planeX((uint64_t) width * height);
+    std::vector<float> planeY((uint64_t) width * height);
+
+    std::vector<double> threadSse(getMaxRowRanges(), 0.0);
+    std::vector<uint64_t> threadMax(threadSse.size(), 0);
+
+    uint32_t numRanges = parallelRows(height, 16, 0, [&](uint32_t t, uint32_t y0, uint32_t y1)
+    {
+        for (uint32_t y = y0; y < y1; ++y)
+        {
+            const uint8_t* a = (const uint8_t*) reference + y * pitch;
+            const uint8_t* b = (const uint8_t*) test + y * pitch;
+            float* px = planeX.data() + (uint64_t) y * width;
+            float* py = planeY.data() + (uint64_t) y * width;
+
+            uint64_t sse = 0;
+            uint64_t maxError = 0;
+
+            if (format == NVPIPE_BGRA32 || format == NVPIPE_BGRA32_ALPHA)
+            {
+                const bool skipAlpha = (format == NVPIPE_BGRA32);
+#ifdef NVPIPE_TOOLS_AVX2
+                if (avx2)
+                    byteErrorsAVX2(a, b, rowSize, skipAlpha, sse, maxError);
+                else
+#endif
+                    byteErrors(a, b, rowSize, skipAlpha, sse, maxError);
+
+                // BT.601 luma
+                for (uint32_t x = 0; x < width; ++x)
+                {
+                    px[x] = (29 * a[4 * x] + 150 * a[4 * x + 1] + 77 * a[4 * x + 2]) * (scale / 256.0f);
+                    py[x] = (29 * b[4 * x] + 150 * b[4 * x + 1] + 77 * b[4 * x + 2]) * (scale / 256.0f);
+                }
+            }
+            else if (format == NVPIPE_UINT8)
+            {
+#ifdef NVPIPE_TOOLS_AVX2
+                if (avx2)
+                    byteErrorsAVX2(a, b, rowSize, false, sse, maxError);
+                else
+#endif
+                    byteErrors(a, b, rowSize, false, sse, maxError);
+
+                for (uint32_t x = 0; x < width; ++x)
+                {
+                    px[x] = a[x] * scale;
+                    py[x] = b[x] * scale;
+                }
+            }
+            else if (format == NVPIPE_UINT16)
+            {
+                const uint16_t* a16 = (const uint16_t*) a;
+                const uint16_t* b16 = (const uint16_t*) b;
+#ifdef NVPIPE_TOOLS_AVX2
+                if (avx2)
+                    shortErrorsAVX2(a16, b16, width, sse, maxError);
+                else
+#endif
+                    shortErrors(a16, b16, width, sse, maxError);
+
+                for (uint32_t x = 0; x < width; ++x)
+                {
+                    px[x] = a16[x] * scale;
+                    py[x] = b16[x] * scale;
+                }
+            }
+            else if (format == NVPIPE_UINT4)
+            {
+                // Even pixel in the higher 4 bits
+                for (uint32_t x = 0; x < width; ++x)
+                {
+                    const uint32_t va = (x & 1) ? (a[x / 2] & 0xF) : (a[x / 2] >> 4);
+                    const uint32_t vb = (x & 1) ? (b[x / 2] & 0xF) : (b[x / 2] >> 4);
+                    const uint64_t d = (va > vb) ? va - vb : vb - va;
+                    sse += d * d;
+                    maxError = std::max(maxError, d);
+                    px[x] = va * scale;
+                    py[x] = vb * scale;
+                }
+            }
+            else if (format == NVPIPE_UINT32)
+            {
+                // Squared differences do not fit into an integer sum
+                const uint32_t* a32 = (const uint32_t*) a;
+                const uint32_t* b32 = (const uint32_t*) b;
+                double rowSse = 0.0;
+                for (uint32_t x = 0; x < width; ++x)
+                {
+                    const uint64_t d = (a32[x] > b32[x]) ? a32[x] - b32[x] : b32[x] - a32[x];
+                    rowSse += (double) d * (double) d;
+                    maxError = std::max(maxError, d);
+                    px[x] = (float) (a32[x] * (1.0 / peak));
+                    py[x] = (float) (b32[x] * (1.0 / peak));
+                }
+                threadSse[t] += rowSse;
+            }
+
+            threadSse[t] += (double) sse;
+            threadMax[t] = std::max(threadMax[t], maxError);
+        }
+    });
+
+    Quality q;
+    double sse = 0.0;
+    for (uint32_t t = 0; t < numRanges; ++t)
+    {
+        sse += threadSse[t];
+        q.maxError = std::max(q.maxError, threadMax[t]);
+    }
+
+    const double samples = (double) width * height * ((format == NVPIPE_BGRA32) ? 3 : (format == NVPIPE_BGRA32_ALPHA) ? 4 : 1);
+    q.mse = sse / samples;
+    q.psnr = (q.mse > 0.0) ? 10.0 * std::log10(peak * peak / q.mse) : std::numeric_limits<double>::infinity();
+
+    // Pass 2: statistics of 4x4 blocks
+    const uint32_t bw = width / 4;
+    const uint32_t bh = height / 4;
+    if (bw < 2 || bh < 2)
+    {
+        // Too small for windows, use global statistics
+        double s[5] = {};
+        for (uint64_t i = 0; i < planeX.size(); ++i)
+        {
+            s[0] += planeX[i];
+            s[1] += planeY[i];
+            s[2] += planeX[i] * planeX[i];
+            s[3] += planeY[i] * planeY[i];
+            s[4] += planeX[i] * planeY[i];
+        }
+        q.ssim = planeX.empty() ? 1.0 : ssimFromSums((double) planeX.size(), s[0], s[1], s[2], s[3], s[4]);
+        return q;
+    }
+
+    std::vector<float> blocks[5];
+    for (auto& b : blocks)
+        b.resize((uint64_t) bw * bh);
+
+    parallelRows(bh, 4, 0, [&](uint32_t, uint32_t by0, uint32_t by1)
+    {
+        std::vector<float> columns(5 * (uint64_t) width);
+        float* const sums[5] = { &columns[0], &columns[width], &columns[2 * width], &columns[3 * width], &columns[4 * width] };
+
+        for (uint32_t by = by0; by < by1; ++by)
+        {
+            const float* const x[4] = { &planeX[(4 * by) * (uint64_t) width], &planeX[(4 * by + 1) * (uint64_t) width], &planeX[(4 * by + 2) * (uint64_t) width], &planeX[(4 * by + 3) * (uint64_t) width] };
+            const float* const y[4] = { &planeY[(4 * by) * (uint64_t) width], &planeY[(4 * by + 1) * (uint64_t) width], &planeY[(4 * by + 2) * (uint64_t) width], &planeY[(4 * by + 3) * (uint64_t) width] };
+
+#ifdef NVPIPE_TOOLS_AVX2
+            if (avx2)
+                columnSumsAVX2(x, y, width, sums);
+            else
+#endif
+                columnSums(x, y, width, sums);
+
+            for (uint32_t k = 0; k < 5; ++k)
+                for (uint32_t bx = 0; bx < bw; ++bx)
+                    blocks[k][(uint64_t) by * bw + bx] = sums[k][4 * bx] + sums[k][4 * bx + 1] + sums[k][4 * bx + 2] + sums[k][4 * bx + 3];
+        }
+    });
+
+    // Pass 3: 8x8 windows made of 2x2 blocks
+    std::vector<double> threadSsim(threadSse.size(), 0.0);
+    numRanges = parallelRows(bh - 1, 4, 0, [&](uint32_t t, uint32_t by0, uint32_t by1)
+    {
+        for (uint32_t by = by0; by < by1; ++by)
+        {
+            for (uint32_t bx = 0; bx + 1 < bw; ++bx)
+            {
+                const uint64_t i = (uint64_t) by * bw + bx;
+                double s[5];
+                for (uint32_t k = 0; k < 5; ++k)
+                    s[k] = (double) blocks[k][i] + blocks[k][i + 1] + blocks[k][i + bw] + blocks[k][i + bw + 1];
+
+                threadSsim[t] += ssimFromSums(64.0, s[0], s[1], s[2], s[3], s[4]);
+            }
+        }
+    });
+
+    double ssim = 0.0;
+    for (uint32_t t = 0; t < numRanges; ++t)
+        ssim += threadSsim[t];
+    q.ssim = ssim / ((double) (bw - 1) * (bh - 1));
+
+    return q;
+}
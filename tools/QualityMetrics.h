@@ -0,0 +1,71 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <NvPipe.h>
+
+#include <cstdint>
+
+
+/**
+ * @brief Full-reference quality of a decoded frame.
+ */
+struct Quality
+{
+    double mse = 0.0;       ///< Mean squared error over all samples (BGRA32: color channels, alpha ignored; BGRA32_ALPHA: all channels)
+    double psnr = 0.0;      ///< Peak signal-to-noise ratio in dB relative to the format's peak value, infinity if identical
+    double ssim = 1.0;      ///< Mean structural similarity of 8x8 windows (step 4) on luma (BGRA32) or values (integer formats)
+    uint64_t maxError = 0;  ///< Largest absolute sample difference
+};
+
+
+/**
+ * @brief Compares a test frame against a reference frame in host memory.
+ *
+ * Rows are processed in parallel; error sums and block statistics use AVX2 if supported.
+ * Error sums are exact integers, so PSNR and max error do not depend on the code path.
+ * @param pitch Row pitch of both frames in bytes, 0 for tightly packed rows.
+ */
+Quality computeQuality(NvPipe_Format format, const void* reference, const void* test, uint32_t width, uint32_t height, uint64_t pitch = 0, bool allowSimd = true);
+
+
+// Row kernels (QualityMetricsAVX2.cpp), only called if ContentGenerator::isAvx2Supported()
+
+/**
+ * @brief Sum of squared and maximum absolute byte differences. Bytes at positions with (i % 4 == 3) are skipped if skipAlpha is set.
+ */
+void byteErrorsAVX2(const uint8_t* a, const uint8_t* b, uint64_t n, bool skipAlpha, uint64_t& sse, uint64_t& maxError);
+
+void shortErrorsAVX2(const uint16_t* a, const uint16_t* b, uint64_t n, uint64_t& sse, uint64_t& maxError);
+
+/**
+ * @brief Accumulates per-column sums of x, y, x^2, y^2 and x*y over four rows for 4x4 block statistics.
+ * @param rows Pointers to four rows of the reference (x) and test (y) planes.
+ * @param sums Five arrays of width floats receiving the column sums.
+ */
+void columnSumsAVX2(const float* const x[4], const float* const y[4], uint32_t width, float* const sums[5]);
@@ -0,0 +1,182 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Compiled with AVX2 enabled (see CMakeLists.txt). Only called after a runtime CPU check.
+
+#include "QualityMetrics.h"
+
+#include <algorithm>
+
+#include <immintrin.h>
+
+
+namespace
+{
+
+uint64_t horizontalSum64(__m256i v)
+{
+    const __m128i s = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    return (uint64_t) _mm_cvtsi128_si64(s) + (uint64_t) _mm_extract_epi64(s, 1);
+}
+
+__m256i widenSum32(__m256i v)
+{
+    return _mm256_add_epi64(_mm256_cvtepu32_epi64(_mm256_castsi256_si128(v)), _mm256_cvtepu32_epi64(_mm256_extracti128_si256(v, 1)));
+}
+
+}
+
+
+void byteErrorsAVX2(const uint8_t* a, const uint8_t* b, uint64_t n, bool skipAlpha, uint64_t& sse, uint64_t& maxError)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i colorMask = _mm256_set1_epi32(skipAlpha ? 0x00FFFFFF : -1);
+
+    __m256i acc64 = zero;
+    __m256i maxDiff = zero;
+
+    uint64_t i = 0;
+    while (i + 32 <= n)
+    {
+        // 32-bit lanes receive at most 4 * 255^2 per iteration, flush before they overflow
+        __m256i acc32 = zero;
+        for (uint32_t k = 0; k < 4096 && i + 32 <= n; ++k, i += 32)
+        {
+            const __m256i va = _mm256_and_si256(_mm256_loadu_si256((const __m256i*) (a + i)), colorMask);
+            const __m256i vb = _mm256_and_si256(_mm256_loadu_si256((const __m256i*) (b + i)), colorMask);
+
+            const __m256i diff = _mm256_or_si256(_mm256_subs_epu8(va, vb), _mm256_subs_epu8(vb, va));
+            maxDiff = _mm256_max_epu8(maxDiff, diff);
+
+            const __m256i lo = _mm256_unpacklo_epi8(diff, zero);
+            const __m256i hi = _mm256_unpackhi_epi8(diff, zero);
+            acc32 = _mm256_add_epi32(acc32, _mm256_add_epi32(_mm256_madd_epi16(lo, lo), _mm256_madd_epi16(hi, hi)));
+        }
+        acc64 = _mm256_add_epi64(acc64, widenSum32(acc32));
+    }
+
+    sse += horizontalSum64(acc64);
+
+    alignas(32) uint8_t lanes[32];
+    _mm256_store_si256((__m256i*) lanes, maxDiff);
+    for (uint32_t k = 0; k < 32; ++k)
+        maxError = std::max<uint64_t>(maxError, lanes[k]);
+
+    // Remainder, i is a multiple of 4 so the alpha position is preserved
+    for (; i < n; ++i)
+    {
+        if (skipAlpha && (i & 3) == 3)
+            continue;
+
+        const uint64_t d = (a[i] > b[i]) ? a[i] - b[i] : b[i] - a[i];
+        sse += d * d;
+        maxError = std::max(maxError, d);
+    }
+}
+
+void shortErrorsAVX2(const uint16_t* a, const uint16_t* b, uint64_t n, uint64_t& sse, uint64_t& maxError)
+{
+    const __m256i zero = _mm256_setzero_si256();
+
+    __m256i acc64 = zero;
+    __m256i maxDiff = zero;
+
+    uint64_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        const __m256i va = _mm256_loadu_si256((const __m256i*) (a + i));
+        const __m256i vb = _mm256_loadu_si256((const __m256i*) (b + i));
+
+        const __m256i diff = _mm256_or_si256(_mm256_subs_epu16(va, vb), _mm256_subs_epu16(vb, va));
+        maxDiff = _mm256_max_epu16(maxDiff, diff);
+
+        // Full 32-bit squares from low and high product halves
+        const __m256i lo = _mm256_mullo_epi16(diff, diff);
+        const __m256i hi = _mm256_mulhi_epu16(diff, diff);
+        acc64 = _mm256_add_epi64(acc64, widenSum32(_mm256_unpacklo_epi16(lo, hi)));
+        acc64 = _mm256_add_epi64(acc64, widenSum32(_mm256_unpackhi_epi16(lo, hi)));
+    }
+
+    sse += horizontalSum64(acc64);
+
+    alignas(32) uint16_t lanes[16];
+    _mm256_store_si256((__m256i*) lanes, maxDiff);
+    for (uint32_t k = 0; k < 16; ++k)
+        maxError = std::max<uint64_t>(maxError, lanes[k]);
+
+    for (; i < n; ++i)
+    {
+        const uint64_t d = (a[i] > b[i]) ? a[i] - b[i] : b[i] - a[i];
+        sse += d * d;
+        maxError = std::max(maxError, d);
+    }
+}
+
+void columnSumsAVX2(const float* const x[4], const float* const y[4], uint32_t width, float* const sums[5])
+{
+    uint32_t i = 0;
+    for (; i + 8 <= width; i += 8)
+    {
+        __m256 sx = _mm256_setzero_ps(), sy = _mm256_setzero_ps();
+        __m256 sxx = _mm256_setzero_ps(), syy = _mm256_setzero_ps(), sxy = _mm256_setzero_ps();
+
+        for (uint32_t r = 0; r < 4; ++r)
+        {
+            const __m256 vx = _mm256_loadu_ps(x[r] + i);
+            const __m256 vy = _mm256_loadu_ps(y[r] + i);
+            sx = _mm256_add_ps(sx, vx);
+            sy = _mm256_add_ps(sy, vy);
+            sxx = _mm256_add_ps(sxx, _mm256_mul_ps(vx, vx));
+            syy = _mm256_add_ps(syy, _mm256_mul_ps(vy, vy));
+            sxy = _mm256_add_ps(sxy, _mm256_mul_ps(vx, vy));
+        }
+
+        _mm256_storeu_ps(sums[0] + i, sx);
+        _mm256_storeu_ps(sums[1] + i, sy);
+        _mm256_storeu_ps(sums[2] + i, sxx);
+        _mm256_storeu_ps(sums[3] + i, syy);
+        _mm256_storeu_ps(sums[4] + i, sxy);
+    }
+
+    for (; i < width; ++i)
+    {
+        float sx = 0.0f, sy = 0.0f, sxx = 0.0f, syy = 0.0f, sxy = 0.0f;
+        for (uint32_t r = 0; r < 4; ++r)
+        {
+            sx += x[r][i];
+            sy += y[r][i];
+            sxx += x[r][i] * x[r][i];
+            syy += y[r][i] * y[r][i];
+            sxy += x[r][i] * y[r][i];
+        }
+        sums[0][i] = sx;
+        sums[1][i] = sy;
+        sums[2][i] = sxx;
+        sums[3][i] = syy;
+        sums[4][i] = sxy;
+    }
+}
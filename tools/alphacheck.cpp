@@ -0,0 +1,213 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <NvPipe.h>
+
+#include "AlphaPacking.h"
+#include "ContentGenerator.h"
+#include "QualityMetrics.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+/**
+ * Checks the NVPIPE_BGRA32_ALPHA packing against its CPU reference (AlphaPacking.h).
+ *
+ * The CPU pass verifies the tile layout and that alpha survives packing and unpacking exactly, and that the color
+ * conversion is consistent (frames with uniform 2x2 blocks round trip within four code values).
+ * If a GPU is available, lossless encoding and decoding through the library must reproduce the CPU reference;
+ * a lossy pass reports the color and alpha quality.
+ */
+
+const uint32_t WIDTH = 640;
+const uint32_t HEIGHT = 360;
+const uint32_t NV12_PADDING = 32;
+
+struct Channels
+{
+    uint64_t maxColorError = 0;
+    uint64_t maxAlphaError = 0;
+};
+
+Channels compareChannels(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b)
+{
+    Channels c;
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        const uint64_t e = (uint64_t) std::abs((int) a[i] - (int) b[i]);
+        if (i % 4 == 3)
+            c.maxAlphaError = std::max(c.maxAlphaError, e);
+        else
+            c.maxColorError = std::max(c.maxColorError, e);
+    }
+    return c;
+}
+
+/**
+ * @brief Content with uniform 2x2 blocks, so chroma subsampling loses nothing.
+ */
+std::vector<uint8_t> generateBlocks(ContentType type, uint32_t frame)
+{
+    ContentGenerator generator(type, NVPIPE_BGRA32_ALPHA, WIDTH / 2, HEIGHT / 2);
+    std::vector<uint8_t> half(generator.getFrameSize());
+    generator.generate(frame, half.data());
+
+    std::vector<uint8_t> frameData((uint64_t) WIDTH * HEIGHT * 4);
+    const uint32_t* src = (const uint32_t*) half.data();
+    uint32_t* dst = (uint32_t*) frameData.data();
+    for (uint32_t y = 0; y < HEIGHT; ++y)
+        for (uint32_t x = 0; x < WIDTH; ++x)
+            dst[y * WIDTH + x] = src[(y / 2) * (WIDTH / 2) + x / 2];
+
+    return frameData;
+}
+
+bool checkCpu(ContentType type)
+{
+    ContentGenerator generator(type, NVPIPE_BGRA32_ALPHA, WIDTH, HEIGHT);
+    std::vector<uint8_t> input(generator.getFrameSize());
+    generator.generate(3, input.data());
+
+    const uint64_t nv12Pitch = 2 * WIDTH + NV12_PADDING;
+    std::vector<uint8_t> nv12(nv12Pitch * HEIGHT * 3 / 2, 0);
+    packBgra32Alpha(input.data(), WIDTH * 4, WIDTH, HEIGHT, nv12.data(), nv12Pitch);
+
+    // Layout: alpha in the right luma tile, neutral chroma next to the color chroma
+    bool layout = true;
+    for (uint32_t y = 0; y < HEIGHT; ++y)
+        for (uint32_t x = 0; x < WIDTH; ++x)
+            layout &= (nv12[y * nv12Pitch + WIDTH + x] == input[(y * WIDTH + x) * 4 + 3]);
+    for (uint32_t y = 0; y < HEIGHT / 2; ++y)
+        for (uint32_t x = 0; x < WIDTH; ++x)
+            layout &= (nv12[(HEIGHT + y) * nv12Pitch + WIDTH + x] == 128);
+
+    std::vector<uint8_t> output(input.size());
+    unpackBgra32Alpha(nv12.data(), nv12Pitch, 0, WIDTH, HEIGHT, output.data(), WIDTH * 4);
+    const Channels full = compareChannels(input, output);
+    const Quality q = computeQuality(NVPIPE_BGRA32, input.data(), output.data(), WIDTH, HEIGHT);
+
+    // Uniform 2x2 blocks only see the quantization of the color conversion
+    std::vector<uint8_t> blocks = generateBlocks(type, 3);
+    packBgra32Alpha(blocks.data(), WIDTH * 4, WIDTH, HEIGHT, nv12.data(), nv12Pitch);
+    std::vector<uint8_t> blocksOutput(blocks.size());
+    unpackBgra32Alpha(nv12.data(), nv12Pitch, 0, WIDTH, HEIGHT, blocksOutput.data(), WIDTH * 4);
+    const Channels uniform = compareChannels(blocks, blocksOutput);
+
+    // Truncation of Y, U, V (studio range) and of the result: 1.16 + 1.86 + 1 code values for blue in the worst case
+    const bool ok = layout && full.maxAlphaError == 0 && uniform.maxAlphaError == 0 && uniform.maxColorError <= 4;
+
+    std::cout << std::setw(18) << ContentGenerator::getName(type) << std::setw(10) << (layout ? "ok" : "FAILED")
+              << std::setw(12) << full.maxAlphaError << std::setw(12) << std::fixed << std::setprecision(2) << q.psnr
+              << std::setw(14) << uniform.maxColorError << std::setw(8) << (ok ? "ok" : "FAILED") << std::endl;
+
+    return ok;
+}
+
+/**
+ * @brief Encodes and decodes a frame through the library. Returns false if no session can be created.
+ */
+bool roundTrip(NvPipe_Compression compression, const std::vector<uint8_t>& input, std::vector<uint8_t>& output)
+{
+    NvPipe* encoder = NvPipe_CreateEncoder(NVPIPE_BGRA32_ALPHA, NVPIPE_H264, compression, 32 * 1000 * 1000, 30);
+    if (!encoder)
+        return false;
+
+    NvPipe* decoder = NvPipe_CreateDecoder(NVPIPE_BGRA32_ALPHA, NVPIPE_H264);
+    if (!decoder)
+    {
+        NvPipe_Destroy(encoder);
+        return false;
+    }
+
+    std::vector<uint8_t> compressed(input.size() * 2);
+    const uint64_t size = NvPipe_Encode(encoder, input.data(), WIDTH * 4, compressed.data(), compressed.size(), WIDTH, HEIGHT, true);
+    const bool ok = (size > 0) && (NvPipe_Decode(decoder, compressed.data(), size, output.data(), WIDTH, HEIGHT) > 0);
+    if (!ok)
+        std::cerr << "Round trip failed: " << NvPipe_GetError(size > 0 ? decoder : encoder) << std::endl;
+
+    NvPipe_Destroy(decoder);
+    NvPipe_Destroy(encoder);
+
+    return ok;
+}
+
+int main()
+{
+    std::cout << "CPU reference" << std::endl;
+    std::cout << std::setw(18) << "Content" << std::setw(10) << "Layout" << std::setw(12) << "Alpha err" << std::setw(12) << "Color dB"
+              << std::setw(14) << "2x2 color err" << std::setw(8) << "Check" << std::endl;
+
+    bool ok = true;
+    for (ContentType type : ContentGenerator::getAllTypes())
+        ok &= checkCpu(type);
+
+    std::cout << std::endl << "Library (lossless must match the CPU reference)" << std::endl;
+    std::cout << std::setw(18) << "Content" << std::setw(16) << "Lossless color" << std::setw(16) << "Lossless alpha"
+              << std::setw(14) << "Lossy dB" << std::setw(14) << "Lossy alpha" << std::setw(8) << "Check" << std::endl;
+
+    for (ContentType type : ContentGenerator::getAllTypes())
+    {
+        ContentGenerator generator(type, NVPIPE_BGRA32_ALPHA, WIDTH, HEIGHT);
+        std::vector<uint8_t> input(generator.getFrameSize());
+        generator.generate(3, input.data());
+
+        std::vector<uint8_t> reference(input.size());
+        std::vector<uint8_t> nv12((uint64_t) 2 * WIDTH * HEIGHT * 3 / 2);
+        packBgra32Alpha(input.data(), WIDTH * 4, WIDTH, HEIGHT, nv12.data(), 2 * WIDTH);
+        unpackBgra32Alpha(nv12.data(), 2 * WIDTH, 0, WIDTH, HEIGHT, reference.data(), WIDTH * 4);
+
+        std::vector<uint8_t> lossless(input.size());
+        if (!roundTrip(NVPIPE_LOSSLESS, input, lossless))
+        {
+            std::cout << "No encoder/decoder session available, library check skipped (" << NvPipe_GetError(NULL) << ")" << std::endl;
+            break;
+        }
+
+        // The kernels may contract multiply-adds, so the float conversion can differ by one code value
+        const Channels exact = compareChannels(reference, lossless);
+        const bool matches = exact.maxAlphaError == 0 && exact.maxColorError <= 1;
+
+        std::vector<uint8_t> lossy(input.size());
+        const bool lossyOk = roundTrip(NVPIPE_LOSSY, input, lossy);
+        const Quality q = computeQuality(NVPIPE_BGRA32_ALPHA, input.data(), lossy.data(), WIDTH, HEIGHT);
+        const Channels lossyErrors = compareChannels(input, lossy);
+
+        std::cout << std::setw(18) << ContentGenerator::getName(type) << std::setw(16) << exact.maxColorError << std::setw(16) << exact.maxAlphaError
+                  << std::setw(14) << std::fixed << std::setprecision(2) << q.psnr << std::setw(14) << lossyErrors.maxAlphaError
+                  << std::setw(8) << ((matches && lossyOk) ? "ok" : "FAILED") << std::endl;
+
+        ok &= matches && lossyOk;
+    }
+
+    return ok ? 0 : 1;
+}
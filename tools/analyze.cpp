@@ -0,0 +1,254 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "BitstreamAnalyzer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+/**
+ * Analyzes recorded H.264/HEVC streams (raw Annex-B or the framed output of nvpExampleFile) without decoding.
+ */
+
+/**
+ * @brief Read-only memory mapping of a file.
+ */
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string& path)
+    {
+#ifdef _WIN32
+        this->file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (this->file == INVALID_HANDLE_VALUE)
+            return;
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(this->file, &size) || size.QuadPart == 0)
+            return;
+        this->size = size.QuadPart;
+
+        this->mapping = CreateFileMappingA(this->file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (this->mapping)
+            this->data = (const uint8_t*) MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+        this->fd = open(path.c_str(), O_RDONLY);
+        if (this->fd < 0)
+            return;
+
+        struct stat st;
+        if (fstat(this->fd, &st) != 0 || st.st_size == 0)
+            return;
+        this->size = st.st_size;
+
+        void* p = mmap(NULL, this->size, PROT_READ, MAP_PRIVATE, this->fd, 0);
+        if (p == MAP_FAILED)
+            return;
+
+        madvise(p, this->size, MADV_SEQUENTIAL);
+        this->data = (const uint8_t*) p;
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifdef _WIN32
+        if (this->data)
+            UnmapViewOfFile(this->data);
+        if (this->mapping)
+            CloseHandle(this->mapping);
+        if (this->file != INVALID_HANDLE_VALUE)
+            CloseHandle(this->file);
+#else
+        if (this->data)
+            munmap((void*) this->data, this->size);
+        if (this->fd >= 0)
+            close(this->fd);
+#endif
+    }
+
+    const uint8_t* getData() const { return this->data; }
+    uint64_t getSize() const { return this->size; }
+
+private:
+    const uint8_t* data = nullptr;
+    uint64_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#else
+    int fd = -1;
+#endif
+};
+
+void usage()
+{
+    std::cout << "Usage: nvpAnalyze <stream> [options]" << std::endl
+              << "  --codec NAME      h264 or hevc (default: detect)" << std::endl
+              << "  --format NAME     annexb or framed (default: detect)" << std::endl
+              << "  --fps N           Frame rate for bitrate statistics (default: 60)" << std::endl
+              << "  --table           Print per-frame table" << std::endl;
+}
+
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2 || std::string(argv[1]) == "--help")
+    {
+        usage();
+        return argc < 2 ? 1 : 0;
+    }
+
+    const std::string path = argv[1];
+    StreamCodec codec = StreamCodec::Unknown;
+    std::string formatName;
+    double fps = 60.0;
+    bool table = false;
+
+    for (int i = 2; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--table")
+        {
+            table = true;
+            continue;
+        }
+
+        if (i + 1 >= argc)
+        {
+            usage();
+            return 1;
+        }
+
+        const std::string value = argv[++i];
+        if (arg == "--codec")
+            codec = (value == "hevc") ? StreamCodec::HEVC : StreamCodec::H264;
+        else if (arg == "--format")
+            formatName = value;
+        else if (arg == "--fps")
+            fps = std::stod(value);
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    MappedFile file(path);
+    if (!file.getData())
+    {
+        std::cerr << "Failed to open " << path << std::endl;
+        return 1;
+    }
+
+    const bool framed = formatName.empty() ? BitstreamAnalyzer::isFramed(file.getData(), file.getSize()) : (formatName == "framed");
+
+    BitstreamAnalyzer analyzer(codec);
+    if (framed)
+        analyzer.analyzeFramed(file.getData(), file.getSize());
+    else
+        analyzer.analyzeAnnexB(file.getData(), file.getSize());
+
+    const std::vector<FrameInfo>& frames = analyzer.getFrames();
+    const StreamCodec detected = analyzer.getCodec();
+
+    if (table)
+    {
+        std::cout << std::setw(8) << "Frame" << std::setw(14) << "Offset" << std::setw(10) << "Size" << "  Type  Key  NAL units" << std::endl;
+        for (uint64_t i = 0; i < frames.size(); ++i)
+        {
+            const FrameInfo& f = frames[i];
+            std::cout << std::setw(8) << i << std::setw(14) << f.offset << std::setw(10) << f.size
+                      << "  " << std::setw(4) << f.sliceType << "  " << std::setw(3) << (f.keyframe ? "*" : "") << "  ";
+
+            const uint32_t n = std::min(f.numNals, FrameInfo::MAX_NALS);
+            for (uint32_t j = 0; j < n; ++j)
+                std::cout << (j ? "," : "") << BitstreamAnalyzer::getNalTypeName(detected, f.nalTypes[j]);
+            if (f.numNals > n)
+                std::cout << ",... (" << f.numNals << ")";
+            if (f.parameterSetChange)
+                std::cout << "  [parameter set change]";
+            std::cout << std::endl;
+        }
+        std::cout << std::endl;
+    }
+
+    const StreamSummary s = analyzer.summarize(fps);
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Stream:          " << path << " (" << (framed ? "framed" : "Annex-B") << ", "
+              << (detected == StreamCodec::HEVC ? "HEVC" : "H.264") << ")" << std::endl;
+    std::cout << "Frames:          " << s.frames << std::endl;
+    if (s.frames == 0)
+        return 0;
+
+    std::cout << "Bytes:           " << s.totalBytes << std::endl;
+    std::cout << "Frame size:      min " << s.minFrameSize << ", avg " << s.averageFrameSize << ", max " << s.maxFrameSize << std::endl;
+    std::cout << "Bitrate:         avg " << s.averageMbps << " Mbps, peak " << s.peakMbps << " Mbps (1 s window at " << fps << " fps)" << std::endl;
+    std::cout << "Slice types:     I " << s.sliceTypeCounts[0] << ", P " << s.sliceTypeCounts[1] << ", B " << s.sliceTypeCounts[2] << ", other " << s.sliceTypeCounts[3] << std::endl;
+    std::cout << "Keyframes:       " << s.keyframes;
+    if (s.keyframes > 1)
+        std::cout << ", interval min " << s.minKeyframeInterval << ", avg " << s.averageKeyframeInterval << ", max " << s.maxKeyframeInterval;
+    std::cout << std::endl;
+    if (s.keyframes > 0)
+        std::cout << "Keyframe bursts: avg " << s.averageKeyframeSize << ", max " << s.maxKeyframeSize << " bytes ("
+                  << s.keyframeBurstRatio << "x other frames)" << std::endl;
+
+    std::cout << "Parameter sets:" << std::endl;
+    for (const ParameterSetChange& c : analyzer.getParameterSetChanges())
+    {
+        std::cout << "  frame " << std::setw(8) << c.frame << "  " << c.type;
+        if (c.width > 0)
+            std::cout << "  " << c.width << "x" << c.height;
+        std::cout << std::endl;
+    }
+
+    std::cout << "Frame size histogram:" << std::endl;
+    for (uint32_t i = 0; i < s.sizeHistogram.size(); ++i)
+    {
+        if (s.sizeHistogram[i] == 0)
+            continue;
+        const uint32_t bar = (uint32_t) (50 * s.sizeHistogram[i] / s.frames);
+        std::cout << "  [" << std::setw(10) << (1ull << i) << ", " << std::setw(10) << (2ull << i) << ")  "
+                  << std::setw(8) << s.sizeHistogram[i] << "  " << std::string(bar, '#') << std::endl;
+    }
+
+    return 0;
+}
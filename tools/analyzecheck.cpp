@@ -0,0 +1,388 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "BitstreamAnalyzer.h"
+#include "Check.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+/**
+ * Check of the bitstream analyzer against synthetic H.264 and HEVC streams: access unit splitting, slice types,
+ * keyframes, parameter set changes and resolution, the framed file format, and the summary statistics.
+ *
+ * The streams only contain the syntax elements the analyzer reads; slice data is filler.
+ */
+
+/**
+ * @brief Writes RBSP bits and appends them as a NAL unit with start code and emulation prevention.
+ */
+class NalWriter
+{
+public:
+    void u(uint32_t n, uint32_t value)
+    {
+        for (uint32_t i = n; i > 0; --i)
+            this->bits.push_back((value >> (i - 1)) & 1);
+    }
+
+    void ue(uint32_t value)
+    {
+        uint32_t length = 0;
+        while ((value + 1) >> (length + 1))
+            ++length;
+        this->u(length, 0);
+        this->u(length + 1, value + 1);
+    }
+
+    /**
+     * @brief Appends the NAL unit with rbsp trailing bits and payload bytes to a stream.
+     */
+    void finish(std::vector<uint8_t>& stream, const std::vector<uint8_t>& header, const std::vector<uint8_t>& payload = {})
+    {
+        this->u(1, 1);
+        while (this->bits.size() % 8)
+            this->u(1, 0);
+
+        std::vector<uint8_t> rbsp;
+        for (size_t i = 0; i < this->bits.size(); i += 8)
+        {
+            uint8_t byte = 0;
+            for (size_t b = 0; b < 8; ++b)
+                byte = (uint8_t) ((byte << 1) | this->bits[i + b]);
+            rbsp.push_back(byte);
+        }
+        rbsp.insert(rbsp.end(), payload.begin(), payload.end());
+
+        stream.insert(stream.end(), { 0, 0, 0, 1 });
+        stream.insert(stream.end(), header.begin(), header.end());
+
+        uint32_t zeros = 0;
+        for (uint8_t byte : rbsp)
+        {
+            if (zeros >= 2 && byte <= 3)
+            {
+                stream.push_back(3);
+                zeros = 0;
+            }
+            stream.push_back(byte);
+            zeros = (byte == 0) ? zeros + 1 : 0;
+        }
+
+        this->bits.clear();
+    }
+
+private:
+    std::vector<uint8_t> bits;
+};
+
+/**
+ * @brief Slice data that contains byte patterns of start codes, which emulation prevention must hide.
+ */
+std::vector<uint8_t> filler(uint32_t size)
+{
+    std::vector<uint8_t> data(size, 0xA5);
+    for (uint32_t i = 0; i + 4 <= size; i += 64)
+    {
+        data[i] = 0;
+        data[i + 1] = 0;
+        data[i + 2] = 1;
+    }
+    return data;
+}
+
+void addH264Sps(std::vector<uint8_t>& stream, uint32_t width, uint32_t height)
+{
+    const uint32_t widthInMbs = (width + 15) / 16;
+    const uint32_t heightInMbs = (height + 15) / 16;
+
+    NalWriter w;
+    w.u(8, 66);    // profile_idc (baseline)
+    w.u(16, 0x1F); // constraint flags, level_idc
+    w.ue(0);       // seq_parameter_set_id
+    w.ue(0);       // log2_max_frame_num_minus4
+    w.ue(2);       // pic_order_cnt_type
+    w.ue(1);       // max_num_ref_frames
+    w.u(1, 0);     // gaps_in_frame_num_value_allowed_flag
+    w.ue(widthInMbs - 1);
+    w.ue(heightInMbs - 1);
+    w.u(1, 1);     // frame_mbs_only_flag
+    w.u(1, 1);     // direct_8x8_inference_flag
+
+    const bool crop = (widthInMbs * 16 != width) || (heightInMbs * 16 != height);
+    w.u(1, crop);
+    if (crop)
+    {
+        // Crop units of 4:2:0 are two samples
+        w.ue(0);
+        w.ue((widthInMbs * 16 - width) / 2);
+        w.ue(0);
+        w.ue((heightInMbs * 16 - height) / 2);
+    }
+    w.u(1, 0); // vui_parameters_present_flag
+    w.finish(stream, { 0x67 });
+}
+
+void addH264Pps(std::vector<uint8_t>& stream)
+{
+    NalWriter w;
+    w.ue(0); // pic_parameter_set_id
+    w.ue(0); // seq_parameter_set_id
+    w.finish(stream, { 0x68 });
+}
+
+void addH264Slice(std::vector<uint8_t>& stream, bool idr, uint32_t size)
+{
+    NalWriter w;
+    w.ue(0);            // first_mb_in_slice
+    w.ue(idr ? 7 : 5);  // slice_type (I or P, all slices of the picture)
+    w.ue(0);            // pic_parameter_set_id
+    w.finish(stream, { (uint8_t) (idr ? 0x65 : 0x41) }, filler(size));
+}
+
+struct Unit
+{
+    std::vector<uint8_t> data;
+    bool keyframe;
+};
+
+/**
+ * @brief H.264 stream of 1080p frames I P P P, then a switch to 720p with I P.
+ */
+std::vector<Unit> createH264Units()
+{
+    std::vector<Unit> units;
+    for (uint32_t i = 0; i < 6; ++i)
+    {
+        const bool keyframe = (i == 0 || i == 4);
+        Unit unit;
+        unit.keyframe = keyframe;
+        if (keyframe)
+        {
+            addH264Sps(unit.data, (i == 0) ? 1920 : 1280, (i == 0) ? 1080 : 720);
+            addH264Pps(unit.data);
+        }
+        addH264Slice(unit.data, keyframe, keyframe ? 5000 : 300 + 100 * i);
+        units.push_back(unit);
+    }
+    return units;
+}
+
+std::vector<uint8_t> concatenate(const std::vector<Unit>& units, bool framed)
+{
+    std::vector<uint8_t> stream;
+    for (const Unit& unit : units)
+    {
+        if (framed)
+        {
+            const uint64_t size = unit.data.size();
+            stream.insert(stream.end(), (const uint8_t*) &size, (const uint8_t*) &size + sizeof(size));
+        }
+        stream.insert(stream.end(), unit.data.begin(), unit.data.end());
+    }
+    return stream;
+}
+
+bool checkFrames(const BitstreamAnalyzer& analyzer, const std::vector<Unit>& units, const std::string& sliceTypes)
+{
+    const std::vector<FrameInfo>& frames = analyzer.getFrames();
+    if (frames.size() != units.size())
+        return false;
+
+    bool ok = true;
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+        ok &= frames[i].size == units[i].data.size();
+        ok &= frames[i].keyframe == units[i].keyframe;
+        ok &= frames[i].sliceType == sliceTypes[i];
+    }
+    return ok;
+}
+
+bool checkH264()
+{
+    const std::vector<Unit> units = createH264Units();
+    const std::vector<uint8_t> stream = concatenate(units, false);
+
+    BitstreamAnalyzer analyzer;
+    analyzer.analyzeAnnexB(stream.data(), stream.size());
+
+    bool ok = analyzer.getCodec() == StreamCodec::H264 && checkFrames(analyzer, units, "IPPPIP");
+
+    // Initial SPS and PPS, then only the SPS changes
+    const std::vector<ParameterSetChange>& changes = analyzer.getParameterSetChanges();
+    ok &= changes.size() == 3;
+    if (ok)
+    {
+        ok &= changes[0].frame == 0 && changes[0].type == "SPS" && changes[0].width == 1920 && changes[0].height == 1080;
+        ok &= changes[1].frame == 0 && changes[1].type == "PPS";
+        ok &= changes[2].frame == 4 && changes[2].type == "SPS" && changes[2].width == 1280 && changes[2].height == 720;
+        ok &= !analyzer.getFrames()[0].parameterSetChange && analyzer.getFrames()[4].parameterSetChange;
+    }
+
+    return check("H.264 Annex-B", ok);
+}
+
+bool checkFramed()
+{
+    const std::vector<Unit> units = createH264Units();
+    const std::vector<uint8_t> framed = concatenate(units, true);
+    const std::vector<uint8_t> raw = concatenate(units, false);
+
+    bool ok = BitstreamAnalyzer::isFramed(framed.data(), framed.size()) && !BitstreamAnalyzer::isFramed(raw.data(), raw.size());
+
+    BitstreamAnalyzer analyzer;
+    analyzer.analyzeFramed(framed.data(), framed.size());
+    ok &= checkFrames(analyzer, units, "IPPPIP");
+
+    // A truncated last frame is ignored
+    BitstreamAnalyzer truncated;
+    truncated.analyzeFramed(framed.data(), framed.size() - 10);
+    ok &= truncated.getFrames().size() == units.size() - 1;
+
+    return check("framed format", ok);
+}
+
+bool checkHevc()
+{
+    std::vector<Unit> units;
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        Unit unit;
+        unit.keyframe = (i == 0);
+
+        if (unit.keyframe)
+        {
+            NalWriter vps;
+            vps.u(4, 0);  // vps_video_parameter_set_id
+            vps.u(12, 0);
+            vps.finish(unit.data, { 32 << 1, 1 });
+
+            NalWriter sps;
+            sps.u(4, 0);  // sps_video_parameter_set_id
+            sps.u(3, 0);  // sps_max_sub_layers_minus1
+            sps.u(1, 1);  // sps_temporal_id_nesting_flag
+            sps.u(32, 0x01600000); // profile_tier_level: general profile space, tier, idc, compatibility flags
+            sps.u(32, 0);
+            sps.u(24, 0);
+            sps.u(8, 93); // general_level_idc
+            sps.ue(0);    // sps_seq_parameter_set_id
+            sps.ue(1);    // chroma_format_idc
+            sps.ue(1920); // pic_width_in_luma_samples
+            sps.ue(1088); // pic_height_in_luma_samples
+            sps.u(1, 1);  // conformance_window_flag
+            sps.ue(0);
+            sps.ue(0);
+            sps.ue(0);
+            sps.ue(4);    // bottom offset in chroma units
+            sps.finish(unit.data, { 33 << 1, 1 });
+
+            NalWriter pps;
+            pps.ue(0);   // pps_pic_parameter_set_id
+            pps.ue(0);   // pps_seq_parameter_set_id
+            pps.u(2, 0);
+            pps.u(3, 0); // num_extra_slice_header_bits
+            pps.finish(unit.data, { 34 << 1, 1 });
+        }
+
+        NalWriter slice;
+        slice.u(1, 1);  // first_slice_segment_in_pic_flag
+        if (unit.keyframe)
+            slice.u(1, 0); // no_output_of_prior_pics_flag
+        slice.ue(0);    // slice_pic_parameter_set_id
+        slice.ue(unit.keyframe ? 2 : 1);
+        slice.finish(unit.data, { (uint8_t) ((unit.keyframe ? 19 : 1) << 1), 1 }, filler(unit.keyframe ? 4000 : 500));
+
+        units.push_back(unit);
+    }
+
+    const std::vector<uint8_t> stream = concatenate(units, false);
+    BitstreamAnalyzer analyzer;
+    analyzer.analyzeAnnexB(stream.data(), stream.size());
+
+    bool ok = analyzer.getCodec() == StreamCodec::HEVC && checkFrames(analyzer, units, "IPPP");
+
+    const std::vector<ParameterSetChange>& changes = analyzer.getParameterSetChanges();
+    ok &= changes.size() == 3 && changes[1].type == "SPS" && changes[1].width == 1920 && changes[1].height == 1080;
+
+    return check("HEVC Annex-B", ok);
+}
+
+bool checkSummary()
+{
+    const std::vector<Unit> units = createH264Units();
+    const std::vector<uint8_t> stream = concatenate(units, false);
+
+    BitstreamAnalyzer analyzer;
+    analyzer.analyzeAnnexB(stream.data(), stream.size());
+
+    const double fps = 2.0;
+    const StreamSummary s = analyzer.summarize(fps);
+
+    uint64_t total = 0;
+    uint64_t keyBytes = 0;
+    uint64_t peakWindow = 0;
+    for (size_t i = 0; i < units.size(); ++i)
+    {
+        total += units[i].data.size();
+        keyBytes += units[i].keyframe ? units[i].data.size() : 0;
+        if (i > 0)
+            peakWindow = std::max<uint64_t>(peakWindow, units[i - 1].data.size() + units[i].data.size());
+    }
+
+    uint64_t histogramFrames = 0;
+    for (uint64_t count : s.sizeHistogram)
+        histogramFrames += count;
+
+    bool ok = s.frames == 6 && s.totalBytes == total && s.keyframes == 2;
+    ok &= s.minKeyframeInterval == 4 && s.maxKeyframeInterval == 4;
+    ok &= s.averageKeyframeSize == keyBytes / 2.0 && s.averageOtherFrameSize == (total - keyBytes) / 4.0;
+    ok &= s.sliceTypeCounts[0] == 2 && s.sliceTypeCounts[1] == 4;
+    ok &= histogramFrames == 6;
+
+    // One-second windows of two frames
+    ok &= std::abs(s.averageMbps - total * 8.0 * fps / 6 / 1.0e6) < 1.0e-9;
+    ok &= std::abs(s.peakMbps - peakWindow * 8.0 * fps / 2 / 1.0e6) < 1.0e-9;
+
+    return check("summary", ok);
+}
+
+int main()
+{
+    bool ok = true;
+    ok &= checkH264();
+    ok &= checkFramed();
+    ok &= checkHevc();
+    ok &= checkSummary();
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Check.h"
+#include "Frame.h"
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+/**
+ * Check of the NV12 frame handles with host-backed frames: plane layout, the copy into a pitched encoder
+ * input surface (as NvPipe_EncodeFrame() does with cudaMemcpy2D) and the release of borrowed surfaces.
+ */
+
+uint8_t sample(uint32_t x, uint32_t y, bool chroma)
+{
+    return (uint8_t) (x * 7 + y * 13 + (chroma ? 101 : 0));
+}
+
+void fill(const Frame& frame)
+{
+    for (uint32_t y = 0; y < frame.height; ++y)
+        for (uint32_t x = 0; x < frame.width; ++x)
+            frame.luma()[y * frame.pitch + x] = sample(x, y, false);
+
+    for (uint32_t y = 0; y < frame.height / 2; ++y)
+        for (uint32_t x = 0; x < frame.width; ++x)
+            frame.chroma()[y * frame.pitch + x] = sample(x, y, true);
+}
+
+/**
+ * @brief Copies a frame into a surface laid out like an NVENC input buffer and verifies it, including the padding.
+ */
+bool copyToSurface(const Frame& frame, uint64_t pitch, uint64_t chromaOffset, uint64_t chromaPitch)
+{
+    const uint8_t padding = 0xAB;
+    std::vector<uint8_t> surface(chromaOffset + chromaPitch * (frame.height / 2), padding);
+
+    frame.copyTo(surface.data(), pitch, surface.data() + chromaOffset, chromaPitch, Frame::copyHost);
+
+    bool ok = true;
+    for (uint32_t y = 0; y < frame.height; ++y)
+        for (uint64_t x = 0; x < pitch; ++x)
+            ok &= surface[y * pitch + x] == (x < frame.width ? sample((uint32_t) x, y, false) : padding);
+
+    for (uint32_t y = 0; y < frame.height / 2; ++y)
+        for (uint64_t x = 0; x < chromaPitch; ++x)
+            ok &= surface[chromaOffset + y * chromaPitch + x] == (x < frame.width ? sample((uint32_t) x, y, true) : padding);
+
+    return ok;
+}
+
+int main()
+{
+    bool ok = true;
+
+    // Own host memory: tightly packed planes
+    {
+        std::unique_ptr<Frame> frame(Frame::createHost(64, 36));
+        fill(*frame);
+
+        ok &= check("host frame layout", frame->memory == Frame::Memory::Host && frame->pitch == 64 && frame->chroma() == frame->data + 64 * 36);
+        ok &= check("copy to pitched surface", copyToSurface(*frame, 128, 128 * 40, 128));
+        ok &= check("copy to separate chroma pitch", copyToSurface(*frame, 80, 80 * 36 + 16, 96));
+    }
+
+    // Borrowed surface with a pitch wider than the frame, e.g., a locked decoder surface
+    {
+        std::vector<uint8_t> surface(256 * (48 + 24));
+        int released = 0;
+        {
+            Frame frame(Frame::Memory::Host, surface.data(), 256, 100, 48, [&released]() { released++; });
+            fill(frame);
+
+            ok &= check("borrowed surface layout", frame.chroma() == surface.data() + 256 * 48 && released == 0);
+            ok &= check("copy of borrowed surface", copyToSurface(frame, 128, 128 * 48, 128));
+
+            // Chaining: a decoded frame handle is copied into a new frame, as a relay would
+            std::unique_ptr<Frame> copy(Frame::createHost(frame.width, frame.height));
+            frame.copyTo(copy->luma(), copy->pitch, copy->chroma(), copy->pitch, Frame::copyHost);
+            ok &= check("chained copy", copyToSurface(*copy, 112, 112 * 48, 112));
+        }
+        ok &= check("surface released once", released == 1);
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,163 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Check.h"
+#include "HostMemory.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/**
+ * Check of the NUMA topology detection against a fake sysfs tree, and of the NUMA/huge page host allocator.
+ *
+ * The fake tree describes a dual-socket machine with a GPU behind each socket and 2 MB and 1 GB hugetlbfs pools.
+ * Allocator results depend on the machine (NUMA support, free huge pages), so only consistency is checked there.
+ */
+
+void writeFile(const std::string& root, const std::string& path, const std::string& content)
+{
+    // Create parent directories
+    for (size_t i = path.find('/'); i != std::string::npos; i = path.find('/', i + 1))
+        mkdir((root + "/" + path.substr(0, i)).c_str(), 0755);
+
+    std::ofstream(root + "/" + path) << content << std::endl;
+}
+
+bool checkTopology(const std::string& root)
+{
+    writeFile(root, "devices/system/node/online", "0-1");
+    writeFile(root, "bus/pci/devices/0000:3b:00.0/numa_node", "0");
+    writeFile(root, "bus/pci/devices/0000:af:00.0/numa_node", "1");
+    writeFile(root, "bus/pci/devices/0000:d8:00.0/numa_node", "-1");
+    writeFile(root, "kernel/mm/hugepages/hugepages-1048576kB/free_hugepages", "0");
+    writeFile(root, "kernel/mm/hugepages/hugepages-2048kB/free_hugepages", "512");
+    writeFile(root, "devices/system/node/node1/hugepages/hugepages-2048kB/free_hugepages", "200");
+    writeFile(root, "kernel/mm/transparent_hugepage/enabled", "always [madvise] never");
+
+    const NumaTopology topology(root);
+    bool ok = true;
+
+    ok &= check("list parsing", NumaTopology::parseList("0-3,8,10-11") == std::vector<int>({ 0, 1, 2, 3, 8, 10, 11 }) && NumaTopology::parseList("").empty());
+    ok &= check("online nodes", topology.getOnlineNodes() == std::vector<int>({ 0, 1 }));
+    ok &= check("GPU node (CUDA bus id notation)", topology.getNodeOfPciDevice("0000:3B:00.0") == 0 && topology.getNodeOfPciDevice("0000:AF:00.0") == 1);
+    ok &= check("GPU without node affinity", topology.getNodeOfPciDevice("0000:d8:00.0") == -1);
+    ok &= check("unknown GPU", topology.getNodeOfPciDevice("0000:01:00.0") == -1);
+    ok &= check("huge page sizes", topology.getHugePageSizes() == std::vector<uint64_t>({ 2ull << 20, 1ull << 30 }));
+    ok &= check("free huge pages", topology.getFreeHugePages(2ull << 20) == 512 && topology.getFreeHugePages(2ull << 20, 1) == 200 && topology.getFreeHugePages(1ull << 30) == 0);
+    ok &= check("transparent huge pages (madvise)", topology.isTransparentHugePagesEnabled());
+
+    writeFile(root, "kernel/mm/transparent_hugepage/enabled", "always madvise [never]");
+    ok &= check("transparent huge pages (never)", !topology.isTransparentHugePagesEnabled());
+
+    // A single node machine needs no binding
+    writeFile(root, "devices/system/node/online", "0");
+    ok &= check("single node", topology.getNodeOfPciDevice("0000:3b:00.0") == -1);
+
+    const NumaTopology missing(root + "/missing");
+    ok &= check("missing sysfs", missing.getOnlineNodes().empty() && missing.getHugePageSizes().empty() && !missing.isTransparentHugePagesEnabled());
+
+    return ok;
+}
+
+bool checkAllocator(int node, HugePages hugePages, const char* name)
+{
+    const NumaTopology topology;
+    const std::vector<uint64_t> sizes = topology.getHugePageSizes();
+    NumaHostAllocator allocator(node, hugePages, sizes.empty() ? 0 : sizes.front());
+
+    bool ok = true;
+    std::vector<void*> blocks;
+    for (uint64_t size : { 1ull, 4096ull, 3ull << 20, 17ull << 20 })
+    {
+        uint8_t* p = (uint8_t*) allocator.allocate(size);
+        memset(p, 0xA5, size);
+        ok &= p[0] == 0xA5 && p[size - 1] == 0xA5;
+        blocks.push_back(p);
+    }
+
+    const HostAllocatorStatistics s = allocator.getStatistics();
+    std::cout << "        " << name << ": " << (s.hugePageBytes >> 20) << " MB huge pages, " << (s.boundBytes >> 20) << " MB bound, " << s.fallbacks << " fallbacks" << std::endl;
+
+    for (void* p : blocks)
+        allocator.free(p);
+    allocator.free(nullptr);
+
+    const HostAllocatorStatistics e = allocator.getStatistics();
+    ok &= s.allocations == 4 && e.hugePageBytes == 0 && e.boundBytes == 0;
+    ok &= (hugePages == HugePages::Explicit) || s.hugePageBytes == 0;
+    ok &= (node >= 0) || s.boundBytes == 0;
+
+    return check(std::string("allocator ") + name, ok);
+}
+
+bool checkPool()
+{
+    // Freed blocks are cached in their size class and reused without a new mapping
+    NumaHostAllocator* backing = new NumaHostAllocator(-1, HugePages::Transparent);
+    CachingAllocator pool(std::unique_ptr<Allocator>(backing), 64ull << 20);
+
+    void* a = pool.allocate(5ull << 20);
+    pool.free(a);
+    void* b = pool.allocate(5ull << 20);
+    pool.free(b);
+
+    return check("caching pool on NUMA allocator", a == b && backing->getStatistics().allocations == 1 && pool.release() > 0);
+}
+
+int main()
+{
+    char dir[] = "/tmp/nvpipe-sysfs-XXXXXX";
+    if (!mkdtemp(dir))
+    {
+        std::cerr << "Failed to create temporary directory" << std::endl;
+        return 1;
+    }
+
+    bool ok = checkTopology(dir);
+
+    const NumaTopology system;
+    std::cout << std::endl << "System: " << system.getOnlineNodes().size() << " NUMA node(s), " << system.getHugePageSizes().size() << " huge page size(s), THP "
+              << (system.isTransparentHugePagesEnabled() ? "enabled" : "disabled") << std::endl;
+
+    ok &= checkAllocator(-1, HugePages::None, "unbound");
+    ok &= checkAllocator(0, HugePages::Transparent, "node 0, transparent");
+    ok &= checkAllocator(0, HugePages::Explicit, "node 0, explicit");
+    ok &= checkPool();
+
+    std::system((std::string("rm -rf ") + dir).c_str());
+
+    return ok ? 0 : 1;
+}
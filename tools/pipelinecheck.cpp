@@ -0,0 +1,206 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Check.h"
+#include "NvPipePipeline.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/**
+ * Check of the staged pipeline framework with plain host stages: ordering, fan-in, backpressure, dropped items
+ * and termination. No GPU is required.
+ */
+
+const nvpipe::StageStatistics& find(const std::vector<nvpipe::StageStatistics>& statistics, const std::string& name)
+{
+    for (const nvpipe::StageStatistics& s : statistics)
+        if (s.name == name)
+            return s;
+    return statistics.front();
+}
+
+bool checkOrder()
+{
+    nvpipe::Pipeline pipeline;
+    auto numbers = pipeline.createQueue<uint64_t>(4);
+    auto squares = pipeline.createQueue<uint64_t>(4);
+
+    uint64_t next = 0;
+    pipeline.addSource<uint64_t>("count", numbers, [&next](uint64_t& out) {
+        out = next++;
+        return out < 10000;
+    });
+    pipeline.addStage<uint64_t, uint64_t>("square", numbers, squares, [](uint64_t& in, uint64_t& out) {
+        out = in * in;
+        return true;
+    });
+
+    std::vector<uint64_t> received;
+    pipeline.addSink<uint64_t>("collect", squares, [&received](uint64_t& in) {
+        received.push_back(in);
+    });
+
+    pipeline.start();
+    pipeline.join();
+
+    bool ok = received.size() == 10000;
+    for (uint64_t i = 0; ok && i < received.size(); ++i)
+        ok = received[i] == i * i;
+
+    const auto statistics = pipeline.getStatistics();
+    ok &= find(statistics, "square").items == 10000 && find(statistics, "collect").items == 10000;
+    ok &= find(statistics, "square").queueCapacity == 4 && find(statistics, "square").maxQueueDepth <= 4;
+
+    return check("order and end of stream", ok);
+}
+
+bool checkFanIn()
+{
+    nvpipe::Pipeline pipeline;
+    auto numbers = pipeline.createQueue<uint64_t>(8, true);
+
+    std::atomic<uint64_t> a{0}, b{0};
+    pipeline.addSource<uint64_t>("a", numbers, [&a](uint64_t& out) {
+        out = 1;
+        return a++ < 5000;
+    });
+    pipeline.addSource<uint64_t>("b", numbers, [&b](uint64_t& out) {
+        out = 1000000;
+        return b++ < 5000;
+    });
+
+    uint64_t sum = 0;
+    uint64_t count = 0;
+    pipeline.addSink<uint64_t>("sum", numbers, [&sum, &count](uint64_t& in) {
+        sum += in;
+        ++count;
+    });
+
+    pipeline.start();
+    pipeline.join();
+
+    // The sink finishes only after both producers closed the queue
+    return check("multiple producers", count == 10000 && sum == 5000 * 1 + 5000 * 1000000ull);
+}
+
+bool checkBackpressure()
+{
+    nvpipe::Pipeline pipeline;
+    auto numbers = pipeline.createQueue<uint64_t>(2);
+
+    uint64_t next = 0;
+    pipeline.addSource<uint64_t>("fast", numbers, [&next](uint64_t& out) {
+        out = next++;
+        return out < 20;
+    });
+
+    uint64_t count = 0;
+    pipeline.addSink<uint64_t>("slow", numbers, [&count](uint64_t&) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        ++count;
+    });
+
+    pipeline.start();
+    pipeline.join();
+
+    // The source cannot run ahead by more than the queue capacity, so it waits for most of the sink's time
+    const auto statistics = pipeline.getStatistics();
+    const bool ok = count == 20 && find(statistics, "fast").blockedMs > 10.0 && find(statistics, "slow").maxQueueDepth <= 2;
+
+    return check("backpressure", ok);
+}
+
+bool checkDropped()
+{
+    nvpipe::Pipeline pipeline;
+    auto numbers = pipeline.createQueue<uint64_t>(4);
+    auto odd = pipeline.createQueue<uint64_t>(4);
+
+    uint64_t next = 0;
+    pipeline.addSource<uint64_t>("count", numbers, [&next](uint64_t& out) {
+        out = next++;
+        return out < 100;
+    });
+    pipeline.addStage<uint64_t, uint64_t>("filter", numbers, odd, [](uint64_t& in, uint64_t& out) {
+        out = in;
+        return (in % 2) == 1;
+    });
+
+    uint64_t count = 0;
+    pipeline.addSink<uint64_t>("collect", odd, [&count](uint64_t& in) {
+        count += in % 2;
+    });
+
+    pipeline.start();
+    pipeline.join();
+
+    const nvpipe::StageStatistics filter = find(pipeline.getStatistics(), "filter");
+    return check("dropped items", count == 50 && filter.items == 100 && filter.dropped == 50);
+}
+
+bool checkStop()
+{
+    nvpipe::Pipeline pipeline;
+    auto numbers = pipeline.createQueue<uint64_t>(4);
+
+    // Endless source, blocked on a full queue most of the time
+    pipeline.addSource<uint64_t>("endless", numbers, [](uint64_t& out) {
+        out = 0;
+        return true;
+    });
+    pipeline.addSink<uint64_t>("slow", numbers, [](uint64_t&) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    });
+
+    pipeline.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    const auto start = std::chrono::steady_clock::now();
+    pipeline.stop();
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    return check("stop", ms < 1000.0);
+}
+
+int main()
+{
+    bool ok = true;
+    ok &= checkOrder();
+    ok &= checkFanIn();
+    ok &= checkBackpressure();
+    ok &= checkDropped();
+    ok &= checkStop();
+
+    return ok ? 0 : 1;
+}
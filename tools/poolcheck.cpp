@@ -0,0 +1,201 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Check.h"
+#include "MemoryPool.h"
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/**
+ * Check of the caching allocator over plain host memory: size classes, reuse, the cache limit, release and counters.
+ *
+ * The same allocator backs the device and host memory pools, so this covers their caching logic without a GPU.
+ */
+
+/**
+ * @brief Host allocator that counts the calls which reach it.
+ */
+class CountingAllocator : public HostAllocator
+{
+public:
+    CountingAllocator(std::atomic<uint64_t>& allocations, std::atomic<uint64_t>& frees) : allocations(allocations), frees(frees)
+    {
+    }
+
+    void* allocate(uint64_t size) override
+    {
+        this->allocations++;
+        return HostAllocator::allocate(size);
+    }
+
+    void free(void* ptr) override
+    {
+        this->frees++;
+        HostAllocator::free(ptr);
+    }
+
+private:
+    std::atomic<uint64_t>& allocations;
+    std::atomic<uint64_t>& frees;
+};
+
+bool checkSizeClasses()
+{
+    bool ok = true;
+    ok &= CachingAllocator::getSizeClass(1) == CachingAllocator::MIN_BLOCK_SIZE;
+    ok &= CachingAllocator::getSizeClass(4096) == 4096;
+    ok &= CachingAllocator::getSizeClass(4097) == 5120;
+    ok &= CachingAllocator::getSizeClass(1 << 20) == (1 << 20);
+    ok &= CachingAllocator::getSizeClass((1 << 20) + 1) == (1 << 20) + (1 << 18);
+
+    // At most 25% overhead
+    for (uint64_t size = 4096; size < (64ull << 20); size = size * 9 / 8 + 1)
+        ok &= CachingAllocator::getSizeClass(size) >= size && CachingAllocator::getSizeClass(size) <= size + size / 4;
+
+    return check("size classes", ok);
+}
+
+bool checkReuse()
+{
+    std::atomic<uint64_t> allocations(0), frees(0);
+    CachingAllocator pool(std::unique_ptr<Allocator>(new CountingAllocator(allocations, frees)), 1 << 20);
+
+    // Slightly different sizes share a class
+    void* a = pool.allocate(5000);
+    pool.free(a);
+    void* b = pool.allocate(4500);
+
+    const PoolStatistics s = pool.getStatistics();
+    bool ok = a == b && allocations == 1 && frees == 0;
+    ok &= s.allocations == 2 && s.hits == 1 && s.getHitRate() == 0.5;
+    ok &= s.liveBytes == 5120 && s.cachedBytes == 0 && s.peakBytes == 5120;
+
+    // A different class is not served from the cache
+    pool.free(b);
+    void* c = pool.allocate(20000);
+    ok &= c != b && allocations == 2 && pool.getStatistics().cachedBytes == 5120;
+    pool.free(c);
+
+    return check("reuse and statistics", ok);
+}
+
+bool checkLimit()
+{
+    // Room for three blocks of 8 KB
+    std::atomic<uint64_t> allocations(0), frees(0);
+    CachingAllocator pool(std::unique_ptr<Allocator>(new CountingAllocator(allocations, frees)), 3 * 8192);
+
+    int64_t cached = 0;
+    pool.setCacheCallback([&cached](int64_t delta) { cached += delta; });
+
+    std::vector<void*> blocks;
+    for (int i = 0; i < 4; ++i)
+        blocks.push_back(pool.allocate(8192));
+    for (void* p : blocks)
+        pool.free(p);
+
+    PoolStatistics s = pool.getStatistics();
+    bool ok = s.cachedBytes == 3 * 8192 && s.liveBytes == 0 && s.evictions == 1 && frees == 1 && cached == 3 * 8192;
+    ok &= s.peakBytes == 4 * 8192;
+
+    // Trim returns all cached blocks to the backing allocator
+    ok &= pool.release() == 3 * 8192;
+    s = pool.getStatistics();
+    ok &= s.cachedBytes == 0 && frees == 4 && cached == 0 && pool.release() == 0;
+
+    // Allocations after a trim reach the backing allocator again
+    pool.free(pool.allocate(8192));
+    ok &= allocations == 5;
+
+    return check("cache limit and release", ok);
+}
+
+bool checkInvalidFree()
+{
+#ifdef NDEBUG
+    std::atomic<uint64_t> allocations(0), frees(0);
+    CachingAllocator pool(std::unique_ptr<Allocator>(new CountingAllocator(allocations, frees)), 1 << 20);
+
+    // Foreign pointers and double frees are reported, not passed to the backing allocator
+    int foreign = 0;
+    pool.free(&foreign);
+    void* p = pool.allocate(100);
+    pool.free(p);
+    pool.free(p);
+
+    const PoolStatistics s = pool.getStatistics();
+    return check("invalid frees", s.invalidFrees == 2 && s.cachedBytes == 4096 && frees == 0);
+#else
+    std::cout << "skipped invalid frees (asserts enabled)" << std::endl;
+    return true;
+#endif
+}
+
+bool checkThreads()
+{
+    std::atomic<uint64_t> allocations(0), frees(0);
+    CachingAllocator pool(std::unique_ptr<Allocator>(new CountingAllocator(allocations, frees)), 1 << 20);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&pool, t]() {
+            for (int i = 0; i < 10000; ++i)
+            {
+                void* p = pool.allocate(4096 * (1 + (i + t) % 8));
+                *(volatile uint8_t*) p = (uint8_t) i;
+                pool.free(p);
+            }
+        });
+    }
+    for (std::thread& t : threads)
+        t.join();
+
+    const PoolStatistics s = pool.getStatistics();
+    const bool ok = s.allocations == 40000 && s.liveBytes == 0 && s.hits + allocations == 40000 && allocations <= 4 * 8;
+
+    pool.release();
+    return check("concurrent use", ok && frees == allocations);
+}
+
+int main()
+{
+    bool ok = true;
+    ok &= checkSizeClasses();
+    ok &= checkReuse();
+    ok &= checkLimit();
+    ok &= checkInvalidFree();
+    ok &= checkThreads();
+
+    return ok ? 0 : 1;
+}
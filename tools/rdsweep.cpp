@@ -0,0 +1,346 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <NvPipe.h>
+
+#include "ContentGenerator.h"
+#include "QualityMetrics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+/**
+ * Sweeps codec, compression mode and bitrate over synthetic content and writes rate-distortion points as CSV.
+ */
+
+std::vector<std::string> split(const std::string& list)
+{
+    std::vector<std::string> items;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ','))
+        if (!item.empty())
+            items.push_back(item);
+    return items;
+}
+
+bool parseFormat(const std::string& name, NvPipe_Format& format)
+{
+    const char* names[] = { "bgra32", "uint4", "uint8", "uint16", "uint32", "bgra32a" };
+    const NvPipe_Format formats[] = { NVPIPE_BGRA32, NVPIPE_UINT4, NVPIPE_UINT8, NVPIPE_UINT16, NVPIPE_UINT32, NVPIPE_BGRA32_ALPHA };
+    for (uint32_t i = 0; i < 6; ++i)
+    {
+        if (name == names[i])
+        {
+            format = formats[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return 1.0e-3 * std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief Adds deterministic, approximately Gaussian noise (sum of four uniforms) to simulate camera or sensor input.
+ * Sigma is given in 8-bit code values and scaled for UINT16. BGRA alpha is left unchanged.
+ */
+void addSensorNoise(NvPipe_Format format, uint8_t* data, uint64_t size, double sigma, uint64_t seed)
+{
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<double> uniform(-0.5, 0.5);
+    const double scale = sigma * std::sqrt(3.0);
+
+    auto noise = [&]()
+    {
+        return (uniform(rng) + uniform(rng) + uniform(rng) + uniform(rng)) * scale;
+    };
+
+    if (format == NVPIPE_UINT16)
+    {
+        uint16_t* values = (uint16_t*) data;
+        for (uint64_t i = 0; i < size / 2; ++i)
+            values[i] = (uint16_t) std::min(std::max(values[i] + noise() * 257.0 + 0.5, 0.0), 65535.0);
+    }
+    else
+    {
+        for (uint64_t i = 0; i < size; ++i)
+            if ((format != NVPIPE_BGRA32 && format != NVPIPE_BGRA32_ALPHA) || i % 4 != 3)
+                data[i] = (uint8_t) std::min(std::max(data[i] + noise() + 0.5, 0.0), 255.0);
+    }
+}
+
+void usage()
+{
+    std::cout << "Usage: nvpRDSweep [options]" << std::endl
+              << "  --content LIST      text,pan,noise,depth,mask,field (default: all)" << std::endl
+              << "  --format NAME       bgra32, bgra32a (with alpha), uint4, uint8, uint16 or uint32 (default: bgra32)" << std::endl
+              << "  --size WxH          Frame size (default: 1920x1080)" << std::endl
+              << "  --frames N          Frames per point (default: 60)" << std::endl
+              << "  --fps N             Target frame rate (default: 60)" << std::endl
+              << "  --bitrates LIST     Target bitrates in Mbps (default: 2,4,8,16,32,64)" << std::endl
+              << "  --codecs LIST       h264,hevc (default: h264,hevc)" << std::endl
+              << "  --compression LIST  lossy,lossless,progressive (default: lossy,lossless)" << std::endl
+              << "  --noise SIGMA       Adds sensor noise (8-bit code values) to bgra32, uint8 or uint16 input;" << std::endl
+              << "                      quality is measured against the clean frames (default: 0)" << std::endl
+              << "  --denoise LIST      Pre-encode denoise strengths between 0 and 1 (default: 0)" << std::endl
+              << "  --seed N            Content seed (default: 0)" << std::endl
+              << "  --output PATH       CSV file (default: stdout)" << std::endl;
+}
+
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> contents = { "text", "pan", "noise", "depth", "mask", "field" };
+    std::string formatName = "bgra32";
+    uint32_t width = 1920;
+    uint32_t height = 1080;
+    uint32_t frames = 60;
+    uint32_t fps = 60;
+    std::vector<std::string> bitrates = { "2", "4", "8", "16", "32", "64" };
+    std::vector<std::string> codecs = { "h264", "hevc" };
+    std::vector<std::string> compressions = { "lossy", "lossless" };
+    double noise = 0.0;
+    std::vector<std::string> denoiseStrengths = { "0" };
+    uint64_t seed = 0;
+    std::string outputPath;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--help" || i + 1 >= argc)
+        {
+            usage();
+            return arg == "--help" ? 0 : 1;
+        }
+
+        const std::string value = argv[++i];
+        if (arg == "--content")
+            contents = split(value);
+        else if (arg == "--format")
+            formatName = value;
+        else if (arg == "--size")
+        {
+            if (sscanf(value.c_str(), "%ux%u", &width, &height) != 2)
+            {
+                std::cerr << "Invalid size: " << value << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "--frames")
+            frames = std::stoul(value);
+        else if (arg == "--fps")
+            fps = std::stoul(value);
+        else if (arg == "--bitrates")
+            bitrates = split(value);
+        else if (arg == "--codecs")
+            codecs = split(value);
+        else if (arg == "--compression")
+            compressions = split(value);
+        else if (arg == "--noise")
+            noise = std::stod(value);
+        else if (arg == "--denoise")
+            denoiseStrengths = split(value);
+        else if (arg == "--seed")
+            seed = std::stoull(value);
+        else if (arg == "--output")
+            outputPath = value;
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    NvPipe_Format format;
+    if (!parseFormat(formatName, format))
+    {
+        std::cerr << "Unknown format: " << formatName << std::endl;
+        return 1;
+    }
+
+    if (noise > 0.0 && format != NVPIPE_BGRA32 && format != NVPIPE_BGRA32_ALPHA && format != NVPIPE_UINT8 && format != NVPIPE_UINT16)
+    {
+        std::cerr << "Sensor noise requires bgra32, bgra32a, uint8 or uint16" << std::endl;
+        return 1;
+    }
+
+    std::ofstream file;
+    if (!outputPath.empty())
+        file.open(outputPath);
+    std::ostream& out = outputPath.empty() ? std::cout : file;
+
+    out << "content,format,codec,compression,target_mbps,actual_mbps,bits_per_pixel,psnr_db,ssim,max_error,encode_ms,decode_ms,noise,denoise" << std::endl;
+
+    for (const std::string& contentName : contents)
+    {
+        ContentType type;
+        if (!ContentGenerator::parseType(contentName, type))
+        {
+            std::cerr << "Unknown content: " << contentName << std::endl;
+            return 1;
+        }
+
+        // Generate the sequence once, outside of the measured encode time
+        ContentGenerator generator(type, format, width, height, seed);
+        const uint64_t frameSize = generator.getFrameSize();
+        std::vector<uint8_t> input(frameSize * frames);
+        for (uint32_t f = 0; f < frames; ++f)
+            generator.generate(f, input.data() + f * frameSize);
+
+        // Noisy input is encoded, the clean frames are the quality reference
+        std::vector<uint8_t> clean;
+        if (noise > 0.0)
+        {
+            clean = input;
+            for (uint32_t f = 0; f < frames; ++f)
+                addSensorNoise(format, input.data() + f * frameSize, frameSize, noise, seed * frames + f);
+        }
+        const std::vector<uint8_t>& reference = clean.empty() ? input : clean;
+
+        std::vector<uint8_t> compressed(frameSize + 4096);
+        std::vector<uint8_t> decoded(frameSize);
+
+        for (const std::string& codecName : codecs)
+        {
+            const NvPipe_Codec codec = (codecName == "hevc") ? NVPIPE_HEVC : NVPIPE_H264;
+
+            for (const std::string& compressionName : compressions)
+            {
+                const NvPipe_Compression compression = (compressionName == "lossless") ? NVPIPE_LOSSLESS : (compressionName == "progressive") ? NVPIPE_PROGRESSIVE : NVPIPE_LOSSY;
+
+                // Bitrate is ignored for lossless compression
+                const std::vector<std::string> targets = (compression == NVPIPE_LOSSLESS) ? std::vector<std::string>{ "0" } : bitrates;
+                for (const std::string& target : targets)
+                {
+                    for (const std::string& denoise : denoiseStrengths)
+                    {
+                        const double targetMbps = std::stod(target);
+                        const float denoiseStrength = std::stof(denoise);
+
+                        NvPipe* encoder = NvPipe_CreateEncoder(format, codec, compression, (uint64_t) (targetMbps * 1000 * 1000), fps);
+                        NvPipe* decoder = NvPipe_CreateDecoder(format, codec);
+                        if (!encoder || !decoder)
+                        {
+                            std::cerr << "Failed to create " << codecName << " session: " << NvPipe_GetError(NULL) << std::endl;
+                            if (encoder)
+                                NvPipe_Destroy(encoder);
+                            if (decoder)
+                                NvPipe_Destroy(decoder);
+                            continue;
+                        }
+
+                        if (denoiseStrength > 0.0f && !NvPipe_SetDenoise(encoder, denoiseStrength))
+                        {
+                            std::cerr << "Failed to enable denoising: " << NvPipe_GetError(encoder) << std::endl;
+                            NvPipe_Destroy(encoder);
+                            NvPipe_Destroy(decoder);
+                            continue;
+                        }
+
+                        uint64_t totalBytes = 0;
+                        double encodeMs = 0.0, decodeMs = 0.0, psnr = 0.0, ssim = 0.0;
+                        uint64_t maxError = 0;
+                        uint32_t lossless = 0;
+
+                        uint32_t f = 0;
+                        for (; f < frames; ++f)
+                        {
+                            const uint8_t* frame = input.data() + f * frameSize;
+
+                            auto start = std::chrono::steady_clock::now();
+                            const uint64_t size = NvPipe_Encode(encoder, frame, generator.getPitch(), compressed.data(), compressed.size(), width, height, false);
+                            encodeMs += elapsedMs(start);
+
+                            if (size == 0)
+                            {
+                                std::cerr << "Encode failed: " << NvPipe_GetError(encoder) << std::endl;
+                                break;
+                            }
+
+                            start = std::chrono::steady_clock::now();
+                            const uint64_t r = NvPipe_Decode(decoder, compressed.data(), size, decoded.data(), width, height);
+                            decodeMs += elapsedMs(start);
+
+                            if (r == 0)
+                            {
+                                std::cerr << "Decode failed: " << NvPipe_GetError(decoder) << std::endl;
+                                break;
+                            }
+
+                            const Quality q = computeQuality(format, reference.data() + f * frameSize, decoded.data(), width, height);
+                            totalBytes += size;
+                            maxError = std::max(maxError, q.maxError);
+                            ssim += q.ssim;
+
+                            // Average PSNR over lossy frames only, identical frames are counted separately
+                            if (std::isinf(q.psnr))
+                                ++lossless;
+                            else
+                                psnr += q.psnr;
+                        }
+
+                        NvPipe_Destroy(encoder);
+                        NvPipe_Destroy(decoder);
+
+                        // Averages over a partial run are not comparable to the other points of the sweep
+                        if (f < frames)
+                        {
+                            std::cerr << "Skipping " << contentName << "/" << formatName << "/" << codecName << "/" << compressionName
+                                      << " at " << targetMbps << " Mbps after " << f << " of " << frames << " frames" << std::endl;
+                            continue;
+                        }
+
+                        const double seconds = (double) frames / fps;
+                        const double actualMbps = totalBytes * 8.0 / seconds / 1.0e6;
+                        const double bitsPerPixel = totalBytes * 8.0 / ((double) width * height * frames);
+                        const std::string psnrText = (lossless == frames) ? "inf" : std::to_string(psnr / (frames - lossless));
+
+                        out << contentName << "," << formatName << "," << codecName << "," << compressionName << ","
+                            << targetMbps << "," << actualMbps << "," << bitsPerPixel << ","
+                            << psnrText << "," << ssim / frames << "," << maxError << ","
+                            << encodeMs / frames << "," << decodeMs / frames << "," << noise << "," << denoiseStrength << std::endl;
+                    }
+                }
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,223 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Check.h"
+#include "Recorder.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+
+/**
+ * Check of the multi-stream recorder: many streams written from several threads, read back through the index.
+ *
+ * Frame contents are derived from (stream, frame), so the reader can verify every byte without keeping the data.
+ * Both I/O backends and direct I/O are exercised; an unclosed recording checks recovery of the index from the blocks.
+ */
+
+const uint32_t numStreams = 16;
+const uint32_t numThreads = 4;
+const uint32_t numFrames = 300;
+
+uint32_t frameSize(uint32_t stream, uint32_t frame)
+{
+    // Mostly small P-frames, large I-frames, some larger than a block
+    std::mt19937 rng(stream * 7919 + frame);
+    if (frame % 60 == 0)
+        return 100000 + rng() % 300000;
+    return 1 + rng() % 20000;
+}
+
+uint8_t frameByte(uint32_t stream, uint32_t frame, uint32_t i)
+{
+    return (uint8_t) (stream * 31 + frame * 7 + i * 13 + (i >> 8));
+}
+
+void writeStreams(Recorder& recorder, const std::vector<uint32_t>& ids, uint32_t first, uint32_t step, uint32_t frames)
+{
+    std::vector<uint8_t> data;
+    for (uint32_t f = 0; f < frames; ++f)
+    {
+        for (uint32_t s = first; s < ids.size(); s += step)
+        {
+            const uint32_t size = frameSize(s, f);
+            data.resize(size);
+            for (uint32_t i = 0; i < size; ++i)
+                data[i] = frameByte(s, f, i);
+
+            recorder.write(ids[s], data.data(), size, f * 16667ull, f % 60 == 0);
+        }
+    }
+}
+
+bool verifyStream(const std::string& path, uint32_t stream, uint32_t frames, bool expectRecovered)
+{
+    RecordingHeader header;
+    std::vector<RecordingIndexEntry> index;
+    bool recovered;
+
+    const std::string error = readRecordingIndex(path, header, index, recovered);
+    if (!error.empty())
+    {
+        std::cerr << path << ": " << error << std::endl;
+        return false;
+    }
+
+    if (recovered != expectRecovered || index.size() != frames || header.width != 1920 || header.height != 1080)
+        return false;
+
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+
+    bool ok = true;
+    std::vector<uint8_t> data;
+    for (uint32_t f = 0; f < frames && ok; ++f)
+    {
+        const RecordingIndexEntry& e = index[f];
+        ok &= e.size == frameSize(stream, f) && e.timestampUs == f * 16667ull && ((e.flags & RECORDING_FRAME_KEY) != 0) == (f % 60 == 0);
+
+        data.resize(e.size);
+        ok &= fseek(file, (long) e.offset, SEEK_SET) == 0 && fread(data.data(), 1, e.size, file) == e.size;
+        for (uint32_t i = 0; i < e.size && ok; ++i)
+            ok &= data[i] == frameByte(stream, f, i);
+    }
+
+    fclose(file);
+    return ok;
+}
+
+bool checkRecorder(const std::string& dir, const RecorderConfig& config, const std::string& name)
+{
+    std::vector<std::string> paths;
+    RecorderStatistics statistics;
+    double seconds;
+    {
+        Recorder recorder(config);
+
+        std::vector<uint32_t> ids;
+        for (uint32_t s = 0; s < numStreams; ++s)
+        {
+            paths.push_back(dir + "/stream" + std::to_string(s) + ".nvpr");
+            ids.push_back(recorder.addStream(paths.back(), 0, 0, 1920, 1080));
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+
+        std::vector<std::thread> threads;
+        for (uint32_t t = 0; t < numThreads; ++t)
+            threads.emplace_back(writeStreams, std::ref(recorder), std::cref(ids), t, numThreads, numFrames);
+        for (std::thread& t : threads)
+            t.join();
+
+        for (uint32_t id : ids)
+            recorder.closeStream(id);
+
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        statistics = recorder.getStatistics();
+    }
+
+    bool ok = statistics.frames == numStreams * numFrames && statistics.blocks > 0 && statistics.diskBytes >= statistics.bytes;
+    for (uint32_t s = 0; s < numStreams; ++s)
+        ok &= verifyStream(paths[s], s, numFrames, false);
+
+    std::cout << "        " << (statistics.ioUring ? "io_uring" : "pwritev") << ", " << statistics.blocks << " blocks, " << statistics.stalls << " stalls, "
+              << (uint64_t) (statistics.diskBytes / seconds / (1 << 20)) << " MB/s" << std::endl;
+
+    return check(name, ok);
+}
+
+bool checkRecovery(const std::string& dir)
+{
+    // Blocks are written but the index is not: a recording cut off by a crash
+    RecorderConfig config;
+    config.blockSize = 64 << 10;
+    config.preallocateBytes = 1 << 20;
+
+    const std::string path = dir + "/crash.nvpr";
+    const uint32_t frames = 120;
+    uint64_t indexOffset = 0;
+    {
+        Recorder recorder(config);
+        const uint32_t id = recorder.addStream(path, 0, 0, 1920, 1080);
+        writeStreams(recorder, { id }, 0, 1, frames);
+        recorder.closeStream(id);
+
+        RecordingHeader header;
+        std::vector<RecordingIndexEntry> index;
+        bool recovered;
+        readRecordingIndex(path, header, index, recovered);
+        indexOffset = index.empty() ? 0 : index.back().offset + index.back().size;
+    }
+
+    // Drop the index and trailer, keep preallocated (zero) space behind the blocks
+    bool ok = indexOffset > 0 && truncate(path.c_str(), (off_t) (indexOffset + (1 << 20))) == 0;
+
+    ok &= verifyStream(path, 0, frames, true);
+
+    return check("index recovery", ok);
+}
+
+int main()
+{
+    char dir[] = "/tmp/nvpipe-record-XXXXXX";
+    if (!mkdtemp(dir))
+    {
+        std::cerr << "Failed to create temporary directory" << std::endl;
+        return 1;
+    }
+
+    bool ok = true;
+
+    RecorderConfig config;
+    config.blockSize = 256 << 10;
+    config.preallocateBytes = 16 << 20;
+    config.maxQueuedBlocks = 8;
+    ok &= checkRecorder(dir, config, "io_uring (if available)");
+
+    config.useIoUring = false;
+    ok &= checkRecorder(dir, config, "pwritev");
+
+    config.useIoUring = true;
+    config.directIO = true;
+    ok &= checkRecorder(dir, config, "direct I/O");
+
+    ok &= checkRecovery(dir);
+
+    std::system((std::string("rm -rf ") + dir).c_str());
+
+    return ok ? 0 : 1;
+}
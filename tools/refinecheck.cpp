@@ -0,0 +1,169 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Check.h"
+#include "Refine.h"
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+/**
+ * Check of the progressive refinement sequence (RefinePlanner): session, lossy rate and IDR frames per input frame.
+ */
+
+/**
+ * @brief Expected decision for one frame.
+ */
+struct Step
+{
+    bool changed;
+    bool lossless;
+    bool forceIFrame;
+    uint64_t bitrate;
+};
+
+/**
+ * @brief Feeds the steps to the planner, tracking the lossy session rate like the encoder does.
+ */
+bool run(RefinePlanner& planner, uint64_t& encoderBitrate, const std::vector<Step>& steps)
+{
+    bool ok = true;
+    for (const Step& step : steps)
+    {
+        const RefinePlanner::Decision d = planner.next(step.changed, encoderBitrate);
+        ok &= d.lossless == step.lossless && d.forceIFrame == step.forceIFrame && d.bitrate == step.bitrate;
+
+        if (d.bitrate > 0)
+            encoderBitrate = d.bitrate;
+    }
+    return ok;
+}
+
+bool checkSequence()
+{
+    const uint64_t rate = 10000000;
+    uint64_t encoderBitrate = rate;
+    RefinePlanner planner;
+    planner.setBitrate(rate);
+
+    const bool ok = run(planner, encoderBitrate, {
+        { true, false, false, 0 },            // moving: lossy at the configured rate
+        { true, false, false, 0 },
+        { false, false, false, 2 * rate },    // first repeat: twice the rate
+        { false, false, false, 4 * rate },    // four times the rate
+        { false, true, true, 0 },             // lossless session, starting with an IDR frame
+        { false, true, false, 0 },            // stays lossless while static
+        { false, true, false, 0 },
+        { true, false, true, rate },          // change: lossy again at the original rate, IDR
+        { true, false, false, 0 },
+    });
+
+    return check("refine to lossless and back", ok && !planner.isRefining() && encoderBitrate == rate);
+}
+
+bool checkInterrupted()
+{
+    const uint64_t rate = 8000000;
+    uint64_t encoderBitrate = rate;
+    RefinePlanner planner;
+    planner.setBitrate(rate);
+
+    // A change during the lossy refinement restores the rate, but needs no IDR frame (same session)
+    const bool ok = run(planner, encoderBitrate, {
+        { true, false, false, 0 },
+        { false, false, false, 2 * rate },
+        { true, false, false, rate },
+        { false, false, false, 2 * rate },
+        { false, false, false, 4 * rate },
+        { true, false, false, rate },
+    });
+
+    return check("change during lossy refinement", ok && encoderBitrate == rate);
+}
+
+bool checkSetBitrate()
+{
+    const uint64_t rate = 10000000;
+    uint64_t encoderBitrate = rate;
+    RefinePlanner planner;
+    planner.setBitrate(rate);
+
+    bool ok = run(planner, encoderBitrate, {
+        { true, false, false, 0 },
+        { false, false, false, 2 * rate },
+    });
+
+    // A new rate during refinement scales the remaining steps and is restored once the input changes
+    planner.setBitrate(3000000);
+    ok &= run(planner, encoderBitrate, {
+        { false, false, false, 4 * 3000000 },
+        { false, true, true, 0 },
+        { true, false, true, 3000000 },
+    });
+
+    return check("bitrate change during refinement", ok && encoderBitrate == 3000000);
+}
+
+bool checkReset()
+{
+    const uint64_t rate = 10000000;
+    uint64_t encoderBitrate = rate;
+    RefinePlanner planner;
+    planner.setBitrate(rate);
+
+    bool ok = run(planner, encoderBitrate, {
+        { true, false, false, 0 },
+        { false, false, false, 2 * rate },
+        { false, false, false, 4 * rate },
+        { false, true, true, 0 },
+    });
+
+    // Recreated sessions start at the configured rate with an IDR frame of their own
+    planner.reset();
+    encoderBitrate = rate;
+    ok &= !planner.isRefining();
+    ok &= run(planner, encoderBitrate, {
+        { true, false, false, 0 },
+        { false, false, false, 2 * rate },
+    });
+
+    return check("reset", ok);
+}
+
+int main()
+{
+    bool ok = true;
+    ok &= checkSequence();
+    ok &= checkInterrupted();
+    ok &= checkSetBitrate();
+    ok &= checkReset();
+
+    return ok ? 0 : 1;
+}
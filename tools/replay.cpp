@@ -0,0 +1,410 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <NvPipe.h>
+
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <cuda_runtime_api.h>
+
+
+/**
+ * Re-executes a trace recorded with NvPipe_StartTrace and compares call durations with the recording.
+ */
+
+struct Call
+{
+    TraceRecord record;
+    std::vector<uint8_t> payload; // decompressed
+};
+
+struct OpStatistics
+{
+    uint64_t count = 0;
+    uint64_t skipped = 0;
+    double recordedMs = 0.0;
+    double recordedMaxMs = 0.0;
+    double replayMs = 0.0;
+    double replayMaxMs = 0.0;
+};
+
+struct Spike
+{
+    uint64_t index;
+    double recordedMs;
+    double replayMs;
+};
+
+const char* opName(TraceOp op)
+{
+    switch (op)
+    {
+    case TraceOp::CreateEncoder: return "CreateEncoder";
+    case TraceOp::SetBitrate: return "SetBitrate";
+    case TraceOp::Encode: return "Encode";
+    case TraceOp::EncodeTexture: return "EncodeTexture";
+    case TraceOp::EncodePBO: return "EncodePBO";
+    case TraceOp::EncodeFrame: return "EncodeFrame";
+    case TraceOp::PostFrame: return "PostFrame";
+    case TraceOp::CreateDecoder: return "CreateDecoder";
+    case TraceOp::Decode: return "Decode";
+    case TraceOp::DecodeTexture: return "DecodeTexture";
+    case TraceOp::DecodePBO: return "DecodePBO";
+    case TraceOp::DecodeFrame: return "DecodeFrame";
+    case TraceOp::QueueDecode: return "QueueDecode";
+    case TraceOp::FetchLatestFrame: return "FetchLatestFrame";
+    case TraceOp::Destroy: return "Destroy";
+    case TraceOp::SetTimeout: return "SetTimeout";
+    case TraceOp::EncodeTimestamped: return "EncodeTimestamped";
+    case TraceOp::SetDenoise: return "SetDenoise";
+    case TraceOp::EncodeVolume: return "EncodeVolume";
+    case TraceOp::DecodeVolume: return "DecodeVolume";
+    }
+    return "Unknown";
+}
+
+uint64_t getFrameSize(NvPipe_Format format, uint64_t width, uint64_t height)
+{
+    if (format == NVPIPE_BGRA32 || format == NVPIPE_BGRA32_ALPHA)
+        return width * height * 4;
+    else if (format == NVPIPE_UINT4)
+        return width * height / 2;
+    else if (format == NVPIPE_UINT8)
+        return width * height;
+    else if (format == NVPIPE_UINT16)
+        return width * height * 2;
+    else if (format == NVPIPE_UINT32)
+        return width * height * 4;
+
+    return 0;
+}
+
+bool loadTrace(const std::string& path, bool& includesPayloads, std::vector<Call>& calls)
+{
+    std::ifstream in(path, std::ios::in | std::ios::binary);
+
+    TraceHeader header;
+    if (!in.read((char*) &header, sizeof(header)) || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 || header.version != TRACE_VERSION)
+    {
+        std::cerr << "Not a valid NvPipe trace: " << path << std::endl;
+        return false;
+    }
+    includesPayloads = header.includesPayloads;
+
+    std::vector<uint8_t> stored;
+    Call call;
+    while (in.read((char*) &call.record, sizeof(call.record)))
+    {
+        stored.resize(call.record.payloadSize);
+        if (!in.read((char*) stored.data(), stored.size()))
+        {
+            std::cerr << "Warning: trace truncated after " << calls.size() << " calls" << std::endl;
+            break;
+        }
+
+        call.payload.resize(call.record.payloadRawSize);
+        if ((TracePayload) call.record.payloadType == TracePayload::RLE)
+        {
+            if (!traceDecompress(stored.data(), stored.size(), call.payload.data(), call.payload.size()))
+            {
+                std::cerr << "Corrupt payload in call " << calls.size() << std::endl;
+                return false;
+            }
+        }
+        else
+        {
+            call.payload.swap(stored);
+        }
+
+        calls.push_back(std::move(call));
+    }
+
+    return true;
+}
+
+
+/**
+ * @brief Host or device scratch buffer, grown on demand.
+ */
+class Buffer
+{
+public:
+    ~Buffer()
+    {
+        if (this->device)
+            cudaFree(this->device);
+    }
+
+    uint8_t* get(uint64_t size, bool onDevice)
+    {
+        if (!onDevice)
+        {
+            if (this->host.size() < size)
+                this->host.resize(size);
+            return this->host.data();
+        }
+
+        if (this->deviceSize < size)
+        {
+            if (this->device)
+                cudaFree(this->device);
+            cudaMalloc(&this->device, size);
+            this->deviceSize = size;
+        }
+        return this->device;
+    }
+
+    uint8_t* upload(const std::vector<uint8_t>& data, uint64_t size, bool onDevice)
+    {
+        uint8_t* ptr = this->get(size, onDevice);
+        const uint64_t copied = std::min<uint64_t>(size, data.size());
+        if (copied > 0)
+            cudaMemcpy(ptr, data.data(), copied, onDevice ? cudaMemcpyHostToDevice : cudaMemcpyHostToHost);
+
+        // Blank frames without payload, not the leftovers of a previous frame
+        if (copied < size)
+        {
+            if (onDevice)
+                cudaMemset(ptr + copied, 0, size - copied);
+            else
+                memset(ptr + copied, 0, size - copied);
+        }
+        return ptr;
+    }
+
+private:
+    std::vector<uint8_t> host;
+    uint8_t* device = nullptr;
+    uint64_t deviceSize = 0;
+};
+
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cout << "Usage: nvpReplay <trace> [--max-speed]" << std::endl;
+        std::cout << "Re-executes an NvPipe API trace at recorded speed (default) or as fast as possible and reports timing differences." << std::endl;
+        return 1;
+    }
+
+    const std::string path = argv[1];
+    const bool maxSpeed = (argc > 2 && std::string(argv[2]) == "--max-speed");
+
+    bool includesPayloads = false;
+    std::vector<Call> calls;
+    if (!loadTrace(path, includesPayloads, calls))
+        return 1;
+
+    std::cout << "Trace: " << path << " (" << calls.size() << " calls, " << (includesPayloads ? "with" : "without") << " payloads)" << std::endl;
+    std::cout << "Speed: " << (maxSpeed ? "maximum" : "recorded") << std::endl << std::endl;
+
+    if (!includesPayloads)
+        std::cout << "Note: Encodes use blank frames and decodes are skipped without recorded payloads." << std::endl << std::endl;
+
+    struct Instance
+    {
+        NvPipe* nvp;
+        NvPipe_Format format;
+        uint64_t frameSize; // of the most recent decode, for fetching
+        std::string error;
+    };
+    std::map<uint64_t, Instance> instances;
+
+    Buffer input;
+    Buffer output;
+    std::map<TraceOp, OpStatistics> statistics;
+    std::vector<Spike> spikes;
+
+    const auto replayStart = std::chrono::steady_clock::now();
+
+    for (uint64_t i = 0; i < calls.size(); ++i)
+    {
+        const TraceRecord& r = calls[i].record;
+        const std::vector<uint8_t>& payload = calls[i].payload;
+        const TraceOp op = (TraceOp) r.op;
+
+        if (!maxSpeed)
+            std::this_thread::sleep_until(replayStart + std::chrono::nanoseconds(r.timestampNs));
+
+        auto it = instances.find(r.instance);
+        NvPipe* nvp = (it != instances.end()) ? it->second.nvp : nullptr;
+        const NvPipe_Format format = (it != instances.end()) ? it->second.format : NVPIPE_BGRA32;
+
+        const bool isCreate = (op == TraceOp::CreateEncoder || op == TraceOp::CreateDecoder);
+        const bool isDecode = (op == TraceOp::Decode || op == TraceOp::DecodeTexture || op == TraceOp::DecodePBO || op == TraceOp::DecodeFrame || op == TraceOp::QueueDecode);
+
+        // Calls that cannot be reproduced: failed creations, unknown instances, GPU resources and frame handles of the original process
+        bool skip = (!isCreate && !nvp) || (isCreate && r.result == 0);
+        skip |= (op == TraceOp::EncodeTexture || op == TraceOp::EncodePBO || op == TraceOp::EncodeFrame);
+        skip |= (isDecode && payload.empty());
+
+        // Prepare inputs outside of the timed section
+        uint8_t* src = nullptr;
+        uint8_t* dst = nullptr;
+        uint64_t srcPitch = 0;
+        if (!skip && (op == TraceOp::Encode || op == TraceOp::PostFrame || op == TraceOp::EncodeTimestamped))
+        {
+            srcPitch = getFrameSize((NvPipe_Format) r.args[5], r.args[2], 1);
+            src = input.upload(payload, srcPitch * r.args[3], op != TraceOp::EncodeTimestamped && r.args[6]);
+            dst = output.get(r.args[1] ? r.args[1] : srcPitch * r.args[3] + 4096, false);
+        }
+        else if (!skip && isDecode)
+        {
+            src = (uint8_t*) payload.data();
+            it->second.frameSize = getFrameSize(format, r.args[0], r.args[1]);
+            dst = output.get(it->second.frameSize, op == TraceOp::Decode && r.args[2]);
+        }
+        else if (!skip && op == TraceOp::FetchLatestFrame)
+        {
+            dst = output.get(it->second.frameSize, r.args[0]);
+        }
+
+        OpStatistics& s = statistics[op];
+        if (skip)
+        {
+            s.skipped++;
+            continue;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+
+        switch (op)
+        {
+        case TraceOp::CreateEncoder:
+            nvp = NvPipe_CreateEncoder((NvPipe_Format) r.args[0], (NvPipe_Codec) r.args[1], (NvPipe_Compression) r.args[2], r.args[3], (uint32_t) r.args[4]);
+            break;
+        case TraceOp::CreateDecoder:
+            nvp = NvPipe_CreateDecoder((NvPipe_Format) r.args[0], (NvPipe_Codec) r.args[1]);
+            break;
+        case TraceOp::SetBitrate:
+            NvPipe_SetBitrate(nvp, r.args[0], (uint32_t) r.args[1]);
+            break;
+        case TraceOp::SetTimeout:
+            NvPipe_SetTimeout(nvp, (uint32_t) r.args[0]);
+            break;
+        case TraceOp::SetDenoise:
+            NvPipe_SetDenoise(nvp, r.args[0] / 1000.0f);
+            break;
+        case TraceOp::Encode:
+        case TraceOp::PostFrame: // The mailbox callback is not part of the trace, frames are encoded synchronously
+            NvPipe_Encode(nvp, src, srcPitch, dst, r.args[1] ? r.args[1] : srcPitch * r.args[3] + 4096, (uint32_t) r.args[2], (uint32_t) r.args[3], r.args[4] != 0);
+            break;
+        case TraceOp::EncodeTimestamped:
+            NvPipe_EncodeTimestamped(nvp, src, srcPitch, dst, r.args[1] ? r.args[1] : srcPitch * r.args[3] + 4096, (uint32_t) r.args[2], (uint32_t) r.args[3], r.args[6], r.args[4] != 0);
+            break;
+        case TraceOp::Decode:
+        case TraceOp::DecodeTexture:
+        case TraceOp::DecodePBO:
+            NvPipe_Decode(nvp, src, payload.size(), dst, (uint32_t) r.args[0], (uint32_t) r.args[1]);
+            break;
+        case TraceOp::DecodeFrame:
+            NvPipe_ReleaseFrame(NvPipe_DecodeFrame(nvp, src, payload.size(), (uint32_t) r.args[0], (uint32_t) r.args[1]));
+            break;
+        case TraceOp::QueueDecode:
+            NvPipe_QueueDecode(nvp, src, payload.size(), (uint32_t) r.args[0], (uint32_t) r.args[1]);
+            break;
+        case TraceOp::FetchLatestFrame:
+            NvPipe_FetchLatestFrame(nvp, dst);
+            break;
+        case TraceOp::Destroy:
+            NvPipe_Destroy(nvp);
+            instances.erase(r.instance);
+            break;
+        default:
+            break;
+        }
+
+        const double replayMs = 1.0e-6 * std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        const double recordedMs = 1.0e-6 * r.durationNs;
+
+        if (isCreate)
+        {
+            if (!nvp)
+                std::cerr << "Call " << i << ": " << opName(op) << " failed: " << NvPipe_GetError(NULL) << std::endl;
+            else
+                instances[r.result] = { nvp, (NvPipe_Format) r.args[0], 0, "" };
+        }
+        else if (op != TraceOp::Destroy && it->second.error != NvPipe_GetError(nvp))
+        {
+            // Errors are sticky, only report new ones
+            it->second.error = NvPipe_GetError(nvp);
+            std::cerr << "Call " << i << ": " << opName(op) << ": " << it->second.error << std::endl;
+        }
+
+        s.count++;
+        s.recordedMs += recordedMs;
+        s.recordedMaxMs = std::max(s.recordedMaxMs, recordedMs);
+        s.replayMs += replayMs;
+        s.replayMaxMs = std::max(s.replayMaxMs, replayMs);
+
+        spikes.push_back({ i, recordedMs, replayMs });
+    }
+
+    for (auto& it : instances)
+        NvPipe_Destroy(it.second.nvp);
+
+    // Report
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << std::setw(18) << "Call" << std::setw(8) << "Count" << std::setw(8) << "Skipped"
+              << std::setw(14) << "Rec. avg ms" << std::setw(14) << "Rec. max ms"
+              << std::setw(14) << "Replay avg ms" << std::setw(14) << "Replay max ms" << std::setw(10) << "Diff %" << std::endl;
+
+    for (auto& it : statistics)
+    {
+        const OpStatistics& s = it.second;
+        const double recordedAvg = s.count ? s.recordedMs / s.count : 0.0;
+        const double replayAvg = s.count ? s.replayMs / s.count : 0.0;
+        const double diff = recordedAvg > 0.0 ? 100.0 * (replayAvg - recordedAvg) / recordedAvg : 0.0;
+
+        std::cout << std::setw(18) << opName(it.first) << std::setw(8) << s.count << std::setw(8) << s.skipped
+                  << std::setw(14) << recordedAvg << std::setw(14) << s.recordedMaxMs
+                  << std::setw(14) << replayAvg << std::setw(14) << s.replayMaxMs << std::setw(10) << std::setprecision(1) << diff << std::setprecision(3) << std::endl;
+    }
+
+    // Slowest recorded calls, e.g., the reported latency spikes
+    std::sort(spikes.begin(), spikes.end(), [](const Spike& a, const Spike& b) { return a.recordedMs > b.recordedMs; });
+    if (spikes.size() > 10)
+        spikes.resize(10);
+
+    std::cout << std::endl << "Slowest recorded calls:" << std::endl;
+    for (const Spike& s : spikes)
+        std::cout << "  #" << s.index << " " << opName((TraceOp) calls[s.index].record.op) << ": recorded " << s.recordedMs << " ms, replay " << s.replayMs << " ms" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,232 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cuda_runtime.h>
+
+#include "HostKernels.h"
+#include "HostResize.h"
+#include "NvCodec/Utils/NvCodecUtils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+simplelogger::Logger* logger = simplelogger::LoggerFactory::CreateConsoleLogger();
+
+
+/**
+ * Benchmarks the host resizer (HostResize.h) single- and multithreaded against its scalar path,
+ * verifies that both produce identical frames, and compares bilinear output with the GPU (Resize.cu).
+ */
+
+enum class Layout
+{
+    NV12,
+    P016,
+    I420
+};
+
+struct Frame
+{
+    Frame(Layout layout, uint32_t width, uint32_t height) : layout(layout), width(width), height(height)
+    {
+        const uint32_t bytes = (layout == Layout::P016) ? 2 : 1;
+        this->pitch = width * bytes;
+        this->chromaPitch = (layout == Layout::I420) ? (width + 1) / 2 : this->pitch;
+
+        const uint64_t chromaSize = (layout == Layout::I420) ? 2ull * this->chromaPitch * ((height + 1) / 2) : this->pitch * (height / 2);
+        this->data.resize(this->pitch * height + chromaSize);
+    }
+
+    uint8_t* u() { return this->data.data() + this->pitch * this->height; }
+    uint8_t* v() { return this->u() + this->chromaPitch * ((this->height + 1) / 2); }
+
+    Layout layout;
+    uint32_t width, height;
+    uint64_t pitch, chromaPitch;
+    std::vector<uint8_t> data;
+};
+
+void resize(const HostResizer& resizer, Frame& src, Frame& dst)
+{
+    if (src.layout == Layout::NV12)
+        resizer.resizeNv12(src.data.data(), src.pitch, dst.data.data(), dst.pitch);
+    else if (src.layout == Layout::P016)
+        resizer.resizeP016(src.data.data(), src.pitch, dst.data.data(), dst.pitch);
+    else
+        resizer.scaleYuv420(src.data.data(), src.u(), src.v(), src.pitch, src.chromaPitch, dst.data.data(), dst.u(), dst.v(), dst.pitch, dst.chromaPitch);
+}
+
+/**
+ * @brief Runs the GPU resize on copies of the frames. Returns false if no device is available.
+ */
+bool resizeGPU(Frame& src, Frame& dst)
+{
+    int count = 0;
+    if (cudaGetDeviceCount(&count) != cudaSuccess || count == 0)
+        return false;
+
+    uint8_t* dpSrc = nullptr;
+    uint8_t* dpDst = nullptr;
+    ck(cudaMalloc(&dpSrc, src.data.size()));
+    ck(cudaMalloc(&dpDst, dst.data.size()));
+    ck(cudaMemcpy(dpSrc, src.data.data(), src.data.size(), cudaMemcpyHostToDevice));
+    ck(cudaMemcpy(dpDst, dst.data.data(), dst.data.size(), cudaMemcpyHostToDevice));
+
+    if (src.layout == Layout::NV12)
+        ResizeNv12(dpDst, (int) dst.pitch, dst.width, dst.height, dpSrc, (int) src.pitch, src.width, src.height);
+    else if (src.layout == Layout::P016)
+        ResizeP016(dpDst, (int) dst.pitch, dst.width, dst.height, dpSrc, (int) src.pitch, src.width, src.height);
+    else
+        ScaleYUV420(dpDst, dpDst + (dst.u() - dst.data.data()), dpDst + (dst.v() - dst.data.data()), (int) dst.pitch, (int) dst.chromaPitch, dst.width, dst.height,
+                    dpSrc, dpSrc + (src.u() - src.data.data()), dpSrc + (src.v() - src.data.data()), (int) src.pitch, (int) src.chromaPitch, src.width, src.height, false);
+
+    ck(cudaDeviceSynchronize());
+    ck(cudaMemcpy(dst.data.data(), dpDst, dst.data.size(), cudaMemcpyDeviceToHost));
+    ck(cudaFree(dpSrc));
+    ck(cudaFree(dpDst));
+
+    return true;
+}
+
+uint32_t maxDifference(const Frame& a, const Frame& b)
+{
+    uint32_t maxDiff = 0;
+    if (a.layout == Layout::P016)
+    {
+        const uint16_t* x = (const uint16_t*) a.data.data();
+        const uint16_t* y = (const uint16_t*) b.data.data();
+        for (size_t i = 0; i < a.data.size() / 2; ++i)
+            maxDiff = std::max<uint32_t>(maxDiff, std::abs((int32_t) x[i] - (int32_t) y[i]));
+    }
+    else
+    {
+        for (size_t i = 0; i < a.data.size(); ++i)
+            maxDiff = std::max<uint32_t>(maxDiff, std::abs((int32_t) a.data[i] - (int32_t) b.data[i]));
+    }
+
+    return maxDiff;
+}
+
+template<typename F>
+double measure(F f, int iterations)
+{
+    f(); // warm-up
+
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+        f();
+
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+bool run(Layout layout, ResizeFilter filter, uint32_t srcWidth, uint32_t srcHeight, uint32_t dstWidth, uint32_t dstHeight, int iterations)
+{
+    // Smooth gradients with noise, so that both interpolation and edge handling are exercised
+    Frame src(layout, srcWidth, srcHeight);
+    std::mt19937 rng(1);
+    const uint64_t rowSize = src.pitch;
+    for (size_t i = 0; i < src.data.size(); ++i)
+        src.data[i] = (uint8_t) ((i % rowSize) * 255 / rowSize / 2 + (i / rowSize) % 64 + (rng() & 63));
+
+    Frame scalar(layout, dstWidth, dstHeight), single(layout, dstWidth, dstHeight), multi(layout, dstWidth, dstHeight);
+
+    HostResizer scalarResizer(srcWidth, srcHeight, dstWidth, dstHeight, filter);
+    scalarResizer.setScalarOnly(true);
+    scalarResizer.setMaxThreads(1);
+    HostResizer singleResizer(srcWidth, srcHeight, dstWidth, dstHeight, filter);
+    singleResizer.setMaxThreads(1);
+    HostResizer multiResizer(srcWidth, srcHeight, dstWidth, dstHeight, filter);
+
+    resize(scalarResizer, src, scalar);
+    resize(multiResizer, src, multi);
+    bool ok = (scalar.data == multi.data);
+
+    std::string gpu = "-";
+    if (filter == ResizeFilter::Bilinear)
+    {
+        Frame device(layout, dstWidth, dstHeight);
+        device.data = multi.data;
+        if (resizeGPU(src, device))
+        {
+            // Rounding differs by design (see HostResizer), 16-bit samples also see the 8-bit weight quantization
+            const uint32_t maxDiff = maxDifference(multi, device);
+            ok &= maxDiff <= (layout == Layout::P016 ? 512u : 2u);
+            gpu = std::to_string(maxDiff);
+        }
+    }
+
+    const double scalarTime = measure([&]() { resize(scalarResizer, src, scalar); }, iterations);
+    const double singleTime = measure([&]() { resize(singleResizer, src, single); }, iterations);
+    const double multiTime = measure([&]() { resize(multiResizer, src, multi); }, iterations);
+
+    const char* names[] = { "NV12", "P016", "I420" };
+    std::cout << std::setw(12) << (std::to_string(srcWidth) + "x" + std::to_string(srcHeight))
+              << std::setw(12) << (std::to_string(dstWidth) + "x" + std::to_string(dstHeight))
+              << std::setw(8) << names[(int) layout] << std::setw(10) << (filter == ResizeFilter::Area ? "area" : "bilinear")
+              << std::setw(12) << scalarTime << std::setw(12) << singleTime << std::setw(12) << multiTime
+              << std::setw(10) << scalarTime / multiTime << std::setw(10) << gpu << std::setw(8) << (ok ? "ok" : "FAILED") << std::endl;
+
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    int iterations = 20;
+    if (argc > 1)
+        iterations = std::max(1, std::stoi(argv[1]));
+
+    std::cout << "Usage: nvpResizeBench [iterations] (default: 20)" << std::endl << std::endl;
+    std::cout << "AVX2: " << (cpuSupportsAvx2() ? "yes" : "no") << std::endl << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << std::setw(12) << "Source" << std::setw(12) << "Target" << std::setw(8) << "Format" << std::setw(10) << "Filter"
+              << std::setw(12) << "Scalar ms" << std::setw(12) << "1 thread" << std::setw(12) << "Threads"
+              << std::setw(10) << "Speedup" << std::setw(10) << "GPU diff" << std::setw(8) << "Check" << std::endl;
+
+    struct Case { uint32_t srcWidth, srcHeight, dstWidth, dstHeight; };
+    const Case cases[] = {
+        { 3840, 2160, 1920, 1080 },
+        { 1920, 1080, 1280, 720 },
+        { 1920, 1080, 854, 480 }, // rows not a multiple of the vector width
+        { 1280, 720, 1920, 1080 }
+    };
+
+    bool ok = true;
+    for (const Case& c : cases)
+        for (Layout layout : { Layout::NV12, Layout::P016, Layout::I420 })
+            for (ResizeFilter filter : { ResizeFilter::Bilinear, ResizeFilter::Area })
+                ok &= run(layout, filter, c.srcWidth, c.srcHeight, c.dstWidth, c.dstHeight, iterations);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,234 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "RateController.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+
+/**
+ * CPU simulation of timestamp-based rate control under variable frame rate input.
+ *
+ * A render-on-demand source alternates between idle periods, bursts and steady phases. Frame sizes
+ * are modeled after NVENC's CBR rate control, which meets the configured per-frame budget up to some
+ * noise and overshoots on IDR frames. The byte-per-second envelope (maximum over a sliding one second
+ * window) is compared against the fixed frame rate assumption and checked against the token bucket bound.
+ */
+
+struct SimFrame
+{
+    uint64_t timestampUs;
+    bool idr;
+};
+
+struct SimResult
+{
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    uint64_t maxWindowBytes = 0;
+    uint64_t reconfigures = 0;
+    uint64_t maxOvershoot = 0;
+};
+
+std::vector<SimFrame> generateSource(double duration, uint32_t fps, std::mt19937& rng)
+{
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    std::vector<SimFrame> frames;
+
+    double t = 0.0;
+    bool first = true;
+    while (t < duration)
+    {
+        const double phase = uniform(rng);
+        double length, interval;
+
+        if (phase < 0.3)
+        {
+            // Idle: nothing changes, nothing is rendered
+            t += 0.5 + 2.5 * uniform(rng);
+            continue;
+        }
+        else if (phase < 0.6)
+        {
+            // Burst, e.g., interaction: up to four times the nominal rate
+            length = 0.2 + 0.8 * uniform(rng);
+            interval = 1.0 / (fps * (2.0 + 2.0 * uniform(rng)));
+        }
+        else
+        {
+            length = 1.0 + 2.0 * uniform(rng);
+            interval = 1.0 / fps;
+        }
+
+        const double end = std::min(t + length, duration);
+        for (; t < end; t += interval * (0.8 + 0.4 * uniform(rng)))
+        {
+            frames.push_back({ (uint64_t) (t * 1.0e6), first || uniform(rng) < 0.01 });
+            first = false;
+        }
+    }
+
+    return frames;
+}
+
+uint64_t encodedSize(uint64_t encoderBitrate, uint32_t fps, bool idr, std::mt19937& rng)
+{
+    std::uniform_real_distribution<double> noise(0.8, 1.2);
+
+    const double target = encoderBitrate / 8.0 / fps;
+    return (uint64_t) (target * noise(rng) * (idr ? 2.5 : 1.0));
+}
+
+SimResult simulate(const std::vector<SimFrame>& frames, uint64_t bitrate, uint32_t fps, bool timestamped, std::mt19937& rng)
+{
+    // Same decisions as the encoder (Encoder::planFrame)
+    RateController controller;
+    controller.configure(bitrate, fps, (double) RateController::WINDOW_FRAMES / fps);
+    uint64_t encoderBitrate = bitrate;
+
+    SimResult result;
+    std::deque<std::pair<uint64_t, uint64_t>> window; // timestamp, bytes
+    uint64_t windowBytes = 0;
+
+    for (const SimFrame& f : frames)
+    {
+        uint64_t budget = bitrate / 8 / fps;
+        if (timestamped)
+        {
+            budget = controller.plan(f.timestampUs);
+
+            const uint64_t rate = controller.getReconfigureBitrate(budget, encoderBitrate);
+            if (rate)
+            {
+                encoderBitrate = rate;
+                result.reconfigures++;
+            }
+        }
+
+        const uint64_t size = encodedSize(encoderBitrate, fps, f.idr, rng);
+        if (timestamped)
+            controller.commit(size);
+
+        result.frames++;
+        result.bytes += size;
+        result.maxOvershoot = std::max(result.maxOvershoot, size > budget ? size - budget : 0);
+
+        window.push_back({ f.timestampUs, size });
+        windowBytes += size;
+        while (window.front().first + 1000000 <= f.timestampUs)
+        {
+            windowBytes -= window.front().second;
+            window.pop_front();
+        }
+        result.maxWindowBytes = std::max(result.maxWindowBytes, windowBytes);
+    }
+
+    return result;
+}
+
+void usage()
+{
+    std::cout << "Usage: nvpVFRSim [options]" << std::endl
+              << "  --bitrate N       Target bitrate in Mbit/s (default: 8)" << std::endl
+              << "  --fps N           Nominal frame rate (default: 30)" << std::endl
+              << "  --duration N      Simulated seconds (default: 120)" << std::endl
+              << "  --seed N          Random seed (default: 1)" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    double bitrateMbps = 8.0;
+    uint32_t fps = 30;
+    double duration = 120.0;
+    uint32_t seed = 1;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--help" || i + 1 >= argc)
+        {
+            usage();
+            return arg == "--help" ? 0 : 1;
+        }
+
+        const std::string value = argv[++i];
+        if (arg == "--bitrate")
+            bitrateMbps = std::stod(value);
+        else if (arg == "--fps")
+            fps = (uint32_t) std::stoul(value);
+        else if (arg == "--duration")
+            duration = std::stod(value);
+        else if (arg == "--seed")
+            seed = (uint32_t) std::stoul(value);
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    const uint64_t bitrate = (uint64_t) (bitrateMbps * 1.0e6);
+
+    std::mt19937 rng(seed);
+    const std::vector<SimFrame> frames = generateSource(duration, fps, rng);
+
+    std::mt19937 rngFixed(seed), rngTimestamped(seed);
+    const SimResult fixed = simulate(frames, bitrate, fps, false, rngFixed);
+    const SimResult timestamped = simulate(frames, bitrate, fps, true, rngTimestamped);
+
+    // Token bucket bound: one second of data plus the bucket, plus the overshoot of a single frame
+    const double bound = bitrate / 8.0 * (1.0 + (double) RateController::WINDOW_FRAMES / fps) + timestamped.maxOvershoot;
+
+    std::cout << frames.size() << " frames in " << duration << " s (" << std::fixed << std::setprecision(1) << frames.size() / duration << " fps average)" << std::endl;
+    std::cout << std::setw(14) << "Mode" << std::setw(16) << "Peak Mbit/s" << std::setw(16) << "Avg Mbit/s" << std::setw(16) << "Utilization %" << std::setw(14) << "Reconfigures" << std::endl;
+
+    for (const auto& it : { std::make_pair("fixed", fixed), std::make_pair("timestamped", timestamped) })
+    {
+        const SimResult& r = it.second;
+        std::cout << std::setw(14) << it.first
+                  << std::setw(16) << r.maxWindowBytes * 8.0e-6
+                  << std::setw(16) << r.bytes * 8.0e-6 / duration
+                  << std::setw(16) << 100.0 * r.bytes * 8.0 / (bitrate * duration)
+                  << std::setw(14) << r.reconfigures << std::endl;
+    }
+
+    if (timestamped.maxWindowBytes > bound)
+    {
+        std::cout << "FAILED: peak exceeds the token bucket bound of " << bound * 8.0e-6 << " Mbit/s" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Peak within the token bucket bound of " << bound * 8.0e-6 << " Mbit/s" << std::endl;
+    return 0;
+}
@@ -0,0 +1,204 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Volume.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+
+/**
+ * CPU check of the volume slicing, bricking, stream index and reassembly (NvPipe_EncodeVolume/DecodeVolume).
+ *
+ * Slices are "encoded" as raw frames, so the reassembled volume must match the input bit-exactly.
+ * Volumes use padded pitches, and bricks do not divide the volume evenly, so that border bricks are padded.
+ */
+
+struct Volume
+{
+    Volume(const VolumeLayout& layout) : rowPitch(layout.getRowPitch() + 5), slicePitch(rowPitch * layout.getVolume().height + 3),
+        data(slicePitch * layout.getVolume().depth, 0) {}
+
+    uint64_t rowPitch;
+    uint64_t slicePitch;
+    std::vector<uint8_t> data;
+};
+
+/**
+ * @brief Compares the samples of a box of two volumes, ignoring the pitch padding.
+ */
+bool compare(const VolumeLayout& layout, const Volume& a, const Volume& b, const VolumeBrick& box)
+{
+    const uint32_t bits = (layout.getFormat() == NVPIPE_UINT4) ? 4 : (layout.getFormat() == NVPIPE_UINT16) ? 16 : (layout.getFormat() == NVPIPE_UINT32) ? 32 : 8;
+
+    for (uint32_t z = box.z; z < box.z + box.depth; ++z)
+    {
+        for (uint32_t y = box.y; y < box.y + box.height; ++y)
+        {
+            const uint8_t* ra = a.data.data() + z * a.slicePitch + y * a.rowPitch;
+            const uint8_t* rb = b.data.data() + z * b.slicePitch + y * b.rowPitch;
+
+            for (uint32_t x = box.x; x < box.x + box.width; ++x)
+            {
+                if (bits == 4)
+                {
+                    const uint32_t shift = (x & 1) ? 0 : 4;
+                    if (((ra[x / 2] >> shift) & 0xF) != ((rb[x / 2] >> shift) & 0xF))
+                        return false;
+                }
+                else if (memcmp(ra + x * (bits / 8), rb + x * (bits / 8), bits / 8) != 0)
+                {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+bool run(NvPipe_Format format, const NvPipe_Volume& geometry)
+{
+    const char* formats[] = { "bgra32", "uint4", "uint8", "uint16", "uint32" };
+    const char* axes[] = { "z", "y", "x" };
+
+    std::cout << std::setw(8) << formats[format] << std::setw(16)
+              << (std::to_string(geometry.width) + "x" + std::to_string(geometry.height) + "x" + std::to_string(geometry.depth))
+              << std::setw(6) << axes[geometry.axis] << std::setw(14)
+              << (std::to_string(geometry.brickWidth) + "x" + std::to_string(geometry.brickHeight) + "x" + std::to_string(geometry.brickDepth));
+
+    const VolumeLayout layout(format, geometry);
+    const std::string error = layout.validate();
+    if (!error.empty())
+    {
+        std::cout << "  " << error << std::endl;
+        return false;
+    }
+
+    Volume input(layout);
+    std::mt19937 rng(geometry.width * 31 + geometry.axis);
+    for (uint8_t& b : input.data)
+        b = (uint8_t) rng();
+
+    const auto start = std::chrono::steady_clock::now();
+
+    // Encode: index followed by the raw slices of all bricks
+    VolumeIndex index(layout);
+    std::vector<uint8_t> stream(index.getSize() + (uint64_t) layout.getNumSlices() * layout.getFrameSize());
+    uint64_t offset = index.getSize();
+
+    for (size_t i = 0; i < layout.getBricks().size(); ++i)
+    {
+        const VolumeBrick& brick = layout.getBricks()[i];
+        index.bricks[i].offset = offset;
+        for (uint32_t s = 0; s < layout.getNumSlices(brick); ++s)
+        {
+            layout.extractSlice(input.data.data(), input.rowPitch, input.slicePitch, brick, s, stream.data() + offset);
+            index.sliceSizes[brick.firstSlice + s] = (uint32_t) layout.getFrameSize();
+            offset += layout.getFrameSize();
+        }
+        index.bricks[i].size = offset - index.bricks[i].offset;
+    }
+    index.write(stream.data());
+
+    // Decode all bricks
+    VolumeIndex parsed;
+    bool ok = VolumeIndex::read(stream.data(), stream.size(), parsed).empty();
+
+    Volume output(layout);
+    const VolumeLayout decodedLayout(parsed.format, parsed.volume);
+    ok &= (decodedLayout.getBricks().size() == parsed.bricks.size());
+
+    for (size_t i = 0; ok && i < parsed.bricks.size(); ++i)
+    {
+        const VolumeBrick& brick = decodedLayout.getBricks()[i];
+        const uint8_t* slice = stream.data() + parsed.bricks[i].offset;
+        for (uint32_t s = 0; s < decodedLayout.getNumSlices(brick); ++s)
+        {
+            decodedLayout.insertSlice(slice, brick, s, output.data.data(), output.rowPitch, output.slicePitch);
+            slice += parsed.sliceSizes[brick.firstSlice + s];
+        }
+    }
+
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    const VolumeBrick whole = { 0, 0, 0, geometry.width, geometry.height, geometry.depth, 0 };
+    ok &= compare(layout, input, output, whole);
+
+    // Random access: a single brick must only touch its own box
+    const VolumeBrick& last = layout.getBricks().back();
+    Volume single(layout);
+    const uint8_t* slice = stream.data() + parsed.bricks.back().offset;
+    for (uint32_t s = 0; s < layout.getNumSlices(last); ++s)
+    {
+        layout.insertSlice(slice, last, s, single.data.data(), single.rowPitch, single.slicePitch);
+        slice += parsed.sliceSizes[last.firstSlice + s];
+    }
+    ok &= compare(layout, input, single, last);
+    ok &= compare(layout, Volume(layout), single, VolumeBrick{ 0, 0, 0, geometry.width, geometry.height, last.z, 0 });
+
+    // Corrupted streams are rejected
+    VolumeIndex rejected;
+    ok &= !VolumeIndex::read(stream.data(), index.getSize() - 1, rejected).empty();
+    ok &= !VolumeIndex::read(stream.data(), stream.size() - 1, rejected).empty();
+
+    std::cout << std::setw(8) << layout.getBricks().size() << std::setw(8) << layout.getNumSlices()
+              << std::setw(12) << (std::to_string(layout.getFrameWidth()) + "x" + std::to_string(layout.getFrameHeight()))
+              << std::setw(10) << std::fixed << std::setprecision(2) << ms << std::setw(8) << (ok ? "ok" : "FAILED") << std::endl;
+
+    return ok;
+}
+
+int main()
+{
+    std::cout << std::setw(8) << "Format" << std::setw(16) << "Volume" << std::setw(6) << "Axis" << std::setw(14) << "Bricks"
+              << std::setw(8) << "Count" << std::setw(8) << "Slices" << std::setw(12) << "Frame" << std::setw(10) << "ms" << std::setw(8) << "Check" << std::endl;
+
+    bool ok = true;
+    for (NvPipe_Format format : { NVPIPE_UINT4, NVPIPE_UINT8, NVPIPE_UINT16, NVPIPE_UINT32 })
+    {
+        for (NvPipe_Axis axis : { NVPIPE_AXIS_Z, NVPIPE_AXIS_Y, NVPIPE_AXIS_X })
+        {
+            ok &= run(format, NvPipe_Volume{ 96, 80, 64, axis, 0, 0, 0 });
+            ok &= run(format, NvPipe_Volume{ 101, 77, 45, axis, 32, 32, 16 });
+        }
+    }
+
+    // Unsupported layouts are reported
+    const bool rejected = !VolumeLayout(NVPIPE_BGRA32, NvPipe_Volume{ 16, 16, 16, NVPIPE_AXIS_Z, 0, 0, 0 }).validate().empty()
+        && !VolumeLayout(NVPIPE_UINT4, NvPipe_Volume{ 15, 16, 16, NVPIPE_AXIS_Z, 0, 0, 0 }).validate().empty();
+    std::cout << std::endl << "Invalid layouts rejected: " << (rejected ? "ok" : "FAILED") << std::endl;
+
+    return (ok && rejected) ? 0 : 1;
+}
@@ -0,0 +1,163 @@
+/* Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "NvCodec/Utils/NvCodecUtils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+
+/**
+ * Benchmarks YuvConverter (planar <-> UV-interleaved) against the previous scalar implementation
+ * and verifies that both produce identical frames.
+ */
+
+template<typename T>
+class ScalarYuvConverter
+{
+public:
+    ScalarYuvConverter(int width, int height) : width(width), height(height), quad(width * height / 4) {}
+
+    void planarToUVInterleaved(T* frame)
+    {
+        T* uv = frame + width * height;
+        memcpy(quad.data(), uv, width * height / 4 * sizeof(T));
+        T* v = uv + (width / 2) * (height / 2);
+        for (int y = 0; y < height / 2; y++)
+        {
+            for (int x = 0; x < width / 2; x++)
+            {
+                uv[y * width + x * 2] = quad[y * width / 2 + x];
+                uv[y * width + x * 2 + 1] = v[y * width / 2 + x];
+            }
+        }
+    }
+
+    void uvInterleavedToPlanar(T* frame)
+    {
+        T* uv = frame + width * height;
+        T* u = uv;
+        T* v = uv + width * height / 4;
+        for (int y = 0; y < height / 2; y++)
+        {
+            for (int x = 0; x < width / 2; x++)
+            {
+                u[y * width / 2 + x] = uv[y * width + x * 2];
+                quad[y * width / 2 + x] = uv[y * width + x * 2 + 1];
+            }
+        }
+        memcpy(v, quad.data(), width * height / 4 * sizeof(T));
+    }
+
+private:
+    int width, height;
+    std::vector<T> quad;
+};
+
+template<typename F>
+double measure(F f, int iterations)
+{
+    f(); // warm-up
+
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+        f();
+
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+template<typename T>
+bool run(const char* name, int width, int height, int iterations)
+{
+    const size_t size = (size_t) width * height * 3 / 2;
+    std::vector<T> frame(size), reference(size), result(size);
+
+    std::mt19937 rng(1);
+    for (T& s : frame)
+        s = (T) rng();
+
+    ScalarYuvConverter<T> scalar(width, height);
+    YuvConverter<T> single(width, height, NULL, 1);
+    YuvConverter<T> multi(width, height);
+
+    // Correctness: both directions against the scalar implementation
+    reference = frame;
+    scalar.planarToUVInterleaved(reference.data());
+    result = frame;
+    multi.PlanarToUVInterleaved(result.data());
+    bool ok = (result == reference);
+
+    scalar.uvInterleavedToPlanar(reference.data());
+    multi.UVInterleavedToPlanar(result.data());
+    ok &= (result == reference) && (result == frame);
+
+    std::vector<T> work = frame;
+    const double scalarI420 = measure([&]() { scalar.planarToUVInterleaved(work.data()); }, iterations);
+    const double scalarNV12 = measure([&]() { scalar.uvInterleavedToPlanar(work.data()); }, iterations);
+    const double singleI420 = measure([&]() { single.PlanarToUVInterleaved(work.data()); }, iterations);
+    const double singleNV12 = measure([&]() { single.UVInterleavedToPlanar(work.data()); }, iterations);
+    const double multiI420 = measure([&]() { multi.PlanarToUVInterleaved(work.data()); }, iterations);
+    const double multiNV12 = measure([&]() { multi.UVInterleavedToPlanar(work.data()); }, iterations);
+
+    std::cout << std::setw(12) << name << std::setw(6) << sizeof(T) * 8 << std::setw(12) << "I420->NV12"
+              << std::setw(12) << scalarI420 << std::setw(12) << singleI420 << std::setw(12) << multiI420
+              << std::setw(10) << scalarI420 / multiI420 << std::setw(8) << (ok ? "ok" : "FAILED") << std::endl;
+    std::cout << std::setw(12) << name << std::setw(6) << sizeof(T) * 8 << std::setw(12) << "NV12->I420"
+              << std::setw(12) << scalarNV12 << std::setw(12) << singleNV12 << std::setw(12) << multiNV12
+              << std::setw(10) << scalarNV12 / multiNV12 << std::setw(8) << (ok ? "ok" : "FAILED") << std::endl;
+
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    int iterations = 50;
+    if (argc > 1)
+        iterations = std::max(1, std::stoi(argv[1]));
+
+    std::cout << "Usage: nvpYuvBench [iterations] (default: 50)" << std::endl << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << std::setw(12) << "Size" << std::setw(6) << "Bits" << std::setw(12) << "Direction"
+              << std::setw(12) << "Scalar ms" << std::setw(12) << "1 thread" << std::setw(12) << "Threads"
+              << std::setw(10) << "Speedup" << std::setw(8) << "Check" << std::endl;
+
+    bool ok = true;
+    ok &= run<uint8_t>("1920x1080", 1920, 1080, iterations);
+    ok &= run<uint16_t>("1920x1080", 1920, 1080, iterations);
+    ok &= run<uint8_t>("3840x2160", 3840, 2160, iterations);
+    ok &= run<uint16_t>("3840x2160", 3840, 2160, iterations);
+    ok &= run<uint8_t>("1366x768", 1366, 768, iterations); // rows not a multiple of the vector width
+
+    return ok ? 0 : 1;
+}